@@ -0,0 +1,415 @@
+/**
+ * GpuCullingBench.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ *
+ * Object culling and submission for a 45-view quilt, as the object count
+ * grows. A field of cubes, some in front of the camera and some out of every
+ * view, drawn
+ *   - culled on the CPU per view, a model uniform and a
+ *     glDrawElementsBaseVertex per visible object and view
+ *   - culled by GpuCulling's compute shader, one glMultiDrawElementsIndirect
+ *     per view
+ *   - the same, one instanced glMultiDrawElementsIndirect for all views over
+ *     the whole quilt, clipped to the tiles as HoloPlayContext's instanced
+ *     views are
+ * Reports the CPU time to submit a quilt, the GPU time of the quilt
+ * (GL_TIME_ELAPSED) and the draw calls made, and checks the commands the GPU
+ * wrote against GpuCulling::cullOnCpu(). Needs an OpenGL 4.3 context; the
+ * window stays hidden.
+ *
+ * usage: gpu_culling_bench [object counts...]
+ */
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "FrameCamera.hpp"
+#include "GpuCulling.hpp"
+#include "Shader.hpp"
+#include "ViewMatrices.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static const int COLUMNS = 5;
+static const int ROWS = 9;
+static const int VIEWS = 45;
+static const int QUILT_SIZE = 4096;
+static const float VIEW_CONE = 40.0f;
+static const float CAMERA_SIZE = 2.0f;
+static const float ASPECT = 0.75f;
+static const int FRAMES = 20;
+
+// one object per draw, its model matrix a uniform
+static const char *cpuVertexShader = R"--(
+  #version 430 core
+  in vec3 position;
+  in vec3 normal;
+  uniform mat4 model;
+  uniform int viewIndex;
+  out vec3 fNormal;
+  void main(void)
+  {
+      fNormal = mat3(model) * normal;
+      gl_Position = holoplayProjection(viewIndex) * holoplayView(viewIndex) *
+                    model * vec4(position, 1.0);
+  }
+)--";
+
+// the object and the view from GPU_CULLING_GLSL, -1 for all views at once
+static const char *gpuVertexShader = R"--(
+  #version 430 core
+  in vec3 position;
+  in vec3 normal;
+  uniform int viewIndex;
+  out vec3 fNormal;
+  void main(void)
+  {
+      int index = viewIndex >= 0 ? viewIndex : culledView();
+      mat4 model = culledModel();
+      fNormal = mat3(model) * normal;
+      gl_Position = holoplayProjection(index) * holoplayView(index) * model *
+                    vec4(position, 1.0);
+      if (viewIndex < 0)
+          gl_Position = holoplayQuiltPosition(gl_Position, index);
+  }
+)--";
+
+static const char *fragmentShader = R"--(
+  #version 430 core
+  in vec3 fNormal;
+  out vec4 color;
+  void main(void)
+  {
+      color = vec4(0.5 + 0.5 * normalize(fNormal), 1.0);
+  }
+)--";
+
+// the source with the FrameCamera block, and GPU_CULLING_GLSL after it
+static string vertexSource(const char *source, bool culled)
+{
+  string text = source;
+  if (culled)
+  {
+    size_t version = text.find("#version");
+    text.insert(text.find('\n', version) + 1, GPU_CULLING_GLSL);
+  }
+  return withFrameCamera(text.c_str());
+}
+
+struct Result
+{
+  double cpuMs;
+  double gpuMs;
+  size_t draws;
+};
+
+enum class Mode
+{
+  CpuCulling,
+  GpuPerView,
+  GpuAllViews
+};
+
+// every mode for every object count, with the context current; false if the
+// GPU's commands differ from the CPU's
+static bool run(const vector<size_t> &counts)
+{
+  // the quilt
+  GLuint framebuffer, color, depth;
+  glGenFramebuffers(1, &framebuffer);
+  glGenRenderbuffers(1, &color);
+  glGenRenderbuffers(1, &depth);
+  glBindRenderbuffer(GL_RENDERBUFFER, color);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, QUILT_SIZE, QUILT_SIZE);
+  glBindRenderbuffer(GL_RENDERBUFFER, depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, QUILT_SIZE,
+                        QUILT_SIZE);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_RENDERBUFFER, color);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                            GL_RENDERBUFFER, depth);
+  glEnable(GL_DEPTH_TEST);
+
+  // the views, and the FrameCamera block HoloPlayContext would upload
+  ViewMatrices views;
+  views.setViews(VIEWS, VIEW_CONE);
+  views.prepare(glm::lookAt(glm::vec3(0.0f, 0.0f, 6.0f), glm::vec3(0.0f),
+                            glm::vec3(0.0f, 1.0f, 0.0f)),
+                CAMERA_SIZE, ASPECT);
+  FrameCamera frame = FrameCamera();
+  frame.centerView = views.getFrameView();
+  frame.centerProjection = views.getFrameProjection();
+  frame.cameraSize = CAMERA_SIZE;
+  frame.viewCone = VIEW_CONE;
+  frame.viewCount = VIEWS;
+  frame.columns = COLUMNS;
+  frame.tileSize = glm::vec2(float(QUILT_SIZE / COLUMNS) / float(QUILT_SIZE),
+                             float(QUILT_SIZE / ROWS) / float(QUILT_SIZE));
+  GLuint frameBuffer;
+  glGenBuffers(1, &frameBuffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, frameBuffer);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(frame), &frame, GL_STATIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  glBindBufferBase(GL_UNIFORM_BUFFER, 1, frameBuffer);
+
+  // a cube, position and normal
+  vector<float> vertices;
+  vector<GLushort> indices;
+  for (int axis = 0; axis < 3; ++axis)
+    for (int side = -1; side <= 1; side += 2)
+    {
+      GLushort first = GLushort(vertices.size() / 6);
+      for (int k = 0; k < 4; ++k)
+      {
+        float p[3], n[3] = {0, 0, 0};
+        n[axis] = float(side);
+        p[axis] = float(side);
+        p[(axis + 1) % 3] = k & 1 ? 1.0f : -1.0f;
+        p[(axis + 2) % 3] = k & 2 ? float(side) : -float(side);
+        vertices.insert(vertices.end(), p, p + 3);
+        vertices.insert(vertices.end(), n, n + 3);
+      }
+      GLushort quad[6] = {first, GLushort(first + 1), GLushort(first + 3),
+                          GLushort(first + 3), GLushort(first + 2), first};
+      indices.insert(indices.end(), quad, quad + 6);
+    }
+  GLuint vbo, ibo;
+  glGenBuffers(1, &vbo);
+  glGenBuffers(1, &ibo);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(vertices.size() * sizeof(float)),
+               vertices.data(), GL_STATIC_DRAW);
+
+  ShaderProgram cpuProgram(
+      {Shader(GL_VERTEX_SHADER, vertexSource(cpuVertexShader, false).c_str()),
+       Shader(GL_FRAGMENT_SHADER, fragmentShader)});
+  ShaderProgram gpuProgram(
+      {Shader(GL_VERTEX_SHADER, vertexSource(gpuVertexShader, true).c_str()),
+       Shader(GL_FRAGMENT_SHADER, fragmentShader)});
+  ShaderProgram *programs[] = {&cpuProgram, &gpuProgram};
+  for (ShaderProgram *program : programs)
+  {
+    GLuint block = glGetUniformBlockIndex(program->getHandle(), "FrameCamera");
+    if (block != GL_INVALID_INDEX)
+      glUniformBlockBinding(program->getHandle(), block, 1);
+  }
+
+  GpuCulling culling;
+  culling.create();
+  GLuint vaos[2];
+  glGenVertexArrays(2, vaos);
+  for (int i = 0; i < 2; ++i)
+  {
+    glBindVertexArray(vaos[i]);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    programs[i]->setAttribute("position", 3, 6 * sizeof(float), 0);
+    programs[i]->setAttribute("normal", 3, 6 * sizeof(float),
+                              3 * sizeof(float));
+    if (i == 1)
+      culling.setDrawAttribute(programs[i]->attribute("culledDraw"));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+  }
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+               GLsizeiptr(indices.size() * sizeof(GLushort)), indices.data(),
+               GL_STATIC_DRAW);
+  glBindVertexArray(0);
+
+  GLuint query;
+  glGenQueries(1, &query);
+  int viewWidth = QUILT_SIZE / COLUMNS, viewHeight = QUILT_SIZE / ROWS;
+  bool ok = true;
+
+  for (size_t count : counts)
+  {
+    // a slab of cubes wider than the views, so that each view sees part
+    mt19937 random(1);
+    uniform_real_distribution<float> across(-6.0f, 6.0f);
+    uniform_real_distribution<float> deep(-4.0f, 2.0f);
+    uniform_real_distribution<float> scale(0.02f, 0.08f);
+    vector<GpuCullObject> objects(count);
+    for (GpuCullObject &object : objects)
+    {
+      glm::vec3 centre(across(random), across(random) * 0.75f, deep(random));
+      float s = scale(random);
+      object.model = glm::scale(glm::translate(glm::mat4(1.0f), centre),
+                                glm::vec3(s));
+      object.sphere = glm::vec4(centre, s * sqrt(3.0f));
+      object.count = uint32_t(indices.size());
+      object.firstIndex = 0;
+      object.baseVertex = 0;
+      object.padding = 0;
+    }
+    culling.setObjects(objects);
+
+    // the GPU's commands against the CPU's
+    vector<DrawElementsIndirectCommand> expected, written;
+    culling.cull(views);
+    culling.cullOnCpu(views, expected);
+    culling.readCommands(written);
+    size_t mismatches = written.size() == expected.size() ? 0 : expected.size();
+    size_t visible = 0;
+    for (size_t i = 0; i < min(written.size(), expected.size()); ++i)
+    {
+      mismatches += written[i].instanceCount != expected[i].instanceCount ||
+                    written[i].baseInstance != expected[i].baseInstance;
+      if (i < count * VIEWS)
+        visible += expected[i].instanceCount;
+    }
+    // a sphere touching a plane may land either side of it in float
+    bool match = mismatches * 1000 <= expected.size();
+    ok = ok && match;
+    cout << "[Bench] " << count << " objects, " << visible
+         << " object views visible of " << count * VIEWS << ", GPU commands "
+         << (match ? "match" : "DO NOT MATCH") << " the CPU cull ("
+         << mismatches << " differ)" << endl;
+
+    const char *names[] = {"CPU cull, a draw per object and view",
+                           "GPU cull, a multi draw per view",
+                           "GPU cull, one multi draw for all views"};
+    Mode modes[] = {Mode::CpuCulling, Mode::GpuPerView, Mode::GpuAllViews};
+    for (int m = 0; m < 3; ++m)
+    {
+      Mode mode = modes[m];
+      Result result = {0, 0, 0};
+      vector<DrawElementsIndirectCommand> commands;
+      for (int f = 0; f <= FRAMES; ++f)
+      {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, QUILT_SIZE, QUILT_SIZE);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glFinish();
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        Clock::time_point start = Clock::now();
+        size_t draws = 0;
+        ShaderProgram &program = mode == Mode::CpuCulling ? cpuProgram
+                                                          : gpuProgram;
+        program.use();
+        glBindVertexArray(vaos[mode == Mode::CpuCulling ? 0 : 1]);
+        if (mode == Mode::CpuCulling)
+          culling.cullOnCpu(views, commands);
+        else
+          culling.cull(views);
+        if (mode == Mode::GpuAllViews)
+        {
+          program.setUniform("viewIndex", -1);
+          for (int plane = 0; plane < 4; ++plane)
+            glEnable(GLenum(GL_CLIP_DISTANCE0 + plane));
+          culling.drawAllViews(GL_TRIANGLES, GL_UNSIGNED_SHORT);
+          for (int plane = 0; plane < 4; ++plane)
+            glDisable(GLenum(GL_CLIP_DISTANCE0 + plane));
+          draws = 1;
+        }
+        else
+        {
+          GLint modelLocation =
+              mode == Mode::CpuCulling ? program.uniform("model") : -1;
+          for (int view = 0; view < VIEWS; ++view)
+          {
+            glViewport((view % COLUMNS) * viewWidth,
+                       (view / COLUMNS) * viewHeight, viewWidth, viewHeight);
+            program.setUniform("viewIndex", view);
+            if (mode == Mode::GpuPerView)
+            {
+              culling.drawView(GL_TRIANGLES, GL_UNSIGNED_SHORT, view);
+              ++draws;
+              continue;
+            }
+            for (size_t o = 0; o < count; ++o)
+            {
+              if (!commands[size_t(view) * count + o].instanceCount)
+                continue;
+              glUniformMatrix4fv(modelLocation, 1, GL_FALSE,
+                                 &objects[o].model[0][0]);
+              glDrawElementsBaseVertex(GL_TRIANGLES, GLsizei(indices.size()),
+                                       GL_UNSIGNED_SHORT, nullptr, 0);
+              ++draws;
+            }
+          }
+        }
+        glBindVertexArray(0);
+        program.unuse();
+        double cpuMs =
+            chrono::duration<double, milli>(Clock::now() - start).count();
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+        // the first frame warms up shaders and buffers
+        if (f == 0)
+          continue;
+        result.cpuMs += cpuMs;
+        result.gpuMs += double(ns) / 1e6;
+        result.draws = draws;
+      }
+      cout << "[Bench]   " << names[m] << ": " << result.cpuMs / FRAMES
+           << " ms CPU, " << result.gpuMs / FRAMES << " ms GPU, "
+           << result.draws << " draw calls per quilt" << endl;
+    }
+  }
+
+  glDeleteQueries(1, &query);
+  culling.release();
+  glDeleteVertexArrays(2, vaos);
+  glDeleteBuffers(1, &vbo);
+  glDeleteBuffers(1, &ibo);
+  glDeleteBuffers(1, &frameBuffer);
+  glDeleteFramebuffers(1, &framebuffer);
+  glDeleteRenderbuffers(1, &color);
+  glDeleteRenderbuffers(1, &depth);
+  return ok;
+}
+
+int main(int argc, char *argv[])
+{
+  vector<size_t> counts;
+  for (int i = 1; i < argc; ++i)
+    counts.push_back(size_t(max(atoi(argv[i]), 1)));
+  if (counts.empty())
+    counts = {1000, 10000, 50000};
+
+  if (!glfwInit())
+    return 1;
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+  GLFWwindow *window = glfwCreateWindow(64, 64, "gpu_culling_bench", NULL, NULL);
+  if (!window)
+  {
+    cout << "[Error] no OpenGL 4.3 context" << endl;
+    glfwTerminate();
+    return 1;
+  }
+  glfwMakeContextCurrent(window);
+  glewExperimental = GL_TRUE;
+  if (glewInit() != GLEW_OK || !GpuCulling::isSupported())
+  {
+    cout << "[Error] no GPU culling on this context" << endl;
+    return 1;
+  }
+  cout << "[Bench] " << glGetString(GL_RENDERER) << ", " << QUILT_SIZE << "x"
+       << QUILT_SIZE << " quilt, " << VIEWS << " views, " << FRAMES
+       << " frames per run" << endl;
+
+  bool ok = run(counts);
+  glfwDestroyWindow(window);
+  glfwTerminate();
+  return ok ? 0 : 1;
+}
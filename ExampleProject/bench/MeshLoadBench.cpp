@@ -0,0 +1,261 @@
+/**
+ * MeshLoadBench.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ *
+ * Startup cost of a mesh: the time from opening the file to having the
+ * vertex and index streams in upload buffers, which is what goes to
+ * glBufferData. Compares
+ *   - parsing an OBJ of the terrain into TerrainVertex, already the float
+ *     layout the shader reads
+ *   - the same, then packed and put in vertex cache order as the baked file
+ *     is, the work the bake moves offline
+ *   - a baked mesh file through MeshFileReader's mapping, packed and float
+ * both with the files in the page cache (warm) and evicted from it before
+ * each run (cold, POSIX only). The upload buffers are ordinary memory
+ * standing in for glBufferData's copy.
+ *
+ * usage: mesh_load_bench [terrain cells] [runs] [directory]
+ */
+
+#include "JobSystem.hpp"
+#include "MeshBake.hpp"
+#include "MeshFileReader.hpp"
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+// drops the file from the page cache so the next open reads the disk; the
+// files were just written, dirty pages stay cached until they are synced
+static bool evict(const string &path)
+{
+#ifndef _WIN32
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  fdatasync(fd);
+  int result = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+  return result == 0;
+#else
+  (void)path;
+  return false;
+#endif
+}
+
+static long fileSize(const string &path)
+{
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file)
+    return 0;
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fclose(file);
+  return size;
+}
+
+struct Upload
+{
+  vector<char> vertices;
+  vector<char> indices;
+};
+
+static bool loadObjFile(const string &path, Upload &upload)
+{
+  TerrainMesh mesh;
+  if (!loadObj(path, mesh))
+    return false;
+  upload.vertices.resize(mesh.vertices.size() * sizeof(TerrainVertex));
+  memcpy(upload.vertices.data(), mesh.vertices.data(), upload.vertices.size());
+  upload.indices.resize(mesh.indices.size() * sizeof(uint32_t));
+  memcpy(upload.indices.data(), mesh.indices.data(), upload.indices.size());
+  return true;
+}
+
+// what bakeMesh() does after parsing, at runtime instead
+static bool loadAndPrepareObjFile(const string &path, Upload &upload)
+{
+  TerrainMesh mesh;
+  if (!loadObj(path, mesh))
+    return false;
+  TerrainBounds bounds;
+  glm::vec3 low = mesh.vertices[0].position, high = low;
+  for (size_t i = 1; i < mesh.vertices.size(); ++i)
+  {
+    low = glm::min(low, mesh.vertices[i].position);
+    high = glm::max(high, mesh.vertices[i].position);
+  }
+  bounds.origin = low;
+  bounds.extent = high - low;
+  vector<uint32_t> ordered(mesh.indices.size());
+  optimizeVertexCache(mesh.indices.data(), mesh.indices.size(),
+                      mesh.vertices.size(), ordered.data());
+  ChunkedMesh chunked;
+  splitMesh(ordered.data(), ordered.size(), mesh.vertices.size(),
+            MAX_CHUNK_VERTICES, chunked);
+  upload.vertices.resize(chunked.remap.size() * sizeof(PackedTerrainVertex));
+  PackedTerrainVertex *out =
+      reinterpret_cast<PackedTerrainVertex *>(upload.vertices.data());
+  for (size_t i = 0; i < chunked.remap.size(); ++i)
+    out[i] = packTerrainVertex(mesh.vertices[chunked.remap[i]], bounds);
+  upload.indices.resize(chunked.indices.size() * sizeof(uint16_t));
+  memcpy(upload.indices.data(), chunked.indices.data(), upload.indices.size());
+  return true;
+}
+
+static bool loadMeshFile(const string &path, Upload &upload)
+{
+  MeshFileReader reader;
+  if (!reader.open(path))
+    return false;
+  reader.prefetch();
+  const MeshFileHeader &header = reader.getHeader();
+  upload.vertices.resize(size_t(header.vertexSize));
+  memcpy(upload.vertices.data(), reader.getVertices(), upload.vertices.size());
+  upload.indices.resize(size_t(header.indexSize));
+  memcpy(upload.indices.data(), reader.getIndices(), upload.indices.size());
+  return true;
+}
+
+static void measure(const char *label, const string &path, bool cold, int runs,
+                    const function<bool()> &load)
+{
+  vector<double> ms;
+  for (int i = 0; i < runs; ++i)
+  {
+    if (cold && !evict(path))
+      return;
+    Clock::time_point start = Clock::now();
+    if (!load())
+    {
+      cout << "[Bench]   " << label << ": failed" << endl;
+      return;
+    }
+    ms.push_back(chrono::duration<double, milli>(Clock::now() - start).count());
+  }
+  sort(ms.begin(), ms.end());
+  cout << "[Bench]   " << label << (cold ? " (cold)" : " (warm)") << ": median "
+       << ms[ms.size() / 2] << " ms, min " << ms.front() << " ms, max "
+       << ms.back() << " ms" << endl;
+}
+
+// every vertex of the baked file against the one it was made from
+static bool matches(const string &path, const TerrainMesh &mesh)
+{
+  MeshFileReader reader;
+  if (!reader.open(path))
+    return false;
+  const MeshFileHeader &h = reader.getHeader();
+  TerrainBounds bounds;
+  bounds.origin = glm::vec3(h.boundsOrigin[0], h.boundsOrigin[1],
+                            h.boundsOrigin[2]);
+  bounds.extent = glm::vec3(h.boundsExtent[0], h.boundsExtent[1],
+                            h.boundsExtent[2]);
+  glm::vec3 step = bounds.extent / 65535.0f;
+  const PackedTerrainVertex *vertices =
+      static_cast<const PackedTerrainVertex *>(reader.getVertices());
+  const uint16_t *indices = static_cast<const uint16_t *>(reader.getIndices());
+  size_t triangles = 0;
+  for (uint32_t c = 0; c < h.chunkCount; ++c)
+  {
+    const MeshFileChunk &chunk = reader.getChunk(c);
+    triangles += size_t(chunk.indexCount) / 3;
+    for (size_t i = 0; i < chunk.indexCount; ++i)
+    {
+      size_t v = size_t(chunk.baseVertex) + indices[chunk.firstIndex + i];
+      TerrainVertex got = unpackTerrainVertex(vertices[v], bounds);
+      // some original vertex lies within a quantization step of it
+      bool found = false;
+      glm::vec3 d;
+      for (size_t k = 0; k < mesh.vertices.size() && !found; ++k)
+      {
+        d = glm::abs(got.position - mesh.vertices[k].position);
+        found = d.x <= step.x && d.y <= step.y && d.z <= step.z;
+      }
+      if (!found)
+        return false;
+      if (i > 64) // a sample per chunk, the search is quadratic
+        break;
+    }
+  }
+  return triangles == mesh.indices.size() / 3;
+}
+
+int main(int argc, char *argv[])
+{
+  unsigned cells = argc > 1 ? unsigned(max(atoi(argv[1]), 2)) : 512;
+  int runs = argc > 2 ? max(atoi(argv[2]), 1) : 5;
+  string dir = argc > 3 ? argv[3] : ".";
+
+  TerrainMesh mesh;
+  JobSystem jobs(1);
+  generateTerrain(cells, 0.1f, mesh, &jobs);
+  string obj = dir + "/mesh_load_bench.obj";
+  string packed = dir + "/mesh_load_bench_packed.hpm";
+  string floats = dir + "/mesh_load_bench_float.hpm";
+  MeshBakeSettings floatSettings;
+  floatSettings.packed = false;
+  floatSettings.optimize = false;
+  // baked from the OBJ as mesh_bake does, so that both number the vertices
+  // alike
+  TerrainMesh source;
+  if (!writeObj(obj, mesh) || !loadObj(obj, source) ||
+      !bakeMesh(source, MeshBakeSettings(), packed) ||
+      !bakeMesh(source, floatSettings, floats))
+  {
+    cout << "[Bench] could not write the test files to " << dir << endl;
+    return 1;
+  }
+
+  cout << "[Bench] terrain of " << cells << "x" << cells << " cells, "
+       << mesh.vertices.size() << " vertices, " << mesh.indices.size() / 3
+       << " triangles; OBJ " << (fileSize(obj) >> 10) << " KiB, packed "
+       << (fileSize(packed) >> 10) << " KiB, float " << (fileSize(floats) >> 10)
+       << " KiB; open to streams in the upload buffers, " << runs << " runs"
+       << endl;
+  Upload upload;
+  for (int cold = 0; cold < 2; ++cold)
+  {
+    measure("OBJ parse", obj, cold != 0, runs,
+            [&] { return loadObjFile(obj, upload); });
+    measure("OBJ parse, pack, reorder", obj, cold != 0, runs,
+            [&] { return loadAndPrepareObjFile(obj, upload); });
+    measure("packed mesh file, mapped", packed, cold != 0, runs,
+            [&] { return loadMeshFile(packed, upload); });
+    measure("float mesh file, mapped", floats, cold != 0, runs,
+            [&] { return loadMeshFile(floats, upload); });
+  }
+
+  // the float file holds the vertices and indices unchanged
+  Upload parsed, mapped;
+  bool ok = loadObjFile(obj, parsed) && loadMeshFile(floats, mapped) &&
+            parsed.indices == mapped.indices &&
+            parsed.vertices == mapped.vertices && matches(packed, source);
+  cout << "[Bench] baked meshes " << (ok ? "match" : "DO NOT MATCH")
+       << " the OBJ" << endl;
+  remove(obj.c_str());
+  remove(packed.c_str());
+  remove(floats.c_str());
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+/**
+ * MeshOptimizerBench.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ *
+ * The terrain's row-major triangle list against the same triangles after
+ * optimizeVertexCache() and splitMesh(), across grid sizes:
+ *   - ACMR and ATVR in FIFO caches of 16 and 32 entries, the range of
+ *     current GPUs; vertices are counted again across chunk boundaries
+ *   - vertex and index bytes, and the vertex shader invocations and index
+ *     bytes of a 45-view frame
+ *   - the time the optimization takes
+ * Also checks that the chunks draw the same triangles as the input.
+ *
+ * usage: mesh_optimizer_bench [grid sizes...]
+ */
+
+#include "MeshOptimizer.hpp"
+#include "TerrainMesh.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static const int VIEWS = 45;
+
+template <typename F> static double timeMs(F run)
+{
+  Clock::time_point start = Clock::now();
+  run();
+  return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+// the chunks as one 32-bit list over the remapped vertices
+static vector<uint32_t> flatten(const ChunkedMesh &mesh)
+{
+  vector<uint32_t> flat;
+  flat.reserve(mesh.indices.size());
+  for (size_t c = 0; c < mesh.chunks.size(); ++c)
+  {
+    const MeshChunk &chunk = mesh.chunks[c];
+    for (size_t i = 0; i < chunk.indexCount; ++i)
+      flat.push_back(uint32_t(chunk.baseVertex) +
+                     mesh.indices[chunk.firstIndex + i]);
+  }
+  return flat;
+}
+
+// every triangle of a, by original vertices and up to rotation, is in b
+static bool sameTriangles(const vector<uint32_t> &a, const vector<uint32_t> &b,
+                          const vector<uint32_t> &remap)
+{
+  if (a.size() != b.size())
+    return false;
+  typedef vector<uint32_t> Triangle;
+  vector<Triangle> ta, tb;
+  for (size_t i = 0; i < a.size(); i += 3)
+  {
+    Triangle x = {a[i], a[i + 1], a[i + 2]};
+    Triangle y = {remap[b[i]], remap[b[i + 1]], remap[b[i + 2]]};
+    rotate(x.begin(), min_element(x.begin(), x.end()), x.end());
+    rotate(y.begin(), min_element(y.begin(), y.end()), y.end());
+    ta.push_back(x);
+    tb.push_back(y);
+  }
+  sort(ta.begin(), ta.end());
+  sort(tb.begin(), tb.end());
+  return ta == tb;
+}
+
+int main(int argc, char *argv[])
+{
+  vector<unsigned> sizes;
+  for (int i = 1; i < argc; ++i)
+    sizes.push_back(unsigned(max(atoi(argv[i]), 1)));
+  if (sizes.empty())
+    sizes = {100, 256, 512, 1024};
+
+  cout << "[Bench] vertex cache optimization, " << VIEWS << " views" << endl;
+  bool ok = true;
+  for (size_t s = 0; s < sizes.size(); ++s)
+  {
+    unsigned size = sizes[s];
+    size_t vertexCount = (size_t(size) + 1) * (size_t(size) + 1);
+    vector<uint32_t> naive(size_t(size) * size * 6);
+    generateTerrainIndices(size, naive.data(), NULL);
+
+    vector<uint32_t> optimized(naive.size());
+    ChunkedMesh chunked;
+    double optimizeMs = timeMs([&] {
+      optimizeVertexCache(naive.data(), naive.size(), vertexCount,
+                          optimized.data());
+    });
+    double splitMs = timeMs([&] {
+      splitMesh(optimized.data(), optimized.size(), vertexCount,
+                MAX_CHUNK_VERTICES, chunked);
+    });
+    vector<uint32_t> flat = flatten(chunked);
+    bool same = sameTriangles(naive, flat, chunked.remap);
+    ok = ok && same;
+
+    size_t triangles = naive.size() / 3;
+    cout << "[Bench]   " << size << "x" << size << " (" << triangles
+         << " triangles, " << chunked.chunks.size() << " chunk(s), "
+         << chunked.remap.size() - vertexCount << " repeated vertices), "
+         << "optimized in " << optimizeMs + splitMs << " ms"
+         << (same ? "" : " MISMATCH") << endl;
+    unsigned caches[] = {16, 32};
+    for (int c = 0; c < 2; ++c)
+    {
+      VertexCacheStats before =
+          analyzeVertexCache(naive.data(), naive.size(), vertexCount, caches[c]);
+      VertexCacheStats after = analyzeVertexCache(
+          flat.data(), flat.size(), chunked.remap.size(), caches[c]);
+      cout << "[Bench]     FIFO " << caches[c] << ": ACMR " << before.acmr
+           << " -> " << after.acmr << ", ATVR " << before.atvr << " -> "
+           << after.atvr << ", vertex shader runs per frame "
+           << size_t(before.acmr * triangles) * VIEWS << " -> "
+           << size_t(after.acmr * triangles) * VIEWS << endl;
+    }
+    cout << "[Bench]     index bytes " << naive.size() * 4 << " -> "
+         << chunked.indices.size() * 2 << ", per frame "
+         << naive.size() * 4 * VIEWS << " -> "
+         << chunked.indices.size() * 2 * VIEWS << endl;
+  }
+  return ok ? 0 : 1;
+}
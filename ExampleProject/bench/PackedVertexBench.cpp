@@ -0,0 +1,128 @@
+/**
+ * PackedVertexBench.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ *
+ * TerrainVertex (40 bytes) against PackedTerrainVertex (16 bytes) across grid
+ * sizes:
+ *   - the memory of the vertex buffer, and the vertex bytes a frame fetches
+ *     with every vertex fetched once per view (45 views)
+ *   - the time to stream those bytes through the CPU, one pass per view, as a
+ *     stand-in for the fetch bandwidth the GPU needs
+ *   - the time to generate either format
+ *   - the quantization error of the packed format: position, angle between
+ *     the normals, colour
+ *
+ * usage: packed_vertex_bench [grid sizes...]
+ */
+
+#include "TerrainMesh.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static const float SPACING = 0.1f;
+static const int VIEWS = 45;
+
+template <typename F> static double timeMs(F run)
+{
+  Clock::time_point start = Clock::now();
+  run();
+  return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+// reads every 8 bytes of [data, data + bytes) once per view
+static uint64_t stream(const void *data, size_t bytes)
+{
+  const uint64_t *words = static_cast<const uint64_t *>(data);
+  size_t count = bytes / sizeof(uint64_t);
+  uint64_t sum = 0;
+  for (int view = 0; view < VIEWS; ++view)
+    for (size_t i = 0; i < count; ++i)
+      sum += words[i];
+  return sum;
+}
+
+static double mib(size_t bytes) { return double(bytes) / (1024.0 * 1024.0); }
+
+int main(int argc, char *argv[])
+{
+  vector<unsigned> sizes;
+  for (int i = 1; i < argc; ++i)
+    sizes.push_back(unsigned(max(atoi(argv[i]), 1)));
+  if (sizes.empty())
+    sizes = {256, 512, 1024, 2048};
+
+  cout << "[Bench] packed terrain vertices, " << sizeof(TerrainVertex)
+       << " -> " << sizeof(PackedTerrainVertex) << " bytes, " << VIEWS
+       << " views" << endl;
+
+  bool ok = true;
+  uint64_t sink = 0;
+  for (size_t s = 0; s < sizes.size(); ++s)
+  {
+    unsigned size = sizes[s];
+    size_t count = (size_t(size) + 1) * (size_t(size) + 1);
+    vector<TerrainVertex> full(count);
+    vector<PackedTerrainVertex> packed(count);
+
+    double fullMs = timeMs(
+        [&] { generateTerrainVertices(size, SPACING, full.data(), NULL); });
+    double packedMs = timeMs([&] {
+      generatePackedTerrainVertices(size, SPACING, packed.data(), NULL);
+    });
+
+    size_t fullBytes = count * sizeof(TerrainVertex);
+    size_t packedBytes = count * sizeof(PackedTerrainVertex);
+    double fullFetchMs = timeMs([&] { sink += stream(full.data(), fullBytes); });
+    double packedFetchMs =
+        timeMs([&] { sink += stream(packed.data(), packedBytes); });
+
+    TerrainBounds bounds = getTerrainBounds(size, SPACING);
+    float position = 0, angle = 0, color = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+      TerrainVertex v = unpackTerrainVertex(packed[i], bounds);
+      const TerrainVertex &f = full[i];
+      for (int c = 0; c < 3; ++c)
+        position = max(position, fabs(v.position[c] - f.position[c]));
+      float d = glm::dot(v.normal, glm::normalize(f.normal));
+      angle = max(angle, float(acos(min(max(d, -1.0f), 1.0f))));
+      for (int c = 0; c < 4; ++c)
+        color = max(color, fabs(v.color[c] - f.color[c]));
+    }
+    float degrees = angle * 57.2957795f;
+    // half a step of the unorm16 grid over the bounds
+    float step = max(bounds.extent.x, max(bounds.extent.y, bounds.extent.z)) /
+                 65535.0f;
+    bool within =
+        position <= 0.51f * step + 1e-6f && degrees < 0.1f && color < 0.003f;
+    ok = ok && within;
+
+    cout << "[Bench]   " << size << "x" << size << " (" << count
+         << " vertices): buffer " << mib(fullBytes) << " -> "
+         << mib(packedBytes) << " MiB, fetched per frame "
+         << mib(fullBytes) * VIEWS << " -> " << mib(packedBytes) * VIEWS
+         << " MiB, streamed in " << fullFetchMs << " -> " << packedFetchMs
+         << " ms (" << fullFetchMs / packedFetchMs << "x), generated in "
+         << fullMs << " -> " << packedMs << " ms; largest error position "
+         << position << ", normal " << degrees << " deg, color " << color
+         << (within ? "" : " TOO LARGE") << endl;
+  }
+  // keeps the streaming from being optimized out
+  if (sink == 1)
+    cout << endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,173 @@
+/**
+ * ProceduralTerrainBench.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ *
+ * What the terrain costs before its first frame, buffered against procedural:
+ *   - glBufferData path: generateTerrain() on every hardware thread, then a
+ *     copy of the vertices and indices as glBufferData makes of them; the
+ *     memory is that of the vertex and index buffers (float and packed)
+ *   - procedural path: two uniforms and no memory; a resolution change costs
+ *     the same
+ * The vertex shader of the procedural path is ported below and checked
+ * against generateTerrain(), vertex by vertex and triangle by triangle, on
+ * grids up to 1024 x 1024.
+ * The trade is shading work: the procedural strip has no index to reuse
+ * vertices by, so every cell runs 2 vertex shaders where an indexed draw in
+ * vertex cache order runs about 1.3.
+ *
+ * usage: procedural_terrain_bench [grid sizes...]
+ */
+
+#include "JobSystem.hpp"
+#include "TerrainMesh.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static const float SPACING = 0.1f;
+
+template <typename F> static double timeMs(F run)
+{
+  Clock::time_point start = Clock::now();
+  run();
+  return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+// loadVertex() of SampleScene's PROCEDURAL_TERRAIN vertex shader, with the
+// grid point it computes
+static TerrainVertex loadVertex(int vertexId, int gridSize, float gridSpacing,
+                                int &x, int &y)
+{
+  int rowLength = 2 * gridSize + 4;
+  y = vertexId / rowLength;
+  int k = vertexId - y * rowLength;
+  x = k < rowLength - 2 ? k / 2 : (k == rowLength - 2 ? gridSize : 0);
+  y += k < rowLength - 2 ? 1 - k % 2 : (k == rowLength - 2 ? 0 : 2);
+  float half = float(gridSize) * 0.5f;
+  glm::vec2 xy((float(x) - half) * gridSpacing, (float(y) - half) * gridSpacing);
+  float sx = sin(xy.x), sy = sin(xy.y), cx = cos(xy.x), cy = cos(xy.y);
+  float h = 2.0f * sx * sy;
+
+  TerrainVertex v;
+  v.position = glm::vec3(xy, h);
+  v.normal = glm::normalize(glm::vec3(-2.0f * cx * sy, -2.0f * sx * cy, 1.0f));
+  float shade = sin(h * 5.0f) * 0.5f + 0.5f;
+  v.color = glm::vec4(shade, 1.0f - shade, 1.0f, 1.0f);
+  return v;
+}
+
+// the triangles of the strip, counterclockwise, without the degenerate ones,
+// as the sorted triangles of the index list must be
+static bool sameTriangles(const vector<int> &strip, const vector<uint32_t> &list)
+{
+  typedef vector<uint32_t> Triangle;
+  vector<Triangle> a, b;
+  for (size_t i = 0; i + 2 < strip.size(); ++i)
+  {
+    Triangle t = {uint32_t(strip[i]), uint32_t(strip[i + 1]),
+                  uint32_t(strip[i + 2])};
+    if (t[0] == t[1] || t[1] == t[2] || t[0] == t[2])
+      continue;
+    if (i % 2)
+      swap(t[0], t[1]);
+    rotate(t.begin(), min_element(t.begin(), t.end()), t.end());
+    a.push_back(t);
+  }
+  for (size_t i = 0; i < list.size(); i += 3)
+  {
+    Triangle t = {list[i], list[i + 1], list[i + 2]};
+    rotate(t.begin(), min_element(t.begin(), t.end()), t.end());
+    b.push_back(t);
+  }
+  sort(a.begin(), a.end());
+  sort(b.begin(), b.end());
+  return a == b;
+}
+
+static float largest(const glm::vec3 &a, const glm::vec3 &b)
+{
+  return max(fabs(a.x - b.x), max(fabs(a.y - b.y), fabs(a.z - b.z)));
+}
+
+static double mib(size_t bytes) { return double(bytes) / (1024.0 * 1024.0); }
+
+int main(int argc, char *argv[])
+{
+  vector<unsigned> sizes;
+  for (int i = 1; i < argc; ++i)
+    sizes.push_back(unsigned(max(atoi(argv[i]), 1)));
+  if (sizes.empty())
+    sizes = {100, 1024, 4096};
+
+  unsigned threads = max(thread::hardware_concurrency(), 1u);
+  JobSystem jobs(threads);
+  cout << "[Bench] terrain startup, buffered against procedural, " << threads
+       << " thread(s)" << endl;
+
+  bool ok = true;
+  for (size_t s = 0; s < sizes.size(); ++s)
+  {
+    unsigned size = sizes[s];
+    size_t vertexCount = (size_t(size) + 1) * (size_t(size) + 1);
+    size_t indexCount = size_t(size) * size * 6;
+    size_t floatBytes = vertexCount * sizeof(TerrainVertex);
+    size_t packedBytes = vertexCount * sizeof(PackedTerrainVertex);
+    size_t indexBytes = indexCount * sizeof(uint32_t);
+    size_t stripLength = size_t(size) * (2 * size_t(size) + 4) - 2;
+
+    TerrainMesh mesh;
+    double generateMs =
+        timeMs([&] { generateTerrain(size, SPACING, mesh, &jobs); });
+    double copyMs = 0;
+    {
+      vector<char> uploaded(floatBytes + indexBytes);
+      copyMs = timeMs([&] {
+        memcpy(uploaded.data(), mesh.vertices.data(), floatBytes);
+        memcpy(uploaded.data() + floatBytes, mesh.indices.data(), indexBytes);
+      });
+    }
+
+    const char *check = "not checked";
+    if (size <= 1024)
+    {
+      float position = 0, normal = 0, color = 0;
+      vector<int> strip(stripLength);
+      for (size_t i = 0; i < stripLength; ++i)
+      {
+        int x, y;
+        TerrainVertex p = loadVertex(int(i), int(size), SPACING, x, y);
+        strip[i] = y * int(size + 1) + x;
+        const TerrainVertex &b = mesh.vertices[size_t(strip[i])];
+        position = max(position, largest(p.position, b.position));
+        normal = max(normal, largest(p.normal, b.normal));
+        color = max(color, fabs(p.color.x - b.color.x));
+      }
+      bool same = position < 1e-4f && normal < 1e-4f && color < 1e-3f &&
+                  sameTriangles(strip, mesh.indices);
+      ok = ok && same;
+      check = same ? "matches generateTerrain()" : "MISMATCH";
+    }
+
+    cout << "[Bench]   " << size << "x" << size << ": buffered "
+         << mib(floatBytes + indexBytes) << " MiB ("
+         << mib(packedBytes + indexBytes) << " MiB packed) in "
+         << generateMs + copyMs << " ms (generate " << generateMs
+         << ", copy " << copyMs << "); procedural 0 MiB, 0 ms, "
+         << stripLength << " vertex shader runs per view against about "
+         << size_t(size) * size * 2 * 2 / 3 << " indexed; " << check << endl;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,193 @@
+/**
+ * QuiltDepthBench.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ *
+ * Overdraw with and without the quilt's depth attachment. Every view of a
+ * 45-view quilt draws a stack of full-view layers with a deliberately costly
+ * fragment shader, the way HoloPlayContext::run() draws a view: viewport and
+ * scissor to the view, depth cleared in the scissor when the quilt has depth.
+ * Layers are drawn front to back, the order early-Z rejects the most, and back
+ * to front, where the depth test can reject nothing.
+ *
+ * Reports the fragments shaded per quilt pixel (GL_SAMPLES_PASSED, the
+ * overdraw) and the GPU time per quilt (GL_TIME_ELAPSED) for each depth mode
+ * of QuiltChain. Needs an OpenGL 3.3 context; the window stays hidden.
+ *
+ * usage: quilt_depth_bench [layers] [shader iterations] [quilt size] [frames]
+ */
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "QuiltChain.hpp"
+#include "Shader.hpp"
+
+using namespace std;
+
+static const int COLUMNS = 5;
+static const int ROWS = 9;
+static const int VIEWS = 45;
+
+// a full-view quad per instance, at a depth set by its layer
+static const char *vertexShader =
+    "#version 330 core\n"
+    "uniform int layers;\n"
+    "uniform int frontToBack;\n"
+    "flat out int layer;\n"
+    "void main() {\n"
+    "  layer = frontToBack != 0 ? gl_InstanceID : layers - 1 - gl_InstanceID;\n"
+    "  vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;\n"
+    "  float z = -0.9 + 1.8 * float(layer) / float(layers);\n"
+    "  gl_Position = vec4(corner, z, 1.0);\n"
+    "}\n";
+
+// busy work standing in for lighting, without discard or depth writes so
+// early-Z stays possible
+static const char *fragmentShader =
+    "#version 330 core\n"
+    "uniform int iterations;\n"
+    "flat in int layer;\n"
+    "out vec4 color;\n"
+    "void main() {\n"
+    "  vec3 c = vec3(gl_FragCoord.xy * 0.001, float(layer) * 0.03);\n"
+    "  for (int i = 0; i < iterations; ++i)\n"
+    "    c = fract(c * 1.37 + sin(c.yzx * 3.1));\n"
+    "  color = vec4(c, 1.0);\n"
+    "}\n";
+
+struct Result
+{
+  double fragmentsPerPixel;
+  double gpuMs;
+};
+
+static Result renderQuilts(QuiltChain &quilts, ShaderProgram &program,
+                           int size, int layers, bool frontToBack, int frames)
+{
+  GLuint queries[2];
+  glGenQueries(2, queries);
+  int viewWidth = size / COLUMNS, viewHeight = size / ROWS;
+
+  program.use();
+  program.setUniform("layers", layers);
+  program.setUniform("frontToBack", frontToBack ? 1 : 0);
+
+  Result result = {0, 0};
+  for (int frame = 0; frame < frames; ++frame)
+  {
+    glBindFramebuffer(GL_FRAMEBUFFER, quilts.beginFrame());
+    glBeginQuery(GL_SAMPLES_PASSED, queries[0]);
+    glBeginQuery(GL_TIME_ELAPSED, queries[1]);
+    glEnable(GL_SCISSOR_TEST);
+    for (int view = 0; view < VIEWS; ++view)
+    {
+      int x = (view % COLUMNS) * viewWidth, y = (view / COLUMNS) * viewHeight;
+      glViewport(x, y, viewWidth, viewHeight);
+      glScissor(x, y, viewWidth, viewHeight);
+      if (quilts.hasDepth())
+        glClear(GL_DEPTH_BUFFER_BIT);
+      glClear(GL_COLOR_BUFFER_BIT);
+      glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, layers);
+    }
+    glDisable(GL_SCISSOR_TEST);
+    glEndQuery(GL_TIME_ELAPSED);
+    glEndQuery(GL_SAMPLES_PASSED);
+    quilts.endRender();
+    // nothing presents the quilts here, keep the chain's fences moving
+    quilts.acquirePresentTexture();
+    quilts.endPresent();
+
+    GLuint64 samples = 0, ns = 0;
+    glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &samples);
+    glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &ns);
+    result.fragmentsPerPixel +=
+        double(samples) / (double(viewWidth * COLUMNS) * double(viewHeight * ROWS));
+    result.gpuMs += double(ns) / 1e6;
+  }
+  program.unuse();
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glDeleteQueries(2, queries);
+  result.fragmentsPerPixel /= frames;
+  result.gpuMs /= frames;
+  return result;
+}
+
+int main(int argc, char *argv[])
+{
+  int layers = argc > 1 ? max(atoi(argv[1]), 1) : 16;
+  int iterations = argc > 2 ? max(atoi(argv[2]), 0) : 32;
+  int size = argc > 3 ? max(atoi(argv[3]), 256) : 4096;
+  int frames = argc > 4 ? max(atoi(argv[4]), 1) : 10;
+
+  if (!glfwInit())
+    return 1;
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+  GLFWwindow *window = glfwCreateWindow(64, 64, "quilt_depth_bench", NULL, NULL);
+  if (!window)
+  {
+    cout << "[Error] no OpenGL 3.3 context" << endl;
+    glfwTerminate();
+    return 1;
+  }
+  glfwMakeContextCurrent(window);
+  glewExperimental = GL_TRUE;
+  if (glewInit() != GLEW_OK)
+    return 1;
+  cout << "[Bench] " << glGetString(GL_RENDERER) << ", " << size << "x" << size
+       << " quilt, " << VIEWS << " views, " << layers << " layers, "
+       << iterations << " iterations per fragment" << endl;
+
+  // the state HoloPlayContext sets up
+  glEnable(GL_DEPTH_TEST);
+  glDepthFunc(GL_LESS);
+
+  GLuint vao;
+  glGenVertexArrays(1, &vao);
+  glBindVertexArray(vao);
+  {
+    ShaderProgram program({Shader(GL_VERTEX_SHADER, vertexShader),
+                           Shader(GL_FRAGMENT_SHADER, fragmentShader)});
+    program.use();
+    program.setUniform("iterations", iterations);
+    program.unuse();
+
+    const char *names[] = {"no depth", "depth renderbuffer", "depth texture"};
+    QuiltDepth modes[] = {QuiltDepth::None, QuiltDepth::Renderbuffer,
+                          QuiltDepth::Texture};
+    for (int m = 0; m < 3; ++m)
+    {
+      QuiltChainSettings settings;
+      settings.depth = modes[m];
+      QuiltChain quilts;
+      quilts.create(size, size, settings);
+      // warm up shaders and allocations
+      renderQuilts(quilts, program, size, layers, true, 1);
+      for (int order = 0; order < 2; ++order)
+      {
+        Result r = renderQuilts(quilts, program, size, layers, order == 0,
+                                frames);
+        cout << "[Bench]   " << names[m]
+             << (order == 0 ? ", front to back: " : ", back to front: ")
+             << r.fragmentsPerPixel << " fragments/pixel, " << r.gpuMs
+             << " ms/quilt" << endl;
+      }
+      quilts.release();
+    }
+  }
+  glDeleteVertexArrays(1, &vao);
+  glfwDestroyWindow(window);
+  glfwTerminate();
+  return 0;
+}
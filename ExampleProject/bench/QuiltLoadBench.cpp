@@ -0,0 +1,196 @@
+/**
+ * QuiltLoadBench.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ *
+ * Startup-to-first-frame for a pre-rendered quilt: the time from opening the
+ * file to having the first quilt's pixels in an upload buffer, which is what
+ * QuiltPlayback does before the first glTexSubImage2D. Compares
+ *   - reading a PPM of the quilt with fread and flipping it to GL's row order,
+ *     a lower bound for loading an image file
+ *   - a raw quilt file through QuiltFileReader's mapping
+ *   - a compressed quilt file decoded from the mapping
+ * both with the file in the page cache (warm) and evicted from it before each
+ * run (cold, POSIX only). The upload buffer is ordinary memory standing in for
+ * the persistently mapped pixel buffer.
+ *
+ * usage: quilt_load_bench [quilt size] [runs] [directory]
+ */
+
+#include "QuiltFileReader.hpp"
+#include "QuiltRecorder.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static void makeQuilt(vector<unsigned char> &pixels, int size)
+{
+  // shaded discs over a flat background, 5x9 views
+  pixels.resize(size_t(size) * size_t(size) * 3);
+  int tileW = size / 5, tileH = size / 9, radius = tileH / 3;
+  for (int y = 0; y < size; ++y)
+    for (int x = 0; x < size; ++x)
+    {
+      int dx = x % tileW - tileW / 2, dy = y % tileH - tileH / 2;
+      int r2 = dx * dx + dy * dy;
+      unsigned char *p = &pixels[(size_t(y) * size_t(size) + size_t(x)) * 3];
+      bool inside = r2 < radius * radius;
+      p[0] = inside ? (unsigned char)(200 - r2 * 150 / (radius * radius)) : 20;
+      p[1] = inside ? (unsigned char)(60 + (y % tileH) * 100 / tileH) : 24;
+      p[2] = inside ? (unsigned char)(80 + (x % tileW) * 100 / tileW) : 30;
+    }
+}
+
+static bool writeQuiltFile(const string &path, const vector<unsigned char> &quilt,
+                           int size, bool compress)
+{
+  QuiltRecordingLayout layout;
+  layout.width = uint32_t(size);
+  layout.height = uint32_t(size);
+  layout.columns = 5;
+  layout.rows = 9;
+  layout.totalViews = 45;
+  layout.aspect = 0.75f;
+  QuiltRecorderSettings settings;
+  settings.threads = 1;
+  settings.compress = compress;
+  QuiltRecorder recorder;
+  if (!recorder.open(path, layout, settings))
+    return false;
+  bool ok = recorder.submit(quilt.data(), quilt.size(), 0, 0.0);
+  recorder.close();
+  return ok;
+}
+
+static bool writePPM(const string &path, const vector<unsigned char> &quilt,
+                     int size)
+{
+  FILE *file = fopen(path.c_str(), "wb");
+  if (!file)
+    return false;
+  fprintf(file, "P6\n%d %d\n255\n", size, size);
+  size_t row = size_t(size) * 3;
+  for (int y = size - 1; y >= 0; --y)
+    fwrite(&quilt[size_t(y) * row], 1, row, file);
+  return fclose(file) == 0;
+}
+
+// drops the file from the page cache so the next open reads the disk
+static bool evict(const string &path)
+{
+#ifndef _WIN32
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  int result = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+  return result == 0;
+#else
+  (void)path;
+  return false;
+#endif
+}
+
+static bool loadPPM(const string &path, unsigned char *dst, vector<unsigned char> &scratch)
+{
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file)
+    return false;
+  int w = 0, h = 0, max = 0;
+  bool ok = fscanf(file, "P6 %d %d %d", &w, &h, &max) == 3 && fgetc(file) != EOF;
+  size_t row = size_t(w) * 3;
+  scratch.resize(row * size_t(h));
+  ok = ok && fread(scratch.data(), 1, scratch.size(), file) == scratch.size();
+  fclose(file);
+  // image files are top-down, GL textures bottom-up
+  for (int y = 0; ok && y < h; ++y)
+    memcpy(dst + size_t(h - 1 - y) * row, &scratch[size_t(y) * row], row);
+  return ok;
+}
+
+static bool loadQuiltFile(const string &path, unsigned char *dst)
+{
+  QuiltFileReader reader;
+  return reader.open(path) && reader.readFrame(0, dst);
+}
+
+static void measure(const char *label, const string &path, bool cold, int runs,
+                    const function<bool()> &load)
+{
+  vector<double> ms;
+  for (int i = 0; i < runs; ++i)
+  {
+    if (cold && !evict(path))
+      return;
+    Clock::time_point start = Clock::now();
+    if (!load())
+    {
+      cout << "[Bench]   " << label << ": failed" << endl;
+      return;
+    }
+    ms.push_back(chrono::duration<double, milli>(Clock::now() - start).count());
+  }
+  sort(ms.begin(), ms.end());
+  cout << "[Bench]   " << label << (cold ? " (cold)" : " (warm)") << ": median "
+       << ms[ms.size() / 2] << " ms, min " << ms.front() << " ms, max "
+       << ms.back() << " ms" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+  int size = argc > 1 ? max(atoi(argv[1]), 64) : 4096;
+  int runs = argc > 2 ? max(atoi(argv[2]), 1) : 10;
+  string dir = argc > 3 ? argv[3] : ".";
+
+  vector<unsigned char> quilt;
+  makeQuilt(quilt, size);
+  string ppm = dir + "/quilt_load_bench.ppm";
+  string raw = dir + "/quilt_load_bench_raw.hpq";
+  string packed = dir + "/quilt_load_bench_packed.hpq";
+  if (!writePPM(ppm, quilt, size) || !writeQuiltFile(raw, quilt, size, false) ||
+      !writeQuiltFile(packed, quilt, size, true))
+  {
+    cout << "[Bench] could not write the test files to " << dir << endl;
+    return 1;
+  }
+
+  // the upload buffer, touched once as a mapped buffer would be
+  vector<unsigned char> staging(quilt.size(), 0), scratch;
+  cout << "[Bench] " << size << "x" << size << " quilt, open to first frame in "
+       << "the upload buffer, " << runs << " runs" << endl;
+  for (int cold = 0; cold < 2; ++cold)
+  {
+    measure("PPM via fread", ppm, cold != 0, runs,
+            [&] { return loadPPM(ppm, staging.data(), scratch); });
+    measure("raw quilt file", raw, cold != 0, runs,
+            [&] { return loadQuiltFile(raw, staging.data()); });
+    measure("compressed quilt file", packed, cold != 0, runs,
+            [&] { return loadQuiltFile(packed, staging.data()); });
+  }
+
+  bool ok = loadQuiltFile(packed, staging.data()) && staging == quilt;
+  cout << "[Bench] compressed frame " << (ok ? "matches" : "DOES NOT MATCH")
+       << endl;
+  remove(ppm.c_str());
+  remove(raw.c_str());
+  remove(packed.c_str());
+  return ok ? 0 : 1;
+}
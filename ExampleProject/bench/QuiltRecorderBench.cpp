@@ -0,0 +1,343 @@
+/**
+ * QuiltRecorderBench.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ *
+ * Render frame times while recording. A render loop paced to a fixed frame
+ * rate draws a 45-view quilt with a deliberately costly fragment shader, the
+ * way HoloPlayContext::run() draws a view: viewport and scissor to the view,
+ * one draw each. It runs three times:
+ *   - without capture
+ *   - with FrameCapture reading every quilt back into a sink that does nothing
+ *   - recording, the sink handing every frame to QuiltRecorder::submit() on
+ *     the capture's delivery thread as HoloPlayContext::startRecording() does
+ *
+ * The frame time is the render thread's, from the start of the frame until
+ * the GPU has finished drawing it, like a swap with one frame in flight; the
+ * readback is queued after that fence, so it only counts where it delays the
+ * next frame's drawing. Reports the frame times of each run, the capture's
+ * drops and readback time, what the recorder wrote, dropped and failed to
+ * write, then reads the file back and checks the frames the sink saw.
+ *
+ * The quilts are a shaded disc per view over a flat background, shifted a
+ * little every frame, which compresses about like a rendered scene. Needs an
+ * OpenGL 3.3 context; the window stays hidden.
+ *
+ * usage: quilt_recorder_bench [seconds] [threads] [quilt size] [fps]
+ *                             [shader iterations] [file]
+ */
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include "FrameCapture.hpp"
+#include "QuiltCodec.hpp"
+#include "QuiltFile.hpp"
+#include "QuiltRecorder.hpp"
+#include "Shader.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static const int COLUMNS = 5;
+static const int ROWS = 9;
+static const int VIEWS = 45;
+static const int CHECKED = 16; // frames the sink remembers for the read back
+
+static const char *vertexShader =
+    "#version 330 core\n"
+    "out vec2 uv;\n"
+    "void main() {\n"
+    "  uv = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n"
+    "  gl_Position = vec4(uv * 2.0 - 1.0, 0.0, 1.0);\n"
+    "}\n";
+
+// a shaded disc per view, moving with the view and the frame; the busy work
+// stands in for lighting and never changes the color, so the quilts compress
+// the same whatever the iterations
+static const char *fragmentShader =
+    "#version 330 core\n"
+    "uniform int view;\n"
+    "uniform int shift;\n"
+    "uniform int iterations;\n"
+    "uniform vec2 tile;\n"
+    "in vec2 uv;\n"
+    "out vec4 color;\n"
+    "void main() {\n"
+    "  vec2 d = uv * tile - tile * 0.5 - vec2(float(view - shift), 0.0);\n"
+    "  float radius = tile.y / 3.0;\n"
+    "  float r2 = dot(d, d) / (radius * radius);\n"
+    "  color = r2 < 1.0 ? vec4(0.8 - 0.6 * r2, 0.25 + 0.4 * uv.y,\n"
+    "                          0.3 + 0.4 * uv.x, 1.0)\n"
+    "                   : vec4(0.08, 0.09, 0.12, 1.0);\n"
+    "  vec3 c = vec3(gl_FragCoord.xy * 0.001, 0.5);\n"
+    "  for (int i = 0; i < iterations; ++i)\n"
+    "    c = fract(c * 1.37 + sin(c.yzx * 3.1));\n"
+    "  if (c.x > 2.0)\n"
+    "    color.rgb = c;\n"
+    "}\n";
+
+struct Quilt
+{
+  int size;
+  GLuint texture;
+  GLuint fbo;
+};
+
+// what the sink saw of the first frames, to check the file against
+struct Checked
+{
+  map<uint64_t, uint64_t> hashes;
+};
+
+static uint64_t fnv1a(const unsigned char *data, size_t size)
+{
+  uint64_t h = 1469598103934665603ull;
+  for (size_t i = 0; i < size; ++i)
+    h = (h ^ data[i]) * 1099511628211ull;
+  return h;
+}
+
+static void print(const char *label, vector<double> &ms)
+{
+  sort(ms.begin(), ms.end());
+  cout << "[Bench]   " << label << ": median " << ms[ms.size() / 2]
+       << " ms, p99 " << ms[ms.size() * 99 / 100] << " ms, max " << ms.back()
+       << " ms" << endl;
+}
+
+// frame times of a loop pacing itself to fps, capturing every quilt if
+// capture is given
+static vector<double> run(const Quilt &quilt, ShaderProgram &program,
+                          FrameCapture *capture, double fps, double seconds)
+{
+  vector<double> frameMs;
+  int viewWidth = quilt.size / COLUMNS, viewHeight = quilt.size / ROWS;
+  program.use();
+  program.setUniform("tile", glm::vec2(float(viewWidth), float(viewHeight)));
+
+  Clock::duration period =
+      chrono::duration_cast<Clock::duration>(chrono::duration<double>(1.0 / fps));
+  Clock::time_point start = Clock::now(), next = start;
+  uint64_t frame = 0;
+  while (Clock::now() - start < chrono::duration<double>(seconds))
+  {
+    Clock::time_point frameStart = Clock::now();
+    glBindFramebuffer(GL_FRAMEBUFFER, quilt.fbo);
+    glEnable(GL_SCISSOR_TEST);
+    program.setUniform("shift", int(frame % 8) * 3);
+    for (int view = 0; view < VIEWS; ++view)
+    {
+      int x = (view % COLUMNS) * viewWidth, y = (view / COLUMNS) * viewHeight;
+      glViewport(x, y, viewWidth, viewHeight);
+      glScissor(x, y, viewWidth, viewHeight);
+      program.setUniform("view", view);
+      glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    }
+    glDisable(GL_SCISSOR_TEST);
+    GLsync drawn = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    if (capture)
+      capture->capture(CaptureSource::Quilt, quilt.fbo, quilt.size, quilt.size,
+                       frame);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glClientWaitSync(drawn, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1e10));
+    glDeleteSync(drawn);
+    frameMs.push_back(
+        chrono::duration<double, milli>(Clock::now() - frameStart).count());
+    frame++;
+    next += period;
+    this_thread::sleep_until(next);
+  }
+  program.unuse();
+  glFinish();
+  return frameMs;
+}
+
+static void printCapture(const FrameCaptureStats &stats)
+{
+  cout << "[Bench]   capture: " << stats.delivered << " of " << stats.requested
+       << " frames delivered, " << stats.droppedNoSlot
+       << " dropped waiting for the GPU, " << stats.droppedQueueFull
+       << " dropped by the sink queue, readback " << stats.averageReadbackMs
+       << " ms, sink " << stats.averageSinkMs << " ms" << endl;
+}
+
+// reads the file back and compares the frames the sink remembered
+static bool verify(const char *path, const Checked &checked)
+{
+  FILE *file = fopen(path, "rb");
+  if (!file)
+    return false;
+  QuiltFileHeader header;
+  bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+            !memcmp(header.magic, QUILT_FILE_MAGIC, sizeof(header.magic)) &&
+            header.indexOffset;
+  vector<QuiltIndexEntry> index(ok ? size_t(header.frameCount) : 0);
+  ok = ok && fseek(file, long(header.indexOffset), SEEK_SET) == 0 &&
+       fread(index.data(), sizeof(QuiltIndexEntry), index.size(), file) ==
+           index.size();
+  vector<unsigned char> stored, raw;
+  int compared = 0;
+  for (size_t i = 0; ok && i < index.size(); ++i)
+  {
+    const QuiltIndexEntry &e = index[i];
+    map<uint64_t, uint64_t>::const_iterator seen = checked.hashes.find(e.frame);
+    if (seen == checked.hashes.end())
+      continue;
+    stored.resize(size_t(e.storedSize));
+    raw.resize(size_t(e.rawSize));
+    ok = fseek(file, long(e.payloadOffset), SEEK_SET) == 0 &&
+         fread(stored.data(), 1, stored.size(), file) == stored.size();
+    if (ok && e.codec == QUILT_CODEC_RAW)
+      raw = stored;
+    else if (ok)
+      ok = quiltDecode(stored.data(), stored.size(), raw.data(), raw.size());
+    ok = ok && fnv1a(raw.data(), raw.size()) == seen->second;
+    compared++;
+  }
+  fclose(file);
+  ok = ok && compared > 0;
+  cout << "[Bench] read back " << compared << " of " << index.size()
+       << " frames: " << (ok ? "match" : "MISMATCH") << endl;
+  return ok;
+}
+
+int main(int argc, char *argv[])
+{
+  double seconds = argc > 1 ? atof(argv[1]) : 60.0;
+  int threads = argc > 2 ? max(atoi(argv[2]), 1) : 2;
+  int size = argc > 3 ? max(atoi(argv[3]), 256) : 4096;
+  double fps = argc > 4 ? max(atof(argv[4]), 1.0) : 60.0;
+  int iterations = argc > 5 ? max(atoi(argv[5]), 0) : 16;
+  const char *path = argc > 6 ? argv[6] : "quilt_recorder_bench.hpq";
+
+  if (!glfwInit())
+    return 1;
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+  GLFWwindow *window =
+      glfwCreateWindow(64, 64, "quilt_recorder_bench", NULL, NULL);
+  if (!window)
+  {
+    cout << "[Error] no OpenGL 3.3 context" << endl;
+    glfwTerminate();
+    return 1;
+  }
+  glfwMakeContextCurrent(window);
+  glewExperimental = GL_TRUE;
+  if (glewInit() != GLEW_OK)
+    return 1;
+  cout << "[Bench] " << glGetString(GL_RENDERER) << ", " << size << "x" << size
+       << " quilts at " << fps << " fps for " << seconds << " s, "
+       << iterations << " iterations per fragment, " << threads
+       << " compression threads, " << thread::hardware_concurrency()
+       << " cores" << endl;
+
+  Quilt quilt;
+  quilt.size = size;
+  glGenTextures(1, &quilt.texture);
+  glBindTexture(GL_TEXTURE_2D, quilt.texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, size, size, 0, GL_RGB,
+               GL_UNSIGNED_BYTE, NULL);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glGenFramebuffers(1, &quilt.fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, quilt.fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         quilt.texture, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  GLuint vao;
+  glGenVertexArrays(1, &vao);
+  glBindVertexArray(vao);
+  bool ok = true;
+  {
+    ShaderProgram program({Shader(GL_VERTEX_SHADER, vertexShader),
+                           Shader(GL_FRAGMENT_SHADER, fragmentShader)});
+    program.use();
+    program.setUniform("iterations", iterations);
+    program.unuse();
+
+    // warm up the shader and the allocations
+    run(quilt, program, NULL, fps, 0.5);
+    vector<double> baseline = run(quilt, program, NULL, fps, seconds);
+
+    // the capture on its own, to tell its cost from the recorder's
+    FrameCapture capture;
+    FrameCaptureSettings captureSettings;
+    captureSettings.dropPolicy = CaptureDropPolicy::DropNewest;
+    if (!capture.start(window, captureSettings, [](const CapturedFrame &) {}))
+      return 1;
+    vector<double> capturing = run(quilt, program, &capture, fps, seconds);
+    capture.stop();
+    FrameCaptureStats captureStats = capture.getStats();
+
+    QuiltRecordingLayout layout;
+    layout.width = uint32_t(size);
+    layout.height = uint32_t(size);
+    layout.columns = COLUMNS;
+    layout.rows = ROWS;
+    layout.totalViews = VIEWS;
+    layout.aspect = 0.75f;
+    layout.metadata = "{\"bench\":true}";
+    QuiltRecorderSettings settings;
+    settings.threads = threads;
+    QuiltRecorder recorder;
+    if (!recorder.open(path, layout, settings))
+      return 1;
+    Checked checked;
+    FrameCapture recording;
+    if (!recording.start(window, captureSettings,
+                         [&recorder, &checked](const CapturedFrame &frame) {
+                           if (recorder.submit(frame.pixels, frame.size,
+                                               frame.frame, frame.captureTime) &&
+                               checked.hashes.size() < CHECKED)
+                             checked.hashes[frame.frame] =
+                                 fnv1a(frame.pixels, frame.size);
+                         }))
+      return 1;
+    vector<double> recordingMs = run(quilt, program, &recording, fps, seconds);
+    recording.stop();
+    FrameCaptureStats recordingCapture = recording.getStats();
+    recorder.close();
+    QuiltRecorderStats stats = recorder.getStats();
+
+    cout << "[Bench] frame time" << endl;
+    print("without capture", baseline);
+    print("capture only", capturing);
+    printCapture(captureStats);
+    print("recording", recordingMs);
+    printCapture(recordingCapture);
+    cout << "[Bench] recorder: " << stats.written << " of " << stats.submitted
+         << " frames written, " << stats.dropped << " dropped, "
+         << stats.failed << " failed, realtime " << stats.realtime
+         << ", encode " << stats.averageEncodeMs << " ms/frame, ratio "
+         << (stats.rawBytes ? double(stats.storedBytes) / double(stats.rawBytes)
+                            : 0)
+         << ", " << stats.writeMBps << " MiB/s written" << endl;
+
+    ok = verify(path, checked);
+    remove(path);
+  }
+  glDeleteVertexArrays(1, &vao);
+  glDeleteFramebuffers(1, &quilt.fbo);
+  glDeleteTextures(1, &quilt.texture);
+  glfwDestroyWindow(window);
+  glfwTerminate();
+  return ok ? 0 : 1;
+}
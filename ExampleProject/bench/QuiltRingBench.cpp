@@ -0,0 +1,119 @@
+/**
+ * QuiltRingBench.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ *
+ * Pushes synthetic quilts through the shared-memory ring at a fixed frame rate
+ * and reports producer cost, stalls, slot occupancy and end-to-end latency.
+ * Pass the path of quilt_ring_consumer to run the consumer as a child process.
+ *
+ * usage: quilt_ring_bench [consumer executable] [size] [fps] [seconds] [slots]
+ */
+
+#include "QuiltRing.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+int main(int argc, const char *argv[])
+{
+  const char *consumer = argc > 1 ? argv[1] : NULL;
+  uint32_t size = argc > 2 ? uint32_t(atoi(argv[2])) : 4096;
+  double fps = argc > 3 ? atof(argv[3]) : 60.0;
+  double seconds = argc > 4 ? atof(argv[4]) : 5.0;
+  uint32_t slots = argc > 5 ? uint32_t(atoi(argv[5])) : 3;
+  const string name = "/holoplay_quilt_bench";
+
+  QuiltRingProducer ring(name, slots, size, size, 3);
+  vector<unsigned char> quilt(ring.getSlotBytes());
+
+#ifndef _WIN32
+  pid_t child = -1;
+  if (consumer)
+  {
+    child = fork();
+    if (child == 0)
+    {
+      string duration = to_string(seconds + 1.0);
+      execl(consumer, consumer, name.c_str(), duration.c_str(), "0",
+            (char *)NULL);
+      _exit(127);
+    }
+    // give the consumer a moment to attach
+    for (int i = 0; i < 200 && !ring.hasConsumer(); ++i)
+      this_thread::sleep_for(chrono::milliseconds(10));
+  }
+#endif
+
+  cout << "[Bench] " << size << "x" << size << " RGB quilts, " << slots
+       << " slots, " << fps << " fps for " << seconds << " s, consumer "
+       << (ring.hasConsumer() ? "attached" : "absent") << endl;
+
+  const auto period = chrono::duration<double>(1.0 / fps);
+  const auto start = chrono::steady_clock::now();
+  vector<double> frameCost;
+  uint64_t dropped = 0;
+  for (uint64_t frame = 0;; ++frame)
+  {
+    auto frameStart = start + chrono::duration_cast<chrono::steady_clock::duration>(
+                                  period * double(frame));
+    if (chrono::duration<double>(frameStart - start).count() >= seconds)
+      break;
+    this_thread::sleep_until(frameStart);
+
+    auto t0 = chrono::steady_clock::now();
+    unsigned char *slot = ring.acquire(0);
+    if (slot)
+    {
+      // stands in for the quilt readback
+      memset(quilt.data(), int(frame & 0xff), 64);
+      memcpy(slot, quilt.data(), quilt.size());
+      ring.publish(5, 9, 45);
+    }
+    else
+    {
+      dropped++;
+    }
+    frameCost.push_back(
+        chrono::duration<double, milli>(chrono::steady_clock::now() - t0)
+            .count());
+  }
+
+#ifndef _WIN32
+  if (child > 0)
+    waitpid(child, NULL, 0);
+#endif
+
+  sort(frameCost.begin(), frameCost.end());
+  QuiltRingMetrics m = ring.getMetrics();
+  double mb = double(ring.getSlotBytes()) / (1024.0 * 1024.0);
+  cout << "[Bench] producer cost per frame: median "
+       << frameCost[frameCost.size() / 2] << " ms, p99 "
+       << frameCost[frameCost.size() * 99 / 100] << " ms ("
+       << mb / (frameCost[frameCost.size() / 2] * 1e-3) << " MB/s)" << endl;
+  cout << "[Bench] published=" << m.published << " consumed=" << m.consumed
+       << " dropped=" << dropped << " overwritten=" << m.overwritten
+       << " skipped=" << m.skipped << endl;
+  cout << "[Bench] stalls=" << m.producerStalls << " avg stall "
+       << m.averageStallMs() << " ms" << endl;
+  cout << "[Bench] occupancy avg=" << m.averageOccupancy()
+       << " max=" << m.occupancyMax << " of " << slots << endl;
+  cout << "[Bench] latency avg=" << m.averageLatencyMs()
+       << " ms max=" << double(m.latencyMaxNs) * 1e-6 << " ms" << endl;
+  return 0;
+}
@@ -0,0 +1,229 @@
+/**
+ * ServiceReconnectBench.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ *
+ * Runs a fake render loop against a mock HoloPlay Service that kills and
+ * restarts itself on a schedule, and reports frame times while it is up and
+ * while it is down. Each restart comes back with a slightly different
+ * calibration, which the render loop must pick up.
+ *
+ * "background" mode uses ServiceConnection; "blocking" mode reconnects from
+ * the render loop, the way an app without it would.
+ *
+ * usage: service_reconnect_bench [background|blocking] [seconds] [up ms]
+ *                                [down ms] [pipe timeout ms]
+ */
+
+#include "ServiceConnection.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+// A service that is up for upMs, then dies for downMs, forever. Calls made
+// while it's down block for the pipe timeout, like the real pipe does when
+// nobody answers.
+class MockService : public ServiceBackend
+{
+public:
+  MockService(int upMs, int downMs, int timeoutMs)
+      : upMs(upMs), downMs(downMs), timeoutMs(timeoutMs), start(Clock::now())
+  {
+  }
+
+  bool alive() const { return phase() < upMs; }
+
+  // number of times the service has (re)started
+  int incarnation() const
+  {
+    return int(chrono::duration_cast<chrono::milliseconds>(Clock::now() - start)
+                   .count() /
+               (upMs + downMs));
+  }
+
+  virtual hpc_client_error connect()
+  {
+    if (!alive())
+    {
+      this_thread::sleep_for(chrono::milliseconds(timeoutMs));
+      return hpc_CLIERR_NOSERVICE;
+    }
+    this_thread::sleep_for(chrono::milliseconds(5));
+    connectedTo = incarnation();
+    return hpc_CLIERR_NOERROR;
+  }
+
+  virtual hpc_client_error refresh()
+  {
+    // a restarted service doesn't know the old pipe
+    if (!alive() || connectedTo != incarnation())
+    {
+      this_thread::sleep_for(chrono::milliseconds(timeoutMs));
+      return hpc_CLIERR_RECVTIMEOUT;
+    }
+    this_thread::sleep_for(chrono::milliseconds(1));
+    return hpc_CLIERR_NOERROR;
+  }
+
+  // what the render thread sends every frame; a dead pipe fails at once
+  hpc_client_error send()
+  {
+    if (!alive() || connectedTo != incarnation())
+      return hpc_CLIERR_PIPEERROR;
+    return hpc_CLIERR_NOERROR;
+  }
+
+  virtual bool readCalibration(int, DeviceCalibration &out)
+  {
+    memset(&out, 0, sizeof(out));
+    out.pitch = 49.8f;
+    out.center = 0.1f + 0.01f * float(connectedTo);
+    out.viewCone = 40.0f;
+    return true;
+  }
+
+  virtual void disconnect() { connectedTo = -1; }
+  virtual void close() { connectedTo = -1; }
+
+private:
+  long long phase() const
+  {
+    return chrono::duration_cast<chrono::milliseconds>(Clock::now() - start)
+               .count() %
+           (upMs + downMs);
+  }
+
+  int upMs, downMs, timeoutMs;
+  Clock::time_point start;
+  atomic<int> connectedTo{-1};
+};
+
+struct FrameStats
+{
+  vector<double> up, down;
+
+  static void print(const char *label, vector<double> &ms)
+  {
+    if (ms.empty())
+      return;
+    sort(ms.begin(), ms.end());
+    cout << "[Bench] " << label << " frames: " << ms.size() << ", median "
+         << ms[ms.size() / 2] << " ms, p99 " << ms[ms.size() * 99 / 100]
+         << " ms, max " << ms.back() << " ms" << endl;
+  }
+};
+
+// stands in for rendering 45 views
+static void renderFrame(double ms)
+{
+  Clock::time_point end =
+      Clock::now() + chrono::duration_cast<Clock::duration>(
+                         chrono::duration<double, milli>(ms));
+  while (Clock::now() < end)
+  {
+  }
+}
+
+int main(int argc, const char *argv[])
+{
+  bool background = !(argc > 1 && string(argv[1]) == "blocking");
+  double seconds = argc > 2 ? atof(argv[2]) : 10.0;
+  int upMs = argc > 3 ? atoi(argv[3]) : 2000;
+  int downMs = argc > 4 ? atoi(argv[4]) : 1000;
+  int timeoutMs = argc > 5 ? atoi(argv[5]) : 250;
+  const double frameMs = 1000.0 / 60.0, workMs = 4.0;
+
+  MockService *mock = new MockService(upMs, downMs, timeoutMs);
+  ServiceConnection connection(mock, 0);
+  connection.initialBackoffMs = 50;
+  connection.maxBackoffMs = 800;
+  connection.pollIntervalMs = 250;
+
+  hpc_client_error errco;
+  if (!connection.connect(errco))
+  {
+    cout << "[Error] " << describeClientError(errco) << endl;
+    return 1;
+  }
+  if (background)
+    connection.start();
+
+  cout << "[Bench] " << (background ? "background" : "blocking")
+       << " reconnect, service up " << upMs << " ms / down " << downMs
+       << " ms, pipe timeout " << timeoutMs << " ms, " << seconds << " s"
+       << endl;
+
+  FrameStats stats;
+  uint64_t loadedGeneration = connection.getGeneration();
+  float center = connection.getCalibration()->center;
+  int calibrationSwaps = 0, dropped = 0, blockingReconnects = 0;
+  bool lost = false;
+  Clock::time_point start = Clock::now(), next = start;
+  while (chrono::duration<double>(Clock::now() - start).count() < seconds)
+  {
+    this_thread::sleep_until(next);
+    next += chrono::duration_cast<Clock::duration>(
+        chrono::duration<double, milli>(frameMs));
+    Clock::time_point t0 = Clock::now();
+    bool serviceUp = mock->alive();
+
+    if (background)
+    {
+      if (connection.getGeneration() != loadedGeneration)
+      {
+        loadedGeneration = connection.getGeneration();
+        center = connection.getCalibration()->center;
+        calibrationSwaps++;
+      }
+      if (!connection.tryCall([&]() { return mock->send(); }))
+        dropped++;
+    }
+    else
+    {
+      // what the app would do without the connection manager
+      if (lost || mock->send() != hpc_CLIERR_NOERROR)
+      {
+        lost = mock->connect() != hpc_CLIERR_NOERROR;
+        if (!lost)
+        {
+          DeviceCalibration calibration;
+          mock->readCalibration(0, calibration);
+          center = calibration.center;
+          calibrationSwaps++;
+          blockingReconnects++;
+        }
+        else
+        {
+          dropped++;
+        }
+      }
+    }
+    renderFrame(workMs);
+
+    double ms = chrono::duration<double, milli>(Clock::now() - t0).count();
+    (serviceUp ? stats.up : stats.down).push_back(ms);
+  }
+
+  FrameStats::print("service up  ", stats.up);
+  FrameStats::print("service down", stats.down);
+  cout << "[Bench] restarts seen " << mock->incarnation() << ", reconnects "
+       << (background ? connection.getReconnectCount()
+                      : uint64_t(blockingReconnects))
+       << ", calibration swaps " << calibrationSwaps << " (center now "
+       << center << "), messages dropped " << dropped << endl;
+  connection.close();
+  return 0;
+}
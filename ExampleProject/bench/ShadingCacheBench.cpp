@@ -0,0 +1,430 @@
+/**
+ * ShadingCacheBench.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ *
+ * Shading the terrain for a 45-view quilt, the costly view independent part
+ * (diffuse light from a number of point lights) done
+ *   - in every view, for every fragment of every view
+ *   - once per frame into a shading cache over the terrain's xy, as
+ *     SampleScene::setShadingCache() does, the views sampling it and adding
+ *     their specular
+ * for a few light counts and cache sizes. Reports the GPU time of the quilt
+ * (GL_TIME_ELAPSED), cache pass included, the GPU time of the cache pass
+ * alone, and how far the cached quilt is from the fully shaded one, read back
+ * with glReadPixels. Needs an OpenGL 3.3 context; the window stays hidden.
+ *
+ * usage: shading_cache_bench [terrain cells] [cache texels...]
+ */
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Shader.hpp"
+#include "TerrainMesh.hpp"
+#include "ViewMatrices.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+using namespace std;
+
+static const int COLUMNS = 5;
+static const int ROWS = 9;
+static const int VIEWS = 45;
+static const int QUILT_SIZE = 4096;
+static const float VIEW_CONE = 40.0f;
+static const float CAMERA_SIZE = 5.0f;
+static const float ASPECT = 0.75f;
+static const float SPACING = 0.1f;
+static const int FRAMES = 10;
+
+// the lights circle over the terrain, shared by every variant
+static const char *LIGHTING_GLSL = R"--(
+  uniform int lights;
+  uniform float lightRadius;
+
+  const float ambient = 0.1;
+
+  vec3 diffuseLight(vec3 position, vec3 normal, vec3 albedo)
+  {
+      vec3 sum = vec3(0.0);
+      for (int i = 0; i < lights; ++i)
+      {
+          float a = 6.2831853 * float(i) / float(lights);
+          vec3 light = vec3(lightRadius * cos(a), lightRadius * sin(a), 1.0);
+          vec3 d = light - position;
+          float attenuation = 1.0 / (1.0 + 0.1 * dot(d, d));
+          sum += max(0.0, dot(normal, normalize(d))) * attenuation;
+      }
+      return ambient + albedo * 0.7 * sum / float(max(lights, 1));
+  }
+
+  float specularLight(vec3 viewPosition, vec3 viewNormal, vec3 viewLight)
+  {
+      vec3 r = reflect(-normalize(viewPosition), normalize(viewNormal));
+      vec3 l = normalize(viewLight - viewPosition);
+      return 0.6 * pow(max(0.0, -dot(r, l)), 4.0);
+  }
+)--";
+
+// CACHE_PASS: the terrain flat over the cache; CACHED: a view sampling it;
+// neither: a view shading in full
+static const char *vertexShader = R"--(
+  in vec3 position;
+  in vec3 normal;
+  in vec4 color;
+  uniform vec3 cacheOrigin;
+  uniform vec3 cacheExtent;
+  uniform mat4 view;
+  uniform mat4 projection;
+  out vec3 fWorldPosition;
+  out vec3 fWorldNormal;
+  out vec3 fViewPosition;
+  out vec3 fViewNormal;
+  out vec3 fViewLight;
+  out vec3 fColor;
+  out vec2 fCacheCoord;
+  void main(void)
+  {
+      fWorldPosition = position;
+      fWorldNormal = normal;
+      fColor = color.xyz;
+      vec3 t = (position - cacheOrigin) / cacheExtent;
+      fCacheCoord = t.xy;
+  #ifdef CACHE_PASS
+      gl_Position = vec4(t.xy * 2.0 - 1.0,
+                         clamp(1.0 - 2.0 * t.z, -1.0, 1.0), 1.0);
+  #else
+      vec4 p = view * vec4(position, 1.0);
+      fViewPosition = p.xyz;
+      fViewNormal = mat3(view) * normal;
+      fViewLight = (view * vec4(0.0, 0.0, 1.0, 1.0)).xyz;
+      gl_Position = projection * p;
+  #endif
+  }
+)--";
+
+static const char *fragmentShader = R"--(
+  in vec3 fWorldPosition;
+  in vec3 fWorldNormal;
+  in vec3 fViewPosition;
+  in vec3 fViewNormal;
+  in vec3 fViewLight;
+  in vec3 fColor;
+  in vec2 fCacheCoord;
+  uniform sampler2D shadingCache;
+  out vec4 color;
+  void main(void)
+  {
+  #if defined(CACHE_PASS)
+      color = vec4(diffuseLight(fWorldPosition, normalize(fWorldNormal),
+                                fColor), 1.0);
+  #else
+  #if defined(CACHED)
+      vec3 diffuse = texture(shadingCache, fCacheCoord).xyz;
+  #else
+      vec3 diffuse = diffuseLight(fWorldPosition, normalize(fWorldNormal),
+                                  fColor);
+  #endif
+      color = vec4(diffuse + specularLight(fViewPosition, fViewNormal,
+                                           fViewLight), 1.0);
+  #endif
+  }
+)--";
+
+static string source(const char *body, const char *define)
+{
+  string text = "#version 330 core\n";
+  if (define)
+    text += string("#define ") + define + "\n";
+  return text + LIGHTING_GLSL + body;
+}
+
+static ShaderProgram *makeProgram(const char *define)
+{
+  return new ShaderProgram(
+      {Shader(GL_VERTEX_SHADER, source(vertexShader, define).c_str()),
+       Shader(GL_FRAGMENT_SHADER, source(fragmentShader, define).c_str())});
+}
+
+// a color framebuffer with depth, the texture sampled if asked for
+struct Target
+{
+  GLuint framebuffer = 0, texture = 0, depth = 0;
+  int size = 0;
+
+  bool create(int texels)
+  {
+    size = texels;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glGenRenderbuffers(1, &depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           texture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                              GL_RENDERBUFFER, depth);
+    bool complete =
+        glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return complete;
+  }
+
+  void release()
+  {
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &depth);
+    glDeleteTextures(1, &texture);
+    framebuffer = texture = depth = 0;
+  }
+};
+
+// every light count and cache size, with the context current
+static void run(unsigned cells, const vector<int> &cacheSizes)
+{
+  TerrainMesh mesh;
+  generateTerrain(cells, SPACING, mesh, NULL);
+  TerrainBounds bounds = getTerrainBounds(cells, SPACING);
+  cout << "[Bench] terrain of " << cells << "x" << cells << " cells, "
+       << mesh.indices.size() / 3 << " triangles, " << VIEWS
+       << " views in a " << QUILT_SIZE << "x" << QUILT_SIZE << " quilt"
+       << endl;
+
+  ShaderProgram *full = makeProgram(NULL);
+  ShaderProgram *cached = makeProgram("CACHED");
+  ShaderProgram *pass = makeProgram("CACHE_PASS");
+  ShaderProgram *programs[] = {full, cached, pass};
+
+  // a vertex array per program, the linker may drop attributes it doesn't use
+  GLuint vbo, ibo, vaos[3];
+  glGenBuffers(1, &vbo);
+  glGenBuffers(1, &ibo);
+  glGenVertexArrays(3, vaos);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER,
+               GLsizeiptr(mesh.vertices.size() * sizeof(TerrainVertex)),
+               mesh.vertices.data(), GL_STATIC_DRAW);
+  for (int i = 0; i < 3; ++i)
+  {
+    glBindVertexArray(vaos[i]);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    programs[i]->setAttribute("position", 3, sizeof(TerrainVertex),
+                              offsetof(TerrainVertex, position));
+    programs[i]->setAttribute("normal", 3, sizeof(TerrainVertex),
+                              offsetof(TerrainVertex, normal));
+    if (programs[i] != cached)
+      programs[i]->setAttribute("color", 4, sizeof(TerrainVertex),
+                                offsetof(TerrainVertex, color));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+  }
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+               GLsizeiptr(mesh.indices.size() * sizeof(uint32_t)),
+               mesh.indices.data(), GL_STATIC_DRAW);
+  glBindVertexArray(0);
+  GLsizei indexCount = GLsizei(mesh.indices.size());
+
+  ViewMatrices views;
+  views.setViews(VIEWS, VIEW_CONE);
+  views.prepare(glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f),
+                            glm::vec3(0.0f, 1.0f, 0.0f)),
+                CAMERA_SIZE, ASPECT);
+
+  Target quilt;
+  if (!quilt.create(QUILT_SIZE))
+  {
+    cout << "[Error] quilt framebuffer incomplete" << endl;
+    return;
+  }
+  glEnable(GL_DEPTH_TEST);
+  // the quilt's elapsed time, and timestamps around the cache pass inside it
+  GLuint queries[3];
+  glGenQueries(3, queries);
+  int viewWidth = QUILT_SIZE / COLUMNS, viewHeight = QUILT_SIZE / ROWS;
+  vector<unsigned char> reference(size_t(QUILT_SIZE) * QUILT_SIZE * 4);
+  vector<unsigned char> pixels(reference.size());
+
+  int lightCounts[] = {1, 16, 64};
+  for (int lights : lightCounts)
+  {
+    // only the uniforms each variant keeps after linking
+    for (ShaderProgram *program : programs)
+    {
+      program->use();
+      if (program != cached)
+      {
+        program->setUniform("lights", lights);
+        program->setUniform("lightRadius", bounds.extent.x * 0.25f);
+      }
+      if (program != full)
+      {
+        program->setUniform("cacheOrigin", bounds.origin);
+        program->setUniform("cacheExtent", bounds.extent);
+      }
+      if (program == cached)
+        program->setUniform("shadingCache", 0);
+      program->unuse();
+    }
+
+    // the full quilt first, its image the reference; 0 texels for no cache
+    vector<int> sizes(1, 0);
+    sizes.insert(sizes.end(), cacheSizes.begin(), cacheSizes.end());
+    for (int texels : sizes)
+    {
+      Target cache;
+      if (texels && !cache.create(texels))
+      {
+        cout << "[Error] cache framebuffer of " << texels
+             << " texels incomplete" << endl;
+        continue;
+      }
+
+      double quiltMs = 0, cacheMs = 0;
+      for (int f = 0; f <= FRAMES; ++f)
+      {
+        glFinish();
+        glBeginQuery(GL_TIME_ELAPSED, queries[0]);
+        if (texels)
+        {
+          glQueryCounter(queries[1], GL_TIMESTAMP);
+          glBindFramebuffer(GL_FRAMEBUFFER, cache.framebuffer);
+          glViewport(0, 0, texels, texels);
+          glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+          pass->use();
+          glBindVertexArray(vaos[2]);
+          glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, NULL);
+          pass->unuse();
+          glQueryCounter(queries[2], GL_TIMESTAMP);
+          glBindTexture(GL_TEXTURE_2D, cache.texture);
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, quilt.framebuffer);
+        glViewport(0, 0, QUILT_SIZE, QUILT_SIZE);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        ShaderProgram *program = texels ? cached : full;
+        program->use();
+        glBindVertexArray(texels ? vaos[1] : vaos[0]);
+        for (int v = 0; v < VIEWS; ++v)
+        {
+          glm::mat4 view, projection;
+          views.get(v, view, projection);
+          program->setUniform("view", view);
+          program->setUniform("projection", projection);
+          glViewport((v % COLUMNS) * viewWidth, (v / COLUMNS) * viewHeight,
+                     viewWidth, viewHeight);
+          glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, NULL);
+        }
+        program->unuse();
+        glEndQuery(GL_TIME_ELAPSED);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        GLuint64 ns = 0, before = 0, after = 0;
+        glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &ns);
+        if (texels)
+        {
+          glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &before);
+          glGetQueryObjectui64v(queries[2], GL_QUERY_RESULT, &after);
+        }
+        // the first frame warms up shaders and buffers
+        if (f == 0)
+          continue;
+        quiltMs += double(ns) / 1e6;
+        cacheMs += double(after - before) / 1e6;
+      }
+
+      glBindFramebuffer(GL_FRAMEBUFFER, quilt.framebuffer);
+      glReadPixels(0, 0, QUILT_SIZE, QUILT_SIZE, GL_RGBA, GL_UNSIGNED_BYTE,
+                   texels ? pixels.data() : reference.data());
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+      cout << "[Bench] " << lights << " lights, ";
+      if (!texels)
+        cout << "shaded in every view: " << quiltMs / FRAMES << " ms GPU"
+             << endl;
+      else
+      {
+        double sum = 0;
+        int largest = 0;
+        for (size_t i = 0; i < pixels.size(); i += 4)
+          for (size_t c = 0; c < 3; ++c)
+          {
+            int d = abs(int(pixels[i + c]) - int(reference[i + c]));
+            sum += d;
+            largest = max(largest, d);
+          }
+        double mean = sum / double(pixels.size() / 4 * 3);
+        cout << texels << "x" << texels << " cache: " << quiltMs / FRAMES
+             << " ms GPU, of which the cache pass " << cacheMs / FRAMES
+             << " ms; mean difference " << mean << ", largest " << largest
+             << " of 255" << endl;
+      }
+      cache.release();
+    }
+  }
+
+  glDeleteQueries(3, queries);
+  quilt.release();
+  glBindVertexArray(0);
+  glDeleteVertexArrays(3, vaos);
+  glDeleteBuffers(1, &vbo);
+  glDeleteBuffers(1, &ibo);
+  delete full;
+  delete cached;
+  delete pass;
+}
+
+int main(int argc, char *argv[])
+{
+  unsigned cells = argc > 1 ? unsigned(max(atoi(argv[1]), 1)) : 256;
+  vector<int> cacheSizes;
+  for (int i = 2; i < argc; ++i)
+    cacheSizes.push_back(max(atoi(argv[i]), 1));
+  if (cacheSizes.empty())
+    cacheSizes = {512, 1024, 2048};
+
+  if (!glfwInit())
+    return 1;
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+  GLFWwindow *window =
+      glfwCreateWindow(256, 256, "shading_cache_bench", NULL, NULL);
+  if (!window)
+  {
+    cout << "[Error] no OpenGL 3.3 context" << endl;
+    glfwTerminate();
+    return 1;
+  }
+  glfwMakeContextCurrent(window);
+  glewExperimental = GL_TRUE;
+  if (glewInit() != GLEW_OK)
+    return 1;
+  cout << "[Bench] " << glGetString(GL_RENDERER) << endl;
+
+  run(cells, cacheSizes);
+
+  glfwDestroyWindow(window);
+  glfwTerminate();
+  return 0;
+}
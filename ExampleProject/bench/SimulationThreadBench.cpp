@@ -0,0 +1,145 @@
+/**
+ * SimulationThreadBench.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ *
+ * Stress test for the simulation thread: a fake render loop targets a fixed
+ * frame rate while update() is deliberately slow, once with update() inline in
+ * the frame (as HoloPlayContext::run() does by default) and once on a
+ * SimulationThread handing snapshots over through a TripleBuffer. Reports the
+ * render frame intervals, the age of the snapshot each frame rendered and the
+ * simulation tick statistics.
+ *
+ * usage: simulation_thread_bench [update ms] [render ms] [fps] [tick hz] [seconds]
+ */
+
+#include "SimulationThread.hpp"
+#include "TripleBuffer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+// what a scene would publish: a camera and a few hundred object transforms
+struct Snapshot
+{
+  uint64_t tick;
+  Clock::time_point published;
+  float transforms[256 * 16];
+};
+
+static void spin(double ms)
+{
+  Clock::time_point end =
+      Clock::now() +
+      chrono::duration_cast<Clock::duration>(chrono::duration<double, milli>(ms));
+  while (Clock::now() < end)
+  {
+  }
+}
+
+static void print(const char *label, vector<double> &ms)
+{
+  sort(ms.begin(), ms.end());
+  cout << "[Bench]   " << label << ": median " << ms[ms.size() / 2]
+       << " ms, p99 " << ms[ms.size() * 99 / 100] << " ms, max " << ms.back()
+       << " ms" << endl;
+}
+
+static void run(bool threaded, double updateMs, double renderMs, double fps,
+                double tickHz, double seconds)
+{
+  TripleBuffer<Snapshot> snapshots;
+  snapshots.reset(Snapshot());
+  uint64_t ticks = 0;
+  float simulated = 0;
+
+  // update() then publishSnapshot(), on whichever thread runs the simulation
+  auto tick = [&](double dt) {
+    spin(updateMs);
+    simulated += float(dt);
+    Snapshot &s = snapshots.write();
+    s.tick = ++ticks;
+    for (int i = 0; i < 256 * 16; ++i)
+      s.transforms[i] = simulated;
+    s.published = Clock::now();
+    snapshots.publish();
+    return true;
+  };
+
+  SimulationThread simulation;
+  if (threaded)
+    simulation.start(tickHz, tick);
+
+  vector<double> intervals, ages;
+  uint64_t lastTick = 0, repeated = 0;
+  const Clock::duration period = chrono::duration_cast<Clock::duration>(
+      chrono::duration<double>(1.0 / fps));
+  Clock::time_point start = Clock::now(), next = start, last = start;
+  while (chrono::duration<double>(Clock::now() - start).count() < seconds)
+  {
+    this_thread::sleep_until(next);
+    next += period;
+    if (!threaded)
+      tick(1.0 / fps);
+
+    // consumeSnapshot()
+    const Snapshot &s = snapshots.read();
+    Clock::time_point now = Clock::now();
+    if (s.tick == lastTick)
+      repeated++;
+    lastTick = s.tick;
+    if (s.tick)
+      ages.push_back(chrono::duration<double, milli>(now - s.published).count());
+
+    // render
+    volatile float sink = s.transforms[0];
+    (void)sink;
+    spin(renderMs);
+
+    now = Clock::now();
+    intervals.push_back(chrono::duration<double, milli>(now - last).count());
+    last = now;
+  }
+  simulation.stop();
+
+  double elapsed = chrono::duration<double>(last - start).count();
+  cout << "[Bench] " << (threaded ? "simulation thread" : "inline update")
+       << ": " << double(intervals.size()) / elapsed << " fps" << endl;
+  print("frame interval", intervals);
+  print("snapshot age  ", ages);
+  cout << "[Bench]   frames reusing the previous snapshot: " << repeated << endl;
+  if (threaded)
+  {
+    SimulationStats stats = simulation.getStats();
+    cout << "[Bench]   ticks " << stats.ticks << " (" << double(stats.ticks) / elapsed
+         << " Hz), overruns " << stats.overruns << ", skipped "
+         << stats.skipped << ", tick avg " << stats.averageTickMs
+         << " ms max " << stats.maxTickMs << " ms" << endl;
+  }
+}
+
+int main(int argc, const char *argv[])
+{
+  double updateMs = argc > 1 ? atof(argv[1]) : 30.0;
+  double renderMs = argc > 2 ? atof(argv[2]) : 5.0;
+  double fps = argc > 3 ? atof(argv[3]) : 60.0;
+  double tickHz = argc > 4 ? atof(argv[4]) : 30.0;
+  double seconds = argc > 5 ? atof(argv[5]) : 5.0;
+
+  cout << "[Bench] update " << updateMs << " ms, render " << renderMs
+       << " ms, target " << fps << " fps, tick " << tickHz << " Hz, "
+       << seconds << " s" << endl;
+  run(false, updateMs, renderMs, fps, tickHz, seconds);
+  run(true, updateMs, renderMs, fps, tickHz, seconds);
+  return 0;
+}
@@ -0,0 +1,220 @@
+/**
+ * StreamBufferBench.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ *
+ * Streaming geometry every frame. Each frame writes a block of vertices and
+ * draws them as points, so the GPU reads all of it, through
+ *   - glBufferData(GL_STATIC_DRAW) from a copy in memory, the only upload the
+ *     scene had before
+ *   - an orphaned GL_STREAM_DRAW buffer filled with glBufferSubData
+ *   - StreamBuffer rings of three frames: glBufferSubData, coherent and
+ *     explicitly flushed persistent mappings
+ *   - a coherent ring of a single frame, which has to wait for the GPU
+ * Reports the CPU time per frame, the write and upload rate in MiB/s, the
+ * frame rate over the whole run and the ring's stalls. Needs an OpenGL 3.3
+ * context, and ARB_buffer_storage for the persistent rings; the window stays
+ * hidden.
+ *
+ * usage: stream_buffer_bench [frames] [KiB per frame...]
+ */
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Shader.hpp"
+#include "StreamBuffer.hpp"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+// every vertex fetched, a point each somewhere in the window
+static const char *vertexShader =
+    "#version 330 core\n"
+    "in vec4 value;\n"
+    "void main() {\n"
+    "  gl_Position = vec4(fract(value.xy * 0.001 + value.zw) * 2.0 - 1.0,"
+    " 0.0, 1.0);\n"
+    "}\n";
+
+static const char *fragmentShader =
+    "#version 330 core\n"
+    "out vec4 color;\n"
+    "void main() { color = vec4(1.0); }\n";
+
+enum class Upload
+{
+  BufferData,
+  Orphan,
+  Ring
+};
+
+struct Mode
+{
+  const char *name;
+  Upload upload;
+  StreamMapping mapping;
+  size_t ringFrames;
+};
+
+// what a frame writes: a vec4 per vertex
+static void fill(float *out, size_t floats, int frame)
+{
+  float t = float(frame);
+  for (size_t i = 0; i < floats; ++i)
+    out[i] = float(i) * 0.25f + t;
+}
+
+int main(int argc, char *argv[])
+{
+  int frames = argc > 1 ? max(atoi(argv[1]), 1) : 300;
+  vector<size_t> sizes;
+  for (int i = 2; i < argc; ++i)
+    sizes.push_back(size_t(max(atoi(argv[i]), 1)) << 10);
+  if (sizes.empty())
+    sizes = {size_t(256) << 10, size_t(4) << 20, size_t(16) << 20};
+
+  if (!glfwInit())
+    return 1;
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+  GLFWwindow *window =
+      glfwCreateWindow(256, 256, "stream_buffer_bench", NULL, NULL);
+  if (!window)
+  {
+    cout << "[Error] no OpenGL 3.3 context" << endl;
+    glfwTerminate();
+    return 1;
+  }
+  glfwMakeContextCurrent(window);
+  glfwSwapInterval(0);
+  glewExperimental = GL_TRUE;
+  if (glewInit() != GLEW_OK)
+    return 1;
+  bool persistent = StreamBuffer::isPersistentSupported();
+  cout << "[Bench] " << glGetString(GL_RENDERER) << ", " << frames
+       << " frames per run"
+       << (persistent ? ""
+                      : ", no ARB_buffer_storage: rings use glBufferSubData")
+       << endl;
+
+  GLuint vao, buffer;
+  glGenVertexArrays(1, &vao);
+  glGenBuffers(1, &buffer);
+  glBindVertexArray(vao);
+  {
+    ShaderProgram program({Shader(GL_VERTEX_SHADER, vertexShader),
+                           Shader(GL_FRAGMENT_SHADER, fragmentShader)});
+    program.use();
+
+    const StreamMapping coherent = StreamMapping::Coherent;
+    Mode modes[] = {
+        {"glBufferData, static", Upload::BufferData, coherent, 0},
+        {"orphan, glBufferSubData", Upload::Orphan, coherent, 0},
+        {"ring, glBufferSubData", Upload::Ring, StreamMapping::BufferSubData,
+         3},
+        {"ring, coherent", Upload::Ring, coherent, 3},
+        {"ring, explicit flush", Upload::Ring, StreamMapping::ExplicitFlush, 3},
+        {"ring of one frame, coherent", Upload::Ring, coherent, 1}};
+    for (size_t bytes : sizes)
+    {
+      size_t floats = bytes / sizeof(float);
+      size_t vertices = floats / 4;
+      vector<float> copy(floats);
+      cout << "[Bench] " << (bytes >> 10) << " KiB, " << vertices
+           << " vertices per frame" << endl;
+      for (const Mode &mode : modes)
+      {
+        StreamBuffer ring;
+        if (mode.upload == Upload::Ring)
+        {
+          StreamBufferSettings settings;
+          // a little over the frames, alignment may take a few bytes
+          settings.size = mode.ringFrames * bytes + 256;
+          settings.mapping = mode.mapping;
+          ring.create(settings);
+        }
+
+        double cpuMs = 0, uploadMs = 0;
+        glFinish();
+        Clock::time_point runStart = Clock::now();
+        for (int f = 0; f < frames; ++f)
+        {
+          Clock::time_point start = Clock::now();
+          size_t offset = 0;
+          if (mode.upload == Upload::Ring)
+          {
+            ring.endFrame();
+            StreamAllocation allocation = ring.allocate(bytes, 16);
+            if (!allocation.data)
+              break;
+            fill(static_cast<float *>(allocation.data), floats, f);
+            ring.flush(allocation);
+            offset = allocation.offset;
+            glBindBuffer(GL_ARRAY_BUFFER, ring.getHandle());
+          }
+          else
+          {
+            fill(copy.data(), floats, f);
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            if (mode.upload == Upload::BufferData)
+              glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(bytes), copy.data(),
+                           GL_STATIC_DRAW);
+            else
+            {
+              glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(bytes), NULL,
+                           GL_STREAM_DRAW);
+              glBufferSubData(GL_ARRAY_BUFFER, 0, GLsizeiptr(bytes),
+                              copy.data());
+            }
+          }
+          Clock::time_point uploaded = Clock::now();
+          program.setAttribute("value", 4, 4 * sizeof(float), GLuint(offset));
+          glClear(GL_COLOR_BUFFER_BIT);
+          glDrawArrays(GL_POINTS, 0, GLsizei(vertices));
+          glfwSwapBuffers(window);
+          Clock::time_point end = Clock::now();
+          uploadMs += chrono::duration<double, milli>(uploaded - start).count();
+          cpuMs += chrono::duration<double, milli>(end - start).count();
+        }
+        glFinish();
+        double runMs =
+            chrono::duration<double, milli>(Clock::now() - runStart).count();
+
+        double mib = double(bytes) * frames / double(1 << 20);
+        double rate = uploadMs > 0 ? mib * 1000.0 / uploadMs : 0;
+        cout << "[Bench]   " << mode.name << ": " << cpuMs / frames
+             << " ms CPU/frame, " << rate << " MiB/s written and uploaded, "
+             << frames * 1000.0 / runMs << " frames/s";
+        if (mode.upload == Upload::Ring)
+        {
+          StreamBufferStats stats = ring.getStats();
+          cout << ", " << stats.stalls << " stalls (" << stats.stallMs
+               << " ms, longest " << stats.maxStallMs << " ms)";
+        }
+        cout << endl;
+        ring.release();
+      }
+    }
+    program.unuse();
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glDeleteBuffers(1, &buffer);
+  glDeleteVertexArrays(1, &vao);
+  glfwDestroyWindow(window);
+  glfwTerminate();
+  return 0;
+}
@@ -0,0 +1,173 @@
+/**
+ * TerrainLodBench.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ *
+ * Chunked LOD of the terrain across grid sizes, with the views of a 45-view
+ * quilt (819 x 455 pixels per view) looking at it from a few cameras:
+ *   - build time and memory of every level
+ *   - triangles drawn per view and per frame against the full grid, for a
+ *     tolerance of 1 and 4 pixels
+ *   - the largest gap between two selected chunks along their shared edges,
+ *     which the skirts have to be deeper than
+ *
+ * usage: terrain_lod_bench [grid sizes...]
+ */
+
+#include "JobSystem.hpp"
+#include "TerrainLod.hpp"
+#include "ViewMatrices.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static const float SPACING = 0.1f;
+static const int VIEWS = 45;
+static const float VIEW_HEIGHT = 455.0f;
+static const float ASPECT = 819.0f / 455.0f;
+
+struct Camera
+{
+    const char *name;
+    glm::vec3 position;
+    glm::vec3 target;
+};
+
+// the cameras of the first and the last view, as HoloPlayContext places them
+static void viewEyes(const glm::mat4 &frameView, float cameraSize,
+                     glm::vec3 &eyeA, glm::vec3 &eyeB, float &pixelScale)
+{
+  glm::mat4 view, projection;
+  ViewMatrices::computeView(0, VIEWS, 40.0f, frameView, cameraSize, ASPECT,
+                            view, projection);
+  eyeA = glm::vec3(glm::inverse(view)[3]);
+  ViewMatrices::computeView(VIEWS - 1, VIEWS, 40.0f, frameView, cameraSize,
+                            ASPECT, view, projection);
+  eyeB = glm::vec3(glm::inverse(view)[3]);
+  pixelScale = VIEW_HEIGHT * 0.5f * projection[1][1];
+}
+
+// the selected chunk holding (x, y), the finest if on an edge
+static size_t chunkAt(const TerrainLod &lod, const vector<size_t> &selected,
+                      float x, float y)
+{
+  size_t found = TerrainLod::NO_CHILD;
+  for (size_t i = 0; i < selected.size(); ++i)
+  {
+    const TerrainLodNode &n = lod.getNodes()[selected[i]];
+    if (x >= n.boundsMin.x && x <= n.boundsMax.x && y >= n.boundsMin.y &&
+        y <= n.boundsMax.y &&
+        (found == TerrainLod::NO_CHILD ||
+         n.level > lod.getNodes()[found].level))
+      found = selected[i];
+  }
+  return found;
+}
+
+// the largest height difference between neighbouring chunks along the edges
+static float largestGap(const TerrainLod &lod, const vector<size_t> &selected)
+{
+  float nudge = lod.getSpacing() * 0.25f;
+  float gap = 0;
+  for (size_t i = 0; i < selected.size(); ++i)
+  {
+    const TerrainLodNode &n = lod.getNodes()[selected[i]];
+    float cell = (n.boundsMax.x - n.boundsMin.x) / TerrainLod::CHUNK_CELLS;
+    for (unsigned k = 0; k <= TerrainLod::CHUNK_CELLS; ++k)
+    {
+      float along = n.boundsMin.x + cell * float(k);
+      float across = n.boundsMin.y + cell * float(k);
+      glm::vec2 points[4][2] = {
+          {{along, n.boundsMin.y}, {along, n.boundsMin.y - nudge}},
+          {{along, n.boundsMax.y}, {along, n.boundsMax.y + nudge}},
+          {{n.boundsMin.x, across}, {n.boundsMin.x - nudge, across}},
+          {{n.boundsMax.x, across}, {n.boundsMax.x + nudge, across}}};
+      for (int e = 0; e < 4; ++e)
+      {
+        size_t other = chunkAt(lod, selected, points[e][1].x, points[e][1].y);
+        if (other == TerrainLod::NO_CHILD)
+          continue; // the border of the terrain
+        float mine = lod.meshHeight(selected[i], points[e][0].x, points[e][0].y);
+        float theirs = lod.meshHeight(other, points[e][0].x, points[e][0].y);
+        gap = max(gap, fabs(mine - theirs));
+      }
+    }
+  }
+  return gap;
+}
+
+int main(int argc, char *argv[])
+{
+  vector<unsigned> sizes;
+  for (int i = 1; i < argc; ++i)
+    sizes.push_back(unsigned(max(atoi(argv[i]), 1)));
+  if (sizes.empty())
+    sizes = {256, 1024, 2048};
+
+  unsigned threads = max(thread::hardware_concurrency(), 1u);
+  JobSystem jobs(threads);
+  cout << "[Bench] terrain LOD, " << VIEWS << " views, " << threads
+       << " thread(s)" << endl;
+
+  bool ok = true;
+  for (size_t s = 0; s < sizes.size(); ++s)
+  {
+    TerrainLod lod;
+    Clock::time_point start = Clock::now();
+    lod.build(sizes[s], SPACING, &jobs);
+    double buildMs =
+        chrono::duration<double, milli>(Clock::now() - start).count();
+    // against the requested grid, which the rounded one spans
+    unsigned size = lod.getSize();
+    size_t full = size_t(sizes[s]) * sizes[s] * 2;
+    float half = float(sizes[s]) * SPACING * 0.5f;
+    cout << "[Bench]   " << sizes[s] << "x" << sizes[s] << " as " << size
+         << "x" << size << ", " << lod.getLevelCount()
+         << " levels of " << lod.getNodes().size() << " chunks: built in "
+         << buildMs << " ms, "
+         << lod.getVertices().size() * sizeof(TerrainVertex) / (1024 * 1024)
+         << " MiB, skirts " << lod.getSkirtDepth() << " deep" << endl;
+
+    Camera cameras[] = {
+        {"close above the centre", {0.0f, -3.0f, 4.0f}, {0.0f, 0.0f, 0.0f}},
+        {"across from an edge", {-half, -half, 3.0f}, {0.0f, 0.0f, 0.0f}},
+        {"high above", {0.0f, -half, half}, {0.0f, 0.0f, 0.0f}}};
+    for (int c = 0; c < 3; ++c)
+    {
+      glm::mat4 frameView = glm::lookAt(cameras[c].position, cameras[c].target,
+                                        glm::vec3(0.0f, 0.0f, 1.0f));
+      glm::vec3 eyeA, eyeB;
+      float pixelScale;
+      viewEyes(frameView, 5.0f, eyeA, eyeB, pixelScale);
+      float tolerances[] = {1.0f, 4.0f};
+      for (int t = 0; t < 2; ++t)
+      {
+        vector<size_t> selected;
+        lod.select(eyeA, eyeB, pixelScale, tolerances[t], selected);
+        size_t drawn = selected.size() * lod.getChunkTriangleCount();
+        float gap = largestGap(lod, selected);
+        bool closed = gap <= lod.getSkirtDepth();
+        ok = ok && closed;
+        cout << "[Bench]     " << cameras[c].name << ", " << tolerances[t]
+             << " px: " << selected.size() << " chunks, " << drawn
+             << " triangles per view (" << full << " full, "
+             << double(full) / double(drawn) << "x fewer), "
+             << drawn * VIEWS << " per frame; largest gap " << gap
+             << (closed ? "" : " NOT COVERED") << endl;
+      }
+    }
+  }
+  return ok ? 0 : 1;
+}
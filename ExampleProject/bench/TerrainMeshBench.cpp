@@ -0,0 +1,150 @@
+/**
+ * TerrainMeshBench.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ *
+ * Height-map terrain generation across grid sizes:
+ *   - the original SampleScene loop: push_back without reserve, three scalar
+ *     height samples per vertex for finite-difference normals
+ *   - generateTerrain() on the calling thread, allocating the mesh
+ *   - generateTerrainVertices() and generateTerrainIndices() into buffers
+ *     that already exist, as SampleScene does into the mapped GL buffers, on
+ *     the calling thread and on a JobSystem with every hardware thread
+ * Also compares the meshes: positions and indices must match, normals differ
+ * by the finite-difference error of the original.
+ *
+ * usage: terrain_mesh_bench [grid sizes...]
+ */
+
+#include "JobSystem.hpp"
+#include "TerrainMesh.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static const float SPACING = 0.1f;
+
+// the constructor of SampleScene before TerrainMesh
+static float heightMap(const glm::vec2 position)
+{
+  return float(2.0 * sin(position.x) * sin(position.y));
+}
+
+static TerrainVertex getHeightMap(const glm::vec2 position)
+{
+  const glm::vec2 dx(1.0, 0.0);
+  const glm::vec2 dy(0.0, 1.0);
+
+  TerrainVertex v;
+  float h = heightMap(position);
+  float hx = 100.f * (heightMap(position + 0.01f * dx) - h);
+  float hy = 100.f * (heightMap(position + 0.01f * dy) - h);
+
+  v.position = glm::vec3(position, h);
+  v.normal = glm::normalize(glm::vec3(-hx, -hy, 1.0));
+
+  float c = float(sin(h * 5.f) * 0.5 + 0.5);
+  v.color = glm::vec4(c, 1.0 - c, 1.0, 1.0);
+  return v;
+}
+
+static void generateSerial(unsigned size, TerrainMesh &mesh)
+{
+  mesh.vertices.clear();
+  mesh.indices.clear();
+  for (unsigned int y = 0; y <= size; ++y)
+    for (unsigned int x = 0; x <= size; ++x)
+    {
+      float xx = (float(x) - float(size) / 2.0f) * SPACING;
+      float yy = (float(y) - float(size) / 2.0f) * SPACING;
+      mesh.vertices.push_back(getHeightMap({xx, yy}));
+    }
+
+  for (unsigned int y = 0; y < size; ++y)
+    for (unsigned int x = 0; x < size; ++x)
+    {
+      mesh.indices.push_back((x + 0) + (size + 1) * (y + 0));
+      mesh.indices.push_back((x + 1) + (size + 1) * (y + 0));
+      mesh.indices.push_back((x + 1) + (size + 1) * (y + 1));
+
+      mesh.indices.push_back((x + 1) + (size + 1) * (y + 1));
+      mesh.indices.push_back((x + 0) + (size + 1) * (y + 1));
+      mesh.indices.push_back((x + 0) + (size + 1) * (y + 0));
+    }
+}
+
+template <typename F> static double timeMs(F generate)
+{
+  Clock::time_point start = Clock::now();
+  generate();
+  return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+static float largest(const glm::vec3 &a, const glm::vec3 &b)
+{
+  return max(fabs(a.x - b.x), max(fabs(a.y - b.y), fabs(a.z - b.z)));
+}
+
+int main(int argc, char *argv[])
+{
+  vector<unsigned> sizes;
+  for (int i = 1; i < argc; ++i)
+    sizes.push_back(unsigned(max(atoi(argv[i]), 1)));
+  if (sizes.empty())
+    sizes = {256, 512, 1024, 2048};
+
+  unsigned threads = max(thread::hardware_concurrency(), 1u);
+  JobSystem jobs(threads);
+  cout << "[Bench] terrain generation, " << threads << " thread(s)" << endl;
+
+  bool ok = true;
+  for (size_t s = 0; s < sizes.size(); ++s)
+  {
+    unsigned size = sizes[s];
+    TerrainMesh serial, allocated, parallel;
+    double serialMs = timeMs([&] { generateSerial(size, serial); });
+    double allocatedMs =
+        timeMs([&] { generateTerrain(size, SPACING, allocated, NULL); });
+    generateTerrain(size, SPACING, parallel, NULL);
+    double inlineMs = timeMs([&] {
+      generateTerrainVertices(size, SPACING, parallel.vertices.data(), NULL);
+      generateTerrainIndices(size, parallel.indices.data(), NULL);
+    });
+    double parallelMs = timeMs([&] {
+      generateTerrainVertices(size, SPACING, parallel.vertices.data(), &jobs);
+      generateTerrainIndices(size, parallel.indices.data(), &jobs);
+    });
+
+    float position = 0, normal = 0, color = 0;
+    for (size_t i = 0; i < serial.vertices.size(); ++i)
+    {
+      const TerrainVertex &a = serial.vertices[i], &b = parallel.vertices[i];
+      position = max(position, largest(a.position, b.position));
+      normal = max(normal, largest(a.normal, b.normal));
+      color = max(color, fabs(a.color.x - b.color.x));
+    }
+    bool same = serial.indices == parallel.indices &&
+                allocated.indices == parallel.indices && position < 1e-5f &&
+                normal < 0.05f && color < 1e-3f;
+    ok = ok && same;
+    cout << "[Bench]   " << size << "x" << size << " (" << serial.vertices.size()
+         << " vertices): original " << serialMs << " ms, allocating "
+         << allocatedMs << " ms, in place " << inlineMs << " ms, in place on "
+         << threads << " thread(s) " << parallelMs << " ms ("
+         << serialMs / parallelMs << "x); largest difference "
+         << "position " << position << ", normal " << normal << ", color "
+         << color << (same ? "" : " MISMATCH") << endl;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,167 @@
+/**
+ * ViewJobsBench.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ *
+ * CPU cost of building the per-view command lists of a quilt on a JobSystem.
+ * A synthetic scene of a few thousand objects is frustum culled for each view,
+ * and the visible ones get a draw with their model-view-projection packed into
+ * a ViewCommandList, the way buildViewCommands() would. No GL is involved, so
+ * this only measures the CPU side the workers take off the render thread.
+ * Runs the same frames with 1, 2, 4 and 8 workers and reports the build time
+ * per frame and how much work was stolen.
+ *
+ * usage: view_jobs_bench [objects] [views] [frames]
+ */
+
+#include "JobSystem.hpp"
+#include "ViewCommands.hpp"
+#include "ViewMatrices.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+struct Object
+{
+  glm::mat4 model;
+  glm::vec3 center;
+  float radius;
+  unsigned int vao;
+  int count;
+};
+
+// the scene is a loose cloud, denser on one side so some views see far more
+// objects than others
+static vector<Object> makeScene(size_t count)
+{
+  vector<Object> objects(count);
+  srand(1);
+  for (size_t i = 0; i < count; ++i)
+  {
+    float u = float(rand()) / float(RAND_MAX);
+    float x = (u * u * 2.0f - 1.0f) * 20.0f;
+    float y = (float(rand()) / float(RAND_MAX) * 2.0f - 1.0f) * 10.0f;
+    float z = -(float(rand()) / float(RAND_MAX)) * 60.0f;
+    objects[i].center = glm::vec3(x, y, z);
+    objects[i].radius = 0.5f;
+    objects[i].model = glm::translate(glm::mat4(1.0f), objects[i].center);
+    objects[i].vao = 1 + unsigned(i % 8);
+    objects[i].count = 36;
+  }
+  return objects;
+}
+
+// cull the scene against the view frustum and record one draw per object
+static void buildView(const vector<Object> &objects, ViewCommandList &commands)
+{
+  glm::mat4 viewProjection = commands.projection * commands.view;
+
+  // frustum planes from the rows of the view-projection matrix
+  glm::vec4 rows[4];
+  for (int r = 0; r < 4; ++r)
+    rows[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r],
+                        viewProjection[2][r], viewProjection[3][r]);
+  glm::vec4 planes[6] = {rows[3] + rows[0], rows[3] - rows[0],
+                         rows[3] + rows[1], rows[3] - rows[1],
+                         rows[3] + rows[2], rows[3] - rows[2]};
+  for (int p = 0; p < 6; ++p)
+  {
+    float length = glm::length(glm::vec3(planes[p]));
+    planes[p] = planes[p] * (1.0f / length);
+  }
+
+  commands.clearMask = 0x4100; // GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT
+  for (size_t i = 0; i < objects.size(); ++i)
+  {
+    const Object &object = objects[i];
+    bool visible = true;
+    for (int p = 0; p < 6 && visible; ++p)
+      visible = glm::dot(planes[p], glm::vec4(object.center, 1.0f)) >
+                -object.radius;
+    if (!visible)
+      continue;
+
+    commands.setUniform(0, viewProjection * object.model);
+    DrawCommand draw = {};
+    draw.program = 1;
+    draw.vao = object.vao;
+    draw.mode = 0x0004; // GL_TRIANGLES
+    draw.count = object.count;
+    draw.indexType = 0x1405; // GL_UNSIGNED_INT
+    commands.draw(draw);
+  }
+  commands.built = true;
+}
+
+static void run(unsigned workers, const vector<Object> &objects, int views,
+                int frames)
+{
+  JobSystem jobs(workers);
+  vector<ViewCommandList> lists((size_t(views)));
+  vector<double> ms;
+  size_t draws = 0;
+
+  for (int frame = 0; frame < frames; ++frame)
+  {
+    glm::mat4 current = glm::lookAt(
+        glm::vec3(sin(float(frame) * 0.01f) * 5.0f, 0.0f, 3.0f),
+        glm::vec3(0.0f, 0.0f, -30.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    Clock::time_point start = Clock::now();
+    jobs.parallelFor(lists.size(), 1, [&](size_t begin, size_t end) {
+      for (size_t v = begin; v < end; ++v)
+      {
+        ViewCommandList &commands = lists[v];
+        commands.clear();
+        commands.viewIndex = int(v);
+        ViewMatrices::computeView(int(v), views, 40.0f, current, 5.0f, 1.6f,
+                                  commands.view, commands.projection);
+        buildView(objects, commands);
+      }
+    });
+    ms.push_back(chrono::duration<double, milli>(Clock::now() - start).count());
+
+    for (size_t v = 0; v < lists.size(); ++v)
+      draws += lists[v].draws.size();
+  }
+
+  sort(ms.begin(), ms.end());
+  uint64_t executed = 0, stolen = 0;
+  vector<JobWorkerStats> stats = jobs.getStats();
+  for (size_t i = 0; i < stats.size(); ++i)
+  {
+    executed += stats[i].executed;
+    stolen += stats[i].stolen;
+  }
+  cout << "[Bench] " << workers << " worker(s): median " << ms[ms.size() / 2]
+       << " ms, p99 " << ms[ms.size() * 99 / 100] << " ms per frame, "
+       << draws / size_t(frames) << " draws per frame, " << stolen << " of "
+       << executed << " views stolen" << endl;
+}
+
+int main(int argc, const char *argv[])
+{
+  size_t objectCount = argc > 1 ? size_t(atoi(argv[1])) : 5000;
+  int views = argc > 2 ? atoi(argv[2]) : 45;
+  int frames = argc > 3 ? atoi(argv[3]) : 100;
+
+  vector<Object> objects = makeScene(objectCount);
+  cout << "[Bench] " << objectCount << " objects, " << views << " views, "
+       << frames << " frames" << endl;
+  const unsigned workerCounts[] = {1, 2, 4, 8};
+  for (size_t i = 0; i < sizeof(workerCounts) / sizeof(workerCounts[0]); ++i)
+    run(workerCounts[i], objects, views, frames);
+  return 0;
+}
@@ -0,0 +1,123 @@
+/**
+ * ViewMatricesBench.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ *
+ * All view and projection matrices of a frame, for 32, 45 and 100 views:
+ *   - one view at a time with glm, as setupVirtualCameraForView() used to
+ *   - batched by ViewMatrices, prepare() then write()
+ * into ViewCamera records 256 bytes apart, the usual uniform buffer offset
+ * alignment. The frame's camera turns a little every frame, so nothing can be
+ * reused between frames. Also checks both give the same matrices.
+ *
+ * usage: view_matrices_bench [frames]
+ */
+
+#include "ViewMatrices.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static const size_t STRIDE = 256;
+static const float VIEW_CONE = 40.0f;
+static const float CAMERA_SIZE = 5.0f;
+static const float ASPECT = 0.75f;
+
+static glm::mat4 frameView(int frame)
+{
+  float angle = float(frame) * 0.001f;
+  glm::vec3 eye(3.0f * sin(angle), 0.5f, 3.0f * cos(angle));
+  return glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+static ViewCamera &cameraAt(vector<unsigned char> &buffer, int view)
+{
+  return *reinterpret_cast<ViewCamera *>(&buffer[size_t(view) * STRIDE]);
+}
+
+static double perViewNs(int views, int frames, vector<unsigned char> &buffer)
+{
+  Clock::time_point start = Clock::now();
+  for (int frame = 0; frame < frames; ++frame)
+  {
+    glm::mat4 view = frameView(frame);
+    for (int i = 0; i < views; ++i)
+    {
+      ViewCamera &camera = cameraAt(buffer, i);
+      ViewMatrices::computeView(i, views, VIEW_CONE, view, CAMERA_SIZE, ASPECT,
+                                camera.view, camera.projection);
+    }
+  }
+  return chrono::duration<double, nano>(Clock::now() - start).count() / frames;
+}
+
+static double batchedNs(int views, int frames, vector<unsigned char> &buffer)
+{
+  ViewMatrices matrices;
+  Clock::time_point start = Clock::now();
+  for (int frame = 0; frame < frames; ++frame)
+  {
+    matrices.setViews(views, VIEW_CONE);
+    matrices.prepare(frameView(frame), CAMERA_SIZE, ASPECT);
+    matrices.write(buffer.data(), STRIDE);
+  }
+  return chrono::duration<double, nano>(Clock::now() - start).count() / frames;
+}
+
+// largest difference between the two, relative to the element's magnitude
+static float maxDifference(int views)
+{
+  vector<unsigned char> batched(size_t(views) * STRIDE), reference = batched;
+  ViewMatrices matrices;
+  matrices.setViews(views, VIEW_CONE);
+  matrices.prepare(frameView(123), CAMERA_SIZE, ASPECT);
+  matrices.write(batched.data(), STRIDE);
+  perViewNs(views, 124, reference);
+
+  float worst = 0;
+  for (int i = 0; i < views; ++i)
+  {
+    const float *a = &cameraAt(batched, i).view[0][0];
+    const float *b = &cameraAt(reference, i).view[0][0];
+    for (int k = 0; k < 32; ++k)
+      worst = max(worst, fabs(a[k] - b[k]) / max(1.0f, fabs(b[k])));
+  }
+  return worst;
+}
+
+int main(int argc, char *argv[])
+{
+  int frames = argc > 1 ? max(atoi(argv[1]), 1) : 100000;
+  const int counts[] = {32, 45, 100};
+
+  cout << "[Bench] view and projection matrices of a frame, " << frames
+       << " frames" << endl;
+  bool ok = true;
+  for (int c = 0; c < 3; ++c)
+  {
+    int views = counts[c];
+    vector<unsigned char> buffer(size_t(views) * STRIDE);
+    perViewNs(views, frames / 10 + 1, buffer); // warm up
+    double perView = perViewNs(views, frames, buffer);
+    double batched = batchedNs(views, frames, buffer);
+    float difference = maxDifference(views);
+    ok = ok && difference < 1e-4f;
+    cout << "[Bench]   " << views << " views: glm per view " << perView / 1000.0
+         << " us, batched " << batched / 1000.0 << " us ("
+         << perView / batched << "x), largest difference " << difference
+         << endl;
+  }
+  return ok ? 0 : 1;
+}
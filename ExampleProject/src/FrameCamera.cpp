@@ -0,0 +1,98 @@
+/**
+ * FrameCamera.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifdef WIN32
+#pragma warning(disable : 4464 4820 4514 5045 4201 5039 4061 4710)
+#endif
+
+#include "FrameCamera.hpp"
+
+using namespace std;
+
+static_assert(sizeof(FrameCamera) == 160, "FrameCamera must match std140");
+
+// the same views as ViewMatrices::computeView(); the field of view and the
+// aspect ratio are read back from the centre projection
+const char *const FRAME_CAMERA_GLSL = R"--(
+layout(std140) uniform FrameCamera
+{
+    mat4 holoplayCenterView;
+    mat4 holoplayCenterProjection;
+    float holoplayCameraSize;
+    float holoplayViewCone;
+    int holoplayViewCount;
+    int holoplayColumns;
+    vec2 holoplayTileSize;
+};
+
+// -cameraSize / tan(fov / 2), the projection holds 1 / tan(fov / 2) in [1][1]
+float holoplayCameraDistance()
+{
+    return -holoplayCameraSize * holoplayCenterProjection[1][1];
+}
+
+// how far the camera of a view moves sideways
+float holoplayViewOffset(int viewIndex)
+{
+    // start at -viewCone * 0.5 and go up to viewCone * 0.5
+    float t = holoplayViewCount > 1
+        ? float(viewIndex) / float(holoplayViewCount - 1) - 0.5 : 0.0;
+    return holoplayCameraDistance() * tan(t * radians(holoplayViewCone));
+}
+
+mat4 holoplayView(int viewIndex)
+{
+    vec4 offsetLocal = holoplayCenterView *
+        vec4(holoplayViewOffset(viewIndex), 0.0, holoplayCameraDistance(), 1.0);
+    mat4 view = holoplayCenterView;
+    view[3] = holoplayCenterView * vec4(offsetLocal.xyz, 1.0);
+    return view;
+}
+
+mat4 holoplayProjection(int viewIndex)
+{
+    // offset / (cameraSize * aspect), with [0][0] / [1][1] = 1 / aspect
+    mat4 projection = holoplayCenterProjection;
+    projection[2][0] += holoplayViewOffset(viewIndex) * projection[0][0] /
+                        (holoplayCameraSize * projection[1][1]);
+    return projection;
+}
+
+// for one instance per view drawn over the whole quilt: keeps clip inside the
+// view with GL_CLIP_DISTANCE0 to 3 and moves it into the view's tile
+vec4 holoplayQuiltPosition(vec4 clip, int viewIndex)
+{
+    gl_ClipDistance[0] = clip.w + clip.x;
+    gl_ClipDistance[1] = clip.w - clip.x;
+    gl_ClipDistance[2] = clip.w + clip.y;
+    gl_ClipDistance[3] = clip.w - clip.y;
+    vec2 tile = vec2(viewIndex % holoplayColumns, viewIndex / holoplayColumns);
+    clip.xy = clip.xy * holoplayTileSize +
+              clip.w * ((2.0 * tile + 1.0) * holoplayTileSize - 1.0);
+    return clip;
+}
+)--";
+
+string withFrameCamera(const char *source)
+{
+  string result = source;
+  size_t at = 0;
+  size_t version = result.find("#version");
+  if (version != string::npos)
+  {
+    at = result.find('\n', version);
+    if (at == string::npos)
+    {
+      at = result.size();
+      result += '\n';
+    }
+    ++at;
+  }
+  result.insert(at, FRAME_CAMERA_GLSL);
+  return result;
+}
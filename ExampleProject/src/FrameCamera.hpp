@@ -0,0 +1,50 @@
+/**
+ * FrameCamera.hpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifndef OPENGL_CMAKE_SKELETON_FRAMECAMERA_HPP
+#define OPENGL_CMAKE_SKELETON_FRAMECAMERA_HPP
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <string>
+
+// Views derived on the GPU.
+//
+// The views of a frame only differ from its centre camera by a sideways offset
+// and the projection shear that goes with it, so a vertex shader can derive
+// them from a view index. HoloPlayContext uploads the centre camera once per
+// frame into the FrameCamera uniform block; a vertex shader built with
+// withFrameCamera() then calls
+//   mat4 holoplayView(int viewIndex);
+//   mat4 holoplayProjection(int viewIndex);
+// and only the view index changes between views: one int uniform per view,
+// or none when the scene draws one instance per view with
+//   vec4 holoplayQuiltPosition(vec4 clip, int viewIndex);
+// which moves a clip-space position into the view's tile of the quilt and
+// clips it to the tile (HoloPlayContext::enableInstancedViews()).
+
+// the FrameCamera uniform block, std140 layout
+struct FrameCamera
+{
+    glm::mat4 centerView;       // the frame's view matrix
+    glm::mat4 centerProjection; // without the per-view shear
+    float cameraSize;
+    float viewCone;             // degrees
+    int32_t viewCount;
+    int32_t columns;            // views per row of the quilt
+    glm::vec2 tileSize;         // one view, as a fraction of the quilt
+    float padding[2];
+};
+
+// the GLSL of the block and the functions using it
+extern const char *const FRAME_CAMERA_GLSL;
+
+// source with FRAME_CAMERA_GLSL inserted after its #version line
+std::string withFrameCamera(const char *source);
+
+#endif // OPENGL_CMAKE_SKELETON_FRAMECAMERA_HPP
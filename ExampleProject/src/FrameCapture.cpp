@@ -0,0 +1,335 @@
+/**
+ * FrameCapture.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifdef WIN32
+#pragma warning(disable : 4464 4820 4514 5045 4201 5039 4061 4710)
+#endif
+
+#include "FrameCapture.hpp"
+
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+// how long a single glClientWaitSync() blocks before trying again
+static const GLuint64 WAIT_STEP_NS = 2000000;
+
+FrameCapture::FrameCapture() : stopping(false)
+{
+  stats = FrameCaptureStats();
+}
+
+FrameCapture::~FrameCapture()
+{
+  // the pixel buffers belong to the GL context, stop() is called while it's
+  // still current
+}
+
+bool FrameCapture::start(GLFWwindow *shareWith,
+                         const FrameCaptureSettings &captureSettings,
+                         const Sink &captureSink)
+{
+  stop();
+  settings = captureSettings;
+  settings.slots = max(settings.slots, 1);
+  settings.queueDepth = max(settings.queueDepth, 1);
+  settings.downscale = max(settings.downscale, 1);
+  sink = captureSink;
+
+  // the hints of the render window are still set, only hide this one
+  glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+  context = glfwCreateWindow(1, 1, "Frame Capture", NULL, shareWith);
+  glfwWindowHint(GLFW_VISIBLE, GL_TRUE);
+  if (!context)
+  {
+    cout << "[Error] could not create the frame capture context" << endl;
+    return false;
+  }
+
+  for (int i = 0; i < settings.slots; ++i)
+  {
+    slots.push_back(unique_ptr<Slot>(new Slot));
+    glGenBuffers(1, &slots.back()->buffer);
+  }
+  nextSlot = 0;
+  {
+    lock_guard<mutex> lock(statsMutex);
+    stats = FrameCaptureStats();
+  }
+
+  stopping = false;
+  workerDone = false;
+  readBack = 0;
+  worker = thread(&FrameCapture::workerLoop, this);
+  delivery = thread(&FrameCapture::deliveryLoop, this);
+  cout << "[Info] frame capture running with " << settings.slots
+       << " pixel buffers" << endl;
+  return true;
+}
+
+void FrameCapture::stop()
+{
+  if (!worker.joinable())
+    return;
+
+  // the worker reads back what is queued before leaving
+  stopping = true;
+  readReady.notify_all();
+  worker.join();
+  delivery.join();
+
+  glfwDestroyWindow(context);
+  context = nullptr;
+  for (size_t i = 0; i < slots.size(); ++i)
+  {
+    if (slots[i]->fence)
+      glDeleteSync(slots[i]->fence);
+    glDeleteBuffers(1, &slots[i]->buffer);
+  }
+  slots.clear();
+  for (size_t i = 0; i < scratches.size(); ++i)
+  {
+    glDeleteFramebuffers(1, &scratches[i].fbo);
+    glDeleteRenderbuffers(1, &scratches[i].renderbuffer);
+  }
+  scratches.clear();
+  toDeliver.clear();
+  freeFrames.clear();
+}
+
+GLuint FrameCapture::getScratch(int width, int height)
+{
+  for (size_t i = 0; i < scratches.size(); ++i)
+    if (scratches[i].width == width && scratches[i].height == height)
+      return scratches[i].fbo;
+
+  Scratch scratch;
+  scratch.width = width;
+  scratch.height = height;
+  glGenRenderbuffers(1, &scratch.renderbuffer);
+  glBindRenderbuffer(GL_RENDERBUFFER, scratch.renderbuffer);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGB8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  glGenFramebuffers(1, &scratch.fbo);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, scratch.fbo);
+  glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_RENDERBUFFER, scratch.renderbuffer);
+  scratches.push_back(scratch);
+  return scratch.fbo;
+}
+
+bool FrameCapture::capture(CaptureSource source, GLuint framebuffer,
+                           int width, int height, uint64_t frame)
+{
+  if (!worker.joinable())
+    return false;
+  {
+    lock_guard<mutex> lock(statsMutex);
+    stats.requested++;
+  }
+
+  // the oldest buffer comes back first, if it isn't free none is
+  Slot &slot = *slots[nextSlot];
+  if (slot.busy.load(memory_order_acquire))
+  {
+    lock_guard<mutex> lock(statsMutex);
+    stats.droppedNoSlot++;
+    return false;
+  }
+  nextSlot = (nextSlot + 1) % slots.size();
+
+  GLint readBinding = 0, drawBinding = 0;
+  glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readBinding);
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawBinding);
+
+  int captureWidth = max(width / settings.downscale, 1);
+  int captureHeight = max(height / settings.downscale, 1);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+  if (settings.downscale > 1)
+  {
+    // let the GPU filter it down, so less goes over the bus
+    GLuint scratch = getScratch(captureWidth, captureHeight);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, scratch);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, captureWidth, captureHeight,
+                      GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, scratch);
+  }
+
+  size_t size = size_t(captureWidth) * size_t(captureHeight) * 3;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+  if (slot.capacity < size)
+  {
+    glBufferData(GL_PIXEL_PACK_BUFFER, GLsizeiptr(size), NULL, GL_STREAM_READ);
+    slot.capacity = size;
+  }
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, captureWidth, captureHeight, GL_RGB, GL_UNSIGNED_BYTE,
+               (void *)0);
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, GLuint(readBinding));
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(drawBinding));
+
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  // the worker's context only sees the fence signal once it's flushed here
+  glFlush();
+  slot.source = source;
+  slot.frame = frame;
+  slot.width = captureWidth;
+  slot.height = captureHeight;
+  slot.captureTime = glfwGetTime();
+  slot.busy.store(true, memory_order_release);
+  {
+    lock_guard<mutex> lock(readMutex);
+    toRead.push_back(&slot);
+  }
+  readReady.notify_one();
+  return true;
+}
+
+unique_ptr<FrameCapture::Frame> FrameCapture::takeFreeFrame()
+{
+  lock_guard<mutex> lock(deliveryMutex);
+  if (freeFrames.empty())
+    return unique_ptr<Frame>(new Frame);
+  unique_ptr<Frame> frame = move(freeFrames.back());
+  freeFrames.pop_back();
+  return frame;
+}
+
+void FrameCapture::workerLoop()
+{
+  glfwMakeContextCurrent(context);
+
+  for (;;)
+  {
+    Slot *slot;
+    {
+      unique_lock<mutex> lock(readMutex);
+      readReady.wait(lock, [this] { return stopping || !toRead.empty(); });
+      if (toRead.empty())
+        break;
+      slot = toRead.front();
+      toRead.pop_front();
+    }
+
+    // no timeout: the frame was submitted and flushed, it will complete
+    for (;;)
+    {
+      GLenum status = glClientWaitSync(slot->fence, 0, WAIT_STEP_NS);
+      if (status != GL_TIMEOUT_EXPIRED)
+        break;
+    }
+    glDeleteSync(slot->fence);
+    slot->fence = 0;
+
+    size_t size = size_t(slot->width) * size_t(slot->height) * 3;
+    unique_ptr<Frame> frame = takeFreeFrame();
+    frame->pixels.resize(size);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->buffer);
+    const void *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                                          GLsizeiptr(size), GL_MAP_READ_BIT);
+    if (mapped)
+    {
+      memcpy(frame->pixels.data(), mapped, size);
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    else
+      cout << "[Error] could not map the capture buffer" << endl;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    frame->info.source = slot->source;
+    frame->info.frame = slot->frame;
+    frame->info.width = slot->width;
+    frame->info.height = slot->height;
+    frame->info.captureTime = slot->captureTime;
+    frame->info.size = size;
+    double readbackMs = (glfwGetTime() - slot->captureTime) * 1000.0;
+
+    // the render thread may reuse the pixel buffer from here
+    slot->busy.store(false, memory_order_release);
+    if (!mapped)
+      continue;
+
+    bool dropped = false;
+    {
+      lock_guard<mutex> lock(deliveryMutex);
+      if (int(toDeliver.size()) >= settings.queueDepth)
+      {
+        dropped = true;
+        if (settings.dropPolicy == CaptureDropPolicy::DropOldest)
+        {
+          freeFrames.push_back(move(toDeliver.front()));
+          toDeliver.pop_front();
+          toDeliver.push_back(move(frame));
+        }
+        else
+          freeFrames.push_back(move(frame));
+      }
+      else
+        toDeliver.push_back(move(frame));
+    }
+    deliveryReady.notify_one();
+
+    lock_guard<mutex> lock(statsMutex);
+    readBack++;
+    stats.averageReadbackMs += (readbackMs - stats.averageReadbackMs) /
+                               double(min(readBack, uint64_t(100)));
+    if (dropped)
+      stats.droppedQueueFull++;
+  }
+
+  // let the delivery thread finish once the queue is empty
+  {
+    lock_guard<mutex> lock(deliveryMutex);
+    workerDone = true;
+  }
+  deliveryReady.notify_all();
+  glfwMakeContextCurrent(NULL);
+}
+
+void FrameCapture::deliveryLoop()
+{
+  for (;;)
+  {
+    unique_ptr<Frame> frame;
+    {
+      unique_lock<mutex> lock(deliveryMutex);
+      deliveryReady.wait(lock,
+                         [this] { return !toDeliver.empty() || workerDone; });
+      if (toDeliver.empty())
+        break;
+      frame = move(toDeliver.front());
+      toDeliver.pop_front();
+    }
+
+    frame->info.pixels = frame->pixels.data();
+    double start = glfwGetTime();
+    sink(frame->info);
+    double sinkMs = (glfwGetTime() - start) * 1000.0;
+
+    {
+      lock_guard<mutex> lock(statsMutex);
+      stats.delivered++;
+      stats.averageSinkMs += (sinkMs - stats.averageSinkMs) /
+                             double(min(stats.delivered, uint64_t(100)));
+    }
+    lock_guard<mutex> lock(deliveryMutex);
+    freeFrames.push_back(move(frame));
+  }
+}
+
+FrameCaptureStats FrameCapture::getStats() const
+{
+  lock_guard<mutex> lock(statsMutex);
+  return stats;
+}
@@ -0,0 +1,175 @@
+/**
+ * FrameCapture.hpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifndef OPENGL_CMAKE_SKELETON_FRAMECAPTURE_HPP
+#define OPENGL_CMAKE_SKELETON_FRAMECAPTURE_HPP
+
+#include <GL/glew.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct GLFWwindow;
+
+// Asynchronous frame capture.
+//
+// capture() only queues a glReadPixels into a pixel buffer object and a fence,
+// it never waits for the GPU. A worker thread with its own hidden context,
+// shared with the render context, waits for the fence, maps the buffer and
+// copies the pixels out, then a delivery thread hands the frame to the sink.
+//
+// Two places can run full:
+//   - every pixel buffer is still being read back: the new capture is dropped
+//   - the sink is slower than the frame rate and the delivery queue is full:
+//     the drop policy picks the frame to lose
+// Either way the render loop carries on, and the drops are counted.
+
+enum class CaptureSource
+{
+    Quilt, // the quilt the views were just rendered into
+    Panel  // the interlaced output in the back buffer, before the swap
+};
+
+enum class CaptureDropPolicy
+{
+    DropNewest, // keep the queued frames, lose the one that didn't fit
+    DropOldest  // keep the latest frames, lose the oldest queued one
+};
+
+struct FrameCaptureSettings
+{
+    int slots = 3;        // pixel buffers in flight
+    int queueDepth = 3;   // frames waiting for the sink
+    int downscale = 1;    // capture at 1/downscale of the width and height
+    CaptureDropPolicy dropPolicy = CaptureDropPolicy::DropNewest;
+};
+
+// a captured frame, RGB with rows packed bottom to top as GL returns them;
+// the pixels are only valid during the sink call
+struct CapturedFrame
+{
+    CaptureSource source;
+    uint64_t frame;             // the frame number passed to capture()
+    int width;
+    int height;
+    const unsigned char *pixels;
+    size_t size;                // width * height * 3
+    double captureTime;         // glfwGetTime() when capture() was called
+};
+
+struct FrameCaptureStats
+{
+    uint64_t requested;         // capture() calls
+    uint64_t delivered;         // frames passed to the sink
+    uint64_t droppedNoSlot;     // no free pixel buffer
+    uint64_t droppedQueueFull;  // lost to the drop policy
+    double averageReadbackMs;   // capture() to pixels copied out
+    double averageSinkMs;
+};
+
+class FrameCapture
+{
+public:
+    // called on the delivery thread
+    typedef std::function<void(const CapturedFrame &frame)> Sink;
+
+    FrameCapture();
+    ~FrameCapture();
+
+    // creates the shared context and the threads; call on the main thread
+    // with shareWith's context current. Returns false if the context can't be
+    // created.
+    bool start(GLFWwindow *shareWith, const FrameCaptureSettings &settings,
+               const Sink &sink);
+
+    // delivers the frames already read back and joins the threads; call on
+    // the main thread with the render context current
+    void stop();
+
+    bool isRunning() const { return worker.joinable(); }
+    const FrameCaptureSettings &getSettings() const { return settings; }
+
+    // queues a read of the color attachment of framebuffer (0 for the back
+    // buffer) over width x height. Returns false if the frame was dropped.
+    bool capture(CaptureSource source, GLuint framebuffer, int width,
+                 int height, uint64_t frame);
+
+    FrameCaptureStats getStats() const;
+
+private:
+    FrameCapture(const FrameCapture &);
+    FrameCapture &operator=(const FrameCapture &);
+
+    struct Slot
+    {
+        GLuint buffer = 0;
+        size_t capacity = 0;
+        GLsync fence = 0;
+        std::atomic<bool> busy; // owned by the worker until read back
+        CaptureSource source = CaptureSource::Quilt;
+        uint64_t frame = 0;
+        int width = 0;
+        int height = 0;
+        double captureTime = 0;
+        Slot() : busy(false) {}
+    };
+
+    struct Frame
+    {
+        CapturedFrame info;
+        std::vector<unsigned char> pixels;
+    };
+
+    // scaled copy of a source, blitted before the read when downscaling
+    struct Scratch
+    {
+        int width;
+        int height;
+        GLuint renderbuffer;
+        GLuint fbo;
+    };
+
+    void workerLoop();
+    void deliveryLoop();
+    GLuint getScratch(int width, int height);
+    std::unique_ptr<Frame> takeFreeFrame();
+
+    FrameCaptureSettings settings;
+    Sink sink;
+    GLFWwindow *context = nullptr; // hidden, shared with the render context
+
+    std::vector<std::unique_ptr<Slot>> slots;
+    size_t nextSlot = 0;
+    std::vector<Scratch> scratches;
+
+    std::thread worker;
+    std::thread delivery;
+    std::atomic<bool> stopping;
+
+    std::mutex readMutex;
+    std::condition_variable readReady;
+    std::deque<Slot *> toRead;
+
+    std::mutex deliveryMutex;
+    std::condition_variable deliveryReady;
+    std::deque<std::unique_ptr<Frame>> toDeliver;
+    std::vector<std::unique_ptr<Frame>> freeFrames;
+    bool workerDone = false; // under deliveryMutex
+
+    mutable std::mutex statsMutex;
+    FrameCaptureStats stats;
+    uint64_t readBack = 0; // frames copied out, for the average
+};
+
+#endif // OPENGL_CMAKE_SKELETON_FRAMECAPTURE_HPP
@@ -0,0 +1,214 @@
+/**
+ * FramePacer.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifdef WIN32
+#pragma warning(disable : 4464 4820 4514 5045 4201 5039 4061 4710)
+#endif
+
+#include "FramePacer.hpp"
+
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+// how long a single glClientWaitSync() blocks before we check again
+static const GLuint64 WAIT_STEP_NS = 1000000;
+
+static double elapsedMs(FrameClock::time_point from, FrameClock::time_point to)
+{
+  return chrono::duration<double, milli>(to - from).count();
+}
+
+FramePacer::FramePacer()
+{
+  inputTime = FrameClock::now();
+}
+
+FramePacer::~FramePacer()
+{
+  // the fences belong to the GL context, which may already be gone here;
+  // release() is called while it's still current
+}
+
+void FramePacer::setSwapInterval(int interval)
+{
+  swapInterval = interval;
+  hasSwapInterval = true;
+}
+
+void FramePacer::setMaxFramesInFlight(int frames)
+{
+  maxFramesInFlight = max(frames, 0);
+}
+
+void FramePacer::apply()
+{
+  if (hasSwapInterval)
+  {
+    glfwSwapInterval(swapInterval);
+    cout << "[Info] swap interval " << swapInterval << endl;
+  }
+  if (maxFramesInFlight > 0)
+    cout << "[Info] at most " << maxFramesInFlight << " frame(s) in flight"
+         << endl;
+}
+
+void FramePacer::waitForFrameSlot()
+{
+  FrameClock::time_point start = FrameClock::now();
+
+  // collect what has signalled without waiting
+  while (!pending.empty())
+  {
+    GLenum status = glClientWaitSync(pending.front().fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+      break;
+    retire(pending.front(), FrameClock::now());
+    pending.pop_front();
+  }
+
+  // then block on the oldest frames until there is room for this one
+  while (maxFramesInFlight > 0 && int(pending.size()) >= maxFramesInFlight)
+  {
+    GLenum status = glClientWaitSync(pending.front().fence,
+                                     GL_SYNC_FLUSH_COMMANDS_BIT, WAIT_STEP_NS);
+    if (status == GL_TIMEOUT_EXPIRED)
+      continue;
+    if (status == GL_WAIT_FAILED)
+    {
+      cout << "[Error] glClientWaitSync failed, dropping the frame fence"
+           << endl;
+      glDeleteSync(pending.front().fence);
+      if (pending.front().query)
+        freeQueries.push_back(pending.front().query);
+    }
+    else
+      retire(pending.front(), FrameClock::now());
+    pending.pop_front();
+  }
+
+  lastWaitMs = elapsedMs(start, FrameClock::now());
+}
+
+void FramePacer::markInputSampled()
+{
+  markInputSampled(FrameClock::now());
+}
+
+void FramePacer::markInputSampled(FrameClock::time_point when)
+{
+  inputTime = when;
+}
+
+void FramePacer::frameSwapped()
+{
+  PendingFrame frame;
+  frame.query = 0;
+  if (GLEW_ARB_timer_query)
+  {
+    if (freeQueries.empty())
+    {
+      GLuint query;
+      glGenQueries(1, &query);
+      freeQueries.push_back(query);
+    }
+    frame.query = freeQueries.back();
+    freeQueries.pop_back();
+    glQueryCounter(frame.query, GL_TIMESTAMP);
+
+    // GPU time is in nanoseconds from an unspecified origin, pin it to the
+    // CPU clock now
+    GLint64 gpuNow = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+    frame.gpuEpoch =
+        FrameClock::now() -
+        chrono::duration_cast<FrameClock::duration>(chrono::nanoseconds(gpuNow));
+  }
+  frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  frame.input = inputTime;
+  frame.latency.frame = frameCount++;
+  frame.latency.inputToSwapMs = elapsedMs(inputTime, FrameClock::now());
+  frame.latency.inputToPresentMs = 0;
+  frame.latency.waitMs = lastWaitMs;
+  if (!frame.fence)
+  {
+    if (frame.query)
+      freeQueries.push_back(frame.query);
+    return;
+  }
+  // make sure the fence reaches the GPU even if nobody waits on it
+  glFlush();
+  pending.push_back(frame);
+}
+
+void FramePacer::retire(PendingFrame &frame, FrameClock::time_point signalled)
+{
+  glDeleteSync(frame.fence);
+  if (frame.query)
+  {
+    // the fence has signalled, so the timestamp is available
+    GLuint64 gpuTime = 0;
+    glGetQueryObjectui64v(frame.query, GL_QUERY_RESULT, &gpuTime);
+    freeQueries.push_back(frame.query);
+    FrameClock::time_point completed =
+        frame.gpuEpoch + chrono::duration_cast<FrameClock::duration>(
+                             chrono::nanoseconds(gpuTime));
+    signalled = min(signalled, completed);
+  }
+  frame.latency.inputToPresentMs = elapsedMs(frame.input, signalled);
+
+  retired++;
+  maxMs = max(maxMs, frame.latency.inputToPresentMs);
+  history.push_back(frame.latency);
+  if (history.size() > HISTORY)
+    history.pop_front();
+}
+
+void FramePacer::release()
+{
+  for (size_t i = 0; i < pending.size(); ++i)
+  {
+    glDeleteSync(pending[i].fence);
+    if (pending[i].query)
+      freeQueries.push_back(pending[i].query);
+  }
+  pending.clear();
+  if (!freeQueries.empty())
+    glDeleteQueries(GLsizei(freeQueries.size()), freeQueries.data());
+  freeQueries.clear();
+}
+
+FrameLatencyStats FramePacer::getStats() const
+{
+  FrameLatencyStats stats = {};
+  stats.frames = retired;
+  stats.maxMs = maxMs;
+  stats.framesInFlight = int(pending.size());
+  if (history.empty())
+    return stats;
+
+  vector<double> latencies;
+  double wait = 0;
+  for (size_t i = 0; i < history.size(); ++i)
+  {
+    latencies.push_back(history[i].inputToPresentMs);
+    wait += history[i].waitMs;
+  }
+  stats.lastMs = history.back().inputToPresentMs;
+  stats.averageWaitMs = wait / double(history.size());
+
+  double sum = 0;
+  for (size_t i = 0; i < latencies.size(); ++i)
+    sum += latencies[i];
+  stats.averageMs = sum / double(latencies.size());
+  sort(latencies.begin(), latencies.end());
+  stats.p95Ms = latencies[latencies.size() * 95 / 100];
+  return stats;
+}
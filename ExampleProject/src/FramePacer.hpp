@@ -0,0 +1,120 @@
+/**
+ * FramePacer.hpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifndef OPENGL_CMAKE_SKELETON_FRAMEPACER_HPP
+#define OPENGL_CMAKE_SKELETON_FRAMEPACER_HPP
+
+#include <GL/glew.h>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Frame pacing for the render loop.
+//
+// Without a limit the driver may queue several frames behind glfwSwapBuffers(),
+// and everything the user does shows up that many frames late. The pacer drops
+// a fence right after each swap and, before the next frame samples its input,
+// waits until no more than maxFramesInFlight fences are still pending. The time
+// from the input sample to the fence of the same frame signalling is reported
+// as the input-to-present latency. A GL_TIMESTAMP query issued with each fence
+// gives the GPU time the frame completed, so the latency doesn't depend on
+// when the pacer happens to look at the fence.
+//
+// All calls are made on the render thread with the GL context current.
+
+typedef std::chrono::steady_clock FrameClock;
+
+// one presented frame
+struct FrameLatency
+{
+    uint64_t frame;
+    double inputToSwapMs;    // input sample to glfwSwapBuffers() returning
+    double inputToPresentMs; // input sample to the post-swap fence signalling
+    double waitMs;           // time spent in waitForFrameSlot() before the frame
+};
+
+struct FrameLatencyStats
+{
+    uint64_t frames;        // frames whose fence has signalled
+    double lastMs;          // input to present of the latest of them
+    double averageMs;       // over the recent frames
+    double p95Ms;
+    double maxMs;
+    double averageWaitMs;
+    int framesInFlight;     // fences still pending right now
+};
+
+class FramePacer
+{
+public:
+    // frames kept for getRecentFrames() and the averages
+    static const size_t HISTORY = 240;
+
+    FramePacer();
+    ~FramePacer();
+
+    // glfwSwapInterval() value applied by apply(); the driver default is kept
+    // until this is called
+    void setSwapInterval(int interval);
+    // 0 doesn't limit the frames queued by the driver
+    void setMaxFramesInFlight(int frames);
+
+    int getMaxFramesInFlight() const { return maxFramesInFlight; }
+
+    // sets the swap interval on the current context
+    void apply();
+
+    // blocks until fewer than maxFramesInFlight frames are pending, and
+    // collects the fences that have signalled since the last call
+    void waitForFrameSlot();
+
+    // time the input of the next frame was sampled
+    void markInputSampled();
+    void markInputSampled(FrameClock::time_point when);
+
+    // right after glfwSwapBuffers()
+    void frameSwapped();
+
+    // deletes the pending fences
+    void release();
+
+    FrameLatencyStats getStats() const;
+    const std::deque<FrameLatency> &getRecentFrames() const { return history; }
+
+private:
+    FramePacer(const FramePacer &);
+    FramePacer &operator=(const FramePacer &);
+
+    struct PendingFrame
+    {
+        GLsync fence;
+        GLuint query;                 // GL_TIMESTAMP after the swap, or 0
+        FrameClock::time_point input;
+        FrameClock::time_point gpuEpoch; // CPU time of GPU time 0, at the swap
+        FrameLatency latency;
+    };
+
+    void retire(PendingFrame &pending, FrameClock::time_point signalled);
+
+    int swapInterval = 0;
+    bool hasSwapInterval = false;
+    int maxFramesInFlight = 0;
+
+    uint64_t frameCount = 0;
+    FrameClock::time_point inputTime;
+    double lastWaitMs = 0;
+    std::deque<PendingFrame> pending;
+    std::vector<GLuint> freeQueries;
+
+    uint64_t retired = 0;
+    double maxMs = 0;
+    std::deque<FrameLatency> history;
+};
+
+#endif // OPENGL_CMAKE_SKELETON_FRAMEPACER_HPP
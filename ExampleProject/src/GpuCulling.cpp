@@ -0,0 +1,381 @@
+/**
+ * GpuCulling.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifdef WIN32
+#pragma warning(disable : 4464 4820 4514 5045 4201 5039 4061 4710)
+#endif
+
+#include "GpuCulling.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#include "Shader.hpp"
+#include "ViewMatrices.hpp"
+#include "glError.hpp"
+
+using namespace std;
+
+// storage buffer binding points, the same in the compute and vertex shaders
+static const GLuint OBJECT_BINDING = 0;
+static const GLuint COMMAND_BINDING = 1;
+static const GLuint PLANE_BINDING = 2;
+
+// more than any instance count, so culledDraw stays at baseInstance
+static const GLuint DRAW_DIVISOR = 1u << 16;
+
+static const GLuint WORKGROUP_SIZE = 64;
+
+static const char *const CULL_SHADER = R"--(
+#version 430 core
+layout(local_size_x = 64) in;
+
+struct CulledObject
+{
+    mat4 model;
+    vec4 sphere;
+    uint count;
+    uint firstIndex;
+    int baseVertex;
+    uint padding;
+};
+
+struct DrawCommand
+{
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+layout(std430, binding = 0) readonly buffer CulledObjects
+{
+    CulledObject culledObjects[];
+};
+layout(std430, binding = 1) writeonly buffer DrawCommands
+{
+    DrawCommand commands[];
+};
+layout(std430, binding = 2) readonly buffer ViewPlanes
+{
+    vec4 planes[];
+};
+
+uniform uint objectCount;
+uniform int viewCount;
+
+void main()
+{
+    uint o = gl_GlobalInvocationID.x;
+    if (o >= objectCount)
+        return;
+    vec4 sphere = culledObjects[o].sphere;
+    uint count = culledObjects[o].count;
+    uint firstIndex = culledObjects[o].firstIndex;
+    int baseVertex = culledObjects[o].baseVertex;
+
+    int first = viewCount, last = -1;
+    for (int v = 0; v < viewCount; ++v)
+    {
+        bool visible = true;
+        for (int p = 0; p < 6; ++p)
+        {
+            vec4 plane = planes[v * 6 + p];
+            visible = visible && dot(plane.xyz, sphere.xyz) + plane.w >= -sphere.w;
+        }
+        if (visible)
+        {
+            first = min(first, v);
+            last = v;
+        }
+        commands[uint(v) * objectCount + o] =
+            DrawCommand(count, visible ? 1u : 0u, firstIndex, baseVertex,
+                        o * uint(viewCount) + uint(v));
+    }
+
+    // the range of views it's visible in, any view between drawn and clipped
+    uint instances = last >= first ? uint(last - first + 1) : 0u;
+    commands[uint(viewCount) * objectCount + o] =
+        DrawCommand(count, instances, firstIndex, baseVertex,
+                    o * uint(viewCount) + uint(instances > 0u ? first : 0));
+}
+)--";
+
+const char *const GPU_CULLING_GLSL = R"--(
+struct CulledObject
+{
+    mat4 model;
+    vec4 sphere;
+    uint count;
+    uint firstIndex;
+    int baseVertex;
+    uint padding;
+};
+
+layout(std430, binding = 0) readonly buffer CulledObjects
+{
+    CulledObject culledObjects[];
+};
+
+// the draw's baseInstance, object * view count + view
+in uint culledDraw;
+
+mat4 culledModel()
+{
+    return culledObjects[culledDraw / uint(holoplayViewCount)].model;
+}
+
+int culledView()
+{
+    return int(culledDraw % uint(holoplayViewCount)) + gl_InstanceID;
+}
+)--";
+
+GpuCulling::GpuCulling() {}
+
+GpuCulling::~GpuCulling()
+{
+  release();
+}
+
+bool GpuCulling::isSupported()
+{
+  // the shaders are #version 430 and Shader exits if one fails to compile,
+  // so the ARB extensions on an older context aren't enough
+  return GLEW_VERSION_4_3;
+}
+
+bool GpuCulling::create()
+{
+  release();
+  if (!isSupported())
+  {
+    cout << "[Error] GPU culling needs OpenGL 4.3" << endl;
+    return false;
+  }
+
+  Shader shader(GL_COMPUTE_SHADER, CULL_SHADER);
+  program = new ShaderProgram({shader});
+  GLint linked = GL_FALSE;
+  glGetProgramiv(program->getHandle(), GL_LINK_STATUS, &linked);
+  if (linked != GL_TRUE)
+  {
+    release();
+    return false;
+  }
+  objectCountLocation = program->uniform("objectCount");
+  viewCountLocation = program->uniform("viewCount");
+
+  glGenBuffers(1, &objectBuffer);
+  glGenBuffers(1, &planeBuffer);
+  glGenBuffers(1, &commandBuffer);
+  glGenBuffers(1, &drawBuffer);
+  glCheckError(__FILE__, __LINE__);
+  return true;
+}
+
+void GpuCulling::release()
+{
+  delete program;
+  program = nullptr;
+  GLuint buffers[4] = {objectBuffer, planeBuffer, commandBuffer, drawBuffer};
+  if (objectBuffer)
+    glDeleteBuffers(4, buffers);
+  objectBuffer = planeBuffer = commandBuffer = drawBuffer = 0;
+  drawCapacity = 0;
+  commandCapacity = 0;
+  viewCount = 0;
+}
+
+void GpuCulling::setObjects(const vector<GpuCullObject> &newObjects)
+{
+  objects = newObjects;
+  if (!program)
+    return;
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER,
+               GLsizeiptr(max<size_t>(objects.size(), 1) * sizeof(GpuCullObject)),
+               objects.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GpuCulling::setDrawAttribute(GLint location)
+{
+  if (!program || location < 0)
+    return;
+  glBindBuffer(GL_ARRAY_BUFFER, drawBuffer);
+  glEnableVertexAttribArray(GLuint(location));
+  glVertexAttribIPointer(GLuint(location), 1, GL_UNSIGNED_INT, 0, NULL);
+  glVertexAttribDivisor(GLuint(location), DRAW_DIVISOR);
+}
+
+// the buffer culledDraw reads from, 0 to count - 1
+void GpuCulling::reserveDraws(size_t count)
+{
+  if (count <= drawCapacity)
+    return;
+  drawCapacity = max(count, drawCapacity * 2);
+  vector<uint32_t> draws(drawCapacity);
+  for (size_t i = 0; i < draws.size(); ++i)
+    draws[i] = uint32_t(i);
+  // the same name keeps the vertex arrays pointing at it
+  glBindBuffer(GL_ARRAY_BUFFER, drawBuffer);
+  glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(draws.size() * sizeof(uint32_t)),
+               draws.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void GpuCulling::frustumPlanes(const glm::mat4 &viewProjection,
+                               glm::vec4 planes[6])
+{
+  glm::vec4 rows[4];
+  for (int r = 0; r < 4; ++r)
+    rows[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r],
+                        viewProjection[2][r], viewProjection[3][r]);
+  planes[0] = rows[3] + rows[0];
+  planes[1] = rows[3] - rows[0];
+  planes[2] = rows[3] + rows[1];
+  planes[3] = rows[3] - rows[1];
+  planes[4] = rows[3] + rows[2];
+  planes[5] = rows[3] - rows[2];
+  // unit normals, so that the distance compares with a radius
+  for (int p = 0; p < 6; ++p)
+    planes[p] = planes[p] * (1.0f / glm::length(glm::vec3(planes[p])));
+}
+
+void GpuCulling::cull(const ViewMatrices &views)
+{
+  if (!program || objects.empty())
+    return;
+  viewCount = views.getViewCount();
+  planes.resize(size_t(viewCount) * 6);
+  for (int v = 0; v < viewCount; ++v)
+  {
+    glm::mat4 view, projection;
+    views.get(v, view, projection);
+    frustumPlanes(projection * view, &planes[size_t(v) * 6]);
+  }
+
+  size_t commandCount = objects.size() * (size_t(viewCount) + 1);
+  reserveDraws(objects.size() * size_t(viewCount));
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, planeBuffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER,
+               GLsizeiptr(planes.size() * sizeof(glm::vec4)), planes.data(),
+               GL_STREAM_DRAW);
+  if (commandCount > commandCapacity)
+  {
+    commandCapacity = commandCount;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER,
+                 GLsizeiptr(commandCapacity *
+                            sizeof(DrawElementsIndirectCommand)),
+                 NULL, GL_DYNAMIC_COPY);
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  program->use();
+  glUniform1ui(objectCountLocation, GLuint(objects.size()));
+  glUniform1i(viewCountLocation, viewCount);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OBJECT_BINDING, objectBuffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMAND_BINDING, commandBuffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PLANE_BINDING, planeBuffer);
+  glDispatchCompute(GLuint((objects.size() + WORKGROUP_SIZE - 1) /
+                           WORKGROUP_SIZE),
+                    1, 1);
+  program->unuse();
+  // the draws read the commands as indirect parameters
+  glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+  glCheckError(__FILE__, __LINE__);
+}
+
+void GpuCulling::drawView(GLenum mode, GLenum indexType, int viewIndex) const
+{
+  if (!program || objects.empty() || viewIndex < 0 || viewIndex >= viewCount)
+    return;
+  size_t offset =
+      size_t(viewIndex) * objects.size() * sizeof(DrawElementsIndirectCommand);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OBJECT_BINDING, objectBuffer);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+  glMultiDrawElementsIndirect(mode, indexType, (const void *)offset,
+                              GLsizei(objects.size()), 0);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void GpuCulling::drawAllViews(GLenum mode, GLenum indexType) const
+{
+  if (!program || objects.empty() || !viewCount)
+    return;
+  size_t offset =
+      size_t(viewCount) * objects.size() * sizeof(DrawElementsIndirectCommand);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OBJECT_BINDING, objectBuffer);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+  glMultiDrawElementsIndirect(mode, indexType, (const void *)offset,
+                              GLsizei(objects.size()), 0);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+// the compute shader, line for line
+void GpuCulling::cullOnCpu(const ViewMatrices &views,
+                           vector<DrawElementsIndirectCommand> &commands) const
+{
+  int count = views.getViewCount();
+  vector<glm::vec4> viewPlanes(size_t(count) * 6);
+  for (int v = 0; v < count; ++v)
+  {
+    glm::mat4 view, projection;
+    views.get(v, view, projection);
+    frustumPlanes(projection * view, &viewPlanes[size_t(v) * 6]);
+  }
+
+  size_t n = objects.size();
+  commands.resize(n * (size_t(count) + 1));
+  for (size_t o = 0; o < n; ++o)
+  {
+    const GpuCullObject &object = objects[o];
+    glm::vec3 centre(object.sphere);
+    int first = count, last = -1;
+    for (int v = 0; v < count; ++v)
+    {
+      bool visible = true;
+      for (int p = 0; p < 6; ++p)
+      {
+        const glm::vec4 &plane = viewPlanes[size_t(v) * 6 + size_t(p)];
+        visible = visible && glm::dot(glm::vec3(plane), centre) + plane.w >=
+                                 -object.sphere.w;
+      }
+      if (visible)
+      {
+        first = min(first, v);
+        last = v;
+      }
+      DrawElementsIndirectCommand command = {
+          object.count, visible ? 1u : 0u, object.firstIndex,
+          object.baseVertex, uint32_t(o * size_t(count) + size_t(v))};
+      commands[size_t(v) * n + o] = command;
+    }
+    uint32_t instances = last >= first ? uint32_t(last - first + 1) : 0u;
+    DrawElementsIndirectCommand all = {
+        object.count, instances, object.firstIndex, object.baseVertex,
+        uint32_t(o * size_t(count) + size_t(instances ? first : 0))};
+    commands[size_t(count) * n + o] = all;
+  }
+}
+
+void GpuCulling::readCommands(vector<DrawElementsIndirectCommand> &commands) const
+{
+  commands.resize(objects.size() * (size_t(viewCount) + 1));
+  if (!program || commands.empty())
+    return;
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+  glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0,
+                     GLsizeiptr(commands.size() *
+                                sizeof(DrawElementsIndirectCommand)),
+                     commands.data());
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
@@ -0,0 +1,137 @@
+/**
+ * GpuCulling.hpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifndef OPENGL_CMAKE_SKELETON_GPUCULLING_HPP
+#define OPENGL_CMAKE_SKELETON_GPUCULLING_HPP
+
+#include <GL/glew.h>
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+class ShaderProgram;
+class ViewMatrices;
+
+// Object culling and draw submission on the GPU, for every view of a frame.
+//
+// Culled per view on the CPU, a scene of thousands of objects costs thousands
+// of draw calls times the view count. Here the objects live in a shader
+// storage buffer, each with its bounding sphere, model matrix and indexed
+// draw. Once per frame cull() uploads the frustum planes of every view and
+// runs a compute shader with an invocation per object, which tests it against
+// every view and writes a DrawElementsIndirectCommand per object and view,
+// with no instance where it's culled, and one per object for all views at
+// once, instanced over the views it's visible in. Then a view is one
+// glMultiDrawElementsIndirect (drawView()), and so is the whole quilt
+// with instanced views (drawAllViews()).
+//
+// A draw tells the vertex shader its object and view through baseInstance:
+// object * viewCount + view. The culledDraw attribute (setDrawAttribute())
+// reads it back from a buffer holding 0, 1, 2, ..., as an instanced attribute
+// with a divisor larger than any instance count starts at baseInstance for
+// every instance. GPU_CULLING_GLSL declares the object buffer and decodes the
+// attribute; it uses the FrameCamera block (FrameCamera.hpp) for the view
+// count.
+//
+// Needs OpenGL 4.3 (compute shaders, storage buffers, multi draw indirect),
+// see isSupported(). All calls are made on the render thread.
+
+// one object, std430 layout; the sphere is in world space
+struct GpuCullObject
+{
+    glm::mat4 model;
+    glm::vec4 sphere;    // centre and radius
+    uint32_t count;      // indices of its draw
+    uint32_t firstIndex;
+    int32_t baseVertex;
+    uint32_t padding;
+};
+
+// the layout glMultiDrawElementsIndirect reads
+struct DrawElementsIndirectCommand
+{
+    uint32_t count;
+    uint32_t instanceCount;
+    uint32_t firstIndex;
+    int32_t baseVertex;
+    uint32_t baseInstance;
+};
+
+static_assert(sizeof(GpuCullObject) == 96, "GpuCullObject must match std430");
+static_assert(sizeof(DrawElementsIndirectCommand) == 20,
+              "DrawElementsIndirectCommand layout");
+
+// the GLSL for vertex shaders drawing the culled objects, after
+// FRAME_CAMERA_GLSL:
+//   in uint culledDraw;
+//   mat4 culledModel();  the model matrix of the object drawn
+//   int culledView();    the view of the instance, in drawAllViews()
+extern const char *const GPU_CULLING_GLSL;
+
+class GpuCulling
+{
+public:
+    GpuCulling();
+    ~GpuCulling();
+
+    // whether the context has what create() needs: OpenGL 4.3, which the
+    // shaders are written for and which brings base instances along
+    static bool isSupported();
+
+    // the compute shader and the buffers, false if not supported
+    bool create();
+    void release();
+    bool isCreated() const { return program != nullptr; }
+
+    void setObjects(const std::vector<GpuCullObject> &objects);
+    size_t getObjectCount() const { return objects.size(); }
+
+    // the culledDraw attribute of the vertex array bound, at location
+    void setDrawAttribute(GLint location);
+
+    // culls every object for every view, fills the commands of the frame
+    void cull(const ViewMatrices &views);
+
+    // the objects visible in one view, one call; the object buffer is bound
+    // for GPU_CULLING_GLSL
+    void drawView(GLenum mode, GLenum indexType, int viewIndex) const;
+    // every view at once, an instance per view
+    void drawAllViews(GLenum mode, GLenum indexType) const;
+
+    // what cull() writes, computed on the CPU, and what it last wrote
+    void cullOnCpu(const ViewMatrices &views,
+                   std::vector<DrawElementsIndirectCommand> &commands) const;
+    void readCommands(std::vector<DrawElementsIndirectCommand> &commands) const;
+
+    // the six planes of a view-projection, normalized, inside positive
+    static void frustumPlanes(const glm::mat4 &viewProjection,
+                              glm::vec4 planes[6]);
+
+private:
+    GpuCulling(const GpuCulling &);
+    GpuCulling &operator=(const GpuCulling &);
+
+    void reserveDraws(size_t count);
+
+    ShaderProgram *program = nullptr;
+    GLint objectCountLocation = -1;
+    GLint viewCountLocation = -1;
+    GLuint objectBuffer = 0;  // GpuCullObject[objects]
+    GLuint planeBuffer = 0;   // vec4[6 * views]
+    GLuint commandBuffer = 0; // per view, objects each, then all views
+    GLuint drawBuffer = 0;    // 0, 1, 2, ... for culledDraw
+    size_t drawCapacity = 0;
+    size_t commandCapacity = 0;
+
+    std::vector<GpuCullObject> objects;
+    std::vector<glm::vec4> planes;
+    int viewCount = 0; // of the last cull()
+};
+
+#endif // OPENGL_CMAKE_SKELETON_GPUCULLING_HPP
@@ -17,9 +17,14 @@
 #include <GLFW/glfw3.h>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/matrix_operation.hpp>
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <stdexcept>
 
+#include "JobSystem.hpp"
+#include "QuiltRing.hpp"
+#include "ServiceConnection.hpp"
 #include "Shader.hpp"
 #include "glError.hpp"
 
@@ -27,6 +32,10 @@ using namespace std;
 
 #define UNUSED(x) [&x]{}()
 
+// uniform buffer binding points of the ViewCamera and FrameCamera blocks
+static const GLuint VIEW_CAMERA_BINDING = 0;
+static const GLuint FRAME_CAMERA_BINDING = 1;
+
 HoloPlayContext *currentApplication = NULL;
 
 HoloPlayContext &HoloPlayContext::getInstance()
@@ -55,7 +64,7 @@ static void external_mouse_callback(GLFWwindow *window,
 {
   // here we access the instance via the singleton pattern and forward the
   // callback to the instance method
-  getInstance().mouse_callback(window, xpos, ypos);
+  getInstance().onCursorPos(window, xpos, ypos);
 }
 
 // wrapper for getting mouse scroll callback
@@ -65,7 +74,13 @@ static void external_scroll_callback(GLFWwindow *window,
 {
   // here we access the instance via the singleton pattern and forward the
   // callback to the instance method
-  getInstance().scroll_callback(window, xpos, ypos);
+  getInstance().onScroll(window, xpos, ypos);
+}
+
+// wrapper for getting key callback, only records the key state
+static void external_key_callback(GLFWwindow *, int key, int, int action, int)
+{
+  getInstance().onKey(key, action);
 }
 
 HoloPlayContext::HoloPlayContext(bool capture_mouse)
@@ -82,11 +97,12 @@ HoloPlayContext::HoloPlayContext(bool capture_mouse)
     cout << "[Info] HoloplayCore Message Pipe tear down" << endl;
     state = State::Exit;
     // must tear down the message pipe before shut down the app
-    hpc_TeardownMessagePipe();
+    delete service;
+    service = NULL;
     throw std::runtime_error("Couldn't find looking glass");
   }
-  // get the viewcone here, which is used as a const
-  viewCone = hpc_GetDevicePropertyFloat(DEV_INDEX, "/calibration/viewCone/value");
+  // get the viewcone here, it's updated along with the calibration
+  viewCone = service->getCalibration()->viewCone;
 
   cout << "[Info] GLFW initialisation" << endl;
 
@@ -123,6 +139,7 @@ HoloPlayContext::HoloPlayContext(bool capture_mouse)
   // set up the cursor callback
   glfwSetCursorPosCallback(window, external_mouse_callback);
   glfwSetScrollCallback(window, external_scroll_callback);
+  glfwSetKeyCallback(window, external_key_callback);
 
   if (capture_mouse)
   {
@@ -156,10 +173,16 @@ HoloPlayContext::HoloPlayContext(bool capture_mouse)
 
   // initialize the holoplay context
   initialize();
+
+  // from now on, reconnect to HoloPlay Service in the background if it goes
+  // away, rendering continues with the last known calibration
+  service->start();
 }
 
 HoloPlayContext::~HoloPlayContext()
 {
+  delete viewJobs;
+  delete service;
 }
 
 void HoloPlayContext::onExit()
@@ -170,8 +193,10 @@ void HoloPlayContext::onExit()
 void HoloPlayContext::exit()
 {
   state = State::Exit;
+  simulation.stop();
   cout << "[Info] Informing Holoplay Core to close app" << endl;
-  hpc_CloseApp();
+  service->close();
+  reportLatency("input to present, whole run");
   // release all the objects created for setting up the HoloPlay Context
   release();
 }
@@ -183,41 +208,84 @@ void HoloPlayContext::run()
 
   // Make the window's context current
   glfwMakeContextCurrent(window);
+  pacer.apply();
 
   time = float(glfwGetTime());
+  lastLatencyReport = time;
+
+  // hand the scene over to the simulation thread, if enabled
+  if (simulationTickHz > 0)
+  {
+    simulation.start(simulationTickHz,
+                     [this](double dt) { return simulate(dt); });
+    cout << "[Info] simulation thread running at " << simulationTickHz
+         << " Hz" << endl;
+  }
 
   while (state == State::Run)
   {
-    // compute new time and delta time
-    float t = float(glfwGetTime());
-    deltaTime = t - time;
-    time = t;
+    // wait for a frame slot before sampling input, so the input isn't left
+    // waiting behind frames queued in the driver
+    pacer.waitForFrameSlot();
+
+    // Poll and process events
+    glfwPollEvents();
+    pacer.markInputSampled();
+
+    // free the replies received during the last frame
+    replies.clear();
+
+    // pick up the calibration published after a reconnection
+    if (service->getGeneration() != calibrationGeneration)
+      loadCalibrationIntoShader();
 
     // detech window related changes
     detectWindowChange();
     glCheckError(__FILE__, __LINE__);
 
-    // press esc to quit
-    if (!processInput(window))
+    if (simulationTickHz > 0)
+    {
+      // processInput() returned false on the simulation thread
+      if (simulation.finished())
+      {
+        exit();
+        onExit();
+        continue;
+      }
+    }
+    else
     {
-      exit();
-      onExit();
-      continue;
+      // compute new time and delta time
+      float t = float(glfwGetTime());
+      deltaTime = t - time;
+      time = t;
+
+      // press esc to quit
+      if (!processInput(window))
+      {
+        exit();
+        onExit();
+        continue;
+      }
+
+      // do the update
+      update();
+      publishSnapshot();
     }
 
+    // take the latest state published by update()
+    consumeSnapshot();
+
     // decide how camera updates here, override in SampleScene.cpp
     glm::mat4 currentViewMatrix = getViewMatrixOfCurrentFrame();
     glCheckError(__FILE__, __LINE__);
 
-    // do the update
-    update();
-
     // clear backbuffer
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glClearColor(0.0, 0.0, 0.0, 1.0);
 
-    // bind quilt texture to frame buffer
-    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    // bind the quilt of this frame to the frame buffer
+    glBindFramebuffer(GL_FRAMEBUFFER, quilts.beginFrame());
 
     // save the viewport for the total quilt
     GLint viewport[4];
@@ -227,33 +295,103 @@ void HoloPlayContext::run()
     int qs_viewWidth = int(float(qs_width) / float(qs_columns));
     int qs_viewHeight = int(float(qs_height) / float(qs_rows));
 
-    // render views and copy each view to the quilt
-    for (int viewIndex = 0; viewIndex < qs_totalViews; viewIndex++)
+    if (playback)
     {
-        // get the x and y origin for this view
-        int x = (viewIndex % qs_columns) * qs_viewWidth;
-        int y = int(float(viewIndex) / float(qs_columns)) * qs_viewHeight;
-
-        // set the viewport to the view to control the projection extent
-        glViewport(x, y, qs_viewWidth, qs_viewHeight);
-
-        // set the scissor to the view to restrict calls like glClear from making modifications
-        glEnable(GL_SCISSOR_TEST);
-        glScissor(x, y, qs_viewWidth, qs_viewHeight);
-
-        // set up the camera rotation and position for current view
-        setupVirtualCameraForView(viewIndex, currentViewMatrix);
+      // the quilt comes from the file, the views aren't rendered
+      playback->uploadFrame(quilts.getRenderTexture(), glfwGetTime());
+    }
+    else
+    {
+      // the matrices of every view, for the CPU and in the uniform buffer
+      prepareViewCameras(currentViewMatrix);
+
+      if (instancedViews)
+      {
+        // all views at once over the whole quilt, see FrameCamera.hpp
+        glViewport(0, 0, qs_width, qs_height);
+        if (quilts.hasDepth())
+          glClear(GL_DEPTH_BUFFER_BIT);
+        for (int plane = 0; plane < 4; ++plane)
+          glEnable(GLenum(GL_CLIP_DISTANCE0 + plane));
+        renderAllViews();
+        for (int plane = 0; plane < 4; ++plane)
+          glDisable(GLenum(GL_CLIP_DISTANCE0 + plane));
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+      }
+
+      // build the command lists of all views in parallel
+      if (viewJobs && !instancedViews)
+      {
+        viewCommands.resize(size_t(qs_totalViews));
+        viewJobs->parallelFor(
+            viewCommands.size(), 1, [&](size_t begin, size_t end) {
+              for (size_t i = begin; i < end; ++i)
+              {
+                ViewCommandList &commands = viewCommands[i];
+                commands.clear();
+                commands.viewIndex = int(i);
+                viewMatrices.get(int(i), commands.view, commands.projection);
+                commands.built = buildViewCommands(commands);
+              }
+            });
+      }
+
+      // render views and copy each view to the quilt
+      for (int viewIndex = 0; viewIndex < qs_totalViews && !instancedViews;
+           viewIndex++)
+      {
+          // get the x and y origin for this view
+          int x = (viewIndex % qs_columns) * qs_viewWidth;
+          int y = int(float(viewIndex) / float(qs_columns)) * qs_viewHeight;
+
+          // set the viewport to the view to control the projection extent
+          glViewport(x, y, qs_viewWidth, qs_viewHeight);
+
+          // set the scissor to the view to restrict calls like glClear from making modifications
+          glEnable(GL_SCISSOR_TEST);
+          glScissor(x, y, qs_viewWidth, qs_viewHeight);
+
+          // every view starts on cleared depth, the scissor keeps the clear
+          // to its own rectangle of the shared depth buffer
+          if (quilts.hasDepth())
+            glClear(GL_DEPTH_BUFFER_BIT);
+
+          // the ViewCamera block of this view, for shaders that use it
+          bindViewCamera(viewIndex);
+
+          if (viewJobs && viewCommands[size_t(viewIndex)].built)
+          {
+              // submit what the workers recorded for this view
+              submitViewCommands(viewCommands[size_t(viewIndex)]);
+          }
+          else
+          {
+              // set up the camera rotation and position for current view
+              setupVirtualCameraForView(viewIndex, currentViewMatrix);
+
+              //render the scene according to the view
+              renderScene();
+          }
+
+          // reset viewport
+          glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+          // restore scissor
+          glDisable(GL_SCISSOR_TEST);
+          glScissor(viewport[0], viewport[1], viewport[2], viewport[3]);
+      }
+    }
 
-        //render the scene according to the view
-        renderScene();
+    quilts.endRender();
 
-        // reset viewport
-        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    // hand the quilt over to the shared-memory ring, if enabled
+    if (quiltRing)
+      publishQuiltToRing();
 
-        // restore scissor
-        glDisable(GL_SCISSOR_TEST);
-        glScissor(viewport[0], viewport[1], viewport[2], viewport[3]);
-    }
+    // queue the quilt for capture, it's read back in the background
+    if (frameCapture && captureQuilt)
+      frameCapture->capture(CaptureSource::Quilt, quilts.getRenderFramebuffer(),
+                            qs_width, qs_height, frameNumber);
 
     // reset framebuffer
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -261,11 +399,28 @@ void HoloPlayContext::run()
     // draw the light field image
     drawLightField();
 
+    // the interlaced image is still in the back buffer
+    if (frameCapture && capturePanel)
+      frameCapture->capture(CaptureSource::Panel, 0, win_w, win_h, frameNumber);
+    frameNumber++;
+
     // Swap Front and Back buffers (double buffering)
     glfwSwapBuffers(window);
+    pacer.frameSwapped();
 
-    // Poll and process events
-    glfwPollEvents();
+    // glfwGetTime() counts from glfwInit() in the constructor
+    if (playback && frameNumber == 1)
+      cout << "[Info] first quilt shown " << glfwGetTime() * 1000.0
+           << " ms after start" << endl;
+
+    if (latencyReportSeconds > 0 &&
+        float(glfwGetTime()) - lastLatencyReport >= float(latencyReportSeconds))
+    {
+      lastLatencyReport = float(glfwGetTime());
+      reportLatency("input to present");
+      if (playback)
+        reportPlayback();
+    }
   }
 
   glfwTerminate();
@@ -319,6 +474,27 @@ bool HoloPlayContext::processInput(GLFWwindow*)
   return true;
 }
 
+void HoloPlayContext::publishSnapshot()
+{
+  // copy the state used by the renderer in the child class
+}
+
+void HoloPlayContext::consumeSnapshot()
+{
+  // take the state published by publishSnapshot() in the child class
+}
+
+bool HoloPlayContext::buildViewCommands(ViewCommandList &)
+{
+  // record the draws of a view in the child class, see enableViewJobs()
+  return false;
+}
+
+void HoloPlayContext::renderAllViews()
+{
+  cout << "[INFO] : render all views" << endl;
+}
+
 // glfw: whenever the mouse moves, this callback is called
 // -------------------------------------------------------
 void HoloPlayContext::mouse_callback(GLFWwindow*,
@@ -382,37 +558,16 @@ float HoloPlayContext::getTime() const
 // And print information about connected Looking Glass devices
 bool HoloPlayContext::GetLookingGlassInfo()
 {
-  hpc_client_error errco =
-      hpc_InitializeApp("Holoplay Core Example App", hpc_LICENSE_NONCOMMERCIAL);
-  if (errco)
+  service = new ServiceConnection(
+      new HoloPlayCoreBackend("Holoplay Core Example App"), DEV_INDEX);
+  hpc_client_error errco;
+  if (!service->connect(errco))
   {
-    string errstr;
-    switch (errco)
-    {
-    case hpc_CLIERR_NOSERVICE:
-      errstr = "HoloPlay Service not running";
-      break;
-    case hpc_CLIERR_SERIALIZEERR:
-      errstr = "Client message could not be serialized";
-      break;
-    case hpc_CLIERR_VERSIONERR:
-      errstr = "Incompatible version of HoloPlay Service";
-      break;
-    case hpc_CLIERR_PIPEERROR:
-      errstr = "Interprocess pipe broken";
-      break;
-    case hpc_CLIERR_SENDTIMEOUT:
-      errstr = "Interprocess pipe send timeout";
-      break;
-    case hpc_CLIERR_RECVTIMEOUT:
-      errstr = "Interprocess pipe receive timeout";
-      break;
-    default:
-      errstr = "Unknown error";
-      break;
-    }
-    cout << "HoloPlay Service access error (code " << errco << "): " << errstr
-         << "!" << endl;
+    if (errco)
+      cout << "HoloPlay Service access error (code " << errco
+           << "): " << describeClientError(errco) << "!" << endl;
+    else
+      cout << "No Looking Glass found at index " << DEV_INDEX << "." << endl;
     return false;
   }
   char buf[1000];
@@ -422,10 +577,6 @@ bool HoloPlayContext::GetLookingGlassInfo()
   cout << "HoloPlay Service version " << buf << "." << endl;
   int num_displays = hpc_GetNumDevices();
   cout << num_displays << " devices connected." << endl;
-  if (num_displays < 1)
-  {
-    return false;
-  }
   for (int i = 0; i < num_displays; ++i)
   {
     cout << "Device information for display " << i << ":" << endl;
@@ -532,26 +683,7 @@ void HoloPlayContext::passQuiltSettingsToShader()
 void HoloPlayContext::setupQuilt()
 {
   cout << "setting up quilt texture and framebuffer" << endl;
-  glGenTextures(1, &quiltTexture);
-  glBindTexture(GL_TEXTURE_2D, quiltTexture);
-
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, qs_width, qs_height, 0, GL_RGB,
-               GL_UNSIGNED_BYTE, NULL);
-
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-  glBindTexture(GL_TEXTURE_2D, 0);
-
-  // framebuffer
-  glGenFramebuffers(1, &FBO);
-  glBindFramebuffer(GL_FRAMEBUFFER, FBO);
-
-  // bind the quilt texture as the color attachment of the framebuffer
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
-                         quiltTexture, 0);
+  quilts.create(qs_width, qs_height, quiltChainSettings);
 
   // vbo and vao
   glGenVertexArrays(1, &VAO);
@@ -608,38 +740,43 @@ void HoloPlayContext::loadLightFieldShaders()
 void HoloPlayContext::loadCalibrationIntoShader()
 {
   cout << "begin assigning calibration uniforms" << endl;
+  // the calibration is only read from HoloPlay Service when (re)connecting
+  shared_ptr<const DeviceCalibration> calibration = service->getCalibration();
+  calibrationGeneration = service->getGeneration();
+  viewCone = calibration->viewCone;
+
   lightFieldShader->use();
-  lightFieldShader->setUniform("pitch", hpc_GetDevicePropertyPitch(DEV_INDEX));
+  lightFieldShader->setUniform("pitch", calibration->pitch);
   glCheckError(__FILE__, __LINE__);
 
-  lightFieldShader->setUniform("tilt", hpc_GetDevicePropertyTilt(DEV_INDEX));
+  lightFieldShader->setUniform("tilt", calibration->tilt);
   glCheckError(__FILE__, __LINE__);
 
-  lightFieldShader->setUniform("center",
-                               hpc_GetDevicePropertyCenter(DEV_INDEX));
+  lightFieldShader->setUniform("center", calibration->center);
   glCheckError(__FILE__, __LINE__);
 
-  lightFieldShader->setUniform("invView",
-                               hpc_GetDevicePropertyInvView(DEV_INDEX));
+  lightFieldShader->setUniform("invView", calibration->invView);
   glCheckError(__FILE__, __LINE__);
 
   lightFieldShader->setUniform("quiltInvert", 0);
   glCheckError(__FILE__, __LINE__);
 
-  lightFieldShader->setUniform("subp", hpc_GetDevicePropertySubp(DEV_INDEX));
+  lightFieldShader->setUniform("subp", calibration->subp);
   glCheckError(__FILE__, __LINE__);
 
-  lightFieldShader->setUniform("ri", hpc_GetDevicePropertyRi(DEV_INDEX));
+  lightFieldShader->setUniform("ri", calibration->ri);
   glCheckError(__FILE__, __LINE__);
 
-  lightFieldShader->setUniform("bi", hpc_GetDevicePropertyBi(DEV_INDEX));
+  lightFieldShader->setUniform("bi", calibration->bi);
   glCheckError(__FILE__, __LINE__);
 
-  lightFieldShader->setUniform("displayAspect",
-                               hpc_GetDevicePropertyDisplayAspect(DEV_INDEX));
+  lightFieldShader->setUniform("displayAspect", calibration->displayAspect);
   glCheckError(__FILE__, __LINE__);
-  lightFieldShader->setUniform("quiltAspect",
-                               hpc_GetDevicePropertyDisplayAspect(DEV_INDEX));
+  // a played back quilt keeps the aspect it was rendered at
+  float quiltAspect = calibration->displayAspect;
+  if (playback && playback->getReader().getHeader().aspect > 0)
+    quiltAspect = playback->getReader().getHeader().aspect;
+  lightFieldShader->setUniform("quiltAspect", quiltAspect);
   glCheckError(__FILE__, __LINE__);
   lightFieldShader->unuse();
   glCheckError(__FILE__, __LINE__);
@@ -650,12 +787,23 @@ void HoloPlayContext::loadCalibrationIntoShader()
 void HoloPlayContext::release()
 {
   cout << "[Info] HoloPlay Context releasing" << endl;
+  delete playback;
+  playback = NULL;
   glDeleteVertexArrays(1, &VAO);
   glDeleteBuffers(1, &VBO);
-  glDeleteFramebuffers(1, &FBO);
-  glDeleteTextures(1, &quiltTexture);
+  quilts.release();
+  glDeleteBuffers(1, &viewCameraBuffer);
+  viewCameraBuffer = 0;
+  viewCameraCapacity = 0;
+  glDeleteBuffers(1, &frameCameraBuffer);
+  frameCameraBuffer = 0;
   delete lightFieldShader;
   delete blitShader;
+  disableQuiltRing();
+  stopRecording();
+  disableFrameCapture();
+  replies.clear();
+  pacer.release();
 }
 
 // render functions
@@ -664,39 +812,140 @@ void HoloPlayContext::release()
 void HoloPlayContext::setupVirtualCameraForView(int currentViewIndex,
                                                 glm::mat4 currentViewMatrix)
 {
-  // The standard model Looking Glass screen is roughly 4.75" vertically. If we
-  // assume the average viewing distance for a user sitting at their desk is
-  // about 36", our field of view should be about 14°. There is no correct
-  // answer, as it all depends on your expected user's distance from the Looking
-  // Glass, but we've found the most success using this figure.
-  const float fov = glm::radians(14.0f);
-  float cameraDistance = -cameraSize / tan(fov / 2.0f);
+  // prepareViewCameras(currentViewMatrix) has computed every view of the frame
+  UNUSED(currentViewMatrix);
+  currentView = currentViewIndex;
+  viewMatrices.get(currentViewIndex, viewMatrix, projectionMatrix);
+}
+
+// all views in one pass, see ViewMatrices.hpp, written straight into the
+// mapped uniform buffer
+void HoloPlayContext::prepareViewCameras(const glm::mat4 &currentViewMatrix)
+{
+  viewMatrices.setViews(qs_totalViews, viewCone);
+  viewMatrices.prepare(currentViewMatrix, cameraSize,
+                       float(win_w) / float(win_h));
 
-  float offsetAngle =
-      (float(currentViewIndex) / (float(qs_totalViews) - 1.0f) - 0.5f) *
-      glm::radians(
-          viewCone); // start at -viewCone * 0.5 and go up to viewCone * 0.5
+  if (viewCameraCapacity < qs_totalViews)
+  {
+    // each view is bound as its own range, which has to start aligned
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    size_t align = size_t(max(alignment, 1));
+    viewCameraStride = (sizeof(ViewCamera) + align - 1) / align * align;
+    viewCameraCapacity = qs_totalViews;
+    if (!viewCameraBuffer)
+      glGenBuffers(1, &viewCameraBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, viewCameraBuffer);
+    glBufferData(GL_UNIFORM_BUFFER,
+                 GLsizeiptr(viewCameraStride * size_t(viewCameraCapacity)),
+                 NULL, GL_STREAM_DRAW);
+  }
 
-  float offset =
-      cameraDistance *
-      tan(offsetAngle); // calculate the offset that the camera should move
+  // invalidating lets the driver hand out fresh storage while the views of
+  // the previous quilt may still be reading the old matrices
+  glBindBuffer(GL_UNIFORM_BUFFER, viewCameraBuffer);
+  size_t bytes = viewCameraStride * size_t(qs_totalViews);
+  void *mapped = glMapBufferRange(
+      GL_UNIFORM_BUFFER, 0, GLsizeiptr(bytes),
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  if (mapped)
+  {
+    viewMatrices.write(mapped, viewCameraStride);
+    glUnmapBuffer(GL_UNIFORM_BUFFER);
+  }
 
-  // modify the view matrix (position)
-  // determine the local direction of the offset using currentViewMatrix and translate
-  glm::vec3 offsetLocal = glm::vec3(currentViewMatrix * glm::vec4(offset, 0.0f, cameraDistance, 1.0f));
-  viewMatrix = glm::translate(currentViewMatrix, offsetLocal);
+  // the centre camera, for shaders deriving the views themselves
+  FrameCamera frame = FrameCamera();
+  frame.centerView = viewMatrices.getFrameView();
+  frame.centerProjection = viewMatrices.getFrameProjection();
+  frame.cameraSize = cameraSize;
+  frame.viewCone = viewCone;
+  frame.viewCount = qs_totalViews;
+  frame.columns = qs_columns;
+  frame.tileSize = glm::vec2(float(qs_width / qs_columns) / float(qs_width),
+                             float(qs_height / qs_rows) / float(qs_height));
+  if (!frameCameraBuffer)
+    glGenBuffers(1, &frameCameraBuffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, frameCameraBuffer);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(frame), &frame, GL_STREAM_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_CAMERA_BINDING, frameCameraBuffer);
+  glCheckError(__FILE__, __LINE__);
+}
 
-  float aspectRatio = getWindowRatio();
+void HoloPlayContext::bindViewCamera(int viewIndex)
+{
+  glBindBufferRange(GL_UNIFORM_BUFFER, VIEW_CAMERA_BINDING, viewCameraBuffer,
+                    GLintptr(size_t(viewIndex) * viewCameraStride),
+                    GLsizeiptr(sizeof(ViewCamera)));
+}
+
+void HoloPlayContext::useViewCameraBlock(ShaderProgram &program)
+{
+  GLuint block = glGetUniformBlockIndex(program.getHandle(), "ViewCamera");
+  if (block != GL_INVALID_INDEX)
+    glUniformBlockBinding(program.getHandle(), block, VIEW_CAMERA_BINDING);
+}
+
+void HoloPlayContext::useFrameCameraBlock(ShaderProgram &program)
+{
+  GLuint block = glGetUniformBlockIndex(program.getHandle(), "FrameCamera");
+  if (block != GL_INVALID_INDEX)
+    glUniformBlockBinding(program.getHandle(), block, FRAME_CAMERA_BINDING);
+}
 
-  projectionMatrix = glm::perspective(fov, aspectRatio, 0.1f, 100.0f);
-  // modify the projection matrix, relative to the camera size and aspect ratio
-  projectionMatrix[2][0] += offset / (cameraSize * aspectRatio);
+// replay a command list built by buildViewCommands(), skipping redundant binds
+void HoloPlayContext::submitViewCommands(const ViewCommandList &commands)
+{
+  if (commands.clearMask)
+  {
+    glClearColor(commands.clearColor.x, commands.clearColor.y,
+                 commands.clearColor.z, commands.clearColor.w);
+    glClear(commands.clearMask);
+  }
+
+  GLuint program = 0, vao = 0;
+  for (size_t i = 0; i < commands.draws.size(); ++i)
+  {
+    const DrawCommand &draw = commands.draws[i];
+    if (draw.program && draw.program != program)
+    {
+      program = draw.program;
+      glUseProgram(program);
+    }
+    if (draw.vao && draw.vao != vao)
+    {
+      vao = draw.vao;
+      glBindVertexArray(vao);
+    }
+    for (size_t u = draw.firstUniform; u < draw.firstUniform + draw.uniformCount; ++u)
+    {
+      const UniformValue &uniform = commands.uniforms[u];
+      if (uniform.matrix == NO_MATRIX)
+        glUniform1i(uniform.location, uniform.integer);
+      else
+        glUniformMatrix4fv(uniform.location, 1, GL_FALSE,
+                           &commands.matrices[uniform.matrix][0][0]);
+    }
+    if (draw.indexType && draw.baseVertex)
+      glDrawElementsBaseVertex(draw.mode, draw.count, draw.indexType,
+                               (const void *)draw.first, draw.baseVertex);
+    else if (draw.indexType)
+      glDrawElements(draw.mode, draw.count, draw.indexType,
+                     (const void *)draw.first);
+    else
+      glDrawArrays(draw.mode, GLint(draw.first), draw.count);
+  }
+  glBindVertexArray(0);
+  glUseProgram(0);
+  glCheckError(__FILE__, __LINE__);
 }
 
 void HoloPlayContext::drawLightField()
 {
-  // bind quilt texture
-  glBindTexture(GL_TEXTURE_2D, quiltTexture);
+  // bind the quilt to show this frame, not necessarily the one just rendered
+  glBindTexture(GL_TEXTURE_2D, quilts.acquirePresentTexture());
 
   // bind vao
   glBindVertexArray(VAO);
@@ -708,6 +957,436 @@ void HoloPlayContext::drawLightField()
   // clean up
   glBindVertexArray(0);
   lightFieldShader->unuse();
+  quilts.endPresent();
+}
+
+// shared-memory quilt output
+// =========================================================
+// send a small control message over the message pipe without waiting for the
+// reply, the frame data itself goes through shared memory. Replies end up in
+// the arena and are freed in bulk at the start of the next frame. The message
+// is dropped while HoloPlay Service is unreachable.
+static void sendQuiltRingMessage(const string &json,
+                                 ServiceConnection &service,
+                                 hpc::ResponseArena &replies)
+{
+  service.tryCall([&]() { return hpc::Request(json).sendAsync(&replies); });
+}
+
+void HoloPlayContext::enableQuiltRing(const std::string &name, int slotCount)
+{
+  disableQuiltRing();
+  quiltRing = new QuiltRingProducer(name, uint32_t(slotCount),
+                                    uint32_t(qs_width), uint32_t(qs_height), 3);
+  cout << "[Info] publishing quilts to " << quiltRing->getName() << " ("
+       << slotCount << " slots)" << endl;
+
+  // copy read-back quilts into the ring on the capture delivery thread, the
+  // only thread touching the producer from here on
+  QuiltRingProducer *ring = quiltRing;
+  uint32_t columns = uint32_t(qs_columns), rows = uint32_t(qs_rows),
+           totalViews = uint32_t(qs_totalViews);
+  FrameCaptureSettings settings;
+  settings.queueDepth = 1;
+  settings.dropPolicy = CaptureDropPolicy::DropOldest;
+  ringCapture = new FrameCapture;
+  ringCapture->start(window, settings, [=](const CapturedFrame &frame) {
+    // never wait for the consumer here, skip the frame if no slot is free
+    unsigned char *pixels = ring->acquire(0);
+    if (!pixels)
+      return;
+    memcpy(pixels, frame.pixels, frame.size);
+    QuiltRingFrameInfo info = ring->publish(columns, rows, totalViews);
+    lock_guard<mutex> lock(ringMutex);
+    ringSequences.push_back(info.sequence);
+  });
+
+  sendQuiltRingMessage("{\"quiltRing\":{\"name\":\"" + quiltRing->getName() +
+                       "\",\"slots\":" + to_string(slotCount) +
+                       ",\"width\":" + to_string(qs_width) +
+                       ",\"height\":" + to_string(qs_height) +
+                       ",\"channels\":3}}",
+                       *service, replies);
+}
+
+void HoloPlayContext::disableQuiltRing()
+{
+  // the capture threads write into the ring, stop them first
+  if (ringCapture)
+    ringCapture->stop();
+  delete ringCapture;
+  ringCapture = NULL;
+  delete quiltRing;
+  quiltRing = NULL;
+  ringSequences.clear();
+}
+
+void HoloPlayContext::publishQuiltToRing()
+{
+  // the quilt framebuffer is still bound; a full capture ring drops the quilt
+  ringCapture->capture(CaptureSource::Quilt, quilts.getRenderFramebuffer(),
+                       qs_width, qs_height, frameNumber);
+
+  // announce what the capture thread published since the last frame
+  vector<uint64_t> published;
+  {
+    lock_guard<mutex> lock(ringMutex);
+    published.swap(ringSequences);
+  }
+  for (size_t i = 0; i < published.size(); ++i)
+    sendQuiltRingMessage("{\"quiltFrame\":{\"name\":\"" +
+                         quiltRing->getName() + "\",\"sequence\":" +
+                         to_string(published[i]) + "}}",
+                         *service, replies);
+}
+
+// frame capture
+// =========================================================
+bool HoloPlayContext::enableFrameCapture(const FrameCaptureSettings &settings,
+                                         const FrameCapture::Sink &sink,
+                                         bool quilt, bool panel)
+{
+  disableFrameCapture();
+  frameCapture = new FrameCapture;
+  if (!frameCapture->start(window, settings, sink))
+  {
+    disableFrameCapture();
+    return false;
+  }
+  captureQuilt = quilt;
+  capturePanel = panel;
+  return true;
+}
+
+void HoloPlayContext::disableFrameCapture()
+{
+  if (!frameCapture)
+    return;
+  frameCapture->stop();
+  FrameCaptureStats stats = frameCapture->getStats();
+  cout << "[Info] frame capture: " << stats.delivered << " of "
+       << stats.requested << " frames delivered, " << stats.droppedNoSlot
+       << " dropped waiting for the GPU, " << stats.droppedQueueFull
+       << " dropped by the sink queue, readback " << stats.averageReadbackMs
+       << " ms, sink " << stats.averageSinkMs << " ms" << endl;
+  delete frameCapture;
+  frameCapture = NULL;
+}
+
+FrameCaptureStats HoloPlayContext::getFrameCaptureStats() const
+{
+  if (!frameCapture)
+    return FrameCaptureStats();
+  return frameCapture->getStats();
+}
+
+// recording
+// =========================================================
+bool HoloPlayContext::startRecording(const string &path,
+                                     const QuiltRecorderSettings &settings,
+                                     int downscale)
+{
+  stopRecording();
+  downscale = max(downscale, 1);
+
+  // the layout and calibration travel with the file so it can be played back
+  // on its own
+  QuiltRecordingLayout layout;
+  layout.width = uint32_t(max(qs_width / downscale, 1));
+  layout.height = uint32_t(max(qs_height / downscale, 1));
+  layout.columns = uint32_t(qs_columns);
+  layout.rows = uint32_t(qs_rows);
+  layout.totalViews = uint32_t(qs_totalViews);
+  shared_ptr<const DeviceCalibration> calibration = service->getCalibration();
+  layout.aspect = calibration->displayAspect;
+  layout.metadata =
+      "{\"quilt\":{\"width\":" + to_string(qs_width) +
+      ",\"height\":" + to_string(qs_height) +
+      ",\"columns\":" + to_string(qs_columns) +
+      ",\"rows\":" + to_string(qs_rows) +
+      ",\"totalViews\":" + to_string(qs_totalViews) +
+      ",\"downscale\":" + to_string(downscale) + "}" +
+      ",\"calibration\":{\"pitch\":" + to_string(calibration->pitch) +
+      ",\"tilt\":" + to_string(calibration->tilt) +
+      ",\"center\":" + to_string(calibration->center) +
+      ",\"invView\":" + to_string(calibration->invView) +
+      ",\"subp\":" + to_string(calibration->subp) +
+      ",\"ri\":" + to_string(calibration->ri) +
+      ",\"bi\":" + to_string(calibration->bi) +
+      ",\"displayAspect\":" + to_string(calibration->displayAspect) +
+      ",\"viewCone\":" + to_string(calibration->viewCone) +
+      ",\"fringe\":" + to_string(calibration->fringe) +
+      ",\"screenW\":" + to_string(calibration->screenW) +
+      ",\"screenH\":" + to_string(calibration->screenH) + "}}";
+
+  recorder = new QuiltRecorder;
+  if (!recorder->open(path, layout, settings))
+  {
+    delete recorder;
+    recorder = NULL;
+    return false;
+  }
+
+  // the recorder has its own bounded queue, so the capture hands frames over
+  // as soon as they are read back and the recorder decides what to drop
+  FrameCaptureSettings capture;
+  capture.downscale = downscale;
+  capture.dropPolicy = CaptureDropPolicy::DropNewest;
+  QuiltRecorder *target = recorder;
+  if (!enableFrameCapture(capture,
+                          [target](const CapturedFrame &frame) {
+                            target->submit(frame.pixels, frame.size,
+                                           frame.frame, frame.captureTime);
+                          },
+                          true, false))
+  {
+    stopRecording();
+    return false;
+  }
+  return true;
+}
+
+void HoloPlayContext::stopRecording()
+{
+  if (!recorder)
+    return;
+  // no more frames once the capture has stopped, then finish the file
+  disableFrameCapture();
+  recorder->close();
+  delete recorder;
+  recorder = NULL;
+}
+
+QuiltRecorderStats HoloPlayContext::getRecordingStats() const
+{
+  if (!recorder)
+    return QuiltRecorderStats();
+  return recorder->getStats();
+}
+
+// playback
+// =========================================================
+bool HoloPlayContext::enablePlayback(const string &path,
+                                     const QuiltPlaybackSettings &settings)
+{
+  // the ring's slots and the layout it publishes are those of the current
+  // quilt, as for setQuiltPreset()
+  if (quiltRing)
+  {
+    cout << "[Error] playback can't change the quilt while the quilt ring is "
+            "enabled"
+         << endl;
+    return false;
+  }
+  if (recorder)
+  {
+    cout << "[Error] playback can't change the quilt while recording" << endl;
+    return false;
+  }
+  disablePlayback();
+  playback = new QuiltPlayback;
+  if (!playback->open(path, settings))
+  {
+    delete playback;
+    playback = NULL;
+    return false;
+  }
+
+  // the quilt takes the file's layout
+  savedQuiltSettings[0] = qs_width;
+  savedQuiltSettings[1] = qs_height;
+  savedQuiltSettings[2] = qs_columns;
+  savedQuiltSettings[3] = qs_rows;
+  savedQuiltSettings[4] = qs_totalViews;
+  const QuiltFileHeader &header = playback->getReader().getHeader();
+  qs_width = int(header.width);
+  qs_height = int(header.height);
+  qs_columns = int(header.columns);
+  qs_rows = int(header.rows);
+  qs_totalViews = int(header.totalViews);
+  passQuiltSettingsToShader();
+  loadCalibrationIntoShader();
+
+  // the player's slots already decouple decoding from presenting, a single
+  // quilt lets drawLightField() show a frame as soon as it's uploaded
+  QuiltChainSettings single = quiltChainSettings;
+  single.bufferCount = 1;
+  single.depth = QuiltDepth::None;
+  quilts.create(qs_width, qs_height, single);
+  glCheckError(__FILE__, __LINE__);
+  return true;
+}
+
+void HoloPlayContext::disablePlayback()
+{
+  if (!playback)
+    return;
+  reportPlayback();
+  delete playback;
+  playback = NULL;
+
+  qs_width = savedQuiltSettings[0];
+  qs_height = savedQuiltSettings[1];
+  qs_columns = savedQuiltSettings[2];
+  qs_rows = savedQuiltSettings[3];
+  qs_totalViews = savedQuiltSettings[4];
+  passQuiltSettingsToShader();
+  loadCalibrationIntoShader();
+  quilts.create(qs_width, qs_height, quiltChainSettings);
+  glCheckError(__FILE__, __LINE__);
+
+  // a ring enabled during playback has slots of the file's quilt, start it
+  // over with the restored layout
+  if (quiltRing)
+  {
+    string name = quiltRing->getName();
+    int slotCount = int(quiltRing->getSlotCount());
+    cout << "[Info] restarting the quilt ring for the " << qs_width << "x"
+         << qs_height << " quilt" << endl;
+    enableQuiltRing(name, slotCount);
+  }
+}
+
+QuiltPlaybackStats HoloPlayContext::getPlaybackStats() const
+{
+  if (!playback)
+    return QuiltPlaybackStats();
+  return playback->getStats();
+}
+
+void HoloPlayContext::reportPlayback()
+{
+  QuiltPlaybackStats stats = playback->getStats();
+  cout << "[Info] playback: " << stats.presented << " quilts shown, "
+       << stats.decoded << " decoded at " << stats.decodeFps << " fps ("
+       << stats.averageDecodeMs << " ms each), queue " << stats.queueDepth
+       << " (avg " << stats.averageQueueDepth << "), " << stats.late
+       << " late, " << stats.dropped << " dropped, " << stats.skipped
+       << " skipped" << endl;
+}
+
+// quilt buffering
+// =========================================================
+void HoloPlayContext::setQuiltBuffering(const QuiltChainSettings &settings)
+{
+  quiltChainSettings = settings;
+  quilts.create(qs_width, qs_height, quiltChainSettings);
+  glCheckError(__FILE__, __LINE__);
+}
+
+void HoloPlayContext::setQuiltPreset(int preset)
+{
+  if (quiltRing)
+  {
+    cout << "[Error] the quilt preset can't change while the quilt ring is "
+            "enabled"
+         << endl;
+    return;
+  }
+  if (recorder)
+  {
+    cout << "[Error] the quilt preset can't change while recording" << endl;
+    return;
+  }
+  setupQuiltSettings(preset);
+  passQuiltSettingsToShader();
+  quilts.create(qs_width, qs_height, quiltChainSettings);
+  glCheckError(__FILE__, __LINE__);
+}
+
+// per-view jobs
+// =========================================================
+void HoloPlayContext::enableViewJobs(unsigned workerCount)
+{
+  delete viewJobs;
+  viewJobs = new JobSystem(workerCount);
+  cout << "[Info] building view command lists on " << viewJobs->getWorkerCount()
+       << " threads" << endl;
+}
+
+// frame pacing
+// =========================================================
+void HoloPlayContext::reportLatency(const char *label)
+{
+  FrameLatencyStats stats = pacer.getStats();
+  if (!stats.frames)
+    return;
+  cout << "[Info] " << label << ": last " << stats.lastMs << " ms, avg "
+       << stats.averageMs << " ms, p95 " << stats.p95Ms << " ms, max "
+       << stats.maxMs << " ms, waited " << stats.averageWaitMs
+       << " ms/frame, " << stats.framesInFlight << " in flight" << endl;
+}
+
+// simulation thread
+// =========================================================
+void HoloPlayContext::enableSimulationThread(double tickHz)
+{
+  simulationTickHz = tickHz;
+}
+
+bool HoloPlayContext::isKeyPressed(int key)
+{
+  if (simulationTickHz > 0)
+    return inputQueue.isKeyPressed(key);
+  return glfwGetKey(window, key) == GLFW_PRESS;
+}
+
+void HoloPlayContext::onCursorPos(GLFWwindow *window, double xpos, double ypos)
+{
+  if (simulationTickHz > 0)
+  {
+    InputEvent event = {InputEvent::CursorPos, xpos, ypos};
+    inputQueue.push(event);
+  }
+  else
+  {
+    mouse_callback(window, xpos, ypos);
+  }
+}
+
+void HoloPlayContext::onScroll(GLFWwindow *window, double xoffset, double yoffset)
+{
+  if (simulationTickHz > 0)
+  {
+    InputEvent event = {InputEvent::Scroll, xoffset, yoffset};
+    inputQueue.push(event);
+  }
+  else
+  {
+    scroll_callback(window, xoffset, yoffset);
+  }
+}
+
+void HoloPlayContext::onKey(int key, int action)
+{
+  if (action == GLFW_PRESS)
+    inputQueue.setKey(key, true);
+  else if (action == GLFW_RELEASE)
+    inputQueue.setKey(key, false);
+}
+
+// runs on the simulation thread: replays the input recorded since the last
+// tick, then processInput() and update() with the fixed time step
+bool HoloPlayContext::simulate(double dt)
+{
+  deltaTime = float(dt);
+  time += deltaTime;
+
+  inputQueue.drain(inputEvents);
+  for (size_t i = 0; i < inputEvents.size(); ++i)
+  {
+    const InputEvent &event = inputEvents[i];
+    if (event.type == InputEvent::CursorPos)
+      mouse_callback(window, event.x, event.y);
+    else
+      scroll_callback(window, event.x, event.y);
+  }
+
+  if (!processInput(window))
+    return false;
+  update();
+  publishSnapshot();
+  return true;
 }
 
 // Other helper functions
@@ -14,11 +14,24 @@
 #include <glm/gtx/matrix_operation.hpp>
 #include <string>
 #include "HoloPlayCore.h"
+#include "FrameCapture.hpp"
+#include "FrameCamera.hpp"
+#include "FramePacer.hpp"
+#include "HoloPlayCore.hpp"
+#include "QuiltChain.hpp"
+#include "QuiltPlayback.hpp"
+#include "QuiltRecorder.hpp"
 #include "Shader.hpp"
+#include "SimulationThread.hpp"
+#include "ViewCommands.hpp"
+#include "ViewMatrices.hpp"
 
 struct GLFWwindow;
 struct GLFWmonitor;
 struct hpc_Uniforms_t;
+class QuiltRingProducer;
+class ServiceConnection;
+class JobSystem;
 
 class HoloPlayContext
 {
@@ -47,6 +60,88 @@ public:
     float getWindowRatio();
     bool windowDimensionChanged();
 
+    // shared-memory quilt output (see QuiltRing.hpp): every rendered quilt is
+    // copied into a ring of slotCount slots, and a small control message
+    // announcing it is sent over the HoloPlay Service message pipe
+    void enableQuiltRing(const std::string &name, int slotCount = 3);
+    void disableQuiltRing();
+
+    // Runs processInput() and update() on a simulation thread at tickHz
+    // instead of once per frame on the render thread; call before run(). GLFW
+    // input is still polled on the main thread and replayed on the simulation
+    // thread. The subclass passes its state to the renderer with
+    // publishSnapshot() / consumeSnapshot(), typically through a TripleBuffer.
+    void enableSimulationThread(double tickHz = 120.0);
+    SimulationStats getSimulationStats() const { return simulation.getStats(); }
+
+    // Builds the per-view command lists on workerCount threads (including the
+    // render thread) with buildViewCommands(), then submits them in view
+    // order. Views the scene doesn't build fall back to renderScene().
+    void enableViewJobs(unsigned workerCount);
+
+    // Lets the scene draw every view of the quilt at once in renderAllViews(),
+    // one instance per view (see FrameCamera.hpp), instead of view by view.
+    void enableInstancedViews(bool enable) { instancedViews = enable; }
+
+    // Reads back every quilt and/or interlaced panel frame through a ring of
+    // pixel buffers (see FrameCapture.hpp) and hands them to sink on a
+    // delivery thread. The render loop never waits for it; frames that can't
+    // keep up are dropped according to settings.dropPolicy.
+    bool enableFrameCapture(const FrameCaptureSettings &settings,
+                            const FrameCapture::Sink &sink,
+                            bool captureQuilt = true, bool capturePanel = false);
+    void disableFrameCapture();
+    FrameCaptureStats getFrameCaptureStats() const;
+
+    // Records every quilt to a quilt file (see QuiltFile.hpp) through the
+    // frame capture, compressing on settings.threads threads so the render
+    // loop only pays for the readback. Replaces enableFrameCapture(); the
+    // file is finished by stopRecording() or release(). The quilt's size
+    // and layout can't change while recording.
+    bool startRecording(const std::string &path,
+                        const QuiltRecorderSettings &settings,
+                        int downscale = 1);
+    void stopRecording();
+    QuiltRecorderStats getRecordingStats() const;
+
+    // Plays the quilts of a quilt file (see QuiltPlayback.hpp) instead of
+    // calling renderScene(), decoding ahead on settings.decodeThreads and
+    // presenting each at its recorded time. The quilt switches to the file's
+    // size and tile layout, as a single quilt, until disablePlayback().
+    // Refused while the quilt ring is enabled or recording; a ring enabled
+    // during playback is restarted with the restored layout when it stops.
+    bool enablePlayback(const std::string &path,
+                        const QuiltPlaybackSettings &settings);
+    void disablePlayback();
+    QuiltPlaybackStats getPlaybackStats() const;
+
+    // Number of quilts rendered and interlaced in turn, and the memory they
+    // may take (see QuiltChain.hpp). With a single context nothing overlaps,
+    // each extra quilt only adds a frame of latency and its memory.
+    void setQuiltBuffering(const QuiltChainSettings &settings);
+    // switches to one of the presets of setupQuiltSettings(), e.g. 2 for 8K;
+    // refused while the quilt ring is enabled or recording
+    void setQuiltPreset(int preset);
+    const QuiltChain &getQuiltChain() const { return quilts; }
+
+    // Frame pacing (see FramePacer.hpp), call before run(). The swap interval
+    // is left to the driver unless set; maxFramesInFlight 0 lets the driver
+    // queue as many frames as it likes. reportSeconds > 0 logs the
+    // input-to-present latency at that interval.
+    void setSwapInterval(int interval) { pacer.setSwapInterval(interval); }
+    void setMaxFramesInFlight(int frames) { pacer.setMaxFramesInFlight(frames); }
+    void setLatencyReportInterval(double seconds) { latencyReportSeconds = seconds; }
+    FrameLatencyStats getFrameLatencyStats() const { return pacer.getStats(); }
+    const std::deque<FrameLatency> &getRecentFrameLatencies() const
+    {
+        return pacer.getRecentFrames();
+    }
+
+    // GLFW event forwarding, used by the static callbacks
+    void onCursorPos(GLFWwindow *window, double xpos, double ypos);
+    void onScroll(GLFWwindow *window, double xoffset, double yoffset);
+    void onKey(int key, int action);
+
     // functions that should be overrieded in the child class
     virtual void onExit();
     virtual void update();      // update function that will run every frame
@@ -62,6 +157,34 @@ public:
                                  double xoffset,
                                  double yoffset);
 
+    // snapshot hooks: publishSnapshot() is called after every update(), on the
+    // thread running it, and should copy the state the renderer needs;
+    // consumeSnapshot() is called on the render thread before each frame and
+    // should take the latest published copy. Both run back to back on the
+    // render thread when there is no simulation thread.
+    virtual void publishSnapshot();
+    virtual void consumeSnapshot();
+
+    // Fills commands for commands.viewIndex, whose view and projection
+    // matrices are already set. Runs on a JobSystem worker when view jobs are
+    // enabled, concurrently for several views: no GL calls, and only read the
+    // scene state. Returns false to render the view with renderScene().
+    virtual bool buildViewCommands(ViewCommandList &commands);
+
+    // Draws all views into the quilt when instanced views are enabled. The
+    // viewport is the whole quilt, its depth is cleared and GL_CLIP_DISTANCE0
+    // to 3 are enabled for holoplayQuiltPosition().
+    virtual void renderAllViews();
+
+    // Binds the ViewCamera uniform block of program, if it declares
+    //   layout(std140) uniform ViewCamera { mat4 view; mat4 projection; };
+    // to the matrices of the view being rendered, which are then set without
+    // any uniform calls
+    void useViewCameraBlock(ShaderProgram &program);
+    // The same for the FrameCamera block of shaders built with
+    // withFrameCamera(), shared by all views
+    void useFrameCameraBlock(ShaderProgram &program);
+
 private:
     enum class State
     {
@@ -85,9 +208,24 @@ private:
     bool windowChanged;
     void detectWindowChange();
 
+    // simulation thread, see enableSimulationThread()
+    double simulationTickHz = 0;
+    SimulationThread simulation;
+    InputQueue inputQueue;
+    std::vector<InputEvent> inputEvents;
+    bool simulate(double dt); // one tick on the simulation thread
+
+    // frame pacing and latency measurement
+    FramePacer pacer;
+    double latencyReportSeconds = 0;
+    float lastLatencyReport = 0;
+    void reportLatency(const char *label);
+    void reportPlayback();
+
     // storing matrix of each view
     glm::mat4 projectionMatrix = glm::mat4(1.0);
     glm::mat4 viewMatrix = glm::mat4(1.0);
+    int currentView = 0;
 
 protected:
     HoloPlayContext(const HoloPlayContext &){};
@@ -97,10 +235,14 @@ protected:
     int opengl_version_minor;
     std::string opengl_version_header;
 
-    // Time:
+    // Time: owned by the thread running update()
     float time;
     float deltaTime;
 
+    // true if key is held down, safe to call from processInput() on either
+    // thread (glfwGetKey may only be called from the main thread)
+    bool isKeyPressed(int key);
+
     // lkg related:
     const int DEV_INDEX = 0; // the index of device we are rendering on,
                              // default is 0, the first Looking Glass detected
@@ -128,22 +270,60 @@ protected:
         NULL; // The shader program for copying views to the quilt
 
     // render var
-    unsigned int
-        quiltTexture; // The texture object used internally to draw quilt,
-                      // It is bound and drawn by drawLightfield()
+    QuiltChain quilts; // The quilt textures and frame buffers the views are
+                       // rendered to, drawn in turn by drawLightfield()
+    QuiltChainSettings quiltChainSettings;
     unsigned int VAO; // The vertex array object used internally to blit to the
                       // quilt and screen
     unsigned int VBO; // The vertex buffer object used internally to blit to the
                       // quilt and screen
-    unsigned int FBO; // The frame buffer object used internally to blit views to
-                      // the quilt
+
+    QuiltRingProducer *quiltRing =
+        NULL; // The shared-memory ring the quilt is published to, if enabled
+    FrameCapture *ringCapture =
+        NULL; // Reads the quilts back for quiltRing without stalling
+    std::mutex ringMutex;
+    std::vector<uint64_t>
+        ringSequences; // Published by ringCapture, announced by the render loop
+
+    FrameCapture *frameCapture =
+        NULL; // Reads back quilts and panel frames for enableFrameCapture()
+    QuiltRecorder *recorder =
+        NULL; // Writes the captured quilts to a file for startRecording()
+    QuiltPlayback *playback =
+        NULL; // Uploads the quilts of a file for enablePlayback()
+    int savedQuiltSettings[5]; // qs_* to restore after playback
+    bool captureQuilt = false;
+    bool capturePanel = false;
+    uint64_t frameNumber = 0; // Frames rendered since run(), for the captures
+    hpc::ResponseArena replies; // Replies to asynchronous messages, freed once
+                                // per frame
+
+    ServiceConnection *service =
+        NULL; // The link to HoloPlay Service, reconnected in the background
+    uint64_t calibrationGeneration =
+        0; // Generation of the calibration loaded into the light-field shader
+
+    JobSystem *viewJobs =
+        NULL; // Builds the per-view command lists, if enabled
+    std::vector<ViewCommandList>
+        viewCommands; // One command list per view, reused every frame
+
+    ViewMatrices viewMatrices; // The matrices of all views, batched per frame
+    unsigned int viewCameraBuffer =
+        0; // Uniform buffer holding a ViewCamera block for every view
+    size_t viewCameraStride = 0; // Bytes between views in viewCameraBuffer
+    int viewCameraCapacity = 0;  // Views viewCameraBuffer has room for
+    unsigned int frameCameraBuffer =
+        0; // Uniform buffer holding the FrameCamera block of the frame
+    bool instancedViews = false; // Render the views with renderAllViews()
 
     // example implementation for rendering 45 views
     // ====================================================================================
     // set up functions
     void initialize(); // calls all the functions necessary to set up the
                        // HoloPlay Context
-    void setupQuilt(); // create the quiltTexture, VBO, VAO, and FBO
+    void setupQuilt(); // create the quilts, VBO and VAO
     void setupQuiltSettings(
         int preset);                  // Set up the quilt settings according to the preset passed
                                       // 0: 32 views
@@ -152,8 +332,8 @@ protected:
                                       // Feel free to customize if you want
     void passQuiltSettingsToShader(); // assign quilt settings to light-field
                                       // shader uniforms
-    void loadCalibrationIntoShader(); // assign calibration to light-field shader
-                                      // uniforms
+    void loadCalibrationIntoShader(); // assign the last known calibration to
+                                      // light-field shader uniforms
     void loadLightFieldShaders();     // create and compile light-field shader
 
     // release function
@@ -161,13 +341,28 @@ protected:
                     // during initialize()
 
     // render functions
+    void prepareViewCameras(        // Computes the matrices of all views in
+        const glm::mat4 &currentViewMatrix); // viewMatrices and writes them
+                                    // to viewCameraBuffer
+
+    void bindViewCamera(int viewIndex); // Binds the range of viewCameraBuffer
+                                        // holding the matrices of a view
+
+    void submitViewCommands(        // Issues the GL calls recorded by
+        const ViewCommandList &commands); // buildViewCommands()
+
     void setupVirtualCameraForView( // Changes the view matrix and projection
         int currentViewIndex,       // accoriding to the view index and the
-                                    // currentViewMatrix
+                                    // currentViewMatrix, prepared by
+                                    // prepareViewCameras()
         glm::mat4 currentViewMatrix);
 
+    void publishQuiltToRing();      // Queues the quilt for ringCapture, which
+                                    // copies it into a free slot of quiltRing,
+                                    // and announces the quilts published since
+
     void drawLightField();          // Uses the lightfieldShader program,
-                                    // binds the quiltTexture, and draws a fullscreen
+                                    // binds the quilt to show, and draws a fullscreen
                                     // quad. Call this after all the views have been
                                     // rendered.
 
@@ -179,10 +374,11 @@ protected:
     openWindowOnLKG(); // open a full-szie window on the looking glass
 
     // some get functions
-    unsigned int getQuiltTexture() { return quiltTexture; }
+    unsigned int getQuiltTexture() { return quilts.getRenderTexture(); }
     unsigned int getLightfieldShader() { return lightFieldShader->getHandle(); }
     glm::mat4 GetProjectionMatrixOfCurrentView() { return projectionMatrix; }
     glm::mat4 GetViewMatrixOfCurrentView() { return viewMatrix; }
+    int GetCurrentViewIndex() { return currentView; }
 };
 
 #endif /* end of include guard: OPENGL_CMAKE_SKELETON_APPLICATION_HPP */
@@ -0,0 +1,185 @@
+/**
+ * JobSystem.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifdef WIN32
+#pragma warning(disable : 4464 4820 4514 5045 4201 5039 4061 4710)
+#endif
+
+#include "JobSystem.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+// worker index of the current thread, 0 outside the workers
+static thread_local unsigned currentWorkerIndex = 0;
+
+JobSystem::JobSystem(unsigned workerCount) : queued(0)
+{
+  workerCount = max(workerCount, 1u);
+  for (unsigned i = 0; i < workerCount; ++i)
+  {
+    queues.push_back(unique_ptr<Queue>(new Queue));
+    queues.back()->executed = 0;
+    queues.back()->stolen = 0;
+  }
+  // worker 0 is whoever calls parallelFor()
+  for (unsigned i = 1; i < workerCount; ++i)
+    threads.push_back(thread(&JobSystem::workerLoop, this, i));
+}
+
+JobSystem::~JobSystem()
+{
+  {
+    lock_guard<mutex> lock(sleepMutex);
+    stopping = true;
+  }
+  sleep.notify_all();
+  for (size_t i = 0; i < threads.size(); ++i)
+    threads[i].join();
+}
+
+unsigned JobSystem::currentWorker()
+{
+  return currentWorkerIndex;
+}
+
+void JobSystem::parallelFor(size_t count, size_t grain, const RangeJob &job)
+{
+  if (!count)
+    return;
+  grain = max(grain, size_t(1));
+  size_t chunks = (count + grain - 1) / grain;
+  unsigned workers = getWorkerCount();
+
+  // nothing to share
+  if (workers == 1 || chunks == 1)
+  {
+    job(0, count);
+    queues[0]->executed += chunks;
+    return;
+  }
+
+  Batch batch;
+  batch.job = &job;
+  batch.remaining = chunks;
+
+  // counted first so a worker popping a task right away never sees less
+  {
+    lock_guard<mutex> lock(sleepMutex);
+    queued += chunks;
+  }
+
+  // deal contiguous blocks of chunks to the workers
+  for (unsigned w = 0; w < workers; ++w)
+  {
+    size_t first = chunks * w / workers, last = chunks * (w + 1) / workers;
+    if (first == last)
+      continue;
+    lock_guard<mutex> lock(queues[w]->mutex);
+    for (size_t c = first; c < last; ++c)
+    {
+      Task task = {c * grain, min(count, (c + 1) * grain), &batch};
+      queues[w]->tasks.push_back(task);
+    }
+  }
+  sleep.notify_all();
+
+  // help until the last chunk is done, possibly by another worker
+  while (batch.remaining.load(memory_order_acquire) > 0)
+  {
+    if (!runOne(0))
+      this_thread::yield();
+  }
+}
+
+bool JobSystem::popOwn(unsigned index, Task &task)
+{
+  Queue &queue = *queues[index];
+  lock_guard<mutex> lock(queue.mutex);
+  if (queue.tasks.empty())
+    return false;
+  task = queue.tasks.back();
+  queue.tasks.pop_back();
+  return true;
+}
+
+bool JobSystem::steal(unsigned thief, Task &task)
+{
+  unsigned workers = getWorkerCount();
+  for (unsigned i = 1; i < workers; ++i)
+  {
+    Queue &victim = *queues[(thief + i) % workers];
+    unique_lock<mutex> lock(victim.mutex, try_to_lock);
+    if (!lock.owns_lock() || victim.tasks.empty())
+      continue;
+    task = victim.tasks.front();
+    victim.tasks.pop_front();
+    return true;
+  }
+  return false;
+}
+
+bool JobSystem::runOne(unsigned index)
+{
+  Task task;
+  bool stolen = false;
+  if (!popOwn(index, task))
+  {
+    if (!steal(index, task))
+      return false;
+    stolen = true;
+  }
+  queued--;
+
+  (*task.batch->job)(task.begin, task.end);
+
+  queues[index]->executed++;
+  if (stolen)
+    queues[index]->stolen++;
+  // last use of the batch, which lives on the caller's stack
+  task.batch->remaining.fetch_sub(1, memory_order_acq_rel);
+  return true;
+}
+
+void JobSystem::workerLoop(unsigned index)
+{
+  currentWorkerIndex = index;
+  for (;;)
+  {
+    {
+      unique_lock<mutex> lock(sleepMutex);
+      sleep.wait(lock, [this] { return stopping || queued.load() > 0; });
+      if (stopping)
+        return;
+    }
+    while (runOne(index))
+    {
+    }
+  }
+}
+
+vector<JobWorkerStats> JobSystem::getStats() const
+{
+  vector<JobWorkerStats> stats(queues.size());
+  for (size_t i = 0; i < queues.size(); ++i)
+  {
+    stats[i].executed = queues[i]->executed.load();
+    stats[i].stolen = queues[i]->stolen.load();
+  }
+  return stats;
+}
+
+void JobSystem::resetStats()
+{
+  for (size_t i = 0; i < queues.size(); ++i)
+  {
+    queues[i]->executed = 0;
+    queues[i]->stolen = 0;
+  }
+}
@@ -0,0 +1,105 @@
+/**
+ * JobSystem.hpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifndef OPENGL_CMAKE_SKELETON_JOBSYSTEM_HPP
+#define OPENGL_CMAKE_SKELETON_JOBSYSTEM_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small work-stealing scheduler for the per-view CPU work of a frame.
+//
+// parallelFor() splits a range into chunks and deals them out to one deque per
+// worker, in contiguous blocks so neighbouring views stay on the same core.
+// Each worker pops from the back of its own deque and, once it runs dry,
+// steals from the front of the others, so uneven chunks (a view looking at a
+// crowded part of the scene) get balanced out. The calling thread is worker 0
+// and works too, parallelFor() returns when every chunk is done.
+//
+// parallelFor() is meant to be called from one thread at a time (the render
+// thread), and jobs must not call it recursively.
+
+// per-worker counters, reset by resetStats()
+struct JobWorkerStats
+{
+    uint64_t executed; // chunks run by this worker
+    uint64_t stolen;   // of those, chunks taken from another worker's deque
+};
+
+class JobSystem
+{
+public:
+    // called with a [begin, end) part of the range
+    typedef std::function<void(size_t begin, size_t end)> RangeJob;
+
+    // workerCount threads share the work, including the caller; 1 runs
+    // everything inline
+    explicit JobSystem(unsigned workerCount);
+    ~JobSystem();
+
+    unsigned getWorkerCount() const { return unsigned(queues.size()); }
+
+    // runs job over [0, count) in chunks of at most grain items
+    void parallelFor(size_t count, size_t grain, const RangeJob &job);
+
+    std::vector<JobWorkerStats> getStats() const;
+    void resetStats();
+
+    // index of the worker running the current job, 0 for the caller
+    static unsigned currentWorker();
+
+private:
+    JobSystem(const JobSystem &);
+    JobSystem &operator=(const JobSystem &);
+
+    struct Batch
+    {
+        const RangeJob *job;
+        std::atomic<size_t> remaining;
+    };
+
+    struct Task
+    {
+        size_t begin;
+        size_t end;
+        Batch *batch;
+    };
+
+    // one per worker, allocated separately so the locks of different workers
+    // don't end up next to each other
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::atomic<uint64_t> executed;
+        std::atomic<uint64_t> stolen;
+    };
+
+    void workerLoop(unsigned index);
+    bool runOne(unsigned index); // false if there was nothing to run
+    bool popOwn(unsigned index, Task &task);
+    bool steal(unsigned thief, Task &task);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+
+    std::atomic<size_t> queued; // tasks sitting in the deques
+    std::mutex sleepMutex;
+    std::condition_variable sleep;
+    bool stopping = false;
+};
+
+#endif // OPENGL_CMAKE_SKELETON_JOBSYSTEM_HPP
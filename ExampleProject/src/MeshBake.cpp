@@ -0,0 +1,426 @@
+/**
+ * MeshBake.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifdef WIN32
+#pragma warning(disable : 4464 4820 4514 5045 4201 5039 4061 4710)
+#endif
+
+#include "MeshBake.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#include "MeshFile.hpp"
+#include "MeshOptimizer.hpp"
+
+using namespace std;
+
+static const char *skipSpaces(const char *p)
+{
+  while (*p == ' ' || *p == '\t')
+    ++p;
+  return p;
+}
+
+static const char *nextLine(const char *p)
+{
+  while (*p && *p != '\n')
+    ++p;
+  return *p ? p + 1 : p;
+}
+
+// up to count floats, the number read
+static int parseFloats(const char *&p, float *out, int count)
+{
+  int read = 0;
+  while (read < count)
+  {
+    char *end;
+    float value = strtof(p, &end);
+    if (end == p)
+      break;
+    out[read++] = value;
+    p = end;
+  }
+  return read;
+}
+
+// an OBJ index, 1-based or negative from the end, to 0-based; -1 if absent,
+// -2 if out of range
+static long parseIndex(const char *&p, size_t count)
+{
+  char *end;
+  long index = strtol(p, &end, 10);
+  if (end == p)
+    return -1;
+  p = end;
+  if (index < 0)
+    index += long(count);
+  else
+    --index;
+  return index >= 0 && size_t(index) < count ? index : -2;
+}
+
+static bool endOfLine(const char *p)
+{
+  return !*p || *p == '\n' || *p == '\r' || *p == '#';
+}
+
+bool loadObj(const string &path, TerrainMesh &mesh)
+{
+  mesh.vertices.clear();
+  mesh.indices.clear();
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file)
+  {
+    cout << "[Error] could not open " << path << endl;
+    return false;
+  }
+  vector<char> text;
+  char buffer[1 << 16];
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    text.insert(text.end(), buffer, buffer + read);
+  fclose(file);
+  text.push_back('\0');
+
+  vector<glm::vec3> positions, normals;
+  vector<glm::vec4> colors;
+  // a vertex for each (position, normal) pair the faces use
+  unordered_map<uint64_t, uint32_t> welded;
+  vector<bool> hasNormal;
+  vector<uint32_t> face;
+  size_t line = 0;
+  for (const char *p = text.data(); *p; p = nextLine(p))
+  {
+    ++line;
+    p = skipSpaces(p);
+    if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+    {
+      p += 2;
+      float v[6] = {0, 0, 0, 1, 1, 1};
+      if (parseFloats(p, v, 6) < 3)
+        continue;
+      positions.push_back(glm::vec3(v[0], v[1], v[2]));
+      colors.push_back(glm::vec4(v[3], v[4], v[5], 1.0f));
+    }
+    else if (p[0] == 'v' && p[1] == 'n')
+    {
+      p += 2;
+      float n[3] = {0, 0, 1};
+      parseFloats(p, n, 3);
+      normals.push_back(glm::vec3(n[0], n[1], n[2]));
+    }
+    else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+    {
+      p += 2;
+      face.clear();
+      while (true)
+      {
+        p = skipSpaces(p);
+        if (endOfLine(p))
+          break;
+        long position = parseIndex(p, positions.size());
+        long normal = -1;
+        if (position >= 0 && *p == '/')
+        {
+          ++p;
+          if (*p != '/')
+            parseIndex(p, size_t(-1) / 2); // texture coordinates, unused
+          if (*p == '/')
+          {
+            ++p;
+            normal = parseIndex(p, normals.size());
+            if (normal == -1)
+              normal = -2;
+          }
+        }
+        // a face missing a corner would leave a hole or fan the wrong ones
+        const char *error = position == -1 ? "malformed face corner"
+                            : position < 0 ? "vertex index out of range"
+                            : normal < -1  ? "normal index missing or out of range"
+                                           : 0;
+        if (error)
+        {
+          cout << "[Error] " << path << ":" << line << ": " << error << endl;
+          return false;
+        }
+        while (*p && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r')
+          ++p;
+
+        uint64_t key = uint64_t(position) << 32 | uint32_t(normal + 1);
+        unordered_map<uint64_t, uint32_t>::iterator found = welded.find(key);
+        if (found == welded.end())
+        {
+          TerrainVertex vertex;
+          vertex.position = positions[size_t(position)];
+          vertex.normal = normal < 0 ? glm::vec3(0.0f)
+                                     : normals[size_t(normal)];
+          vertex.color = colors[size_t(position)];
+          found = welded.insert(make_pair(key, uint32_t(mesh.vertices.size())))
+                      .first;
+          mesh.vertices.push_back(vertex);
+          hasNormal.push_back(normal >= 0);
+        }
+        face.push_back(found->second);
+      }
+      if (face.size() < 3)
+      {
+        cout << "[Error] " << path << ":" << line
+             << ": face of fewer than three corners" << endl;
+        return false;
+      }
+      for (size_t k = 2; k < face.size(); ++k)
+      {
+        mesh.indices.push_back(face[0]);
+        mesh.indices.push_back(face[k - 1]);
+        mesh.indices.push_back(face[k]);
+      }
+    }
+  }
+
+  // the cross product is twice the area, so summing them weights by area
+  if (find(hasNormal.begin(), hasNormal.end(), false) != hasNormal.end())
+  {
+    for (size_t i = 0; i + 3 <= mesh.indices.size(); i += 3)
+    {
+      TerrainVertex *v[3];
+      for (int k = 0; k < 3; ++k)
+        v[k] = &mesh.vertices[mesh.indices[i + size_t(k)]];
+      glm::vec3 n = glm::cross(v[1]->position - v[0]->position,
+                               v[2]->position - v[0]->position);
+      for (int k = 0; k < 3; ++k)
+        if (!hasNormal[mesh.indices[i + size_t(k)]])
+          v[k]->normal += n;
+    }
+    for (size_t i = 0; i < mesh.vertices.size(); ++i)
+    {
+      glm::vec3 &n = mesh.vertices[i].normal;
+      if (!hasNormal[i])
+        n = glm::dot(n, n) > 0.0f ? glm::normalize(n) : glm::vec3(0, 0, 1);
+    }
+  }
+
+  if (mesh.indices.empty())
+  {
+    cout << "[Error] " << path << " holds no triangles" << endl;
+    return false;
+  }
+  return true;
+}
+
+bool writeObj(const string &path, const TerrainMesh &mesh)
+{
+  FILE *file = fopen(path.c_str(), "wb");
+  if (!file)
+  {
+    cout << "[Error] could not create " << path << endl;
+    return false;
+  }
+  setvbuf(file, NULL, _IOFBF, 1 << 20);
+  for (size_t i = 0; i < mesh.vertices.size(); ++i)
+  {
+    const TerrainVertex &v = mesh.vertices[i];
+    fprintf(file, "v %g %g %g %g %g %g\n", v.position.x, v.position.y,
+            v.position.z, v.color.x, v.color.y, v.color.z);
+  }
+  for (size_t i = 0; i < mesh.vertices.size(); ++i)
+  {
+    const glm::vec3 &n = mesh.vertices[i].normal;
+    fprintf(file, "vn %g %g %g\n", n.x, n.y, n.z);
+  }
+  // vertex i has normal i
+  for (size_t i = 0; i + 3 <= mesh.indices.size(); i += 3)
+    fprintf(file, "f %u//%u %u//%u %u//%u\n", mesh.indices[i] + 1,
+            mesh.indices[i] + 1, mesh.indices[i + 1] + 1,
+            mesh.indices[i + 1] + 1, mesh.indices[i + 2] + 1,
+            mesh.indices[i + 2] + 1);
+  if (fclose(file) != 0)
+  {
+    cout << "[Error] could not write " << path << endl;
+    return false;
+  }
+  return true;
+}
+
+static void setAttribute(MeshFileHeader &header, const char *name,
+                         uint32_t components, uint32_t type,
+                         uint32_t normalized, size_t offset)
+{
+  MeshFileAttribute &a = header.attributes[header.attributeCount++];
+  strncpy(a.name, name, sizeof(a.name) - 1);
+  a.components = components;
+  a.type = type;
+  a.normalized = normalized;
+  a.offset = uint32_t(offset);
+}
+
+// sequential write, zero-filling any gap up to offset
+static bool writeAt(FILE *file, uint64_t &fileOffset, uint64_t offset,
+                    const void *data, size_t size)
+{
+  static const char zeros[MESH_FILE_PAGE] = {};
+  while (fileOffset < offset)
+  {
+    size_t gap = size_t(min(offset - fileOffset, uint64_t(sizeof(zeros))));
+    if (fwrite(zeros, 1, gap, file) != gap)
+      return false;
+    fileOffset += gap;
+  }
+  if (size && fwrite(data, 1, size, file) != size)
+    return false;
+  fileOffset += size;
+  return true;
+}
+
+bool bakeMesh(const TerrainMesh &mesh, const MeshBakeSettings &settings,
+              const string &path)
+{
+  size_t vertexCount = mesh.vertices.size();
+  if (!vertexCount || mesh.indices.size() < 3)
+  {
+    cout << "[Error] nothing to bake into " << path << endl;
+    return false;
+  }
+
+  TerrainBounds bounds;
+  glm::vec3 low = mesh.vertices[0].position, high = low;
+  for (size_t i = 1; i < vertexCount; ++i)
+  {
+    low = glm::min(low, mesh.vertices[i].position);
+    high = glm::max(high, mesh.vertices[i].position);
+  }
+  bounds.origin = low;
+  bounds.extent = high - low;
+
+  // the triangles, in chunks; vertex i of the chunks is remap[i]
+  vector<uint32_t> remap;
+  vector<MeshChunk> chunks;
+  vector<uint16_t> shortIndices;
+  const vector<uint32_t> *intIndices = nullptr;
+  if (settings.optimize)
+  {
+    vector<uint32_t> ordered(mesh.indices.size());
+    optimizeVertexCache(mesh.indices.data(), mesh.indices.size(), vertexCount,
+                        ordered.data());
+    ChunkedMesh chunked;
+    splitMesh(ordered.data(), ordered.size(), vertexCount, MAX_CHUNK_VERTICES,
+              chunked);
+    remap.swap(chunked.remap);
+    chunks.swap(chunked.chunks);
+    shortIndices.swap(chunked.indices);
+  }
+  else
+  {
+    remap.resize(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i)
+      remap[i] = uint32_t(i);
+    MeshChunk whole = {0, mesh.indices.size(), 0, vertexCount};
+    chunks.assign(1, whole);
+    if (vertexCount <= MAX_CHUNK_VERTICES)
+      shortIndices.assign(mesh.indices.begin(), mesh.indices.end());
+    else
+      intIndices = &mesh.indices;
+  }
+
+  MeshFileHeader header = MeshFileHeader();
+  memcpy(header.magic, MESH_FILE_MAGIC, sizeof(header.magic));
+  header.version = MESH_FILE_VERSION;
+  header.headerSize = sizeof(MeshFileHeader);
+  for (int i = 0; i < 3; ++i)
+  {
+    header.boundsOrigin[i] = bounds.origin[i];
+    header.boundsExtent[i] = bounds.extent[i];
+  }
+
+  vector<char> vertices;
+  if (settings.packed)
+  {
+    typedef PackedTerrainVertex V;
+    setAttribute(header, "position", 3, MESH_TYPE_UNSIGNED_SHORT, 1,
+                 offsetof(V, position));
+    setAttribute(header, "normal", 2, MESH_TYPE_SHORT, 1, offsetof(V, normal));
+    setAttribute(header, "color", 4, MESH_TYPE_UNSIGNED_BYTE, 1,
+                 offsetof(V, color));
+    header.vertexStride = sizeof(V);
+    vertices.resize(remap.size() * sizeof(V));
+    V *out = reinterpret_cast<V *>(vertices.data());
+    for (size_t i = 0; i < remap.size(); ++i)
+      out[i] = packTerrainVertex(mesh.vertices[remap[i]], bounds);
+  }
+  else
+  {
+    typedef TerrainVertex V;
+    setAttribute(header, "position", 3, MESH_TYPE_FLOAT, 0,
+                 offsetof(V, position));
+    setAttribute(header, "normal", 3, MESH_TYPE_FLOAT, 0, offsetof(V, normal));
+    setAttribute(header, "color", 4, MESH_TYPE_FLOAT, 0, offsetof(V, color));
+    header.vertexStride = sizeof(V);
+    vertices.resize(remap.size() * sizeof(V));
+    remapVertices(vertices.data(), mesh.vertices.data(), sizeof(V),
+                  remap.data(), remap.size());
+  }
+
+  vector<MeshFileChunk> table(chunks.size());
+  for (size_t i = 0; i < chunks.size(); ++i)
+  {
+    table[i].firstIndex = chunks[i].firstIndex;
+    table[i].indexCount = chunks[i].indexCount;
+    table[i].baseVertex = chunks[i].baseVertex;
+    table[i].vertexCount = chunks[i].vertexCount;
+  }
+
+  const void *indices = intIndices ? static_cast<const void *>(intIndices->data())
+                                   : shortIndices.data();
+  header.indexType = intIndices ? MESH_TYPE_UNSIGNED_INT
+                                : MESH_TYPE_UNSIGNED_SHORT;
+  header.indexCount = intIndices ? intIndices->size() : shortIndices.size();
+  header.indexSize = header.indexCount * meshFileTypeSize(header.indexType);
+  header.vertexCount = remap.size();
+  header.vertexSize = vertices.size();
+  header.chunkCount = uint32_t(table.size());
+  header.chunkOffset = MESH_FILE_PAGE;
+  header.vertexOffset =
+      meshFileAlign(header.chunkOffset + table.size() * sizeof(MeshFileChunk));
+  header.indexOffset = meshFileAlign(header.vertexOffset + header.vertexSize);
+
+  FILE *file = fopen(path.c_str(), "wb");
+  if (!file)
+  {
+    cout << "[Error] could not create " << path << endl;
+    return false;
+  }
+  setvbuf(file, NULL, _IOFBF, 1 << 20);
+  uint64_t fileOffset = 0;
+  bool ok =
+      writeAt(file, fileOffset, 0, &header, sizeof(header)) &&
+      writeAt(file, fileOffset, header.chunkOffset, table.data(),
+              table.size() * sizeof(MeshFileChunk)) &&
+      writeAt(file, fileOffset, header.vertexOffset, vertices.data(),
+              vertices.size()) &&
+      writeAt(file, fileOffset, header.indexOffset, indices,
+              size_t(header.indexSize));
+  ok = (fclose(file) == 0) && ok;
+  if (!ok)
+  {
+    cout << "[Error] could not write " << path << endl;
+    return false;
+  }
+  cout << "[Info] baked " << header.vertexCount << " vertices ("
+       << (settings.packed ? "packed" : "float") << ") and "
+       << header.indexCount / 3 << " triangles in " << header.chunkCount
+       << " chunk(s) of " << meshFileTypeSize(header.indexType) * 8
+       << "-bit indices into " << path << endl;
+  return true;
+}
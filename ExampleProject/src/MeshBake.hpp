@@ -0,0 +1,48 @@
+/**
+ * MeshBake.hpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifndef OPENGL_CMAKE_SKELETON_MESHBAKE_HPP
+#define OPENGL_CMAKE_SKELETON_MESHBAKE_HPP
+
+#include <string>
+
+#include "TerrainMesh.hpp"
+
+// The offline half of baked meshes: reads a source mesh and writes it as a
+// mesh file (MeshFile.hpp) in the layout SampleScene draws, so that startup
+// only maps the file and uploads it (MeshFileReader.hpp).
+//
+// Everything a loader would otherwise do per run happens here once: OBJ
+// parsing and the welding of its separate position and normal indices into
+// vertices, normals for meshes without them, packing into
+// PackedTerrainVertex, the vertex cache order and the split into chunks of
+// 16-bit indices of MeshOptimizer.hpp.
+//
+// Any TerrainMesh can be baked, not only a terrain. GL free.
+
+struct MeshBakeSettings
+{
+    bool packed = true;   // PackedTerrainVertex instead of TerrainVertex
+    bool optimize = true; // vertex cache order in chunks of 16-bit indices;
+                          // otherwise one chunk, 16-bit indices if they fit
+};
+
+// the triangles of a Wavefront OBJ file: "v x y z [r g b]", "vn x y z" and
+// "f" lines of three or more corners, fanned into triangles; everything else
+// is skipped. Corners with the same position and normal become one vertex,
+// vertices without a normal get the area-weighted one of their faces. A face
+// with a malformed or out of range index fails the load, with its line.
+bool loadObj(const std::string &path, TerrainMesh &mesh);
+
+// the mesh as OBJ, colours after the positions
+bool writeObj(const std::string &path, const TerrainMesh &mesh);
+
+bool bakeMesh(const TerrainMesh &mesh, const MeshBakeSettings &settings,
+              const std::string &path);
+
+#endif // OPENGL_CMAKE_SKELETON_MESHBAKE_HPP
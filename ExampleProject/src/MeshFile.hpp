@@ -0,0 +1,116 @@
+/**
+ * MeshFile.hpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifndef OPENGL_CMAKE_SKELETON_MESHFILE_HPP
+#define OPENGL_CMAKE_SKELETON_MESHFILE_HPP
+
+#include <cstdint>
+
+// On-disk layout of baked mesh files (.hpm), written by MeshBake.hpp.
+//
+//   MeshFileHeader             at 0, padded to MESH_FILE_PAGE
+//   MeshFileChunk[chunkCount]  at header.chunkOffset, page aligned
+//   vertices                   at header.vertexOffset, page aligned
+//   indices                    at header.indexOffset, page aligned
+//
+// The vertex and index streams are exactly what goes into the vertex and
+// element buffers: interleaved vertices of vertexStride bytes described by
+// the attribute table, and indices of indexType relative to each chunk's
+// base vertex. A loader maps the file and hands the streams to glBufferData
+// as they are, nothing is converted at startup. Types are GL's enum values,
+// so they are passed on to glVertexAttribPointer and glDrawElements as is.
+//
+// All fields are little-endian.
+
+static const char MESH_FILE_MAGIC[8] = {'H', 'P', 'M', 'E', 'S', 'H', '0', '1'};
+static const uint32_t MESH_FILE_VERSION = 1;
+static const uint32_t MESH_FILE_PAGE = 4096;
+static const uint32_t MESH_FILE_MAX_ATTRIBUTES = 8;
+
+// the GL types a mesh file uses, with GL's values
+enum MeshFileType
+{
+    MESH_TYPE_BYTE = 0x1400,
+    MESH_TYPE_UNSIGNED_BYTE = 0x1401,
+    MESH_TYPE_SHORT = 0x1402,
+    MESH_TYPE_UNSIGNED_SHORT = 0x1403,
+    MESH_TYPE_UNSIGNED_INT = 0x1405,
+    MESH_TYPE_FLOAT = 0x1406
+};
+
+// one vertex attribute, as ShaderProgram::setAttribute() takes it
+struct MeshFileAttribute
+{
+    char name[16];          // the shader input, NUL terminated
+    uint32_t components;    // 1 to 4
+    uint32_t type;          // MeshFileType
+    uint32_t normalized;    // 1 for integers read as [0, 1] or [-1, 1]
+    uint32_t offset;        // in the vertex
+};
+
+struct MeshFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;    // sizeof(MeshFileHeader)
+    uint32_t attributeCount;
+    uint32_t vertexStride;
+    uint64_t vertexCount;
+    uint64_t vertexOffset;
+    uint64_t vertexSize;    // vertexCount * vertexStride
+    uint32_t indexType;     // MESH_TYPE_UNSIGNED_SHORT or _INT
+    uint32_t chunkCount;
+    uint64_t indexCount;
+    uint64_t indexOffset;
+    uint64_t indexSize;
+    uint64_t chunkOffset;
+    float boundsOrigin[3];  // the box of the positions, what packed
+    float boundsExtent[3];  // positions are quantized in
+    uint8_t reserved[16];
+    MeshFileAttribute attributes[MESH_FILE_MAX_ATTRIBUTES];
+};
+
+// one draw: indexCount indices from firstIndex, offset by baseVertex
+struct MeshFileChunk
+{
+    uint64_t firstIndex;
+    uint64_t indexCount;
+    uint64_t baseVertex;
+    uint64_t vertexCount;
+};
+
+static_assert(sizeof(MeshFileAttribute) == 32, "MeshFileAttribute layout");
+static_assert(sizeof(MeshFileHeader) == 384, "MeshFileHeader layout");
+static_assert(sizeof(MeshFileChunk) == 32, "MeshFileChunk layout");
+
+// first page-aligned offset at or after offset
+inline uint64_t meshFileAlign(uint64_t offset)
+{
+    return (offset + MESH_FILE_PAGE - 1) / MESH_FILE_PAGE * MESH_FILE_PAGE;
+}
+
+// bytes of one component of a MeshFileType, 0 for anything else
+inline uint32_t meshFileTypeSize(uint32_t type)
+{
+    switch (type)
+    {
+    case MESH_TYPE_BYTE:
+    case MESH_TYPE_UNSIGNED_BYTE:
+        return 1;
+    case MESH_TYPE_SHORT:
+    case MESH_TYPE_UNSIGNED_SHORT:
+        return 2;
+    case MESH_TYPE_UNSIGNED_INT:
+    case MESH_TYPE_FLOAT:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+#endif // OPENGL_CMAKE_SKELETON_MESHFILE_HPP
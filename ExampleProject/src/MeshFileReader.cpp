@@ -0,0 +1,183 @@
+/**
+ * MeshFileReader.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifdef WIN32
+#pragma warning(disable : 4464 4820 4514 5045 4201 5039 4061 4710)
+#endif
+
+#include "MeshFileReader.hpp"
+
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+MeshFileReader::MeshFileReader()
+{
+  header = MeshFileHeader();
+}
+
+MeshFileReader::~MeshFileReader()
+{
+  close();
+}
+
+bool MeshFileReader::open(const string &path)
+{
+  close();
+  if (!map(path))
+  {
+    cout << "[Error] could not map " << path << endl;
+    return false;
+  }
+
+  if (mappingSize < sizeof(MeshFileHeader))
+  {
+    cout << "[Error] " << path << " is not a mesh file" << endl;
+    close();
+    return false;
+  }
+  memcpy(&header, mapping, sizeof(header));
+  if (memcmp(header.magic, MESH_FILE_MAGIC, sizeof(header.magic)) ||
+      header.version != MESH_FILE_VERSION || !validate())
+  {
+    cout << "[Error] " << path << " is not a mesh file this build can read"
+         << endl;
+    close();
+    return false;
+  }
+  return true;
+}
+
+void MeshFileReader::close()
+{
+  if (!mapping)
+    return;
+#ifdef _WIN32
+  UnmapViewOfFile(mapping);
+  CloseHandle(mappingHandle);
+  CloseHandle(fileHandle);
+  mappingHandle = nullptr;
+  fileHandle = nullptr;
+#else
+  munmap((void *)mapping, size_t(mappingSize));
+#endif
+  mapping = nullptr;
+  mappingSize = 0;
+}
+
+bool MeshFileReader::map(const string &path)
+{
+#ifdef _WIN32
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+  LARGE_INTEGER size;
+  HANDLE view = NULL;
+  if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+    view = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  void *data = view ? MapViewOfFile(view, FILE_MAP_READ, 0, 0, 0) : NULL;
+  if (!data)
+  {
+    if (view)
+      CloseHandle(view);
+    CloseHandle(file);
+    return false;
+  }
+  fileHandle = file;
+  mappingHandle = view;
+  mappingSize = uint64_t(size.QuadPart);
+#else
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  void *data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+    data = mmap(NULL, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED)
+    return false;
+  mappingSize = uint64_t(st.st_size);
+#endif
+  mapping = static_cast<const unsigned char *>(data);
+  return true;
+}
+
+// whether every stream, chunk and attribute lies where the header says,
+// within the file
+bool MeshFileReader::validate() const
+{
+  const MeshFileHeader &h = header;
+  uint32_t indexSize = meshFileTypeSize(h.indexType);
+  if (h.headerSize != sizeof(MeshFileHeader) ||
+      h.attributeCount > MESH_FILE_MAX_ATTRIBUTES || !h.vertexStride ||
+      (h.indexType != MESH_TYPE_UNSIGNED_SHORT &&
+       h.indexType != MESH_TYPE_UNSIGNED_INT) ||
+      h.vertexCount > h.vertexSize / h.vertexStride ||
+      h.vertexSize != h.vertexCount * h.vertexStride ||
+      h.indexCount > h.indexSize / indexSize ||
+      h.indexSize != h.indexCount * indexSize)
+    return false;
+  if (h.vertexOffset > mappingSize || h.vertexSize > mappingSize - h.vertexOffset ||
+      h.indexOffset > mappingSize || h.indexSize > mappingSize - h.indexOffset ||
+      h.chunkOffset % sizeof(uint64_t) || h.chunkOffset > mappingSize ||
+      h.chunkCount > (mappingSize - h.chunkOffset) / sizeof(MeshFileChunk))
+    return false;
+
+  for (uint32_t i = 0; i < h.attributeCount; ++i)
+  {
+    const MeshFileAttribute &a = h.attributes[i];
+    uint32_t size = meshFileTypeSize(a.type);
+    if (!memchr(a.name, '\0', sizeof(a.name)) || !size || !a.components ||
+        a.components > 4 || a.offset > h.vertexStride ||
+        a.components * size > h.vertexStride - a.offset)
+      return false;
+  }
+  for (uint32_t i = 0; i < h.chunkCount; ++i)
+  {
+    const MeshFileChunk &c = getChunk(i);
+    if (c.firstIndex > h.indexCount || c.indexCount > h.indexCount - c.firstIndex ||
+        c.baseVertex > h.vertexCount ||
+        c.vertexCount > h.vertexCount - c.baseVertex)
+      return false;
+  }
+  return true;
+}
+
+const MeshFileAttribute *MeshFileReader::findAttribute(const char *name) const
+{
+  for (uint32_t i = 0; i < header.attributeCount; ++i)
+    if (!strcmp(header.attributes[i].name, name))
+      return &header.attributes[i];
+  return nullptr;
+}
+
+void MeshFileReader::prefetch() const
+{
+  if (!mapping)
+    return;
+#ifdef _WIN32
+  WIN32_MEMORY_RANGE_ENTRY range;
+  range.VirtualAddress = (PVOID)mapping;
+  range.NumberOfBytes = size_t(mappingSize);
+  PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+  madvise((void *)mapping, size_t(mappingSize), MADV_WILLNEED);
+#endif
+}
@@ -0,0 +1,65 @@
+/**
+ * MeshFileReader.hpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifndef OPENGL_CMAKE_SKELETON_MESHFILEREADER_HPP
+#define OPENGL_CMAKE_SKELETON_MESHFILEREADER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "MeshFile.hpp"
+
+// Read-only view of a baked mesh file (MeshFile.hpp) through a memory
+// mapping.
+//
+// open() maps the file and checks the header against it, the streams aren't
+// copied or converted: getVertices() and getIndices() point into the mapping
+// and go to glBufferData as they are. prefetch() asks the OS to read the
+// whole file in at once, so that the upload doesn't fault it in page by page.
+// The mapping only has to outlive the upload.
+
+class MeshFileReader
+{
+public:
+    MeshFileReader();
+    ~MeshFileReader();
+
+    bool open(const std::string &path);
+    void close();
+    bool isOpen() const { return mapping != nullptr; }
+
+    const MeshFileHeader &getHeader() const { return header; }
+    const MeshFileAttribute *findAttribute(const char *name) const;
+    const MeshFileChunk &getChunk(size_t i) const
+    {
+        return reinterpret_cast<const MeshFileChunk *>(
+            mapping + header.chunkOffset)[i];
+    }
+    const void *getVertices() const { return mapping + header.vertexOffset; }
+    const void *getIndices() const { return mapping + header.indexOffset; }
+
+    void prefetch() const;
+
+private:
+    MeshFileReader(const MeshFileReader &);
+    MeshFileReader &operator=(const MeshFileReader &);
+
+    bool map(const std::string &path);
+    bool validate() const;
+
+    const unsigned char *mapping = nullptr;
+    uint64_t mappingSize = 0;
+#ifdef _WIN32
+    void *fileHandle = nullptr;
+    void *mappingHandle = nullptr;
+#endif
+    MeshFileHeader header;
+};
+
+#endif // OPENGL_CMAKE_SKELETON_MESHFILEREADER_HPP
@@ -0,0 +1,230 @@
+/**
+ * MeshOptimizer.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifdef WIN32
+#pragma warning(disable : 4464 4820 4514 5045 4201 5039 4061 4710)
+#endif
+
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+static const size_t NONE = size_t(-1);
+
+VertexCacheStats analyzeVertexCache(const uint32_t *indices, size_t indexCount,
+                                    size_t vertexCount, unsigned cacheSize)
+{
+  // FIFO: a vertex is cached while fewer than cacheSize misses followed its
+  // own
+  vector<size_t> insertedAt(vertexCount, NONE);
+  size_t misses = 0, used = 0;
+  for (size_t i = 0; i < indexCount; ++i)
+  {
+    uint32_t v = indices[i];
+    if (insertedAt[v] == NONE)
+      ++used;
+    if (insertedAt[v] == NONE || misses - insertedAt[v] > cacheSize - 1)
+    {
+      insertedAt[v] = misses;
+      ++misses;
+    }
+  }
+
+  VertexCacheStats stats;
+  stats.acmr = indexCount ? float(misses) / float(indexCount / 3) : 0.0f;
+  stats.atvr = used ? float(misses) / float(used) : 0.0f;
+  return stats;
+}
+
+// Forsyth's scoring: the three vertices of the last triangle score a fixed
+// 0.75 so that the next triangle doesn't just rotate them, older cache entries
+// score less the older they are, and vertices with few triangles left score
+// more so that they are finished off instead of left behind
+static const int CACHE_SIZE = 32;
+static const float CACHE_DECAY_POWER = 1.5f;
+static const float LAST_TRIANGLE_SCORE = 0.75f;
+static const float VALENCE_BOOST_SCALE = 2.0f;
+static const float VALENCE_BOOST_POWER = 0.5f;
+static const unsigned VALENCE_TABLE = 32;
+
+struct ForsythScores
+{
+  float cache[CACHE_SIZE];
+  float valence[VALENCE_TABLE];
+
+  ForsythScores()
+  {
+    for (int i = 0; i < CACHE_SIZE; ++i)
+      cache[i] = i < 3 ? LAST_TRIANGLE_SCORE
+                       : pow(1.0f - float(i - 3) / float(CACHE_SIZE - 3),
+                             CACHE_DECAY_POWER);
+    valence[0] = 0.0f;
+    for (unsigned i = 1; i < VALENCE_TABLE; ++i)
+      valence[i] = VALENCE_BOOST_SCALE * pow(float(i), -VALENCE_BOOST_POWER);
+  }
+
+  float vertex(int cachePosition, unsigned remaining) const
+  {
+    if (remaining == 0)
+      return -1.0f; // nothing left to draw with it
+    float score = cachePosition < 0 ? 0.0f : cache[cachePosition];
+    return score + valence[min(remaining, VALENCE_TABLE - 1)];
+  }
+};
+
+void optimizeVertexCache(const uint32_t *indices, size_t indexCount,
+                         size_t vertexCount, uint32_t *out)
+{
+  static const ForsythScores scores;
+  size_t triangleCount = indexCount / 3;
+
+  // the triangles of each vertex, the first remaining[v] of them not drawn
+  vector<uint32_t> remaining(vertexCount, 0);
+  for (size_t i = 0; i < triangleCount * 3; ++i)
+    ++remaining[indices[i]];
+  vector<size_t> firstTriangle(vertexCount + 1, 0);
+  for (size_t v = 0; v < vertexCount; ++v)
+    firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+  vector<uint32_t> triangles(triangleCount * 3);
+  {
+    vector<size_t> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; ++i)
+      triangles[filled[indices[i]]++] = uint32_t(i / 3);
+  }
+
+  vector<int> cachePosition(vertexCount, -1);
+  vector<float> vertexScore(vertexCount);
+  for (size_t v = 0; v < vertexCount; ++v)
+    vertexScore[v] = scores.vertex(-1, remaining[v]);
+  vector<char> drawn(triangleCount, 0);
+
+  uint32_t cache[CACHE_SIZE + 3], next[CACHE_SIZE + 3];
+  int cached = 0;
+  size_t cursor = 0; // no triangle before it is left
+  size_t best = NONE;
+  for (size_t emitted = 0; emitted < triangleCount; ++emitted)
+  {
+    if (best == NONE)
+    {
+      // nothing in the cache connects, carry on in the original order
+      while (drawn[cursor])
+        ++cursor;
+      best = cursor;
+    }
+
+    const uint32_t *triangle = indices + best * 3;
+    memcpy(out + emitted * 3, triangle, 3 * sizeof(uint32_t));
+    drawn[best] = 1;
+
+    // the triangle's vertices go to the front, the rest of the cache follows
+    int nextCount = 0;
+    for (int k = 0; k < 3; ++k)
+    {
+      uint32_t v = triangle[k];
+      uint32_t *list = &triangles[firstTriangle[v]];
+      uint32_t *last = list + remaining[v] - 1;
+      *find(list, last, uint32_t(best)) = *last;
+      *last = uint32_t(best);
+      --remaining[v];
+      if (find(next, next + nextCount, v) == next + nextCount)
+        next[nextCount++] = v;
+    }
+    for (int i = 0; i < cached; ++i)
+      if (find(next, next + nextCount, cache[i]) == next + nextCount)
+        next[nextCount++] = cache[i];
+
+    // rescore the vertices that moved or fell out, then their triangles
+    for (int i = 0; i < nextCount; ++i)
+    {
+      uint32_t v = next[i];
+      cachePosition[v] = i < CACHE_SIZE ? i : -1;
+      vertexScore[v] = scores.vertex(cachePosition[v], remaining[v]);
+    }
+    best = NONE;
+    float bestScore = -1.0f;
+    for (int i = 0; i < nextCount; ++i)
+    {
+      uint32_t v = next[i];
+      const uint32_t *list = &triangles[firstTriangle[v]];
+      for (uint32_t j = 0; j < remaining[v]; ++j)
+      {
+        uint32_t t = list[j];
+        float score = vertexScore[indices[t * 3]] +
+                      vertexScore[indices[t * 3 + 1]] +
+                      vertexScore[indices[t * 3 + 2]];
+        if (score > bestScore)
+        {
+          bestScore = score;
+          best = t;
+        }
+      }
+    }
+
+    cached = min(nextCount, CACHE_SIZE);
+    memcpy(cache, next, size_t(cached) * sizeof(uint32_t));
+  }
+}
+
+void splitMesh(const uint32_t *indices, size_t indexCount, size_t vertexCount,
+               size_t maxVertices, ChunkedMesh &mesh)
+{
+  maxVertices = max<size_t>(3, min(maxVertices, MAX_CHUNK_VERTICES));
+  mesh.remap.clear();
+  mesh.indices.clear();
+  mesh.chunks.clear();
+  mesh.indices.reserve(indexCount);
+
+  // the chunk that last numbered each vertex, and its number there
+  vector<size_t> owner(vertexCount, NONE);
+  vector<uint16_t> local(vertexCount);
+  MeshChunk chunk = {0, 0, 0, 0};
+  for (size_t i = 0; i + 3 <= indexCount; i += 3)
+  {
+    size_t fresh = 0;
+    for (int k = 0; k < 3; ++k)
+      fresh += owner[indices[i + k]] != mesh.chunks.size() &&
+               find(indices + i, indices + i + k, indices[i + k]) ==
+                   indices + i + k;
+    if (chunk.vertexCount + fresh > maxVertices)
+    {
+      mesh.chunks.push_back(chunk);
+      chunk.firstIndex = mesh.indices.size();
+      chunk.indexCount = 0;
+      chunk.baseVertex = mesh.remap.size();
+      chunk.vertexCount = 0;
+    }
+
+    for (int k = 0; k < 3; ++k)
+    {
+      uint32_t v = indices[i + k];
+      if (owner[v] != mesh.chunks.size())
+      {
+        owner[v] = mesh.chunks.size();
+        local[v] = uint16_t(chunk.vertexCount++);
+        mesh.remap.push_back(v);
+      }
+      mesh.indices.push_back(local[v]);
+    }
+    chunk.indexCount += 3;
+  }
+  if (chunk.indexCount)
+    mesh.chunks.push_back(chunk);
+}
+
+void remapVertices(void *dst, const void *src, size_t stride,
+                   const uint32_t *remap, size_t count)
+{
+  char *out = static_cast<char *>(dst);
+  const char *in = static_cast<const char *>(src);
+  for (size_t i = 0; i < count; ++i)
+    memcpy(out + i * stride, in + size_t(remap[i]) * stride, stride);
+}
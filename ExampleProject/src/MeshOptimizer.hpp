@@ -0,0 +1,70 @@
+/**
+ * MeshOptimizer.hpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifndef OPENGL_CMAKE_SKELETON_MESHOPTIMIZER_HPP
+#define OPENGL_CMAKE_SKELETON_MESHOPTIMIZER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Reorders an indexed triangle list for the GPU's vertex caches.
+//
+// optimizeVertexCache() reorders the triangles so that consecutive ones share
+// vertices while those are still in the post-transform cache (Forsyth's
+// linear-speed algorithm with a 32-entry LRU model). splitMesh() then cuts
+// the triangles, in that order, into chunks of at most 65535 vertices. It
+// numbers each chunk's vertices in the order the triangles first use them,
+// which is also the order that makes vertex fetch sequential, so each chunk
+// draws with 16-bit indices from its own base vertex. Every view repeats the
+// same draw, so what is saved here is saved once per view.
+//
+// GL free; SampleScene uploads the result.
+
+static const size_t MAX_CHUNK_VERTICES = 65535;
+
+// how well an index order uses a FIFO post-transform cache
+struct VertexCacheStats
+{
+    float acmr; // vertices transformed per triangle, 0.5 at best on a grid
+    float atvr; // vertices transformed per vertex used, 1 at best
+};
+
+VertexCacheStats analyzeVertexCache(const uint32_t *indices, size_t indexCount,
+                                    size_t vertexCount, unsigned cacheSize);
+
+// writes the triangles of indices to out in cache friendly order; out may not
+// be indices
+void optimizeVertexCache(const uint32_t *indices, size_t indexCount,
+                         size_t vertexCount, uint32_t *out);
+
+struct MeshChunk
+{
+    size_t firstIndex;  // in ChunkedMesh::indices
+    size_t indexCount;
+    size_t baseVertex;  // the chunk's first vertex in the remapped vertices
+    size_t vertexCount;
+};
+
+struct ChunkedMesh
+{
+    std::vector<uint32_t> remap;   // vertex i of the chunks is vertex remap[i]
+    std::vector<uint16_t> indices; // relative to the chunk's baseVertex
+    std::vector<MeshChunk> chunks;
+};
+
+// splits the triangles, in order, into chunks of at most maxVertices vertices;
+// a vertex used by several chunks is repeated in each
+void splitMesh(const uint32_t *indices, size_t indexCount, size_t vertexCount,
+               size_t maxVertices, ChunkedMesh &mesh);
+
+// dst[i] = src[remap[i]] for vertices of stride bytes
+void remapVertices(void *dst, const void *src, size_t stride,
+                   const uint32_t *remap, size_t count);
+
+#endif // OPENGL_CMAKE_SKELETON_MESHOPTIMIZER_HPP
@@ -0,0 +1,219 @@
+/**
+ * QuiltChain.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifdef WIN32
+#pragma warning(disable : 4464 4820 4514 5045 4201 5039 4061 4710)
+#endif
+
+#include "QuiltChain.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+QuiltChain::QuiltChain() {}
+
+QuiltChain::~QuiltChain()
+{
+  // the textures belong to the GL context, release() is called while it's
+  // still current
+}
+
+size_t QuiltChain::getBytesPerQuilt() const
+{
+  // drivers usually store GL_RGB8 with 4 bytes per pixel
+  size_t bytesPerPixel = internalFormat == GL_RGB565 ? 2 : 4;
+  return size_t(width) * size_t(height) * bytesPerPixel;
+}
+
+size_t QuiltChain::getDepthBytes() const
+{
+  // GL_DEPTH_COMPONENT24 is stored in 4 bytes
+  return depthKind == QuiltDepth::None ? 0 : size_t(width) * size_t(height) * 4;
+}
+
+bool QuiltChain::create(int w, int h, const QuiltChainSettings &settings)
+{
+  release();
+  width = w;
+  height = h;
+  internalFormat = GL_RGB8;
+  depthKind = settings.depth;
+
+  int count = max(settings.bufferCount, 1);
+  bool fits = true;
+  if (settings.memoryBudgetBytes)
+  {
+    // try the 16-bit format before giving up quilts
+    size_t budget = settings.memoryBudgetBytes;
+    budget -= min(budget, getDepthBytes()); // one for all quilts
+    if (getBytesPerQuilt() * size_t(count) > budget &&
+        settings.allowCompactFormat)
+    {
+      // GL_RGB565 is only a required colour-renderable format from GL 4.1
+      if (GLEW_VERSION_4_1 || GLEW_ARB_ES2_compatibility)
+      {
+        internalFormat = GL_RGB565;
+        cout << "[Info] quilts don't fit in "
+             << (settings.memoryBudgetBytes >> 20)
+             << " MiB, using 16-bit colour" << endl;
+      }
+      else
+        cout << "[Info] 16-bit quilts aren't renderable on this context, "
+                "keeping GL_RGB8"
+             << endl;
+    }
+    while (count > 1 && getBytesPerQuilt() * size_t(count) > budget)
+      count--;
+    fits = getBytesPerQuilt() <= budget;
+    if (!fits)
+      cout << "[Error] a single quilt of " << (getBytesPerQuilt() >> 20)
+           << " MiB is over the " << (settings.memoryBudgetBytes >> 20)
+           << " MiB budget" << endl;
+    else if (count < settings.bufferCount)
+      cout << "[Info] memory budget allows " << count << " of "
+           << settings.bufferCount << " quilts" << endl;
+  }
+
+  // the depth shared by all quilts
+  if (depthKind == QuiltDepth::Renderbuffer)
+  {
+    glGenRenderbuffers(1, &depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  }
+  else if (depthKind == QuiltDepth::Texture)
+  {
+    glGenTextures(1, &depth);
+    glBindTexture(GL_TEXTURE_2D, depth);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0,
+                 GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+    // sampled per texel by the passes reading it, never filtered across views
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+  }
+
+  targets.resize(size_t(count));
+  for (size_t i = 0; i < targets.size(); ++i)
+  {
+    Target &target = targets[i];
+    target.rendered = 0;
+    target.interlaced = 0;
+    target.valid = false;
+
+    glGenTextures(1, &target.texture);
+    glBindTexture(GL_TEXTURE_2D, target.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GLint(internalFormat), width, height, 0,
+                 GL_RGB, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // bind the quilt texture as the color attachment of its framebuffer
+    glGenFramebuffers(1, &target.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           target.texture, 0);
+    if (depthKind == QuiltDepth::Renderbuffer)
+      glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                GL_RENDERBUFFER, depth);
+    else if (depthKind == QuiltDepth::Texture)
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
+                             depth, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+      cout << "[Error] quilt framebuffer " << i << " is incomplete" << endl;
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  frame = 0;
+  renderIndex = 0;
+  presentIndex = 0;
+  cout << "[Info] " << targets.size() << " quilt(s) of " << width << "x"
+       << height << (depthKind == QuiltDepth::None ? "" : " with depth") << ", "
+       << (getTotalBytes() >> 20) << " MiB" << endl;
+  return fits;
+}
+
+void QuiltChain::release()
+{
+  for (size_t i = 0; i < targets.size(); ++i)
+  {
+    if (targets[i].rendered)
+      glDeleteSync(targets[i].rendered);
+    if (targets[i].interlaced)
+      glDeleteSync(targets[i].interlaced);
+    glDeleteFramebuffers(1, &targets[i].fbo);
+    glDeleteTextures(1, &targets[i].texture);
+  }
+  targets.clear();
+  if (depth && depthKind == QuiltDepth::Renderbuffer)
+    glDeleteRenderbuffers(1, &depth);
+  else if (depth)
+    glDeleteTextures(1, &depth);
+  depth = 0;
+}
+
+// queue the dependency on the GPU, the CPU never waits. In this single
+// context the commands already run in order, the wait only matters once
+// another context renders or presents the quilts
+void QuiltChain::waitAndDelete(GLsync &fence)
+{
+  if (!fence)
+    return;
+  glWaitSync(fence, 0, GL_TIMEOUT_IGNORED);
+  glDeleteSync(fence);
+  fence = 0;
+}
+
+GLuint QuiltChain::beginFrame()
+{
+  renderIndex = size_t(frame % targets.size());
+  Target &target = targets[renderIndex];
+
+  // the light-field pass of an earlier frame may still sample this quilt
+  waitAndDelete(target.interlaced);
+  target.valid = false;
+  return target.fbo;
+}
+
+void QuiltChain::endRender()
+{
+  Target &target = targets[renderIndex];
+  if (target.rendered)
+    glDeleteSync(target.rendered);
+  target.rendered = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  target.valid = true;
+}
+
+GLuint QuiltChain::acquirePresentTexture()
+{
+  // the quilt the next frame renders into is the oldest complete one
+  presentIndex = size_t((frame + 1) % targets.size());
+  if (!targets[presentIndex].valid)
+    presentIndex = renderIndex; // warming up
+  Target &target = targets[presentIndex];
+  waitAndDelete(target.rendered);
+  return target.texture;
+}
+
+void QuiltChain::endPresent()
+{
+  Target &target = targets[presentIndex];
+  if (target.interlaced)
+    glDeleteSync(target.interlaced);
+  target.interlaced = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  frame++;
+}
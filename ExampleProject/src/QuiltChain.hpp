@@ -0,0 +1,134 @@
+/**
+ * QuiltChain.hpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifndef OPENGL_CMAKE_SKELETON_QUILTCHAIN_HPP
+#define OPENGL_CMAKE_SKELETON_QUILTCHAIN_HPP
+
+#include <GL/glew.h>
+#include <cstddef>
+#include <vector>
+
+// Ring of quilt textures and framebuffers.
+//
+// With a single quilt the views of a frame are rendered into the texture that
+// the light-field pass samples right after. With N quilts frame f renders into
+// quilt f % N and the light-field pass shows the quilt rendered N - 1 frames
+// earlier. Every quilt carries two fences: one after its views are rendered,
+// waited on before interlacing it, and one after it's interlaced, waited on
+// before the quilt is rendered into again. Both are GPU-side waits
+// (glWaitSync), the CPU doesn't block on them.
+//
+// Everything runs in one context, whose commands the GPU executes in order:
+// rendering a quilt never overlaps interlacing another, and the fences only
+// restate that order. They are the hand-off a renderer on a second, shared
+// context would need; until there is one, more than one quilt brings no
+// overlap, only a frame of latency and a full quilt of memory (256 MiB for the
+// 8K preset, as drivers usually pad GL_RGB8 to 4 bytes per pixel) per extra
+// quilt, and no measurement has shown a gain. The default stays at one.
+// A memory budget can cap the count: over budget the chain first switches to
+// GL_RGB565 if allowed and renderable (GL 4.1 or ARB_ES2_compatibility), then
+// drops quilts.
+//
+// The quilts share one depth attachment of the quilt's size: frames render
+// one after the other on the GPU and each view clears its own rectangle of it
+// first, so one is enough. Without it the depth test enabled for the views
+// does nothing, every fragment of every layer is shaded and early-Z never
+// rejects anything. As a texture the depth can be sampled by later passes,
+// and holds the per-view depth of the newest rendered quilt.
+//
+// All calls are made on the render thread with the GL context current.
+
+enum class QuiltDepth
+{
+    None,          // colour only
+    Renderbuffer,  // depth test and early-Z
+    Texture        // the same, and the depth can be sampled afterwards
+};
+
+struct QuiltChainSettings
+{
+    int bufferCount = 1;          // more adds latency, see above
+    size_t memoryBudgetBytes = 0; // 0 for no limit
+    bool allowCompactFormat = false; // GL_RGB565 instead of GL_RGB8 to fit,
+                                     // where it's renderable
+    QuiltDepth depth = QuiltDepth::Renderbuffer;
+};
+
+class QuiltChain
+{
+public:
+    QuiltChain();
+    ~QuiltChain();
+
+    // (re)creates the quilts, returns false if even one quilt is over budget
+    // in which case a single quilt is created anyway
+    bool create(int width, int height, const QuiltChainSettings &settings);
+    void release();
+
+    // makes the GPU wait until the quilt of the new frame is no longer being
+    // interlaced, and returns its framebuffer
+    GLuint beginFrame();
+
+    // after the views of the frame are rendered
+    void endRender();
+
+    // the quilt the light-field pass should sample this frame: the one
+    // rendered bufferCount - 1 frames ago, or the newest while warming up.
+    // The GPU waits for its views before it's sampled.
+    GLuint acquirePresentTexture();
+
+    // after the light-field pass has sampled the present texture
+    void endPresent();
+
+    int getBufferCount() const { return int(targets.size()); }
+    GLenum getInternalFormat() const { return internalFormat; }
+    size_t getBytesPerQuilt() const;
+    size_t getDepthBytes() const;
+    size_t getTotalBytes() const
+    {
+        return getBytesPerQuilt() * targets.size() + getDepthBytes();
+    }
+
+    bool hasDepth() const { return depthKind != QuiltDepth::None; }
+    // the shared depth texture, 0 unless created with QuiltDepth::Texture
+    GLuint getDepthTexture() const
+    {
+        return depthKind == QuiltDepth::Texture ? depth : 0;
+    }
+
+    // the quilt being rendered this frame
+    GLuint getRenderTexture() const { return targets[renderIndex].texture; }
+    GLuint getRenderFramebuffer() const { return targets[renderIndex].fbo; }
+
+private:
+    QuiltChain(const QuiltChain &);
+    QuiltChain &operator=(const QuiltChain &);
+
+    struct Target
+    {
+        GLuint texture;
+        GLuint fbo;
+        GLsync rendered;    // views drawn, waited on before interlacing
+        GLsync interlaced;  // light-field pass done, waited on before rendering
+        bool valid;         // holds a complete quilt
+    };
+
+    static void waitAndDelete(GLsync &fence);
+
+    std::vector<Target> targets;
+    QuiltDepth depthKind = QuiltDepth::None;
+    GLuint depth = 0;       // renderbuffer or texture, per depthKind
+    int width = 0;
+    int height = 0;
+    GLenum internalFormat = GL_RGB8;
+    unsigned long long frame = 0;
+    size_t renderIndex = 0;
+    size_t presentIndex = 0;
+};
+
+#endif // OPENGL_CMAKE_SKELETON_QUILTCHAIN_HPP
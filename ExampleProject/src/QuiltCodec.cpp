@@ -0,0 +1,303 @@
+/**
+ * QuiltCodec.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifdef WIN32
+#pragma warning(disable : 4464 4820 4514 5045 4201 5039 4061 4710)
+#endif
+
+#include "QuiltCodec.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+// LZ block layout
+static const size_t MIN_MATCH = 4;
+static const size_t LAST_LITERALS = 5;   // the block always ends on literals
+static const size_t MATCH_LIMIT = 12;    // no match starts this close to the end
+static const size_t MAX_OFFSET = 65535;
+static const int HASH_BITS = 14;
+
+// pixels are RGB, the delta is taken against the previous pixel
+static const size_t DELTA_STRIDE = 3;
+
+static inline uint32_t read32(const unsigned char *p)
+{
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+static inline uint64_t read64(const unsigned char *p)
+{
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+static inline void write32(unsigned char *p, uint32_t v)
+{
+  memcpy(p, &v, 4);
+}
+
+static inline uint32_t hash4(uint32_t v)
+{
+  return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// length continuation bytes: 255 until the rest is below 255
+static inline void writeLength(vector<unsigned char> &out, size_t length)
+{
+  while (length >= 255)
+  {
+    out.push_back(255);
+    length -= 255;
+  }
+  out.push_back((unsigned char)length);
+}
+
+static void writeSequence(vector<unsigned char> &out, const unsigned char *literals,
+                          size_t literalCount, size_t offset, size_t matchLength)
+{
+  unsigned char token =
+      (unsigned char)(min(literalCount, size_t(15)) << 4);
+  if (matchLength)
+    token |= (unsigned char)min(matchLength - MIN_MATCH, size_t(15));
+  out.push_back(token);
+  if (literalCount >= 15)
+    writeLength(out, literalCount - 15);
+  out.insert(out.end(), literals, literals + literalCount);
+  if (!matchLength)
+    return;
+  out.push_back((unsigned char)(offset & 0xff));
+  out.push_back((unsigned char)(offset >> 8));
+  if (matchLength - MIN_MATCH >= 15)
+    writeLength(out, matchLength - MIN_MATCH - 15);
+}
+
+// greedy LZ77 over one block, appended to out
+static void compressBlock(const unsigned char *src, size_t size,
+                          vector<unsigned char> &out, vector<uint32_t> &table)
+{
+  fill(table.begin(), table.end(), 0u);
+  size_t anchor = 0, pos = 0;
+  if (size > MATCH_LIMIT)
+  {
+    size_t limit = size - MATCH_LIMIT;
+    while (pos < limit)
+    {
+      uint32_t sequence = read32(src + pos);
+      uint32_t h = hash4(sequence);
+      // positions are stored + 1 so 0 means empty
+      size_t candidate = table[h];
+      table[h] = uint32_t(pos + 1);
+      if (!candidate || pos - (candidate - 1) > MAX_OFFSET ||
+          read32(src + candidate - 1) != sequence)
+      {
+        // step faster through data that doesn't match, like noise
+        pos += 1 + ((pos - anchor) >> 6);
+        continue;
+      }
+      candidate--;
+
+      size_t length = MIN_MATCH;
+      size_t maxLength = size - LAST_LITERALS - pos;
+      while (length + 8 <= maxLength &&
+             read64(src + candidate + length) == read64(src + pos + length))
+        length += 8;
+      while (length < maxLength && src[candidate + length] == src[pos + length])
+        length++;
+
+      writeSequence(out, src + anchor, pos - anchor, pos - candidate, length);
+      pos += length;
+      anchor = pos;
+    }
+  }
+  writeSequence(out, src + anchor, size - anchor, 0, 0);
+}
+
+// false if the block doesn't decode to exactly size bytes
+static bool decompressBlock(const unsigned char *src, size_t srcSize,
+                            unsigned char *dst, size_t size)
+{
+  const unsigned char *in = src, *inEnd = src + srcSize;
+  size_t out = 0;
+  while (in < inEnd)
+  {
+    unsigned char token = *in++;
+
+    size_t literals = token >> 4;
+    if (literals == 15)
+    {
+      unsigned char b;
+      do
+      {
+        if (in >= inEnd)
+          return false;
+        b = *in++;
+        literals += b;
+      } while (b == 255);
+    }
+    if (size_t(inEnd - in) < literals || size - out < literals)
+      return false;
+    memcpy(dst + out, in, literals);
+    in += literals;
+    out += literals;
+
+    // the last sequence has no match
+    if (in == inEnd)
+      break;
+
+    if (inEnd - in < 2)
+      return false;
+    size_t offset = size_t(in[0]) | (size_t(in[1]) << 8);
+    in += 2;
+    size_t length = (token & 15u);
+    if (length == 15)
+    {
+      unsigned char b;
+      do
+      {
+        if (in >= inEnd)
+          return false;
+        b = *in++;
+        length += b;
+      } while (b == 255);
+    }
+    length += MIN_MATCH;
+    if (!offset || offset > out || size - out < length)
+      return false;
+
+    // an overlapping match repeats the last offset bytes: copy them once,
+    // then double the copied run, which always starts on the pattern
+    const unsigned char *match = dst + out - offset;
+    if (offset >= length)
+      memcpy(dst + out, match, length);
+    else
+    {
+      memcpy(dst + out, match, offset);
+      size_t copied = offset;
+      while (copied < length)
+      {
+        size_t n = min(copied, length - copied);
+        memcpy(dst + out + copied, dst + out, n);
+        copied += n;
+      }
+    }
+    out += length;
+  }
+  return out == size;
+}
+
+static void deltaEncode(const unsigned char *src, size_t size, unsigned char *dst)
+{
+  size_t head = min(size, DELTA_STRIDE);
+  memcpy(dst, src, head);
+  for (size_t i = head; i < size; ++i)
+    dst[i] = (unsigned char)(src[i] - src[i - DELTA_STRIDE]);
+}
+
+static void deltaDecode(unsigned char *data, size_t size)
+{
+  for (size_t i = DELTA_STRIDE; i < size; ++i)
+    data[i] = (unsigned char)(data[i] + data[i - DELTA_STRIDE]);
+}
+
+size_t quiltEncode(const unsigned char *pixels, size_t size,
+                   vector<unsigned char> &out)
+{
+  size_t start = out.size();
+  uint32_t blocks = uint32_t((size + QUILT_CODEC_BLOCK - 1) / QUILT_CODEC_BLOCK);
+  size_t sizesAt = start + 8;
+  out.resize(sizesAt + 4 * size_t(blocks));
+  write32(&out[start], blocks);
+  write32(&out[start + 4], QUILT_CODEC_BLOCK);
+
+  vector<unsigned char> delta(min(size, size_t(QUILT_CODEC_BLOCK)));
+  vector<uint32_t> table(size_t(1) << HASH_BITS);
+  for (uint32_t b = 0; b < blocks; ++b)
+  {
+    size_t offset = size_t(b) * QUILT_CODEC_BLOCK;
+    size_t length = min(size - offset, size_t(QUILT_CODEC_BLOCK));
+    deltaEncode(pixels + offset, length, delta.data());
+
+    size_t blockStart = out.size();
+    compressBlock(delta.data(), length, out, table);
+    size_t encoded = out.size() - blockStart;
+    if (encoded >= length)
+    {
+      // incompressible, keep the pixels as they are
+      out.resize(blockStart);
+      out.insert(out.end(), pixels + offset, pixels + offset + length);
+      encoded = 0;
+    }
+    write32(&out[sizesAt + 4 * size_t(b)], uint32_t(encoded));
+  }
+  return out.size() - start;
+}
+
+uint32_t quiltEncodedBlocks(const unsigned char *encoded, size_t encodedSize)
+{
+  if (encodedSize < 8)
+    return 0;
+  uint32_t blocks = read32(encoded);
+  if (encodedSize < 8 + 4 * size_t(blocks))
+    return 0;
+  return blocks;
+}
+
+bool quiltDecodeBlocks(const unsigned char *encoded, size_t encodedSize,
+                       uint32_t first, uint32_t last, unsigned char *raw,
+                       size_t rawSize)
+{
+  uint32_t blocks = quiltEncodedBlocks(encoded, encodedSize);
+  uint32_t blockSize = encodedSize >= 8 ? read32(encoded + 4) : 0;
+  if (!blocks || !blockSize || last > blocks || first > last ||
+      (rawSize + blockSize - 1) / blockSize != blocks)
+    return false;
+
+  // skip to the first block
+  size_t at = 8 + 4 * size_t(blocks);
+  for (uint32_t b = 0; b < first; ++b)
+  {
+    uint32_t stored = read32(encoded + 8 + 4 * size_t(b));
+    size_t length = min(rawSize - size_t(b) * blockSize, size_t(blockSize));
+    at += stored ? stored : length;
+  }
+  if (at > encodedSize)
+    return false;
+
+  for (uint32_t b = first; b < last; ++b)
+  {
+    uint32_t stored = read32(encoded + 8 + 4 * size_t(b));
+    size_t offset = size_t(b) * blockSize;
+    size_t length = min(rawSize - offset, size_t(blockSize));
+    size_t inBlock = stored ? stored : length;
+    if (encodedSize - at < inBlock)
+      return false;
+    if (!stored)
+      memcpy(raw + offset, encoded + at, length);
+    else
+    {
+      if (!decompressBlock(encoded + at, stored, raw + offset, length))
+        return false;
+      deltaDecode(raw + offset, length);
+    }
+    at += inBlock;
+  }
+  return true;
+}
+
+bool quiltDecode(const unsigned char *encoded, size_t encodedSize,
+                 unsigned char *raw, size_t rawSize)
+{
+  return quiltDecodeBlocks(encoded, encodedSize, 0,
+                           quiltEncodedBlocks(encoded, encodedSize), raw,
+                           rawSize);
+}
@@ -0,0 +1,50 @@
+/**
+ * QuiltCodec.hpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifndef OPENGL_CMAKE_SKELETON_QUILTCODEC_HPP
+#define OPENGL_CMAKE_SKELETON_QUILTCODEC_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Lossless codec for quilt frames (QUILT_CODEC_DELTA_LZ in QuiltFile.hpp).
+//
+// A frame is cut into independent blocks of QUILT_CODEC_BLOCK bytes so they
+// can be decoded in parallel and straight into a mapped buffer. Each block
+// goes through a byte delta against the same channel of the previous pixel,
+// which turns smooth gradients and the flat background between views into
+// runs of small values, then through a greedy LZ77 coder in the LZ4 block
+// layout (64 KiB window, 4-byte minimum match).
+//
+// Encoded frame:
+//   uint32_t blockCount
+//   uint32_t blockSize                  raw bytes per block, the last is shorter
+//   uint32_t encodedSize[blockCount]    0 stores the block raw
+//   blocks, back to back
+
+static const uint32_t QUILT_CODEC_BLOCK = 1 << 20;
+
+// appends the encoded frame to out, returns its size
+size_t quiltEncode(const unsigned char *pixels, size_t size,
+                   std::vector<unsigned char> &out);
+
+// number of blocks of an encoded frame, 0 if it is malformed
+uint32_t quiltEncodedBlocks(const unsigned char *encoded, size_t encodedSize);
+
+// decodes blocks [first, last) into raw, which holds the whole frame of
+// rawSize bytes; false if the data is malformed
+bool quiltDecodeBlocks(const unsigned char *encoded, size_t encodedSize,
+                       uint32_t first, uint32_t last, unsigned char *raw,
+                       size_t rawSize);
+
+// decodes every block
+bool quiltDecode(const unsigned char *encoded, size_t encodedSize,
+                 unsigned char *raw, size_t rawSize);
+
+#endif // OPENGL_CMAKE_SKELETON_QUILTCODEC_HPP
@@ -0,0 +1,109 @@
+/**
+ * QuiltFile.hpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifndef OPENGL_CMAKE_SKELETON_QUILTFILE_HPP
+#define OPENGL_CMAKE_SKELETON_QUILTFILE_HPP
+
+#include <cstdint>
+
+// On-disk layout of quilt files (.hpq), one quilt or a sequence of them.
+//
+//   QuiltFileHeader            at 0, padded to QUILT_FILE_PAGE
+//   metadata                   UTF-8 JSON (layout, calibration), page aligned
+//   per frame:
+//     QuiltChunkHeader         the QUILT_CHUNK_HEADER bytes before the payload
+//     payload                  page aligned, raw pixels or QuiltCodec blocks
+//   QuiltIndexEntry[frameCount] at header.indexOffset
+//
+// Payloads start on a page so a mapping of the file can be handed to GL
+// as is. A file whose recording was cut short has no index (indexOffset 0);
+// its chunks can still be found by walking the chunk headers: the next one
+// always ends on the first page boundary after the previous payload, see
+// quiltNextChunk().
+//
+// All fields are little-endian.
+
+static const char QUILT_FILE_MAGIC[8] = {'H', 'P', 'Q', 'U', 'I', 'L', 'T', '1'};
+static const uint32_t QUILT_FILE_VERSION = 1;
+static const uint32_t QUILT_FILE_PAGE = 4096;
+static const uint32_t QUILT_CHUNK_MAGIC = 0x4d525146; // "FQRM"
+static const uint32_t QUILT_CHUNK_HEADER = 64;
+
+enum QuiltPixelFormat
+{
+    QUILT_PIXELS_RGB8 = 1 // 3 bytes per pixel, rows bottom to top as GL reads
+};
+
+enum QuiltCodecId
+{
+    QUILT_CODEC_RAW = 0,
+    QUILT_CODEC_DELTA_LZ = 1 // see QuiltCodec.hpp
+};
+
+struct QuiltFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;    // sizeof(QuiltFileHeader)
+    uint32_t width;         // quilt size in pixels
+    uint32_t height;
+    uint32_t columns;       // tile layout, as in setupQuiltSettings()
+    uint32_t rows;
+    uint32_t totalViews;
+    uint32_t pixelFormat;   // QuiltPixelFormat
+    float aspect;           // aspect ratio of a view, 0 if unknown
+    uint32_t reserved0;
+    uint64_t frameCount;    // frames in the index
+    uint64_t indexOffset;   // 0 while recording
+    uint64_t metadataOffset;
+    uint64_t metadataSize;
+    double frameRate;       // frames per second over the recording, 0 for a still
+    uint8_t reserved[40];
+};
+
+struct QuiltChunkHeader
+{
+    uint32_t magic;         // QUILT_CHUNK_MAGIC
+    uint32_t codec;         // QuiltCodecId
+    uint64_t frame;         // frame number at capture
+    double timestamp;       // seconds since the first frame
+    uint64_t storedSize;    // payload bytes in the file
+    uint64_t rawSize;       // width * height * 3
+    uint8_t reserved[24];
+};
+
+struct QuiltIndexEntry
+{
+    uint64_t payloadOffset; // page aligned
+    uint64_t storedSize;
+    uint64_t rawSize;
+    uint64_t frame;
+    double timestamp;
+    uint32_t codec;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(QuiltFileHeader) == 128, "QuiltFileHeader layout");
+static_assert(sizeof(QuiltChunkHeader) == QUILT_CHUNK_HEADER,
+              "QuiltChunkHeader layout");
+static_assert(sizeof(QuiltIndexEntry) == 48, "QuiltIndexEntry layout");
+
+// first page-aligned offset at or after offset
+inline uint64_t quiltFileAlign(uint64_t offset)
+{
+    return (offset + QUILT_FILE_PAGE - 1) / QUILT_FILE_PAGE * QUILT_FILE_PAGE;
+}
+
+// offset of the chunk header following a payload
+inline uint64_t quiltNextChunk(uint64_t payloadOffset, uint64_t storedSize)
+{
+    return quiltFileAlign(payloadOffset + storedSize + QUILT_CHUNK_HEADER) -
+           QUILT_CHUNK_HEADER;
+}
+
+#endif // OPENGL_CMAKE_SKELETON_QUILTFILE_HPP
@@ -0,0 +1,260 @@
+/**
+ * QuiltFileReader.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifdef WIN32
+#pragma warning(disable : 4464 4820 4514 5045 4201 5039 4061 4710)
+#endif
+
+#include "QuiltFileReader.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "QuiltCodec.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+QuiltFileReader::QuiltFileReader()
+{
+  header = QuiltFileHeader();
+}
+
+QuiltFileReader::~QuiltFileReader()
+{
+  close();
+}
+
+bool QuiltFileReader::open(const string &path)
+{
+  close();
+  if (!map(path))
+  {
+    cout << "[Error] could not map " << path << endl;
+    return false;
+  }
+
+  if (mappingSize < sizeof(QuiltFileHeader))
+  {
+    cout << "[Error] " << path << " is not a quilt file" << endl;
+    close();
+    return false;
+  }
+  memcpy(&header, mapping, sizeof(header));
+  size_t frameSize = getFrameSize();
+  if (memcmp(header.magic, QUILT_FILE_MAGIC, sizeof(header.magic)) ||
+      header.version != QUILT_FILE_VERSION ||
+      header.pixelFormat != QUILT_PIXELS_RGB8 || !frameSize ||
+      !header.columns || !header.rows || !header.totalViews ||
+      header.metadataOffset > mappingSize ||
+      header.metadataSize > mappingSize - header.metadataOffset)
+  {
+    cout << "[Error] " << path << " is not a quilt file this build can read"
+         << endl;
+    close();
+    return false;
+  }
+
+  if (!loadIndex())
+  {
+    rebuildIndex();
+    recovered = true;
+    cout << "[Info] " << path << " has no index, found " << index.size()
+         << " frames from the chunk headers" << endl;
+  }
+  if (index.empty())
+  {
+    cout << "[Error] " << path << " holds no frames" << endl;
+    close();
+    return false;
+  }
+  return true;
+}
+
+void QuiltFileReader::close()
+{
+  index.clear();
+  recovered = false;
+  if (!mapping)
+    return;
+#ifdef _WIN32
+  UnmapViewOfFile(mapping);
+  CloseHandle(mappingHandle);
+  CloseHandle(fileHandle);
+  mappingHandle = nullptr;
+  fileHandle = nullptr;
+#else
+  munmap((void *)mapping, size_t(mappingSize));
+#endif
+  mapping = nullptr;
+  mappingSize = 0;
+}
+
+bool QuiltFileReader::map(const string &path)
+{
+#ifdef _WIN32
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+  LARGE_INTEGER size;
+  HANDLE view = NULL;
+  if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+    view = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  void *data = view ? MapViewOfFile(view, FILE_MAP_READ, 0, 0, 0) : NULL;
+  if (!data)
+  {
+    if (view)
+      CloseHandle(view);
+    CloseHandle(file);
+    return false;
+  }
+  fileHandle = file;
+  mappingHandle = view;
+  mappingSize = uint64_t(size.QuadPart);
+#else
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  void *data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+    data = mmap(NULL, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED)
+    return false;
+  mappingSize = uint64_t(st.st_size);
+#endif
+  mapping = static_cast<const unsigned char *>(data);
+  return true;
+}
+
+// the index written by QuiltRecorder::close(), false if there is none or it
+// doesn't match the file
+bool QuiltFileReader::loadIndex()
+{
+  uint64_t count = header.frameCount;
+  if (!header.indexOffset || header.indexOffset > mappingSize ||
+      count > (mappingSize - header.indexOffset) / sizeof(QuiltIndexEntry))
+    return false;
+  index.resize(size_t(count));
+  memcpy(index.data(), mapping + header.indexOffset,
+         index.size() * sizeof(QuiltIndexEntry));
+  for (size_t i = 0; i < index.size(); ++i)
+  {
+    const QuiltIndexEntry &e = index[i];
+    if (e.payloadOffset > mappingSize ||
+        e.storedSize > mappingSize - e.payloadOffset ||
+        e.rawSize != getFrameSize() ||
+        (e.codec != QUILT_CODEC_RAW && e.codec != QUILT_CODEC_DELTA_LZ) ||
+        (e.codec == QUILT_CODEC_RAW && e.storedSize != e.rawSize))
+    {
+      index.clear();
+      return false;
+    }
+  }
+  return true;
+}
+
+// walks the chunks from the metadata on, up to the first incomplete one
+void QuiltFileReader::rebuildIndex()
+{
+  index.clear();
+  uint64_t at = quiltNextChunk(header.metadataOffset, header.metadataSize);
+  while (at + QUILT_CHUNK_HEADER <= mappingSize)
+  {
+    QuiltChunkHeader chunk;
+    memcpy(&chunk, mapping + at, sizeof(chunk));
+    uint64_t payload = at + QUILT_CHUNK_HEADER;
+    if (chunk.magic != QUILT_CHUNK_MAGIC || chunk.rawSize != getFrameSize() ||
+        chunk.storedSize > mappingSize - payload ||
+        (chunk.codec != QUILT_CODEC_RAW && chunk.codec != QUILT_CODEC_DELTA_LZ))
+      break;
+
+    QuiltIndexEntry entry = QuiltIndexEntry();
+    entry.payloadOffset = payload;
+    entry.storedSize = chunk.storedSize;
+    entry.rawSize = chunk.rawSize;
+    entry.frame = chunk.frame;
+    entry.timestamp = chunk.timestamp;
+    entry.codec = chunk.codec;
+    index.push_back(entry);
+    at = quiltNextChunk(payload, chunk.storedSize);
+  }
+}
+
+string QuiltFileReader::getMetadata() const
+{
+  if (!mapping)
+    return string();
+  const char *data =
+      reinterpret_cast<const char *>(mapping + header.metadataOffset);
+  return string(data, data + header.metadataSize);
+}
+
+size_t QuiltFileReader::getFrameSize() const
+{
+  return size_t(header.width) * size_t(header.height) * 3;
+}
+
+double QuiltFileReader::getDuration() const
+{
+  return index.empty() ? 0.0 : index.back().timestamp;
+}
+
+size_t QuiltFileReader::findFrame(double t) const
+{
+  size_t lo = 0, hi = index.size();
+  while (hi - lo > 1)
+  {
+    size_t mid = (lo + hi) / 2;
+    if (index[mid].timestamp <= t)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+void QuiltFileReader::prefetch(size_t i) const
+{
+  if (i >= index.size())
+    return;
+#ifdef _WIN32
+  WIN32_MEMORY_RANGE_ENTRY range;
+  range.VirtualAddress = (PVOID)getPayload(i);
+  range.NumberOfBytes = size_t(index[i].storedSize);
+  PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+  // payloads start on a page, as madvise() needs
+  madvise((void *)getPayload(i), size_t(index[i].storedSize), MADV_WILLNEED);
+#endif
+}
+
+bool QuiltFileReader::readFrame(size_t i, unsigned char *dst) const
+{
+  if (i >= index.size())
+    return false;
+  const QuiltIndexEntry &e = index[i];
+  if (e.codec == QUILT_CODEC_RAW)
+  {
+    memcpy(dst, getPayload(i), size_t(e.rawSize));
+    return true;
+  }
+  return quiltDecode(getPayload(i), size_t(e.storedSize), dst,
+                     size_t(e.rawSize));
+}
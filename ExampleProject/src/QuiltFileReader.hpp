@@ -0,0 +1,82 @@
+/**
+ * QuiltFileReader.hpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifndef OPENGL_CMAKE_SKELETON_QUILTFILEREADER_HPP
+#define OPENGL_CMAKE_SKELETON_QUILTFILEREADER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "QuiltFile.hpp"
+
+// Read-only view of a quilt file (QuiltFile.hpp) through a memory mapping.
+//
+// open() only maps the file and checks the header and index, nothing is read
+// until a frame is used, so opening is as fast for a 10 GB sequence as for a
+// single quilt. Payloads are used in place: raw frames are copied straight
+// from the mapping and compressed ones decoded from it. A file whose
+// recording was cut short gets its index rebuilt from the chunk headers.
+//
+// The reader is not modified after open(), so any number of threads may read
+// frames at once.
+
+class QuiltFileReader
+{
+public:
+    QuiltFileReader();
+    ~QuiltFileReader();
+
+    bool open(const std::string &path);
+    void close();
+    bool isOpen() const { return mapping != nullptr; }
+
+    const QuiltFileHeader &getHeader() const { return header; }
+    std::string getMetadata() const;
+    size_t getFrameCount() const { return index.size(); }
+    size_t getFrameSize() const;   // raw bytes, width * height * 3
+    double getDuration() const;    // timestamp of the last frame
+    bool wasRecovered() const { return recovered; }
+
+    const QuiltIndexEntry &getFrame(size_t i) const { return index[i]; }
+    const unsigned char *getPayload(size_t i) const
+    {
+        return mapping + index[i].payloadOffset;
+    }
+
+    // last frame at or before t seconds
+    size_t findFrame(double t) const;
+
+    // asks the OS to start reading frame i in, so it's resident when used
+    void prefetch(size_t i) const;
+
+    // copies or decodes frame i into dst (getFrameSize() bytes), false if
+    // the payload is malformed
+    bool readFrame(size_t i, unsigned char *dst) const;
+
+private:
+    QuiltFileReader(const QuiltFileReader &);
+    QuiltFileReader &operator=(const QuiltFileReader &);
+
+    bool map(const std::string &path);
+    bool loadIndex();
+    void rebuildIndex();
+
+    const unsigned char *mapping = nullptr;
+    uint64_t mappingSize = 0;
+#ifdef _WIN32
+    void *fileHandle = nullptr;
+    void *mappingHandle = nullptr;
+#endif
+    QuiltFileHeader header;
+    std::vector<QuiltIndexEntry> index;
+    bool recovered = false;
+};
+
+#endif // OPENGL_CMAKE_SKELETON_QUILTFILEREADER_HPP
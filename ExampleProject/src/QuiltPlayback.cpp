@@ -0,0 +1,399 @@
+/**
+ * QuiltPlayback.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifdef WIN32
+#pragma warning(disable : 4464 4820 4514 5045 4201 5039 4061 4710)
+#endif
+
+#include "QuiltPlayback.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include "glError.hpp"
+
+using namespace std;
+
+QuiltPlayback::QuiltPlayback()
+{
+  stats = QuiltPlaybackStats();
+}
+
+QuiltPlayback::~QuiltPlayback()
+{
+  release();
+}
+
+bool QuiltPlayback::open(const string &path,
+                         const QuiltPlaybackSettings &playbackSettings)
+{
+  release();
+  if (!reader.open(path))
+    return false;
+  settings = playbackSettings;
+  settings.decodeThreads = max(settings.decodeThreads, 1);
+  settings.slots = max(settings.slots, 2);
+
+  // the last frame is shown for one frame interval before the loop wraps
+  double duration = reader.getDuration();
+  double rate = reader.getHeader().frameRate;
+  double interval =
+      rate > 0 ? 1.0 / rate : duration / double(reader.getFrameCount());
+  loopPeriod = duration > 0 ? duration + interval : 0;
+  if (loopPeriod <= 0)
+    settings.loop = false; // a still quilt, decode it once
+
+  // slots start on a page so the copies out of the mapping stay aligned
+  slotSize = (reader.getFrameSize() + 4095) / 4096 * 4096;
+  size_t total = slotSize * size_t(settings.slots);
+  glGenBuffers(1, &pbo);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+  persistent = GLEW_ARB_buffer_storage;
+  if (persistent)
+  {
+    GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, GLsizeiptr(total), NULL, flags);
+    mapped = static_cast<unsigned char *>(
+        glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, GLsizeiptr(total), flags));
+    persistent = mapped != nullptr;
+    if (!persistent)
+    {
+      // immutable storage can't be respecified, start over with a plain buffer
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      glDeleteBuffers(1, &pbo);
+      glGenBuffers(1, &pbo);
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    }
+  }
+  if (!persistent)
+  {
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, GLsizeiptr(slotSize), NULL,
+                 GL_STREAM_DRAW);
+    staging.resize(total);
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  glCheckError(__FILE__, __LINE__);
+
+  unsigned char *base = persistent ? mapped : staging.data();
+  slots.resize(size_t(settings.slots));
+  for (size_t i = 0; i < slots.size(); ++i)
+  {
+    slots[i].state = SlotState::Free;
+    slots[i].sequence = 0;
+    slots[i].pixels = base + i * slotSize;
+    slots[i].fence = NULL;
+  }
+
+  stopping = false;
+  nextToDecode = 0;
+  due = 0;
+  started = false;
+  shown = -1;
+  stats = QuiltPlaybackStats();
+  decodeMsTotal = 0;
+  queueDepthTotal = 0;
+  uploadCalls = 0;
+  opened = Clock::now();
+  for (int i = 0; i < settings.decodeThreads; ++i)
+    decoders.push_back(thread(&QuiltPlayback::decodeLoop, this));
+
+  const QuiltFileHeader &header = reader.getHeader();
+  cout << "[Info] playing " << path << ": " << reader.getFrameCount() << " "
+       << header.width << "x" << header.height << " quilts ("
+       << header.columns << "x" << header.rows << ", " << header.totalViews
+       << " views) over " << reader.getDuration() << " s, "
+       << settings.decodeThreads << " decode threads, " << settings.slots
+       << " slots (" << (total >> 20) << " MiB"
+       << (persistent ? "" : ", without persistent mapping") << ")" << endl;
+  return true;
+}
+
+void QuiltPlayback::release()
+{
+  {
+    lock_guard<mutex> lock(slotMutex);
+    stopping = true;
+  }
+  slotFreed.notify_all();
+  for (size_t i = 0; i < decoders.size(); ++i)
+    decoders[i].join();
+  decoders.clear();
+
+  for (size_t i = 0; i < slots.size(); ++i)
+    if (slots[i].fence)
+      glDeleteSync(slots[i].fence);
+  slots.clear();
+  if (pbo)
+  {
+    if (mapped)
+    {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &pbo);
+  }
+  pbo = 0;
+  mapped = nullptr;
+  staging.clear();
+  started = false;
+  shown = -1;
+  textureSequences.clear();
+  reader.close();
+}
+
+size_t QuiltPlayback::fileFrame(uint64_t sequence) const
+{
+  return size_t(sequence % reader.getFrameCount());
+}
+
+// the frame number, across loops, shown t seconds into playback
+uint64_t QuiltPlayback::sequenceDue(double t) const
+{
+  if (!settings.loop)
+    return reader.findFrame(t);
+  double loops = floor(t / loopPeriod);
+  return uint64_t(loops) * reader.getFrameCount() +
+         reader.findFrame(t - loops * loopPeriod);
+}
+
+bool QuiltPlayback::canDecode() const
+{
+  if (!settings.loop && nextToDecode >= reader.getFrameCount())
+    return false;
+  for (size_t i = 0; i < slots.size(); ++i)
+    if (slots[i].state == SlotState::Free)
+      return true;
+  return false;
+}
+
+void QuiltPlayback::decodeLoop()
+{
+  for (;;)
+  {
+    Slot *slot = NULL;
+    uint64_t sequence;
+    {
+      unique_lock<mutex> lock(slotMutex);
+      slotFreed.wait(lock, [this] { return stopping || canDecode(); });
+      if (stopping)
+        return;
+      // frames the clock has already passed would only be dropped
+      if (nextToDecode < due)
+      {
+        stats.skipped += due - nextToDecode;
+        nextToDecode = due;
+      }
+      for (size_t i = 0; !slot; ++i)
+        if (slots[i].state == SlotState::Free)
+          slot = &slots[i];
+      slot->state = SlotState::Decoding;
+      sequence = nextToDecode++;
+      slot->sequence = sequence;
+    }
+
+    // page the following frame in while this one is decoded
+    reader.prefetch(fileFrame(sequence + 1));
+    Clock::time_point start = Clock::now();
+    bool ok = reader.readFrame(fileFrame(sequence), slot->pixels);
+    double ms = chrono::duration<double, milli>(Clock::now() - start).count();
+
+    {
+      lock_guard<mutex> lock(slotMutex);
+      if (ok)
+      {
+        slot->state = SlotState::Ready;
+        stats.decoded++;
+        decodeMsTotal += ms;
+      }
+      else
+      {
+        slot->state = SlotState::Free;
+        stats.skipped++;
+      }
+    }
+    if (!ok)
+    {
+      cout << "[Error] could not decode quilt " << fileFrame(sequence)
+           << " of the file" << endl;
+      slotFreed.notify_one();
+    }
+    frameDecoded.notify_all();
+  }
+}
+
+// gives back the slots the GPU has finished reading
+void QuiltPlayback::recycleSlots()
+{
+  bool freed = false;
+  {
+    lock_guard<mutex> lock(slotMutex);
+    for (size_t i = 0; i < slots.size(); ++i)
+    {
+      Slot &slot = slots[i];
+      if (slot.state != SlotState::Retired)
+        continue;
+      if (glClientWaitSync(slot.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+        continue;
+      glDeleteSync(slot.fence);
+      slot.fence = NULL;
+      slot.state = SlotState::Free;
+      freed = true;
+    }
+  }
+  if (freed)
+    slotFreed.notify_all();
+}
+
+bool QuiltPlayback::uploadFrame(GLuint texture, double now)
+{
+  if (!reader.isOpen())
+    return false;
+  recycleSlots();
+
+  bool freed = false;
+  {
+    unique_lock<mutex> lock(slotMutex);
+    if (!started)
+    {
+      // start on a picture rather than a blank quilt
+      bool ready = frameDecoded.wait_for(lock, chrono::seconds(5), [this] {
+        for (size_t i = 0; i < slots.size(); ++i)
+          if (slots[i].state == SlotState::Ready)
+            return true;
+        return false;
+      });
+      if (!ready)
+        return false;
+      startTime = now;
+      started = true;
+    }
+
+    uint64_t target = sequenceDue(now - startTime);
+    due = target;
+
+    // the newest decoded frame that is due
+    int best = -1;
+    for (size_t i = 0; i < slots.size(); ++i)
+      if (slots[i].state == SlotState::Ready && slots[i].sequence <= target &&
+          (best < 0 || slots[i].sequence > slots[size_t(best)].sequence))
+        best = int(i);
+    if (best >= 0 && (shown < 0 || slots[size_t(best)].sequence >
+                                       slots[size_t(shown)].sequence))
+    {
+      if (shown >= 0)
+      {
+        Slot &old = slots[size_t(shown)];
+        old.state = old.fence ? SlotState::Retired : SlotState::Free;
+        freed = true;
+      }
+      shown = best;
+      slots[size_t(shown)].state = SlotState::Shown;
+      stats.presented++;
+    }
+    if (shown < 0)
+      return false;
+    uint64_t shownSequence = slots[size_t(shown)].sequence;
+    if (shownSequence < target)
+      stats.late++;
+
+    // decoded frames the clock overtook, or that finished after a newer one
+    int queued = 0;
+    for (size_t i = 0; i < slots.size(); ++i)
+    {
+      if (slots[i].state != SlotState::Ready)
+        continue;
+      if (slots[i].sequence <= shownSequence)
+      {
+        slots[i].state = SlotState::Free;
+        stats.dropped++;
+        freed = true;
+      }
+      else
+        queued++;
+    }
+    stats.queueDepth = queued;
+    queueDepthTotal += queued;
+    uploadCalls++;
+  }
+  if (freed)
+    slotFreed.notify_all();
+
+  // the shown slot belongs to the render thread, no lock needed
+  Slot &slot = slots[size_t(shown)];
+  map<GLuint, uint64_t>::iterator held = textureSequences.find(texture);
+  if (held == textureSequences.end() || held->second != slot.sequence)
+  {
+    upload(slot, texture);
+    textureSequences[texture] = slot.sequence;
+  }
+  return true;
+}
+
+void QuiltPlayback::upload(Slot &slot, GLuint texture)
+{
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+  size_t offset = 0;
+  if (persistent)
+    offset = size_t(slot.pixels - mapped);
+  else
+  {
+    // orphan the previous upload and copy the slot in
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, GLsizeiptr(slotSize), NULL,
+                 GL_STREAM_DRAW);
+    void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0,
+                                 GLsizeiptr(slotSize),
+                                 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!dst)
+    {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      return;
+    }
+    memcpy(dst, slot.pixels, reader.getFrameSize());
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+  }
+
+  const QuiltFileHeader &header = reader.getHeader();
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, GLsizei(header.width),
+                  GLsizei(header.height), GL_RGB, GL_UNSIGNED_BYTE,
+                  reinterpret_cast<const void *>(offset));
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  // the slot is reused once the GPU has read it; fences signal in order, so
+  // the last upload's covers the earlier ones
+  if (persistent)
+  {
+    if (slot.fence)
+      glDeleteSync(slot.fence);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+  glCheckError(__FILE__, __LINE__);
+}
+
+size_t QuiltPlayback::getCurrentFrame() const
+{
+  return shown >= 0 ? fileFrame(slots[size_t(shown)].sequence) : 0;
+}
+
+QuiltPlaybackStats QuiltPlayback::getStats() const
+{
+  lock_guard<mutex> lock(slotMutex);
+  QuiltPlaybackStats s = stats;
+  double elapsed = chrono::duration<double>(Clock::now() - opened).count();
+  s.decodeFps = elapsed > 0 ? double(s.decoded) / elapsed : 0;
+  s.averageDecodeMs = s.decoded ? decodeMsTotal / double(s.decoded) : 0;
+  s.averageQueueDepth = uploadCalls ? queueDepthTotal / double(uploadCalls) : 0;
+  return s;
+}
@@ -0,0 +1,156 @@
+/**
+ * QuiltPlayback.hpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifndef OPENGL_CMAKE_SKELETON_QUILTPLAYBACK_HPP
+#define OPENGL_CMAKE_SKELETON_QUILTPLAYBACK_HPP
+
+#include <GL/glew.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "QuiltFileReader.hpp"
+
+// Plays the quilts of a quilt file (QuiltFile.hpp) in place of rendered views.
+//
+// The file is memory-mapped by QuiltFileReader. Decode threads run ahead of
+// the presentation clock and copy or decode frames from the mapping straight
+// into the slots of a persistently mapped pixel unpack buffer; the render
+// thread only issues the glTexSubImage2D of the slot due, which the driver
+// can run as a DMA from the buffer. The slots bound how far the decoders get
+// ahead: a slot is given back once the GPU is done reading it, found through
+// a fence the render thread polls without waiting. Without GL 4.4 /
+// ARB_buffer_storage the slots are ordinary memory, copied into a buffer
+// mapped for each upload.
+//
+// Frames are presented by their recorded timestamps on a clock that starts
+// when the first frame is ready. Every uploadFrame() shows the newest decoded
+// frame that is due: decoded frames overtaken by the clock are dropped, and
+// the previous frame is repeated when the one due isn't decoded yet (a late
+// frame). When decoding falls behind the clock, the decoders skip ahead to
+// the frame due rather than decode frames that would only be dropped.
+//
+// Sequences loop by default; frames are numbered across loops so a loop is
+// just more frames to the decoders.
+//
+// All calls are made on the render thread with the GL context current.
+
+struct QuiltPlaybackSettings
+{
+    bool loop = true;
+    int decodeThreads = 2;
+    int slots = 4;     // decoded frames held, including the one shown
+};
+
+struct QuiltPlaybackStats
+{
+    uint64_t decoded;         // frames decoded
+    uint64_t presented;       // distinct frames shown
+    uint64_t late;            // uploads that repeated a frame, the due one not ready
+    uint64_t dropped;         // decoded frames the clock overtook before showing
+    uint64_t skipped;         // frames not decoded because decoding was behind
+    double decodeFps;         // frames decoded per second of playback
+    double averageDecodeMs;   // per frame, on one thread
+    double averageQueueDepth; // decoded frames waiting, sampled per upload
+    int queueDepth;           // decoded frames waiting now
+};
+
+class QuiltPlayback
+{
+public:
+    QuiltPlayback();
+    ~QuiltPlayback();
+
+    // maps the file, creates the slots and starts decoding
+    bool open(const std::string &path, const QuiltPlaybackSettings &settings);
+    void release();
+
+    const QuiltFileReader &getReader() const { return reader; }
+
+    // fills texture, of the file's size, with the frame due at now (seconds
+    // on any clock). The first call waits for the first frame to be decoded.
+    // Returns false if no frame could be shown.
+    bool uploadFrame(GLuint texture, double now);
+
+    // file frame shown by the last uploadFrame()
+    size_t getCurrentFrame() const;
+
+    QuiltPlaybackStats getStats() const;
+
+private:
+    QuiltPlayback(const QuiltPlayback &);
+    QuiltPlayback &operator=(const QuiltPlayback &);
+
+    enum class SlotState
+    {
+        Free,      // may be decoded into
+        Decoding,  // a decode thread is writing it
+        Ready,     // decoded, waiting for its time
+        Shown,     // the frame on screen, uploaded to textures
+        Retired    // replaced, the GPU may still read it
+    };
+
+    struct Slot
+    {
+        SlotState state;
+        uint64_t sequence;    // frame number across loops
+        unsigned char *pixels;
+        GLsync fence;         // after the last upload from it
+    };
+
+    typedef std::chrono::steady_clock Clock;
+
+    void decodeLoop();
+    uint64_t sequenceDue(double t) const;
+    size_t fileFrame(uint64_t sequence) const;
+    bool canDecode() const;   // under slotMutex
+    void recycleSlots();
+    void upload(Slot &slot, GLuint texture);
+
+    QuiltFileReader reader;
+    QuiltPlaybackSettings settings;
+    double loopPeriod = 0;    // duration plus one frame interval
+
+    // upload buffer
+    GLuint pbo = 0;
+    bool persistent = false;
+    unsigned char *mapped = nullptr;      // all slots, if persistent
+    std::vector<unsigned char> staging;   // all slots, if not
+    size_t slotSize = 0;
+
+    // slots and decoders
+    mutable std::mutex slotMutex;
+    std::condition_variable slotFreed;
+    std::condition_variable frameDecoded;
+    std::vector<Slot> slots;
+    std::vector<std::thread> decoders;
+    bool stopping = false;
+    uint64_t nextToDecode = 0;
+    uint64_t due = 0;         // published by the render thread for skipping
+
+    // presentation, render thread
+    bool started = false;
+    double startTime = 0;
+    int shown = -1;           // slot on screen
+    std::map<GLuint, uint64_t> textureSequences; // frame held by each texture
+
+    // statistics, under slotMutex
+    Clock::time_point opened;
+    QuiltPlaybackStats stats;
+    double decodeMsTotal = 0;
+    double queueDepthTotal = 0;
+    uint64_t uploadCalls = 0;
+};
+
+#endif // OPENGL_CMAKE_SKELETON_QUILTPLAYBACK_HPP
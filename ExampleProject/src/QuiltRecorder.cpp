@@ -0,0 +1,375 @@
+/**
+ * QuiltRecorder.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifdef WIN32
+#pragma warning(disable : 4464 4820 4514 5045 4201 5039 4061 4710)
+#endif
+
+#include "QuiltRecorder.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "QuiltCodec.hpp"
+
+using namespace std;
+
+QuiltRecorder::QuiltRecorder()
+{
+  stats = QuiltRecorderStats();
+}
+
+QuiltRecorder::~QuiltRecorder()
+{
+  close();
+}
+
+bool QuiltRecorder::open(const string &path,
+                         const QuiltRecordingLayout &recordingLayout,
+                         const QuiltRecorderSettings &recorderSettings)
+{
+  close();
+  layout = recordingLayout;
+  settings = recorderSettings;
+  settings.threads = max(settings.threads, 1);
+  settings.maxFramesInFlight = max(settings.maxFramesInFlight, 1);
+  frameSize = size_t(layout.width) * size_t(layout.height) * 3;
+
+  file = fopen(path.c_str(), "wb");
+  if (!file)
+  {
+    cout << "[Error] could not create " << path << endl;
+    return false;
+  }
+  // large sequential writes, the frames are megabytes each
+  setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+  // header, completed by close(), then the metadata on the next page
+  QuiltFileHeader header = QuiltFileHeader();
+  memcpy(header.magic, QUILT_FILE_MAGIC, sizeof(header.magic));
+  header.version = QUILT_FILE_VERSION;
+  header.headerSize = sizeof(QuiltFileHeader);
+  header.width = layout.width;
+  header.height = layout.height;
+  header.columns = layout.columns;
+  header.rows = layout.rows;
+  header.totalViews = layout.totalViews;
+  header.pixelFormat = QUILT_PIXELS_RGB8;
+  header.aspect = layout.aspect;
+  header.metadataOffset = QUILT_FILE_PAGE;
+  header.metadataSize = layout.metadata.size();
+  fileOffset = 0;
+  if (!writeAt(0, &header, sizeof(header)) ||
+      !writeAt(header.metadataOffset, layout.metadata.data(),
+               layout.metadata.size()))
+  {
+    cout << "[Error] could not write " << path << endl;
+    fclose(file);
+    file = nullptr;
+    return false;
+  }
+
+  index.clear();
+  stopping = false;
+  nextSequence = 0;
+  nextToWrite = 0;
+  inFlight = 0;
+  firstFrame = true;
+  stats = QuiltRecorderStats();
+  encodeMsTotal = 0;
+  droppedSinceLog = 0;
+  started = Clock::now();
+  lastDropLog = started;
+
+  for (int i = 0; i < settings.threads; ++i)
+    encoders.push_back(thread(&QuiltRecorder::encodeLoop, this));
+  writer = thread(&QuiltRecorder::writeLoop, this);
+  cout << "[Info] recording " << layout.width << "x" << layout.height
+       << " quilts to " << path << " with " << settings.threads
+       << " compression threads" << endl;
+  return true;
+}
+
+void QuiltRecorder::close()
+{
+  if (!file)
+    return;
+
+  // let the threads finish what was submitted
+  {
+    lock_guard<mutex> lock(jobMutex);
+    stopping = true;
+    stopped = Clock::now();
+  }
+  encodeReady.notify_all();
+  for (size_t i = 0; i < encoders.size(); ++i)
+    encoders[i].join();
+  encoders.clear();
+  writeReady.notify_all();
+  writer.join();
+
+  // index after the last payload, then the final header
+  QuiltFileHeader header = QuiltFileHeader();
+  memcpy(header.magic, QUILT_FILE_MAGIC, sizeof(header.magic));
+  header.version = QUILT_FILE_VERSION;
+  header.headerSize = sizeof(QuiltFileHeader);
+  header.width = layout.width;
+  header.height = layout.height;
+  header.columns = layout.columns;
+  header.rows = layout.rows;
+  header.totalViews = layout.totalViews;
+  header.pixelFormat = QUILT_PIXELS_RGB8;
+  header.aspect = layout.aspect;
+  header.metadataOffset = QUILT_FILE_PAGE;
+  header.metadataSize = layout.metadata.size();
+  header.frameCount = index.size();
+  header.indexOffset = quiltFileAlign(fileOffset);
+  if (index.size() > 1 && index.back().timestamp > 0)
+    header.frameRate = double(index.size() - 1) / index.back().timestamp;
+
+  bool ok = writeAt(header.indexOffset, index.data(),
+                    index.size() * sizeof(QuiltIndexEntry));
+  ok = ok && fseek(file, 0, SEEK_SET) == 0 &&
+       fwrite(&header, sizeof(header), 1, file) == 1;
+  ok = (fclose(file) == 0) && ok;
+  file = nullptr;
+  if (!ok)
+    cout << "[Error] could not finish the quilt recording" << endl;
+
+  QuiltRecorderStats s = getStats();
+  cout << "[Info] recorded " << s.written << " of " << s.submitted
+       << " quilts (" << s.dropped << " dropped, " << s.mismatched
+       << " of another size, " << s.failed << " failed to write), " << (s.storedBytes >> 20)
+       << " MiB stored for " << (s.rawBytes >> 20) << " MiB raw, "
+       << s.writtenFps << " fps written for " << s.inputFps << " fps offered"
+       << endl;
+
+  lock_guard<mutex> lock(jobMutex);
+  toEncode.clear();
+  toWrite.clear();
+  freeJobs.clear();
+}
+
+bool QuiltRecorder::submit(const unsigned char *pixels, size_t size,
+                           uint64_t frame, double captureTime)
+{
+  unique_ptr<Job> job;
+  {
+    lock_guard<mutex> lock(jobMutex);
+    if (!file || stopping)
+      return false;
+    stats.submitted++;
+    if (size != frameSize)
+    {
+      // the quilt changed size or layout, the file can't hold it
+      if (!stats.mismatched)
+        cout << "[Error] quilt of " << size << " bytes doesn't match the "
+             << layout.width << "x" << layout.height
+             << " recording, stop the recording before changing the quilt"
+             << endl;
+      stats.mismatched++;
+      return false;
+    }
+    if (inFlight >= settings.maxFramesInFlight)
+    {
+      // compression or the disk is behind, lose this frame
+      stats.dropped++;
+      droppedSinceLog++;
+      logDrops();
+      return false;
+    }
+    inFlight++;
+    if (!freeJobs.empty())
+    {
+      job = move(freeJobs.back());
+      freeJobs.pop_back();
+    }
+    if (firstFrame)
+    {
+      firstTimestamp = captureTime;
+      firstFrame = false;
+    }
+    if (!job)
+      job.reset(new Job);
+    job->sequence = nextSequence++;
+  }
+
+  // the copy is the only work done on the caller's thread
+  job->frame = frame;
+  job->timestamp = captureTime - firstTimestamp;
+  job->raw.assign(pixels, pixels + size);
+
+  {
+    lock_guard<mutex> lock(jobMutex);
+    toEncode.push_back(move(job));
+  }
+  encodeReady.notify_one();
+  return true;
+}
+
+// called with jobMutex held
+void QuiltRecorder::logDrops()
+{
+  Clock::time_point now = Clock::now();
+  if (now - lastDropLog < chrono::seconds(1))
+    return;
+  double elapsed = chrono::duration<double>(now - started).count();
+  cout << "[Info] recorder can't keep up: " << droppedSinceLog
+       << " quilts dropped, " << double(stats.written) / elapsed
+       << " fps written for " << double(stats.submitted) / elapsed
+       << " fps offered" << endl;
+  droppedSinceLog = 0;
+  lastDropLog = now;
+}
+
+void QuiltRecorder::encodeLoop()
+{
+  for (;;)
+  {
+    unique_ptr<Job> job;
+    {
+      unique_lock<mutex> lock(jobMutex);
+      encodeReady.wait(lock, [this] { return stopping || !toEncode.empty(); });
+      if (toEncode.empty())
+        return;
+      job = move(toEncode.front());
+      toEncode.pop_front();
+    }
+
+    Clock::time_point start = Clock::now();
+    job->encoded.clear();
+    job->codec = QUILT_CODEC_RAW;
+    if (settings.compress)
+    {
+      quiltEncode(job->raw.data(), job->raw.size(), job->encoded);
+      // keep raw frames raw, they can be uploaded straight from the file
+      if (job->encoded.size() < job->raw.size())
+        job->codec = QUILT_CODEC_DELTA_LZ;
+    }
+    double ms = chrono::duration<double, milli>(Clock::now() - start).count();
+
+    {
+      lock_guard<mutex> lock(jobMutex);
+      encodeMsTotal += ms;
+      uint64_t sequence = job->sequence;
+      toWrite[sequence] = move(job);
+    }
+    writeReady.notify_one();
+  }
+}
+
+void QuiltRecorder::writeLoop()
+{
+  for (;;)
+  {
+    unique_ptr<Job> job;
+    {
+      unique_lock<mutex> lock(jobMutex);
+      // frames are written in submission order, whichever thread encoded them
+      writeReady.wait(lock, [this] {
+        return (!toWrite.empty() && toWrite.begin()->first == nextToWrite) ||
+               (stopping && toEncode.empty() && inFlight == 0);
+      });
+      if (toWrite.empty() || toWrite.begin()->first != nextToWrite)
+        return;
+      job = move(toWrite.begin()->second);
+      toWrite.erase(toWrite.begin());
+    }
+
+    bool written = writeJob(*job);
+
+    {
+      lock_guard<mutex> lock(jobMutex);
+      nextToWrite++;
+      inFlight--;
+      if (written)
+      {
+        stats.written++;
+        stats.rawBytes += job->raw.size();
+        stats.storedBytes += job->codec == QUILT_CODEC_RAW
+                                 ? job->raw.size()
+                                 : job->encoded.size();
+      }
+      else
+        stats.failed++;
+      freeJobs.push_back(move(job));
+    }
+    // the stop condition depends on inFlight
+    writeReady.notify_one();
+  }
+}
+
+bool QuiltRecorder::writeJob(Job &job)
+{
+  const vector<unsigned char> &payload =
+      job.codec == QUILT_CODEC_RAW ? job.raw : job.encoded;
+
+  // the payload starts on a page, the chunk header right before it; the
+  // file ends on the metadata or on the previous payload
+  uint64_t chunkOffset = quiltNextChunk(fileOffset, 0);
+  QuiltChunkHeader chunk = QuiltChunkHeader();
+  chunk.magic = QUILT_CHUNK_MAGIC;
+  chunk.codec = job.codec;
+  chunk.frame = job.frame;
+  chunk.timestamp = job.timestamp;
+  chunk.storedSize = payload.size();
+  chunk.rawSize = job.raw.size();
+  if (!writeAt(chunkOffset, &chunk, sizeof(chunk)) ||
+      !writeAt(chunkOffset + QUILT_CHUNK_HEADER, payload.data(), payload.size()))
+  {
+    cout << "[Error] writing quilt " << job.frame << " failed" << endl;
+    return false;
+  }
+
+  QuiltIndexEntry entry = QuiltIndexEntry();
+  entry.payloadOffset = chunkOffset + QUILT_CHUNK_HEADER;
+  entry.storedSize = chunk.storedSize;
+  entry.rawSize = chunk.rawSize;
+  entry.frame = chunk.frame;
+  entry.timestamp = chunk.timestamp;
+  entry.codec = chunk.codec;
+  index.push_back(entry);
+  return true;
+}
+
+// sequential write, zero-filling any gap up to offset
+bool QuiltRecorder::writeAt(uint64_t offset, const void *data, size_t size)
+{
+  static const char zeros[QUILT_FILE_PAGE] = {};
+  while (fileOffset < offset)
+  {
+    size_t gap = size_t(min(offset - fileOffset, uint64_t(sizeof(zeros))));
+    if (fwrite(zeros, 1, gap, file) != gap)
+      return false;
+    fileOffset += gap;
+  }
+  if (size && fwrite(data, 1, size, file) != size)
+    return false;
+  fileOffset += size;
+  return true;
+}
+
+QuiltRecorderStats QuiltRecorder::getStats() const
+{
+  lock_guard<mutex> lock(jobMutex);
+  QuiltRecorderStats s = stats;
+  // rates over the recording, not the time close() spent draining it
+  Clock::time_point end = stopping ? stopped : Clock::now();
+  double elapsed = chrono::duration<double>(end - started).count();
+  if (elapsed > 0)
+  {
+    s.inputFps = double(s.submitted) / elapsed;
+    s.writtenFps = double(s.written) / elapsed;
+    s.writeMBps = double(s.storedBytes) / (1024.0 * 1024.0) / elapsed;
+  }
+  s.realtime = s.inputFps > 0 ? s.writtenFps / s.inputFps : 0;
+  uint64_t encoded = s.written + s.failed;
+  s.averageEncodeMs = encoded ? encodeMsTotal / double(encoded) : 0;
+  return s;
+}
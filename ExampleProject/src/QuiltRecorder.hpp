@@ -0,0 +1,146 @@
+/**
+ * QuiltRecorder.hpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifndef OPENGL_CMAKE_SKELETON_QUILTRECORDER_HPP
+#define OPENGL_CMAKE_SKELETON_QUILTRECORDER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "QuiltFile.hpp"
+
+// Streams a quilt sequence to a quilt file (QuiltFile.hpp).
+//
+// submit() copies the frame and returns; a pool of threads compresses frames
+// in parallel with QuiltCodec and a writer thread appends them to the file in
+// submission order, one chunk per frame, then writes the index on close().
+// At most maxFramesInFlight frames are held between submit() and the disk;
+// when compression or the disk can't keep up with the frame rate, new frames
+// are dropped and the drops are logged once per second. Frames of another
+// size than the recording's are refused with an error, not counted as drops.
+
+struct QuiltRecordingLayout
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t columns;     // qs_columns
+    uint32_t rows;        // qs_rows
+    uint32_t totalViews;  // qs_totalViews
+    float aspect;         // of a view, 0 if unknown
+    std::string metadata; // JSON stored with the file, e.g. the calibration
+};
+
+struct QuiltRecorderSettings
+{
+    int threads = 2;            // compression threads
+    int maxFramesInFlight = 8;  // frames buffered in memory
+    bool compress = true;       // false writes raw frames
+};
+
+struct QuiltRecorderStats
+{
+    uint64_t submitted;         // frames offered to submit()
+    uint64_t written;           // frames on disk
+    uint64_t dropped;           // frames refused because too many were in flight
+    uint64_t mismatched;        // frames refused because the quilt changed size
+    uint64_t failed;            // frames encoded but not written, see the log
+    uint64_t rawBytes;          // of the frames written
+    uint64_t storedBytes;
+    double inputFps;            // frames offered per second
+    double writtenFps;
+    double realtime;            // writtenFps / inputFps, 1 keeps up
+    double writeMBps;           // stored bytes per second
+    double averageEncodeMs;     // per frame, on one thread
+};
+
+class QuiltRecorder
+{
+public:
+    QuiltRecorder();
+    ~QuiltRecorder();
+
+    // creates the file and starts the threads
+    bool open(const std::string &path, const QuiltRecordingLayout &layout,
+              const QuiltRecorderSettings &settings);
+
+    // writes what is in flight, the index and the final header
+    void close();
+
+    bool isOpen() const { return file != nullptr; }
+
+    // copies width * height * 3 bytes; captureTime in seconds on any clock.
+    // Returns false if the frame was dropped. Call from one thread at a time.
+    bool submit(const unsigned char *pixels, size_t size, uint64_t frame,
+                double captureTime);
+
+    QuiltRecorderStats getStats() const;
+
+private:
+    QuiltRecorder(const QuiltRecorder &);
+    QuiltRecorder &operator=(const QuiltRecorder &);
+
+    struct Job
+    {
+        uint64_t sequence;
+        uint64_t frame;
+        double timestamp;
+        std::vector<unsigned char> raw;
+        std::vector<unsigned char> encoded;
+        uint32_t codec;
+    };
+
+    typedef std::chrono::steady_clock Clock;
+
+    void encodeLoop();
+    void writeLoop();
+    bool writeJob(Job &job);
+    bool writeAt(uint64_t offset, const void *data, size_t size);
+    void logDrops();
+
+    QuiltRecorderSettings settings;
+    QuiltRecordingLayout layout;
+    size_t frameSize = 0;
+    FILE *file = nullptr;
+    uint64_t fileOffset = 0;     // writer thread
+    std::vector<QuiltIndexEntry> index;
+
+    std::vector<std::thread> encoders;
+    std::thread writer;
+    bool stopping = false;       // under jobMutex
+
+    mutable std::mutex jobMutex;
+    std::condition_variable encodeReady;
+    std::condition_variable writeReady;
+    std::deque<std::unique_ptr<Job>> toEncode;
+    std::map<uint64_t, std::unique_ptr<Job>> toWrite; // by sequence
+    std::vector<std::unique_ptr<Job>> freeJobs;
+    uint64_t nextSequence = 0;   // given to the next submitted frame
+    uint64_t nextToWrite = 0;
+    int inFlight = 0;
+    bool firstFrame = true;
+    double firstTimestamp = 0;
+
+    // statistics, under jobMutex
+    Clock::time_point started;
+    Clock::time_point stopped;
+    QuiltRecorderStats stats;
+    double encodeMsTotal = 0;
+    uint64_t droppedSinceLog = 0;
+    Clock::time_point lastDropLog;
+};
+
+#endif // OPENGL_CMAKE_SKELETON_QUILTRECORDER_HPP
@@ -0,0 +1,523 @@
+/**
+ * QuiltRing.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifdef WIN32
+#pragma warning(disable : 4464 4820 4514 5045 4201 5039 4061 4710)
+#endif
+
+#include "QuiltRing.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+const uint32_t QUILT_RING_MAGIC = 0x51524E47; // "QRNG"
+const size_t PAGE_ALIGNMENT = 4096;
+
+size_t alignUp(size_t value, size_t alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+string shmName(const string &name)
+{
+  // POSIX shared memory names must start with a single slash
+  return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+void atomicMax(atomic<uint64_t> &target, uint64_t value)
+{
+  uint64_t previous = target.load(memory_order_relaxed);
+  while (previous < value &&
+         !target.compare_exchange_weak(previous, value, memory_order_relaxed))
+  {
+  }
+}
+} // namespace
+
+// layout of the shared-memory object:
+// [QuiltRingHeader][QuiltRingSlotHeader * slotCount] ... page aligned slots
+struct QuiltRingSlotHeader
+{
+  atomic<uint32_t> state;
+  atomic<uint64_t> sequence; // copy of info.sequence for scanning
+  QuiltRingFrameInfo info;   // written while Writing, read while Reading
+};
+
+struct QuiltRingHeader
+{
+  atomic<uint32_t> magic; // stored last by the producer
+  uint32_t version;
+  uint32_t slotCount;
+  uint32_t policy;
+  uint32_t width;
+  uint32_t height;
+  uint32_t channels;
+  uint64_t slotBytes;
+  uint64_t slotStride;
+  uint64_t dataOffset;
+
+  atomic<uint64_t> writeSequence; // sequence of the last published frame
+  atomic<uint32_t> consumerAttached;
+
+  // metrics, see QuiltRingMetrics
+  atomic<uint64_t> published;
+  atomic<uint64_t> consumed;
+  atomic<uint64_t> overwritten;
+  atomic<uint64_t> skipped;
+  atomic<uint64_t> producerStalls;
+  atomic<uint64_t> stallTimeNs;
+  atomic<uint64_t> occupancySum;
+  atomic<uint32_t> occupancyMax;
+  atomic<uint64_t> latencySumNs;
+  atomic<uint64_t> latencyMaxNs;
+};
+
+// metrics
+// =========================================================
+double QuiltRingMetrics::averageOccupancy() const
+{
+  return published ? double(occupancySum) / double(published) : 0.0;
+}
+
+double QuiltRingMetrics::averageLatencyMs() const
+{
+  return consumed ? double(latencySumNs) / double(consumed) * 1e-6 : 0.0;
+}
+
+double QuiltRingMetrics::averageStallMs() const
+{
+  return producerStalls ? double(stallTimeNs) / double(producerStalls) * 1e-6
+                        : 0.0;
+}
+
+// mapping
+// =========================================================
+QuiltRingMapping::QuiltRingMapping(const std::string &name)
+    : name(shmName(name))
+{
+#ifdef _WIN32
+  throw std::runtime_error("Quilt ring transport requires POSIX shared memory");
+#endif
+}
+
+QuiltRingMapping::~QuiltRingMapping()
+{
+#ifndef _WIN32
+  if (mapping)
+    munmap(mapping, mappingSize);
+#endif
+}
+
+uint64_t QuiltRingMapping::now()
+{
+  return uint64_t(chrono::duration_cast<chrono::nanoseconds>(
+                      chrono::steady_clock::now().time_since_epoch())
+                      .count());
+}
+
+uint32_t QuiltRingMapping::getSlotCount() const
+{
+  return header->slotCount;
+}
+
+size_t QuiltRingMapping::getSlotBytes() const
+{
+  return size_t(header->slotBytes);
+}
+
+QuiltRingMetrics QuiltRingMapping::getMetrics() const
+{
+  QuiltRingMetrics m;
+  m.published = header->published.load(memory_order_relaxed);
+  m.consumed = header->consumed.load(memory_order_relaxed);
+  m.overwritten = header->overwritten.load(memory_order_relaxed);
+  m.skipped = header->skipped.load(memory_order_relaxed);
+  m.producerStalls = header->producerStalls.load(memory_order_relaxed);
+  m.stallTimeNs = header->stallTimeNs.load(memory_order_relaxed);
+  m.occupancySum = header->occupancySum.load(memory_order_relaxed);
+  m.occupancyMax = header->occupancyMax.load(memory_order_relaxed);
+  m.latencySumNs = header->latencySumNs.load(memory_order_relaxed);
+  m.latencyMaxNs = header->latencyMaxNs.load(memory_order_relaxed);
+  return m;
+}
+
+QuiltRingSlotHeader *QuiltRingMapping::slot(uint32_t index) const
+{
+  return reinterpret_cast<QuiltRingSlotHeader *>(
+             reinterpret_cast<unsigned char *>(header) +
+             alignUp(sizeof(QuiltRingHeader), 64)) +
+         index;
+}
+
+unsigned char *QuiltRingMapping::slotData(uint32_t index) const
+{
+  return reinterpret_cast<unsigned char *>(header) + header->dataOffset +
+         header->slotStride * index;
+}
+
+uint32_t QuiltRingMapping::countReadySlots() const
+{
+  uint32_t ready = 0;
+  for (uint32_t i = 0; i < header->slotCount; ++i)
+    if (slot(i)->state.load(memory_order_relaxed) ==
+        uint32_t(QuiltSlotState::Ready))
+      ready++;
+  return ready;
+}
+
+// producer
+// =========================================================
+QuiltRingProducer::QuiltRingProducer(const std::string &name,
+                                     uint32_t slotCount,
+                                     uint32_t width,
+                                     uint32_t height,
+                                     uint32_t channels,
+                                     QuiltRingPolicy policy)
+    : QuiltRingMapping(name), policy(policy)
+{
+#ifndef _WIN32
+  if (slotCount < 2)
+    throw std::invalid_argument("A quilt ring needs at least two slots");
+
+  size_t slotBytes = size_t(width) * height * channels;
+  size_t slotStride = alignUp(slotBytes, PAGE_ALIGNMENT);
+  size_t dataOffset =
+      alignUp(alignUp(sizeof(QuiltRingHeader), 64) +
+                  sizeof(QuiltRingSlotHeader) * slotCount,
+              PAGE_ALIGNMENT);
+  mappingSize = dataOffset + slotStride * slotCount;
+
+  int fd = shm_open(this->name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0600);
+  if (fd < 0)
+    throw std::runtime_error("Couldn't create shared memory " + this->name);
+
+  if (ftruncate(fd, off_t(mappingSize)) != 0)
+  {
+    close(fd);
+    shm_unlink(this->name.c_str());
+    throw std::runtime_error("Couldn't size shared memory " + this->name);
+  }
+
+  mapping = mmap(NULL, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+  {
+    mapping = nullptr;
+    shm_unlink(this->name.c_str());
+    throw std::runtime_error("Couldn't map shared memory " + this->name);
+  }
+
+  header = new (mapping) QuiltRingHeader();
+  if (!header->writeSequence.is_lock_free() || !header->magic.is_lock_free())
+  {
+    shm_unlink(this->name.c_str());
+    throw std::runtime_error("Quilt ring needs lock-free atomics");
+  }
+
+  header->version = QUILT_RING_VERSION;
+  header->slotCount = slotCount;
+  header->policy = uint32_t(policy);
+  header->width = width;
+  header->height = height;
+  header->channels = channels;
+  header->slotBytes = slotBytes;
+  header->slotStride = slotStride;
+  header->dataOffset = dataOffset;
+  for (uint32_t i = 0; i < slotCount; ++i)
+  {
+    QuiltRingSlotHeader *s = new (slot(i)) QuiltRingSlotHeader();
+    s->state.store(uint32_t(QuiltSlotState::Free), memory_order_relaxed);
+    s->sequence.store(0, memory_order_relaxed);
+  }
+
+  // publish the initialized header to consumers
+  header->magic.store(QUILT_RING_MAGIC, memory_order_release);
+#else
+  (void)slotCount;
+  (void)width;
+  (void)height;
+  (void)channels;
+#endif
+}
+
+QuiltRingProducer::~QuiltRingProducer()
+{
+#ifndef _WIN32
+  shm_unlink(name.c_str());
+#endif
+}
+
+bool QuiltRingProducer::hasConsumer() const
+{
+  return header->consumerAttached.load(memory_order_relaxed) != 0;
+}
+
+unsigned char *QuiltRingProducer::acquire(int timeoutMs)
+{
+  if (current >= 0)
+    return slotData(uint32_t(current));
+
+  const uint32_t count = header->slotCount;
+  const uint32_t preferred = uint32_t((nextSequence - 1) % count);
+  const uint64_t start = now();
+  bool stalled = false;
+
+  for (;;)
+  {
+    // the slot after the last published one, then any free slot
+    for (uint32_t n = 0; n < count && current < 0; ++n)
+    {
+      uint32_t i = (preferred + n) % count;
+      uint32_t expected = uint32_t(QuiltSlotState::Free);
+      if (slot(i)->state.compare_exchange_strong(
+              expected, uint32_t(QuiltSlotState::Writing),
+              memory_order_acquire))
+        current = i;
+    }
+
+    // then the oldest unread frame, if we are allowed to drop it
+    if (current < 0 && policy == QuiltRingPolicy::Overwrite)
+    {
+      int64_t oldest = -1;
+      uint64_t oldestSequence = ~uint64_t(0);
+      for (uint32_t i = 0; i < count; ++i)
+      {
+        QuiltRingSlotHeader *s = slot(i);
+        if (s->state.load(memory_order_acquire) ==
+                uint32_t(QuiltSlotState::Ready) &&
+            s->sequence.load(memory_order_relaxed) < oldestSequence)
+        {
+          oldest = i;
+          oldestSequence = s->sequence.load(memory_order_relaxed);
+        }
+      }
+      uint32_t expected = uint32_t(QuiltSlotState::Ready);
+      if (oldest >= 0 &&
+          slot(uint32_t(oldest))->state.compare_exchange_strong(
+              expected, uint32_t(QuiltSlotState::Writing),
+              memory_order_acquire))
+      {
+        current = oldest;
+        header->overwritten.fetch_add(1, memory_order_relaxed);
+      }
+    }
+
+    if (current >= 0)
+      break;
+
+    stalled = true;
+    if (now() - start >= uint64_t(timeoutMs) * 1000000u)
+      break;
+    this_thread::sleep_for(chrono::microseconds(100));
+  }
+
+  const uint64_t end = now();
+  if (stalled)
+  {
+    header->producerStalls.fetch_add(1, memory_order_relaxed);
+    header->stallTimeNs.fetch_add(end - start, memory_order_relaxed);
+  }
+
+  if (current < 0)
+    return nullptr;
+
+  acquireTimeNs = end;
+  return slotData(uint32_t(current));
+}
+
+QuiltRingFrameInfo QuiltRingProducer::publish(uint32_t columns,
+                                              uint32_t rows,
+                                              uint32_t totalViews)
+{
+  if (current < 0)
+    throw std::logic_error("QuiltRingProducer::publish without acquire");
+
+  QuiltRingSlotHeader *s = slot(uint32_t(current));
+  QuiltRingFrameInfo &info = s->info;
+  info.sequence = nextSequence++;
+  info.acquireTimeNs = acquireTimeNs;
+  info.publishTimeNs = now();
+  info.width = header->width;
+  info.height = header->height;
+  info.channels = header->channels;
+  info.columns = columns;
+  info.rows = rows;
+  info.totalViews = totalViews;
+  s->sequence.store(info.sequence, memory_order_relaxed);
+
+  // the release store is the fence: pixels and info are visible before Ready
+  s->state.store(uint32_t(QuiltSlotState::Ready), memory_order_release);
+  header->writeSequence.store(info.sequence, memory_order_release);
+  current = -1;
+
+  uint32_t occupancy = countReadySlots();
+  header->published.fetch_add(1, memory_order_relaxed);
+  header->occupancySum.fetch_add(occupancy, memory_order_relaxed);
+  uint32_t previous = header->occupancyMax.load(memory_order_relaxed);
+  while (previous < occupancy &&
+         !header->occupancyMax.compare_exchange_weak(previous, occupancy,
+                                                     memory_order_relaxed))
+  {
+  }
+
+  return info;
+}
+
+void QuiltRingProducer::cancel()
+{
+  if (current < 0)
+    return;
+  slot(uint32_t(current))->state.store(uint32_t(QuiltSlotState::Free),
+                                       memory_order_release);
+  current = -1;
+}
+
+// consumer
+// =========================================================
+QuiltRingConsumer::QuiltRingConsumer(const std::string &name)
+    : QuiltRingMapping(name)
+{
+#ifndef _WIN32
+  int fd = shm_open(this->name.c_str(), O_RDWR, 0600);
+  if (fd < 0)
+    throw std::runtime_error("Couldn't open shared memory " + this->name);
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(QuiltRingHeader))
+  {
+    close(fd);
+    throw std::runtime_error("Shared memory " + this->name + " is too small");
+  }
+
+  mappingSize = size_t(st.st_size);
+  mapping = mmap(NULL, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+  {
+    mapping = nullptr;
+    throw std::runtime_error("Couldn't map shared memory " + this->name);
+  }
+
+  header = static_cast<QuiltRingHeader *>(mapping);
+  if (header->magic.load(memory_order_acquire) != QUILT_RING_MAGIC ||
+      header->version != QUILT_RING_VERSION ||
+      header->dataOffset + header->slotStride * header->slotCount > mappingSize)
+    throw std::runtime_error("Shared memory " + this->name +
+                             " is not a compatible quilt ring");
+
+  header->consumerAttached.store(1, memory_order_relaxed);
+#endif
+}
+
+QuiltRingConsumer::~QuiltRingConsumer()
+{
+  if (!header)
+    return;
+  release();
+  header->consumerAttached.store(0, memory_order_relaxed);
+}
+
+const unsigned char *QuiltRingConsumer::acquireLatest(QuiltRingFrameInfo &info)
+{
+  if (current >= 0)
+    release();
+
+  const uint32_t count = header->slotCount;
+  const bool lossless = header->policy == uint32_t(QuiltRingPolicy::Wait);
+
+  // retry if the producer overwrites the frame we picked
+  for (int attempt = 0; attempt < 4; ++attempt)
+  {
+    int64_t target = -1;
+    uint64_t targetSequence = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+      QuiltRingSlotHeader *s = slot(i);
+      if (s->state.load(memory_order_acquire) !=
+          uint32_t(QuiltSlotState::Ready))
+        continue;
+      uint64_t sequence = s->sequence.load(memory_order_relaxed);
+      if (sequence <= lastSequence)
+        continue;
+      // lossless rings are read in order, lossy ones jump to the newest frame
+      if (target < 0 || (lossless ? sequence < targetSequence
+                                  : sequence > targetSequence))
+      {
+        target = i;
+        targetSequence = sequence;
+      }
+    }
+
+    if (target < 0)
+      return nullptr;
+
+    uint32_t expected = uint32_t(QuiltSlotState::Ready);
+    QuiltRingSlotHeader *s = slot(uint32_t(target));
+    if (!s->state.compare_exchange_strong(expected,
+                                          uint32_t(QuiltSlotState::Reading),
+                                          memory_order_acquire))
+      continue;
+
+    current = target;
+    info = s->info;
+    lastSequence = info.sequence;
+
+    // release the frames we jumped over so the producer can reuse them; the
+    // sequence is checked again once we own the slot, it may have been
+    // rewritten with a newer frame in between
+    if (!lossless)
+      for (uint32_t i = 0; i < count; ++i)
+      {
+        QuiltRingSlotHeader *old = slot(i);
+        uint32_t ready = uint32_t(QuiltSlotState::Ready);
+        if (old->sequence.load(memory_order_relaxed) >= lastSequence ||
+            !old->state.compare_exchange_strong(
+                ready, uint32_t(QuiltSlotState::Reading), memory_order_acquire))
+          continue;
+        bool stale = old->sequence.load(memory_order_relaxed) < lastSequence;
+        old->state.store(uint32_t(stale ? QuiltSlotState::Free
+                                        : QuiltSlotState::Ready),
+                         memory_order_release);
+        if (stale)
+          header->skipped.fetch_add(1, memory_order_relaxed);
+      }
+
+    currentAcquireTimeNs = info.acquireTimeNs;
+    return slotData(uint32_t(current));
+  }
+  return nullptr;
+}
+
+void QuiltRingConsumer::release()
+{
+  if (current < 0)
+    return;
+
+  uint64_t latency = now() - currentAcquireTimeNs;
+  slot(uint32_t(current))->state.store(uint32_t(QuiltSlotState::Free),
+                                       memory_order_release);
+  current = -1;
+
+  header->consumed.fetch_add(1, memory_order_relaxed);
+  header->latencySumNs.fetch_add(latency, memory_order_relaxed);
+  atomicMax(header->latencyMaxNs, latency);
+}
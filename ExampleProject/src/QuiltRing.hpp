@@ -0,0 +1,169 @@
+/**
+ * QuiltRing.hpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifndef OPENGL_CMAKE_SKELETON_QUILTRING_HPP
+#define OPENGL_CMAKE_SKELETON_QUILTRING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Shared-memory transport for quilt frames.
+//
+// A producer creates a POSIX shared-memory object holding a header and a ring
+// of fixed-size quilt slots. Every slot carries its own state word (the fence)
+// and the sequence number of the frame it holds, so pixel data never goes
+// through the message pipe: only small control messages do. The consumer maps
+// the same object, always takes the newest ready frame and hands the slot back.
+//
+// Both sides only use lock-free 32 and 64 bit atomics living inside the
+// mapping, which are address-free and therefore valid across processes.
+
+// version of the layout below, bumped on every incompatible change
+const uint32_t QUILT_RING_VERSION = 1;
+
+enum class QuiltSlotState : uint32_t
+{
+    Free,    // may be taken by the producer
+    Writing, // the producer is filling it
+    Ready,   // published, waiting for the consumer
+    Reading  // the consumer is reading it
+};
+
+// what the producer does when the slot it wants still holds an unread frame
+enum class QuiltRingPolicy
+{
+    Overwrite, // drop the unread frame, a display only wants the latest one
+    Wait       // stall until the consumer catches up (lossless)
+};
+
+// description of a frame, stored next to its pixels
+struct QuiltRingFrameInfo
+{
+    uint64_t sequence;      // 1 for the first published frame
+    uint64_t acquireTimeNs; // steady clock when the producer took the slot
+    uint64_t publishTimeNs; // steady clock when the frame was published
+    uint32_t width;         // quilt width in pixels
+    uint32_t height;        // quilt height in pixels
+    uint32_t channels;      // bytes per pixel (3 for RGB)
+    uint32_t columns;       // quilt layout, see setupQuiltSettings()
+    uint32_t rows;
+    uint32_t totalViews;
+};
+
+// counters shared by both sides, readable from either process
+struct QuiltRingMetrics
+{
+    uint64_t published;      // frames published by the producer
+    uint64_t consumed;       // frames released by the consumer
+    uint64_t overwritten;    // unread frames replaced by newer ones
+    uint64_t skipped;        // ready frames the consumer jumped over
+    uint64_t producerStalls; // acquires that could not get a slot at once
+    uint64_t stallTimeNs;    // total time the producer spent stalled
+    uint64_t occupancySum;   // ready slots summed over every publish
+    uint32_t occupancyMax;   // highest number of ready slots seen
+    uint64_t latencySumNs;   // acquire -> consumer release, summed
+    uint64_t latencyMaxNs;
+
+    double averageOccupancy() const;
+    double averageLatencyMs() const;
+    double averageStallMs() const;
+};
+
+struct QuiltRingSlotHeader;
+struct QuiltRingHeader;
+
+// shared base: owns the mapping
+class QuiltRingMapping
+{
+public:
+    virtual ~QuiltRingMapping();
+
+    const std::string &getName() const { return name; }
+    uint32_t getSlotCount() const;
+    size_t getSlotBytes() const;
+    QuiltRingMetrics getMetrics() const;
+
+    // steady clock in nanoseconds, comparable between both processes
+    static uint64_t now();
+
+protected:
+    QuiltRingMapping(const std::string &name);
+
+    QuiltRingSlotHeader *slot(uint32_t index) const;
+    unsigned char *slotData(uint32_t index) const;
+    uint32_t countReadySlots() const;
+
+    std::string name;
+    void *mapping = nullptr;
+    size_t mappingSize = 0;
+    QuiltRingHeader *header = nullptr;
+
+private:
+    QuiltRingMapping(const QuiltRingMapping &);
+    QuiltRingMapping &operator=(const QuiltRingMapping &);
+};
+
+// Creates the ring and writes frames into it. Owns the shared-memory name and
+// unlinks it on destruction.
+class QuiltRingProducer : public QuiltRingMapping
+{
+public:
+    QuiltRingProducer(const std::string &name,
+                      uint32_t slotCount,
+                      uint32_t width,
+                      uint32_t height,
+                      uint32_t channels = 3,
+                      QuiltRingPolicy policy = QuiltRingPolicy::Overwrite);
+    virtual ~QuiltRingProducer();
+
+    // returns the pixel storage of the next slot, or nullptr if no slot could
+    // be taken within timeoutMs (only possible with QuiltRingPolicy::Wait or
+    // when the consumer holds the slot)
+    unsigned char *acquire(int timeoutMs = 0);
+
+    // publishes the slot taken by acquire() with the given quilt layout and
+    // returns the description stored with it
+    QuiltRingFrameInfo publish(uint32_t columns, uint32_t rows,
+                               uint32_t totalViews);
+
+    // gives back an acquired slot without publishing it
+    void cancel();
+
+    bool hasConsumer() const;
+
+private:
+    QuiltRingPolicy policy;
+    int64_t current = -1;        // slot taken by acquire(), -1 if none
+    uint64_t acquireTimeNs = 0;
+    uint64_t nextSequence = 1;
+};
+
+// Opens an existing ring and reads the newest frame from it.
+class QuiltRingConsumer : public QuiltRingMapping
+{
+public:
+    QuiltRingConsumer(const std::string &name);
+    virtual ~QuiltRingConsumer();
+
+    // takes the newest ready frame newer than the last one read, or returns
+    // nullptr if there is none. Older ready frames are released unread, except
+    // on QuiltRingPolicy::Wait rings which are read in order.
+    const unsigned char *acquireLatest(QuiltRingFrameInfo &info);
+
+    // hands the slot taken by acquireLatest() back to the producer
+    void release();
+
+private:
+    int64_t current = -1;
+    uint64_t lastSequence = 0;
+    uint64_t currentAcquireTimeNs = 0;
+};
+
+#endif // OPENGL_CMAKE_SKELETON_QUILTRING_HPP
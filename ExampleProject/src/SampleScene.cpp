@@ -13,11 +13,19 @@
 #include "SampleScene.hpp"
 
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <chrono>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/matrix_operation.hpp>
 #include <iostream>
+#include <random>
+#include <string>
+#include <thread>
 #include <vector>
 
+#include "JobSystem.hpp"
+#include "MeshFileReader.hpp"
+#include "ViewMatrices.hpp"
 #include "glError.hpp"
 
 #ifdef _DEBUG
@@ -26,100 +34,77 @@ static const bool capture_mouse = false;
 static const bool capture_mouse = true;
 #endif
 
-struct VertexType
-{
-  glm::vec3 position;
-  glm::vec3 normal;
-  glm::vec4 color;
-};
-
-float heightMap(const glm::vec2 position)
-{
-  return float(2.0 * sin(position.x) * sin(position.y));
-}
+// distance between two vertices of the terrain
+static const float TERRAIN_SPACING = 0.1f;
+// frames of animated terrain vertices the stream ring holds, as many as the
+// driver usually queues
+static const size_t STREAMED_FRAMES = 3;
+// the texture unit of the shading cache, which nothing else binds
+static const GLint SHADING_CACHE_UNIT = 4;
 
-VertexType getHeightMap(const glm::vec2 position)
+SampleScene::SampleScene()
+    : HoloPlayContext(capture_mouse), shaderProgram(NULL)
 {
-  const glm::vec2 dx(1.0, 0.0);
-  const glm::vec2 dy(0.0, 1.0);
+  glCheckError(__FILE__, __LINE__);
 
-  VertexType v;
-  float h = heightMap(position);
-  float hx = 100.f * (heightMap(position + 0.01f * dx) - h);
-  float hy = 100.f * (heightMap(position + 0.01f * dy) - h);
+  // creation of the mesh ------------------------------------------------------
+  glGenBuffers(1, &vbo);
+  glGenBuffers(1, &ibo);
+  vao = 0;
+  startTime = std::chrono::steady_clock::now();
+  buildTerrain();
+  buildProgram();
+
+  // first snapshot of the camera
+  zoom = cameraSize;
+  renderedCamera.position = cameraPos;
+  renderedCamera.front = cameraFront;
+  renderedCamera.up = cameraUp;
+  renderedCamera.size = zoom;
+  renderedCamera.debug = debug;
+  renderedCamera.time = animationTime;
+  cameraStates.reset(renderedCamera);
+}
 
-  v.position = glm::vec3(position, h);
-  v.normal = glm::normalize(glm::vec3(-hx, -hy, 1.0));
+// the lighting of the terrain and the objects
+static const char *const FRAGMENT_SHADER = R"--(
+    #version 150
 
-  float c = float(sin(h * 5.f) * 0.5 + 0.5);
-  v.color = glm::vec4(c, 1.0 - c, 1.0, 1.0);
-  return v;
-}
+    // SHADING_CACHE_PASS: ambient and diffuse into the shading cache
+    // SHADING_CACHE: ambient and diffuse read back from it, see
+    // SampleScene::setShadingCache()
 
-SampleScene::SampleScene() : HoloPlayContext(capture_mouse)
-{
-  glCheckError(__FILE__, __LINE__);
+    // output
+    out vec4 color;
 
-  // creation of the mesh ------------------------------------------------------
-  std::vector<VertexType> vertices;
-  std::vector<GLuint> index;
+    const float ambient = 0.1;
 
-  for (unsigned int y = 0; y <= size; ++y)
-    for (unsigned int x = 0; x <= size; ++x)
+    float diffuse(vec3 n, vec3 l)
     {
-      float xx = (float(x) - float(size) / 2.0f) * 0.1f;
-      float yy = (float(y) - float(size) / 2.0f) * 0.1f;
-      vertices.push_back(getHeightMap({xx, yy}));
+        return 0.7*max(0.0,dot(n,l));
     }
 
-  for (unsigned int y = 0; y < size; ++y)
-    for (unsigned int x = 0; x < size; ++x)
-    {
-      index.push_back((x + 0) + (size + 1) * (y + 0));
-      index.push_back((x + 1) + (size + 1) * (y + 0));
-      index.push_back((x + 1) + (size + 1) * (y + 1));
+  #if defined(SHADING_CACHE_PASS)
+    in vec3 fWorldPosition;
+    in vec3 fWorldNormal;
+    in vec4 fColor;
 
-      index.push_back((x + 1) + (size + 1) * (y + 1));
-      index.push_back((x + 0) + (size + 1) * (y + 1));
-      index.push_back((x + 0) + (size + 1) * (y + 0));
+    void main(void)
+    {
+        // in world space, the light is at (0, 0, 1) for every view
+        vec3 n = normalize(fWorldNormal);
+        vec3 l = normalize(vec3(0.0,0.0,1.0)-fWorldPosition);
+        color = vec4(ambient + fColor.xyz * diffuse(n,l), 1.0);
     }
-
-  std::cout << "vertices=" << vertices.size() << std::endl;
-  std::cout << "index=" << index.size() << std::endl;
-
-  // creation of the vertex array buffer----------------------------------------
-
-  // vbo
-  glGenBuffers(1, &vbo);
-  glBindBuffer(GL_ARRAY_BUFFER, vbo);
-  glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(vertices.size() * sizeof(VertexType)),
-               vertices.data(), GL_STATIC_DRAW);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-  // ibo
-  glGenBuffers(1, &ibo);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, GLsizeiptr(index.size() * sizeof(GLuint)),
-               index.data(), GL_STATIC_DRAW);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-  // vao
-  glGenVertexArrays(1, &vao);
-  glBindVertexArray(vao);
-
-  // bind vbo
-  glBindBuffer(GL_ARRAY_BUFFER, vbo);
-
-  const char *fragmentShaderSource = R"--(
-    #version 150
-
+  #else
     in vec4 fPosition;
     in vec4 fColor;
     in vec4 fLightPosition;
     in vec3 fNormal;
-
-    // output
-    out vec4 color;
+  #if defined(SHADING_CACHE)
+    in vec2 fCacheCoord;
+    uniform sampler2D shadingCache;
+  #endif
 
     void main(void)
     {       
@@ -128,92 +113,1142 @@ SampleScene::SampleScene() : HoloPlayContext(capture_mouse)
         vec3 r = reflect(o,n);
         vec3 l = normalize(fLightPosition.xyz-fPosition.xyz);
 
-        float ambient = 0.1;
-        float diffus = 0.7*max(0.0,dot(n,l));
         float specular = 0.6*pow(max(0.0,-dot(r,l)),4.0);
 
-        color = vec4(ambient + fColor.xyz * diffus + specular, fColor.w);
+  #if defined(SHADING_CACHE)
+        color = vec4(texture(shadingCache, fCacheCoord).xyz + specular, fColor.w);
+  #else
+        color = vec4(ambient + fColor.xyz * diffuse(n,l) + specular, fColor.w);
+  #endif
     }
+  #endif
   )--";
+
+// source with the defines inserted after its #version line
+static std::string withDefines(const std::string &source,
+                               const std::string &defines)
+{
+  std::string text = source;
+  text.insert(text.find('\n', text.find("#version")) + 1, defines);
+  return text;
+}
+
+// the shader and the vertex array for the current vertex format
+void SampleScene::buildProgram()
+{
   const char *vertexShaderSource = R"--(
     #version 150
 
+    // PROCEDURAL_TERRAIN: no vertex buffer, the grid comes from gl_VertexID
+    // PACKED_VERTICES: PackedTerrainVertex, see TerrainMesh.hpp
+  #if defined(PROCEDURAL_TERRAIN)
+    uniform int gridSize;      // cells per side
+    uniform float gridSpacing;
+
+    // the vertices of generateTerrain() as one triangle strip: each row of
+    // cells zigzags (x, y + 1), (x, y) from x = 0 to gridSize, then repeats
+    // its last vertex and the first of the next row, two degenerate
+    // triangles that keep the winding
+    void loadVertex(out vec3 p, out vec3 n, out vec4 c)
+    {
+        int rowLength = 2 * gridSize + 4;
+        int y = gl_VertexID / rowLength;
+        int k = gl_VertexID - y * rowLength;
+        int x = k < rowLength - 2 ? k / 2 : (k == rowLength - 2 ? gridSize : 0);
+        y += k < rowLength - 2 ? 1 - k % 2 : (k == rowLength - 2 ? 0 : 2);
+        vec2 xy = (vec2(x, y) - float(gridSize) * 0.5) * gridSpacing;
+        vec2 s = sin(xy), co = cos(xy);
+        float h = 2.0 * s.x * s.y;
+        p = vec3(xy, h);
+        n = normalize(vec3(-2.0 * co.x * s.y, -2.0 * s.x * co.y, 1.0));
+        float shade = sin(h * 5.0) * 0.5 + 0.5;
+        c = vec4(shade, 1.0 - shade, 1.0, 1.0);
+    }
+  #elif defined(PACKED_VERTICES)
+    in vec3 position; // unorm16 within the bounds
+    in vec2 normal;   // snorm16 octahedral
+    in vec4 color;    // unorm8
+
+    uniform vec3 positionOrigin;
+    uniform vec3 positionExtent;
+
+    void loadVertex(out vec3 p, out vec3 n, out vec4 c)
+    {
+        p = positionOrigin + positionExtent * position;
+        n = vec3(normal, 1.0 - abs(normal.x) - abs(normal.y));
+        float t = max(-n.z, 0.0);
+        n.x += n.x >= 0.0 ? -t : t;
+        n.y += n.y >= 0.0 ? -t : t;
+        c = color;
+    }
+  #else
     in vec3 position;
     in vec3 normal;
     in vec4 color;
 
-    uniform mat4 projection;
-    uniform mat4 view;
+    void loadVertex(out vec3 p, out vec3 n, out vec4 c)
+    {
+        p = position;
+        n = normal;
+        c = color;
+    }
+  #endif
+
+  #if defined(SHADING_CACHE) || defined(SHADING_CACHE_PASS)
+    // the box of the terrain, the shading cache spans its xy
+    uniform vec3 cacheOrigin;
+    uniform vec3 cacheExtent;
+  #endif
+
+  #if defined(SHADING_CACHE_PASS)
+    out vec3 fWorldPosition;
+    out vec3 fWorldNormal;
+    out vec4 fColor;
+
+    // the terrain laid flat over the cache by its xy; the depth keeps the
+    // highest surface where the LOD skirts fold under it
+    void main(void)
+    {
+        vec3 position, normal;
+        loadVertex(position, normal, fColor);
+        fWorldPosition = position;
+        fWorldNormal = normal;
+        vec3 t = (position - cacheOrigin) / cacheExtent;
+        gl_Position = vec4(t.xy * 2.0 - 1.0,
+                           clamp(1.0 - 2.0 * t.z, -1.0, 1.0), 1.0);
+    }
+  #else
+    // the view drawn, or -1 for one instance per view (FrameCamera.hpp)
+    uniform int viewIndex;
 
     out vec4 fPosition;
     out vec4 fColor;
     out vec4 fLightPosition;
     out vec3 fNormal;
+  #if defined(SHADING_CACHE)
+    out vec2 fCacheCoord;
+  #endif
 
     void main(void)
     {
+        int index = viewIndex >= 0 ? viewIndex : gl_InstanceID;
+        mat4 view = holoplayView(index);
+
+        vec3 position, normal;
+        loadVertex(position, normal, fColor);
+
         fPosition = view * vec4(position,1.0);
         fLightPosition = view * vec4(0.0,0.0,1.0,1.0);
 
-        fColor = color;
         fNormal = vec3(view * vec4(normal,0.0));
+  #if defined(SHADING_CACHE)
+        fCacheCoord = (position.xy - cacheOrigin.xy) / cacheExtent.xy;
+  #endif
 
-        gl_Position = projection * fPosition;
+        gl_Position = holoplayProjection(index) * fPosition;
+        if (viewIndex < 0)
+            gl_Position = holoplayQuiltPosition(gl_Position, index);
         /*gl_Position.x *= 1000.0f;*/
         /*gl_Position.y = 0.0;*/
     }
+  #endif
   )--";
-  Shader vertexShader(GL_VERTEX_SHADER, vertexShaderSource);
-  Shader fragmentShader(GL_FRAGMENT_SHADER, fragmentShaderSource);
+  std::string vertexSource = withFrameCamera(vertexShaderSource);
+  bool meshFile = !meshPath.empty();
+  std::string defines;
+  if (proceduralTerrain && !meshFile)
+    defines = "#define PROCEDURAL_TERRAIN\n";
+  else if (meshFile ? meshPacked : packedVertices)
+    defines = "#define PACKED_VERTICES\n";
+  // a baked mesh may fold over itself in xy, only the height map is cached
+  bool cached = shadingCacheSize > 0 && !meshFile;
+  if (shadingCacheSize > 0 && meshFile)
+    std::cout << "[Info] no shading cache for a mesh file, every view is "
+                 "shaded in full"
+              << std::endl;
+  std::string viewDefines =
+      cached ? defines + "#define SHADING_CACHE\n" : defines;
+  Shader vertexShader(GL_VERTEX_SHADER,
+                      withDefines(vertexSource, viewDefines).c_str());
+  Shader fragmentShader(GL_FRAGMENT_SHADER,
+                        withDefines(FRAGMENT_SHADER, viewDefines).c_str());
 
+  delete shaderProgram;
   shaderProgram = new ShaderProgram({vertexShader, fragmentShader});
 
-  // map vbo to shader attributes
-  shaderProgram->setAttribute("position", 3, sizeof(VertexType),
-                              offsetof(VertexType, position));
-  shaderProgram->setAttribute("normal", 3, sizeof(VertexType),
-                              offsetof(VertexType, normal));
-  shaderProgram->setAttribute("color", 4, sizeof(VertexType),
-                              offsetof(VertexType, color));
+  // map vbo to shader attributes, on a new vertex array so that none stay
+  // enabled from the previous format
+  glDeleteVertexArrays(1, &vao);
+  glGenVertexArrays(1, &vao);
+  glBindVertexArray(vao);
+  setVertexFormat(*shaderProgram);
+  glBindVertexArray(0);
+
+  // the same vertices drawn into the shading cache
+  delete cacheProgram;
+  cacheProgram = nullptr;
+  glDeleteVertexArrays(1, &cacheVao);
+  cacheVao = 0;
+  if (cached)
+  {
+    std::string cacheDefines = defines + "#define SHADING_CACHE_PASS\n";
+    Shader cacheVertexShader(GL_VERTEX_SHADER,
+                             withDefines(vertexSource, cacheDefines).c_str());
+    Shader cacheFragmentShader(
+        GL_FRAGMENT_SHADER, withDefines(FRAGMENT_SHADER, cacheDefines).c_str());
+    cacheProgram = new ShaderProgram({cacheVertexShader, cacheFragmentShader});
+    glGenVertexArrays(1, &cacheVao);
+    glBindVertexArray(cacheVao);
+    setVertexFormat(*cacheProgram);
+    glBindVertexArray(0);
+  }
+
+  // the views are derived in the shader from the FrameCamera block
+  useFrameCameraBlock(*shaderProgram);
+  viewIndexLocation = shaderProgram->uniform("viewIndex");
+  setTerrainUniforms();
+}
+
+// the terrain's vbo and ibo as the attributes of program, into the bound
+// vertex array
+void SampleScene::setVertexFormat(ShaderProgram &program)
+{
+  bool meshFile = !meshPath.empty();
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  if (meshFile)
+  {
+    // the layout the file describes
+    for (uint32_t i = 0; i < meshHeader.attributeCount; ++i)
+    {
+      const MeshFileAttribute &a = meshHeader.attributes[i];
+      program.setAttribute(a.name, GLint(a.components),
+                           GLsizei(meshHeader.vertexStride), a.offset,
+                           GLboolean(a.normalized != 0), GLenum(a.type));
+    }
+  }
+  else if (proceduralTerrain)
+  {
+    // nothing to fetch
+  }
+  else if (packedVertices)
+  {
+    typedef PackedTerrainVertex V;
+    program.setNormalizedAttribute("position", 3, sizeof(V),
+                                   offsetof(V, position), GL_UNSIGNED_SHORT);
+    program.setNormalizedAttribute("normal", 2, sizeof(V), offsetof(V, normal),
+                                   GL_SHORT);
+    program.setNormalizedAttribute("color", 4, sizeof(V), offsetof(V, color),
+                                   GL_UNSIGNED_BYTE);
+  }
+  else
+  {
+    program.setAttribute("position", 3, sizeof(TerrainVertex),
+                         offsetof(TerrainVertex, position));
+    program.setAttribute("normal", 3, sizeof(TerrainVertex),
+                         offsetof(TerrainVertex, normal));
+    program.setAttribute("color", 4, sizeof(TerrainVertex),
+                         offsetof(TerrainVertex, color));
+  }
 
-  // bind the ibo
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+}
 
-  // vao end
-  glBindVertexArray(0);
+// the uniforms of the vertex format that depend on the terrain size, for the
+// views and the shading cache
+void SampleScene::setTerrainUniforms()
+{
+  ShaderProgram *programs[] = {shaderProgram, cacheProgram};
+  for (ShaderProgram *program : programs)
+  {
+    if (!program)
+      continue;
+    program->use();
+    if (!meshPath.empty())
+    {
+      if (meshPacked)
+      {
+        program->setUniform("positionOrigin",
+                            glm::vec3(meshHeader.boundsOrigin[0],
+                                      meshHeader.boundsOrigin[1],
+                                      meshHeader.boundsOrigin[2]));
+        program->setUniform("positionExtent",
+                            glm::vec3(meshHeader.boundsExtent[0],
+                                      meshHeader.boundsExtent[1],
+                                      meshHeader.boundsExtent[2]));
+      }
+    }
+    else if (proceduralTerrain)
+    {
+      program->setUniform("gridSize", int(size));
+      program->setUniform("gridSpacing", TERRAIN_SPACING);
+    }
+    else if (packedVertices)
+    {
+      TerrainBounds bounds = getPackedBounds();
+      program->setUniform("positionOrigin", bounds.origin);
+      program->setUniform("positionExtent", bounds.extent);
+    }
+    if (cacheProgram)
+    {
+      // the box of the whole height map, skirts included
+      TerrainBounds bounds = getPackedBounds();
+      program->setUniform("cacheOrigin", bounds.origin);
+      program->setUniform("cacheExtent", bounds.extent);
+      if (program == shaderProgram)
+        program->setUniform("shadingCache", SHADING_CACHE_UNIT);
+    }
+    program->unuse();
+  }
+  glCheckError(__FILE__, __LINE__);
 }
 
-// process input: query GLFW if relevant keys are pressed/released 
-// if ESC pressed, return false
-// ---------------------------------------------------------------------------------------------------------
-bool SampleScene::processInput(GLFWwindow *window)
+// the terrain, generated in parallel straight into the GL buffers
+void SampleScene::buildTerrain()
 {
-  if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+  // only the animated grid streams, and it starts a new ring
+  terrainStream.release();
+  if (!meshPath.empty())
+  {
+    if (loadMeshFile())
+      return;
+    meshPath.clear(); // draw the terrain instead
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  unsigned threads = std::max(std::thread::hardware_concurrency(), 1u);
+  JobSystem jobs(threads);
+
+  size_t side = size_t(size) + 1;
+  size_t vertexCount = side * side;
+  size_t indexCount = size_t(size) * size_t(size) * 6;
+  size_t stride = packedVertices ? sizeof(PackedTerrainVertex)
+                                 : sizeof(TerrainVertex);
+  if (proceduralTerrain)
+  {
+    // the vertex shader computes every vertex, the buffers are released
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, 0, NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, 0, NULL, GL_STATIC_DRAW);
+    size_t stripLength = size_t(size) * (2 * size_t(size) + 4) - 2;
+    MeshChunk whole = {0, stripLength, 0, 0};
+    terrainChunks.assign(1, whole);
+    terrainMode = GL_TRIANGLE_STRIP;
+    terrainIndexType = 0;
+    vertexCount = 0;
+  }
+  else if (lodTerrain)
+  {
+    buildLodTerrain(jobs);
+    vertexCount = terrainLod.getVertices().size();
+  }
+  else if (optimizedMesh)
+  {
+    buildOptimizedTerrain(jobs);
+    vertexCount = 0;
+    for (size_t i = 0; i < terrainChunks.size(); ++i)
+      vertexCount += terrainChunks[i].vertexCount;
+  }
+  else if (animatedTerrain)
+  {
+    // the vertices change every frame, see streamTerrain(); the indices don't
+    StreamBufferSettings settings;
+    settings.size = STREAMED_FRAMES * (vertexCount * stride + 16);
+    settings.mapping = streamMapping;
+    terrainStream.create(settings);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, 0, NULL, GL_STATIC_DRAW);
+    std::vector<GLuint> indices(indexCount);
+    generateTerrainIndices(size, indices.data(), &jobs);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                 GLsizeiptr(indexCount * sizeof(GLuint)), indices.data(),
+                 GL_STATIC_DRAW);
+    MeshChunk whole = {0, indexCount, 0, vertexCount};
+    terrainChunks.assign(1, whole);
+    terrainMode = GL_TRIANGLES;
+    terrainIndexType = GL_UNSIGNED_INT;
+  }
+  else
+  {
+    size_t vertexBytes = vertexCount * stride;
+    size_t indexBytes = indexCount * sizeof(GLuint);
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(vertexBytes), NULL,
+                 GL_STATIC_DRAW);
+    void *vertices =
+        glMapBufferRange(GL_ARRAY_BUFFER, 0, GLsizeiptr(vertexBytes),
+                         GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, GLsizeiptr(indexBytes), NULL,
+                 GL_STATIC_DRAW);
+    void *indices =
+        glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, GLsizeiptr(indexBytes),
+                         GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (vertices && packedVertices)
+      generatePackedTerrainVertices(
+          size, TERRAIN_SPACING, static_cast<PackedTerrainVertex *>(vertices),
+          &jobs);
+    else if (vertices)
+      generateTerrainVertices(size, TERRAIN_SPACING,
+                              static_cast<TerrainVertex *>(vertices), &jobs);
+    if (indices)
+      generateTerrainIndices(size, static_cast<GLuint *>(indices), &jobs);
+
+    // an unmap can fail if the buffer was lost meanwhile, upload a copy then
+    bool mapped = vertices && glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE;
+    mapped =
+        indices && glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER) == GL_TRUE && mapped;
+    if (!mapped)
+    {
+      TerrainMesh mesh;
+      generateTerrain(size, TERRAIN_SPACING, mesh, &jobs);
+      std::vector<PackedTerrainVertex> packed;
+      if (packedVertices)
+      {
+        TerrainBounds bounds = getTerrainBounds(size, TERRAIN_SPACING);
+        for (size_t i = 0; i < mesh.vertices.size(); ++i)
+          packed.push_back(packTerrainVertex(mesh.vertices[i], bounds));
+      }
+      glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(vertexBytes),
+                   packedVertices ? static_cast<const void *>(packed.data())
+                                  : mesh.vertices.data(),
+                   GL_STATIC_DRAW);
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, GLsizeiptr(indexBytes),
+                   mesh.indices.data(), GL_STATIC_DRAW);
+    }
+
+    // one draw of the whole grid
+    MeshChunk whole = {0, indexCount, 0, vertexCount};
+    terrainChunks.assign(1, whole);
+    terrainMode = GL_TRIANGLES;
+    terrainIndexType = GL_UNSIGNED_INT;
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  glCheckError(__FILE__, __LINE__);
+
+  double ms = std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+  if (proceduralTerrain)
+    std::cout << "[Info] terrain of " << size_t(size) * size_t(size) * 2
+              << " triangles computed from gl_VertexID, no vertex or index "
+                 "buffer"
+              << std::endl;
+  else if (terrainStream.isCreated())
+    std::cout << "[Info] animated terrain of " << vertexCount << " vertices ("
+              << vertexCount * stride / 1024 << " KiB) and "
+              << size_t(size) * size_t(size) * 2
+              << " triangles, the vertices streamed every frame" << std::endl;
+  else
+    std::cout << "[Info] terrain of " << vertexCount << " vertices ("
+              << vertexCount * stride / 1024 << " KiB"
+              << (packedVertices ? ", packed" : "") << ") and "
+              << size_t(size) * size_t(size) * 2 << " triangles generated in "
+              << ms << " ms on " << threads << " thread(s)" << std::endl;
+}
+
+// the mesh of meshPath, its streams uploaded from the mapping as they are
+bool SampleScene::loadMeshFile()
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  MeshFileReader reader;
+  if (!reader.open(meshPath))
+    return false;
+  // the shader reads the two vertex formats of TerrainMesh.hpp
+  const MeshFileAttribute *position = reader.findAttribute("position");
+  if (!position || !reader.getHeader().chunkCount)
+  {
+    std::cout << "[Error] " << meshPath << " has no positions or no triangles"
+              << std::endl;
     return false;
+  }
+  meshHeader = reader.getHeader();
+  meshPacked = position->type != MESH_TYPE_FLOAT;
 
-  int new_debug = 0;
+  // read ahead of the copies so they don't fault the file in page by page
+  reader.prefetch();
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(meshHeader.vertexSize),
+               reader.getVertices(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, GLsizeiptr(meshHeader.indexSize),
+               reader.getIndices(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  glCheckError(__FILE__, __LINE__);
+
+  terrainChunks.resize(meshHeader.chunkCount);
+  for (size_t i = 0; i < terrainChunks.size(); ++i)
+  {
+    const MeshFileChunk &c = reader.getChunk(i);
+    MeshChunk chunk = {size_t(c.firstIndex), size_t(c.indexCount),
+                       size_t(c.baseVertex), size_t(c.vertexCount)};
+    terrainChunks[i] = chunk;
+  }
+  terrainMode = GL_TRIANGLES;
+  terrainIndexType = GLenum(meshHeader.indexType);
+
+  double ms = std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+  std::cout << "[Info] mesh of " << meshHeader.vertexCount << " vertices ("
+            << meshHeader.vertexSize / 1024 << " KiB"
+            << (meshPacked ? ", packed" : "") << ") and "
+            << meshHeader.indexCount / 3 << " triangles in "
+            << meshHeader.chunkCount << " chunk(s) loaded from " << meshPath
+            << " in " << ms << " ms" << std::endl;
+  return true;
+}
 
-  if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS)
-    new_debug = 1;
+// the terrain with its triangles in vertex cache order, cut into chunks of
+// 16-bit indices and uploaded from a copy
+void SampleScene::buildOptimizedTerrain(JobSystem &jobs)
+{
+  TerrainMesh mesh;
+  generateTerrain(size, TERRAIN_SPACING, mesh, &jobs);
+  std::vector<uint32_t> ordered(mesh.indices.size());
+  optimizeVertexCache(mesh.indices.data(), mesh.indices.size(),
+                      mesh.vertices.size(), ordered.data());
+  ChunkedMesh chunked;
+  splitMesh(ordered.data(), ordered.size(), mesh.vertices.size(),
+            MAX_CHUNK_VERTICES, chunked);
+
+  // the vertices in the order the chunks number them
+  std::vector<PackedTerrainVertex> packed;
+  const void *source = mesh.vertices.data();
+  size_t stride = sizeof(TerrainVertex);
+  if (packedVertices)
+  {
+    TerrainBounds bounds = getTerrainBounds(size, TERRAIN_SPACING);
+    packed.resize(mesh.vertices.size());
+    for (size_t i = 0; i < mesh.vertices.size(); ++i)
+      packed[i] = packTerrainVertex(mesh.vertices[i], bounds);
+    source = packed.data();
+    stride = sizeof(PackedTerrainVertex);
+  }
+  std::vector<char> vertices(chunked.remap.size() * stride);
+  remapVertices(vertices.data(), source, stride, chunked.remap.data(),
+                chunked.remap.size());
 
-  if (debug != new_debug)
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(vertices.size()), vertices.data(),
+               GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+               GLsizeiptr(chunked.indices.size() * sizeof(uint16_t)),
+               chunked.indices.data(), GL_STATIC_DRAW);
+  terrainChunks = chunked.chunks;
+  terrainMode = GL_TRIANGLES;
+  terrainIndexType = GL_UNSIGNED_SHORT;
+
+  // the same stats over all chunks as one list of the remapped vertices
+  std::vector<uint32_t> flat;
+  flat.reserve(chunked.indices.size());
+  for (size_t c = 0; c < chunked.chunks.size(); ++c)
   {
-    debug = new_debug;
-    lightFieldShader->use();
-    lightFieldShader->setUniform("debug", debug);
-    lightFieldShader->unuse();
+    const MeshChunk &chunk = chunked.chunks[c];
+    for (size_t i = 0; i < chunk.indexCount; ++i)
+      flat.push_back(uint32_t(chunk.baseVertex) +
+                     chunked.indices[chunk.firstIndex + i]);
   }
+  VertexCacheStats before = analyzeVertexCache(
+      mesh.indices.data(), mesh.indices.size(), mesh.vertices.size(), 32);
+  VertexCacheStats after =
+      analyzeVertexCache(flat.data(), flat.size(), chunked.remap.size(), 32);
+  std::cout << "[Info] terrain reordered for the vertex cache: ACMR "
+            << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr
+            << " -> " << after.atvr << " (FIFO 32), "
+            << chunked.chunks.size() << " chunk(s) of 16-bit indices"
+            << std::endl;
+}
+
+// every level of the terrain's quadtree, the chunks drawn are picked each
+// frame by selectTerrainLod()
+void SampleScene::buildLodTerrain(JobSystem &jobs)
+{
+  terrainLod.build(size, TERRAIN_SPACING, &jobs);
+  const std::vector<TerrainVertex> &lodVertices = terrainLod.getVertices();
+
+  // all chunks share the triangles of one
+  std::vector<uint16_t> chunkIndices = terrainLod.getIndices();
+  if (optimizedMesh)
+  {
+    std::vector<uint32_t> in(chunkIndices.begin(), chunkIndices.end());
+    std::vector<uint32_t> out(in.size());
+    optimizeVertexCache(in.data(), in.size(),
+                        terrainLod.getChunkVertexCount(), out.data());
+    chunkIndices.assign(out.begin(), out.end());
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  if (packedVertices)
+  {
+    TerrainBounds bounds = getPackedBounds();
+    std::vector<PackedTerrainVertex> packed(lodVertices.size());
+    for (size_t i = 0; i < lodVertices.size(); ++i)
+      packed[i] = packTerrainVertex(lodVertices[i], bounds);
+    glBufferData(GL_ARRAY_BUFFER,
+                 GLsizeiptr(packed.size() * sizeof(PackedTerrainVertex)),
+                 packed.data(), GL_STATIC_DRAW);
+  }
+  else
+    glBufferData(GL_ARRAY_BUFFER,
+                 GLsizeiptr(lodVertices.size() * sizeof(TerrainVertex)),
+                 lodVertices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+               GLsizeiptr(chunkIndices.size() * sizeof(uint16_t)),
+               chunkIndices.data(), GL_STATIC_DRAW);
+
+  // the root until the first selection
+  MeshChunk root = {0, chunkIndices.size(), 0,
+                    terrainLod.getChunkVertexCount()};
+  terrainChunks.assign(1, root);
+  terrainMode = GL_TRIANGLES;
+  terrainIndexType = GL_UNSIGNED_SHORT;
+  lodReportedChunks = 0;
+
+  std::cout << "[Info] terrain LOD of " << terrainLod.getLevelCount()
+            << " levels, " << terrainLod.getNodes().size() << " chunks of "
+            << terrainLod.getChunkTriangleCount() << " triangles over "
+            << terrainLod.getSize() << "x" << terrainLod.getSize()
+            << " cells " << terrainLod.getSpacing() << " apart, skirts "
+            << terrainLod.getSkirtDepth() << " deep"
+            << std::endl;
+}
+
+// one selection for all views, from the cameras of the first and last view
+void SampleScene::selectTerrainLod()
+{
+  glm::mat4 frameView = getViewMatrixOfCurrentFrame();
+  // the aspect only shears the projections, the cameras don't depend on it
+  float aspect = float(qs_width * qs_rows) / float(qs_height * qs_columns);
+  int views = std::max(qs_totalViews, 2);
+  glm::mat4 view, projection;
+  ViewMatrices::computeView(0, views, viewCone, frameView, cameraSize, aspect,
+                            view, projection);
+  glm::vec3 eyeA(glm::inverse(view)[3]);
+  ViewMatrices::computeView(views - 1, views, viewCone, frameView, cameraSize,
+                            aspect, view, projection);
+  glm::vec3 eyeB(glm::inverse(view)[3]);
+  float pixelScale = 0.5f * float(qs_height) / float(qs_rows) * projection[1][1];
+  terrainLod.select(eyeA, eyeB, pixelScale, lodTolerance, lodSelection);
+
+  size_t indexCount = terrainLod.getIndices().size();
+  size_t vertexCount = terrainLod.getChunkVertexCount();
+  terrainChunks.resize(lodSelection.size());
+  for (size_t i = 0; i < lodSelection.size(); ++i)
+  {
+    MeshChunk chunk = {0, indexCount,
+                       terrainLod.getNodes()[lodSelection[i]].baseVertex,
+                       vertexCount};
+    terrainChunks[i] = chunk;
+  }
+
+  // at most once a second, when the selection changed size
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if (lodSelection.size() != lodReportedChunks &&
+      now - lodReportTime >= std::chrono::seconds(1))
+  {
+    // against the grid drawn without LOD
+    size_t full = size_t(size) * size_t(size) * 2;
+    std::cout << "[Info] terrain LOD: " << lodSelection.size() << " chunks, "
+              << lodSelection.size() * terrainLod.getChunkTriangleCount()
+              << " triangles per view instead of " << full << std::endl;
+    lodReportedChunks = lodSelection.size();
+    lodReportTime = now;
+  }
+}
+
+// the box PackedTerrainVertex positions are quantized in, skirts included
+TerrainBounds SampleScene::getPackedBounds() const
+{
+  if (!lodTerrain)
+    return getTerrainBounds(size, TERRAIN_SPACING);
+  return terrainLod.getBounds();
+}
+
+// a field of cubes over the terrain, sharing one mesh, and their program
+void SampleScene::buildObjects(size_t count)
+{
+  // the six faces of a unit cube, four vertices each
+  std::vector<TerrainVertex> vertices;
+  std::vector<GLushort> indices;
+  for (int axis = 0; axis < 3; ++axis)
+    for (int side = -1; side <= 1; side += 2)
+    {
+      glm::vec3 n(0.0f), u(0.0f), v(0.0f);
+      n[axis] = float(side);
+      u[(axis + 1) % 3] = 1.0f;
+      v[(axis + 2) % 3] = float(side);
+      GLushort first = GLushort(vertices.size());
+      for (int k = 0; k < 4; ++k)
+      {
+        TerrainVertex vertex;
+        vertex.position = n + (k & 1 ? u : -u) + (k & 2 ? v : -v);
+        vertex.normal = n;
+        vertex.color = glm::vec4(glm::vec3(0.5f) + 0.5f * glm::abs(n), 1.0f);
+        vertices.push_back(vertex);
+      }
+      GLushort quad[6] = {first, GLushort(first + 1), GLushort(first + 3),
+                          GLushort(first + 3), GLushort(first + 2), first};
+      indices.insert(indices.end(), quad, quad + 6);
+    }
+
+  // scattered over the terrain, between it and the camera
+  float half = float(size) * TERRAIN_SPACING * 0.5f;
+  std::mt19937 random(1);
+  std::uniform_real_distribution<float> across(-half, half);
+  std::uniform_real_distribution<float> height(2.2f, 2.8f);
+  std::uniform_real_distribution<float> scale(0.01f, 0.04f);
+  std::vector<GpuCullObject> objects(count);
+  for (size_t i = 0; i < count; ++i)
+  {
+    glm::vec3 centre(across(random), across(random), height(random));
+    float s = scale(random);
+    GpuCullObject &object = objects[i];
+    object.model = glm::scale(glm::translate(glm::mat4(1.0f), centre),
+                              glm::vec3(s));
+    object.sphere = glm::vec4(centre, s * std::sqrt(3.0f));
+    object.count = uint32_t(indices.size());
+    object.firstIndex = 0;
+    object.baseVertex = 0;
+    object.padding = 0;
+  }
+  gpuCulling.setObjects(objects);
+
+  if (!objectProgram)
+  {
+    const char *vertexShaderSource = R"--(
+    #version 430 core
+
+    in vec3 position;
+    in vec3 normal;
+    in vec4 color;
+
+    // the view drawn, or -1 for drawAllViews()
+    uniform int viewIndex;
+
+    out vec4 fPosition;
+    out vec4 fColor;
+    out vec4 fLightPosition;
+    out vec3 fNormal;
+
+    void main(void)
+    {
+        int index = viewIndex >= 0 ? viewIndex : culledView();
+        mat4 view = holoplayView(index);
+        mat4 modelView = view * culledModel();
+
+        fPosition = modelView * vec4(position, 1.0);
+        fLightPosition = view * vec4(0.0, 0.0, 1.0, 1.0);
+        fNormal = vec3(modelView * vec4(normal, 0.0));
+        fColor = color;
+
+        gl_Position = holoplayProjection(index) * fPosition;
+        if (viewIndex < 0)
+            gl_Position = holoplayQuiltPosition(gl_Position, index);
+    }
+  )--";
+    // the FrameCamera block goes first, GPU_CULLING_GLSL uses it
+    std::string vertexSource = vertexShaderSource;
+    size_t version = vertexSource.find("#version");
+    vertexSource.insert(vertexSource.find('\n', version) + 1, GPU_CULLING_GLSL);
+    vertexSource = withFrameCamera(vertexSource.c_str());
+    std::string fragmentSource = FRAGMENT_SHADER;
+    fragmentSource.replace(fragmentSource.find("#version 150"), 12,
+                           "#version 430 core");
+    Shader vertexShader(GL_VERTEX_SHADER, vertexSource.c_str());
+    Shader fragmentShader(GL_FRAGMENT_SHADER, fragmentSource.c_str());
+    objectProgram = new ShaderProgram({vertexShader, fragmentShader});
+    useFrameCameraBlock(*objectProgram);
+
+    glGenVertexArrays(1, &objectVao);
+    glGenBuffers(1, &objectVbo);
+    glGenBuffers(1, &objectIbo);
+    glBindVertexArray(objectVao);
+    glBindBuffer(GL_ARRAY_BUFFER, objectVbo);
+    objectProgram->setAttribute("position", 3, sizeof(TerrainVertex),
+                                offsetof(TerrainVertex, position));
+    objectProgram->setAttribute("normal", 3, sizeof(TerrainVertex),
+                                offsetof(TerrainVertex, normal));
+    objectProgram->setAttribute("color", 4, sizeof(TerrainVertex),
+                                offsetof(TerrainVertex, color));
+    gpuCulling.setDrawAttribute(objectProgram->attribute("culledDraw"));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, objectIbo);
+    glBindVertexArray(0);
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, objectVbo);
+  glBufferData(GL_ARRAY_BUFFER,
+               GLsizeiptr(vertices.size() * sizeof(TerrainVertex)),
+               vertices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, objectIbo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+               GLsizeiptr(indices.size() * sizeof(GLushort)), indices.data(),
+               GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  glCheckError(__FILE__, __LINE__);
+
+  std::cout << "[Info] " << count << " objects culled on the GPU, one multi "
+            << "draw indirect per view" << std::endl;
+}
+
+// the objects visible in viewIndex, or in every view for -1; the first view
+// of the frame culls them for all views
+void SampleScene::drawObjects(int viewIndex)
+{
+  if (!gpuCulling.isCreated() || !gpuCulling.getObjectCount())
+    return;
+  if (viewIndex <= 0)
+    gpuCulling.cull(viewMatrices);
+  objectProgram->use();
+  objectProgram->setUniform("viewIndex", viewIndex);
+  glBindVertexArray(objectVao);
+  if (viewIndex < 0)
+    gpuCulling.drawAllViews(GL_TRIANGLES, GL_UNSIGNED_SHORT);
+  else
+    gpuCulling.drawView(GL_TRIANGLES, GL_UNSIGNED_SHORT, viewIndex);
+  glBindVertexArray(0);
+  objectProgram->unuse();
+}
+
+// every chunk of the terrain, instances times
+void SampleScene::drawTerrain(GLsizei instances)
+{
+  size_t indexSize =
+      terrainIndexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+  for (size_t i = 0; i < terrainChunks.size(); ++i)
+  {
+    const MeshChunk &chunk = terrainChunks[i];
+    const void *offset = (const void *)(chunk.firstIndex * indexSize);
+    if (!terrainIndexType)
+      glDrawArraysInstanced(terrainMode, 0, GLsizei(chunk.indexCount),
+                            instances);
+    else if (instances > 1)
+      glDrawElementsInstancedBaseVertex(terrainMode, GLsizei(chunk.indexCount),
+                                        terrainIndexType, offset, instances,
+                                        GLint(chunk.baseVertex));
+    else
+      glDrawElementsBaseVertex(terrainMode, GLsizei(chunk.indexCount),
+                               terrainIndexType, offset,
+                               GLint(chunk.baseVertex));
+  }
+}
+
+// this frame's vertices of the animated terrain into the ring, and the
+// vertex array pointed at them; the fence of endFrame() follows every command
+// queued so far, the previous frame's draws included
+void SampleScene::streamTerrain(float time)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  terrainStream.endFrame();
+  size_t side = size_t(size) + 1;
+  StreamAllocation vertices =
+      terrainStream.allocate(side * side * sizeof(TerrainVertex), 16);
+  if (!vertices.data)
+    return;
+  if (!terrainJobs)
+    terrainJobs =
+        new JobSystem(std::max(std::thread::hardware_concurrency(), 1u));
+  generateAnimatedTerrainVertices(size, TERRAIN_SPACING, time,
+                                  static_cast<TerrainVertex *>(vertices.data),
+                                  terrainJobs);
+  terrainStream.flush(vertices);
+
+  // the views' vertex array and the shading cache's, if any
+  GLuint arrays[] = {vao, cacheVao};
+  ShaderProgram *programs[] = {shaderProgram, cacheProgram};
+  glBindBuffer(GL_ARRAY_BUFFER, terrainStream.getHandle());
+  GLuint offset = GLuint(vertices.offset);
+  for (int i = 0; i < 2; ++i)
+  {
+    if (!programs[i])
+      continue;
+    glBindVertexArray(arrays[i]);
+    programs[i]->setAttribute("position", 3, sizeof(TerrainVertex),
+                              offset + offsetof(TerrainVertex, position));
+    programs[i]->setAttribute("normal", 3, sizeof(TerrainVertex),
+                              offset + offsetof(TerrainVertex, normal));
+    programs[i]->setAttribute("color", 4, sizeof(TerrainVertex),
+                              offset + offsetof(TerrainVertex, color));
+  }
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  terrainStreamMs += std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+}
+
+// logs why the animated terrain can't be combined with the terrain of what,
+// which buildTerrain() would draw instead of streaming
+static void refuseAnimatedTerrain(const char *what)
+{
+  std::cout << "[Error] the animated terrain streams float vertices of the "
+               "whole grid, it can't be "
+            << what << std::endl;
+}
+
+void SampleScene::setAnimatedTerrain(bool animated, StreamMapping mapping)
+{
+  if (animated)
+  {
+    const char *conflict = packedVertices      ? "packed"
+                           : proceduralTerrain ? "procedural"
+                           : lodTerrain        ? "drawn with LOD"
+                           : optimizedMesh     ? "optimized"
+                           : !meshPath.empty() ? "a mesh file"
+                                               : nullptr;
+    if (conflict)
+    {
+      refuseAnimatedTerrain(conflict);
+      return;
+    }
+  }
+  if (animated == animatedTerrain && mapping == streamMapping)
+    return;
+  animatedTerrain = animated;
+  streamMapping = mapping;
+  glBindVertexArray(0);
+  buildTerrain();
+}
+
+void SampleScene::setShadingCache(int resolution)
+{
+  resolution = std::max(resolution, 0);
+  if (resolution == shadingCacheSize)
+    return;
+  releaseShadingCache();
+  shadingCacheSize = resolution;
+  if (resolution > 0)
+  {
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    shadingCacheSize = std::min(resolution, int(maxSize));
+
+    // linear, a view sees the texels from any angle; no mipmaps, regenerating
+    // them every frame would cost more than the few views that minify
+    glGenTextures(1, &cacheTexture);
+    glBindTexture(GL_TEXTURE_2D, cacheTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, shadingCacheSize,
+                 shadingCacheSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenRenderbuffers(1, &cacheDepth);
+    glBindRenderbuffer(GL_RENDERBUFFER, cacheDepth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24,
+                          shadingCacheSize, shadingCacheSize);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    GLint previous = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+    glGenFramebuffers(1, &cacheFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, cacheFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           cacheTexture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                              GL_RENDERBUFFER, cacheDepth);
+    bool complete =
+        glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, GLuint(previous));
+    glCheckError(__FILE__, __LINE__);
+    if (!complete)
+    {
+      std::cout << "[Error] shading cache framebuffer incomplete, every view "
+                   "is shaded in full"
+                << std::endl;
+      releaseShadingCache();
+    }
+    else
+      std::cout << "[Info] shading cache of " << shadingCacheSize << "x"
+                << shadingCacheSize << " texels, shaded once per frame"
+                << std::endl;
+  }
+  glBindVertexArray(0);
+  buildProgram();
+}
+
+void SampleScene::releaseShadingCache()
+{
+  glDeleteFramebuffers(1, &cacheFramebuffer);
+  glDeleteRenderbuffers(1, &cacheDepth);
+  glDeleteTextures(1, &cacheTexture);
+  cacheFramebuffer = 0;
+  cacheDepth = 0;
+  cacheTexture = 0;
+  shadingCacheSize = 0;
+}
+
+// the view independent part of the terrain's lighting, once for all the
+// views: the terrain is drawn flat over the cache texture by its xy, which the
+// views then sample where they see it; left bound on SHADING_CACHE_UNIT
+void SampleScene::renderShadingCache()
+{
+  GLint previous = 0;
+  GLint viewport[4];
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+  glGetIntegerv(GL_VIEWPORT, viewport);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, cacheFramebuffer);
+  glViewport(0, 0, shadingCacheSize, shadingCacheSize);
+  glClearColor(0.0, 0.0, 0.0, 1.0);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  cacheProgram->use();
+  glBindVertexArray(cacheVao);
+  drawTerrain(1);
+  glBindVertexArray(0);
+  cacheProgram->unuse();
+
+  glBindFramebuffer(GL_FRAMEBUFFER, GLuint(previous));
+  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+  glActiveTexture(GLenum(GL_TEXTURE0 + SHADING_CACHE_UNIT));
+  glBindTexture(GL_TEXTURE_2D, cacheTexture);
+  glActiveTexture(GL_TEXTURE0);
+  glCheckError(__FILE__, __LINE__);
+}
+
+void SampleScene::setTerrainSize(unsigned int cells)
+{
+  size = std::max(cells, 1u);
+  // keep the vertex array's element buffer out of the way of the rebuild
+  glBindVertexArray(0);
+  buildTerrain();
+  setTerrainUniforms();
+}
+
+void SampleScene::setTerrainLod(float tolerance)
+{
+  if (tolerance > 0 && animatedTerrain)
+  {
+    refuseAnimatedTerrain("drawn with LOD");
+    return;
+  }
+  lodTolerance = tolerance;
+  if ((tolerance > 0) == lodTerrain)
+    return;
+  lodTerrain = tolerance > 0;
+  glBindVertexArray(0);
+  buildTerrain();
+  setTerrainUniforms();
+}
+
+void SampleScene::setProceduralTerrain(bool procedural)
+{
+  if (procedural == proceduralTerrain)
+    return;
+  if (procedural && animatedTerrain)
+  {
+    refuseAnimatedTerrain("procedural");
+    return;
+  }
+  proceduralTerrain = procedural;
+  glBindVertexArray(0);
+  buildTerrain();
+  buildProgram();
+}
+
+void SampleScene::setOptimizedMesh(bool optimized)
+{
+  if (optimized == optimizedMesh)
+    return;
+  if (optimized && animatedTerrain)
+  {
+    refuseAnimatedTerrain("optimized");
+    return;
+  }
+  optimizedMesh = optimized;
+  glBindVertexArray(0);
+  buildTerrain();
+}
+
+void SampleScene::setMeshFile(const std::string &path)
+{
+  if (!path.empty() && animatedTerrain)
+  {
+    refuseAnimatedTerrain("a mesh file");
+    return;
+  }
+  meshPath = path;
+  glBindVertexArray(0);
+  buildTerrain();
+  buildProgram();
+}
+
+void SampleScene::setCulledObjects(size_t count)
+{
+  if (!count)
+  {
+    releaseObjects();
+    return;
+  }
+  if (!gpuCulling.isCreated() && !gpuCulling.create())
+  {
+    std::cout << "[Error] no GPU culling, the scene stays without objects"
+              << std::endl;
+    return;
+  }
+  glBindVertexArray(0);
+  buildObjects(count);
+}
+
+// the culling buffers together with the vertex array reading culledDraw from
+// them, so that the next setCulledObjects() points it at the new ones
+void SampleScene::releaseObjects()
+{
+  gpuCulling.release();
+  glDeleteVertexArrays(1, &objectVao);
+  glDeleteBuffers(1, &objectVbo);
+  glDeleteBuffers(1, &objectIbo);
+  objectVao = objectVbo = objectIbo = 0;
+  delete objectProgram;
+  objectProgram = nullptr;
+}
+
+void SampleScene::setPackedVertices(bool packed)
+{
+  if (packed == packedVertices)
+    return;
+  if (packed && animatedTerrain)
+  {
+    refuseAnimatedTerrain("packed");
+    return;
+  }
+  packedVertices = packed;
+  glBindVertexArray(0);
+  buildTerrain();
+  buildProgram();
+}
+
+// process input: query GLFW if relevant keys are pressed/released 
+// if ESC pressed, return false
+// ---------------------------------------------------------------------------------------------------------
+// may run on the simulation thread: no GL calls here, see consumeSnapshot()
+bool SampleScene::processInput(GLFWwindow*)
+{
+  if (isKeyPressed(GLFW_KEY_ESCAPE))
+    return false;
+
+  debug = isKeyPressed(GLFW_KEY_SPACE) ? 1 : 0;
 
   // Here add your code to control the camera by keys
   float cameraSpeed = 5 * deltaTime;
-  if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+  if (isKeyPressed(GLFW_KEY_W))
     cameraPos += cameraSpeed * cameraFront;
-  if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+  if (isKeyPressed(GLFW_KEY_S))
     cameraPos -= cameraSpeed * cameraFront;
-  if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+  if (isKeyPressed(GLFW_KEY_A))
     cameraPos +=
         glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
-  if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+  if (isKeyPressed(GLFW_KEY_D))
     cameraPos -=
         glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
 
@@ -266,49 +1301,105 @@ void SampleScene::scroll_callback(GLFWwindow*,
   // here we implement zoom in and zoom out control
   const float MAX_SIZE = 10; // for example
   const float MIN_SIZE = 1;  // for example
-  if (cameraSize >= MIN_SIZE && cameraSize <= MAX_SIZE)
-    cameraSize -= float(yoffset);
-  if (cameraSize <= MIN_SIZE)
-    cameraSize = MIN_SIZE;
-  if (cameraSize >= MAX_SIZE)
-    cameraSize = MAX_SIZE;
+  if (zoom >= MIN_SIZE && zoom <= MAX_SIZE)
+    zoom -= float(yoffset);
+  if (zoom <= MIN_SIZE)
+    zoom = MIN_SIZE;
+  if (zoom >= MAX_SIZE)
+    zoom = MAX_SIZE;
 }
 
 void SampleScene::update()
 {
   // add your updates for each frame here
+  animationTime = std::chrono::duration<float>(
+                      std::chrono::steady_clock::now() - startTime)
+                      .count();
+  if (updateDelayMs > 0)
+    std::this_thread::sleep_for(std::chrono::milliseconds(updateDelayMs));
+}
+
+// copy what renderScene() needs, on the thread running update()
+void SampleScene::publishSnapshot()
+{
+  CameraState &state = cameraStates.write();
+  state.position = cameraPos;
+  state.front = cameraFront;
+  state.up = cameraUp;
+  state.size = zoom;
+  state.debug = debug;
+  state.time = animationTime;
+  cameraStates.publish();
+}
+
+// take the latest camera on the render thread
+void SampleScene::consumeSnapshot()
+{
+  const CameraState &state = cameraStates.read();
+  if (state.debug != renderedCamera.debug)
+  {
+    lightFieldShader->use();
+    lightFieldShader->setUniform("debug", state.debug);
+    lightFieldShader->unuse();
+  }
+  renderedCamera = state;
+  cameraSize = state.size;
+  if (lodTerrain && !proceduralTerrain && meshPath.empty())
+    selectTerrainLod();
+  if (terrainStream.isCreated())
+    streamTerrain(state.time);
+  if (cacheProgram)
+    renderShadingCache();
 }
 
 void SampleScene::onExit()
 {
+  if (terrainStream.isCreated())
+  {
+    StreamBufferStats stats = terrainStream.getStats();
+    double mib = double(stats.bytes) / double(1 << 20);
+    std::cout << "[Info] streamed " << mib << " MiB of terrain vertices over "
+              << stats.frames << " frames, "
+              << (terrainStreamMs > 0 ? mib * 1000.0 / terrainStreamMs : 0)
+              << " MiB/s, " << stats.stalls << " stalls ("
+              << stats.stallMs << " ms, longest " << stats.maxStallMs << " ms)"
+              << std::endl;
+  }
+  terrainStream.release();
+  delete terrainJobs;
   glDeleteVertexArrays(1, &vao);
   glDeleteBuffers(1, &vbo);
   glDeleteBuffers(1, &ibo);
   delete shaderProgram;
+  delete cacheProgram;
+  glDeleteVertexArrays(1, &cacheVao);
+  releaseShadingCache();
+  releaseObjects();
 }
 
 glm::mat4 SampleScene::getViewMatrixOfCurrentFrame()
 {
-  return glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+  return glm::lookAt(renderedCamera.position,
+                     renderedCamera.position + renderedCamera.front,
+                     renderedCamera.up);
 }
 
 void SampleScene::renderScene()
 {
   glCheckError(__FILE__, __LINE__);
 
-  // clear
-  glClear(GL_COLOR_BUFFER_BIT);
+  // clear, HoloPlayContext has cleared the depth of the view
   glClearColor(0.0, 0.0, 0.0, 1.0);
-
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  glClear(GL_COLOR_BUFFER_BIT);
   glCheckError(__FILE__, __LINE__);
 
   shaderProgram->use();
   glCheckError(__FILE__, __LINE__);
 
-  // holoplay special camera setup for each view, don't delete
-  shaderProgram->setUniform("view", GetViewMatrixOfCurrentView());
-  shaderProgram->setUniform("projection", GetProjectionMatrixOfCurrentView());
+  // holoplay special camera setup for each view, don't delete: the shader
+  // derives the view from its index, shaders with matrix uniforms would set
+  // GetViewMatrixOfCurrentView() and GetProjectionMatrixOfCurrentView()
+  shaderProgram->setUniform("viewIndex", GetCurrentViewIndex());
   glCheckError(__FILE__, __LINE__);
 
   // render your scene here as usual
@@ -317,13 +1408,57 @@ void SampleScene::renderScene()
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
 
   glCheckError(__FILE__, __LINE__);
-  glDrawElements(GL_TRIANGLES,        // mode
-                 GLsizei(size * size * 2 * 3), // count
-                 GL_UNSIGNED_INT,     // type
-                 NULL                 // element array buffer offset
-  );
+  drawTerrain(1);
 
   glBindVertexArray(0);
 
   shaderProgram->unuse();
+
+  drawObjects(GetCurrentViewIndex());
+}
+
+// the same draw as renderScene(), recorded on a view worker
+bool SampleScene::buildViewCommands(ViewCommandList &commands)
+{
+  // the objects are drawn from renderScene(), their commands are on the GPU
+  if (gpuCulling.isCreated() && gpuCulling.getObjectCount())
+    return false;
+
+  commands.clearColor = glm::vec4(0.0, 0.0, 0.0, 1.0);
+  commands.clearMask = GL_COLOR_BUFFER_BIT;
+
+  commands.setUniform(viewIndexLocation, commands.viewIndex);
+
+  size_t indexSize =
+      terrainIndexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+  for (size_t i = 0; i < terrainChunks.size(); ++i)
+  {
+    const MeshChunk &chunk = terrainChunks[i];
+    DrawCommand draw = {};
+    draw.program = shaderProgram->getHandle();
+    draw.vao = vao;
+    draw.mode = terrainMode;
+    draw.count = GLsizei(chunk.indexCount);
+    draw.indexType = terrainIndexType;
+    draw.first = chunk.firstIndex * indexSize;
+    draw.baseVertex = int(chunk.baseVertex);
+    commands.draw(draw);
+  }
+  return true;
+}
+
+// every view in one draw, an instance per view
+void SampleScene::renderAllViews()
+{
+  glClearColor(0.0, 0.0, 0.0, 1.0);
+  glClear(GL_COLOR_BUFFER_BIT);
+
+  shaderProgram->use();
+  shaderProgram->setUniform("viewIndex", -1);
+  glBindVertexArray(vao);
+  drawTerrain(GLsizei(qs_totalViews));
+  glBindVertexArray(0);
+  shaderProgram->unuse();
+  drawObjects(-1);
+  glCheckError(__FILE__, __LINE__);
 }
@@ -8,12 +8,56 @@
 #ifndef OPENGL_CMAKE_SKELETON_MYAPPLICATION
 #define OPENGL_CMAKE_SKELETON_MYAPPLICATION
 
+#include "GpuCulling.hpp"
 #include "HoloPlayContext.hpp"
+#include "MeshFile.hpp"
+#include "MeshOptimizer.hpp"
+#include "StreamBuffer.hpp"
+#include "TerrainLod.hpp"
+#include "TerrainMesh.hpp"
+#include "TripleBuffer.hpp"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+class JobSystem;
 
 class SampleScene : public HoloPlayContext
 {
 public:
   SampleScene();
+
+  // makes update() take at least ms milliseconds, to try the simulation
+  // thread against a slow update
+  void setUpdateDelay(int ms) { updateDelayMs = ms; }
+  // regenerates the terrain with cells x cells quads
+  void setTerrainSize(unsigned int cells);
+  // PackedTerrainVertex (16 bytes) instead of TerrainVertex (40 bytes)
+  void setPackedVertices(bool packed);
+  // triangles in vertex cache order, in chunks of 16-bit indices
+  void setOptimizedMesh(bool optimized);
+  // no vertex or index buffer, the vertex shader computes the grid
+  void setProceduralTerrain(bool procedural);
+  // quadtree of chunks picked each frame for an error of at most tolerance
+  // pixels, 0 for the whole grid
+  void setTerrainLod(float tolerance);
+  // draws a baked mesh file (MeshBake.hpp) instead of the terrain, uploaded
+  // straight from its mapping; the terrain stays if it can't be read
+  void setMeshFile(const std::string &path);
+  // count cubes above the terrain, culled for every view and drawn with
+  // multi draw indirect by GpuCulling; 0 for none
+  void setCulledObjects(size_t count);
+  // the height map moves, its vertices generated every frame into a
+  // persistently mapped StreamBuffer ring; refused with packed vertices, the
+  // procedural, LOD or optimized terrain and mesh files
+  void setAnimatedTerrain(bool animated,
+                          StreamMapping mapping = StreamMapping::Coherent);
+  // the ambient and diffuse light of the terrain rendered once per frame
+  // into a resolution x resolution texture over its xy, which every view
+  // samples and adds its specular to; 0 for full shading in each view. Not
+  // for mesh files, and the objects are always shaded in full
+  void setShadingCache(int resolution);
   // control
   virtual void mouse_callback(GLFWwindow *window, double xpos, double ypos);
   virtual void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
@@ -24,16 +68,80 @@ protected:
   virtual void renderScene();
   virtual glm::mat4 getViewMatrixOfCurrentFrame();
   virtual bool processInput(GLFWwindow *window);
+  virtual void publishSnapshot();
+  virtual void consumeSnapshot();
+  virtual bool buildViewCommands(ViewCommandList &commands);
+  virtual void renderAllViews();
 
   ShaderProgram *shaderProgram;
 
 private:
-  const unsigned int size = 100;
+  unsigned int size = 100; // terrain cells per side
+  bool packedVertices = false;
+  bool optimizedMesh = false;
+  bool proceduralTerrain = false;
+  bool lodTerrain = false;
+  float lodTolerance = 0;
+  bool animatedTerrain = false;
+  StreamMapping streamMapping = StreamMapping::Coherent;
+  void buildTerrain();      // fills vbo and ibo for size
+  void buildOptimizedTerrain(JobSystem &jobs);
+  bool loadMeshFile();
+  void buildLodTerrain(JobSystem &jobs);
+  void selectTerrainLod();
+  TerrainBounds getPackedBounds() const;
+  void buildProgram();      // shaderProgram and vao for the vertex format
+  void setTerrainUniforms();
+  void drawTerrain(GLsizei instances);
+  void streamTerrain(float time);
+  void setVertexFormat(ShaderProgram &program);
+  void renderShadingCache();
+  void releaseShadingCache();
+  void buildObjects(size_t count);
+  void drawObjects(int viewIndex);
+  void releaseObjects();
+
+  // the draws of the terrain, one chunk unless optimizedMesh; no index type
+  // draws arrays, indexCount vertices of them
+  std::vector<MeshChunk> terrainChunks;
+  GLenum terrainMode = GL_TRIANGLES;
+  GLenum terrainIndexType = GL_UNSIGNED_INT;
+
+  // the file drawn instead of the terrain, when not empty, and its layout
+  std::string meshPath;
+  MeshFileHeader meshHeader = MeshFileHeader();
+  bool meshPacked = false;
+
+  // the levels of the terrain and this frame's chunks, when lodTerrain
+  TerrainLod terrainLod;
+  std::vector<size_t> lodSelection;
+  size_t lodReportedChunks = 0;
+  std::chrono::steady_clock::time_point lodReportTime;
+
+  // the vertices of the animated terrain, a frame's worth per allocation,
+  // and the time spent generating them into it
+  StreamBuffer terrainStream;
+  JobSystem *terrainJobs = nullptr;
+  double terrainStreamMs = 0;
 
   // VBO/VAO/ibo
   GLuint vao, vbo, ibo;
 
-  // camera
+  // the texture of setShadingCache(), its target and the terrain drawn into it
+  int shadingCacheSize = 0;
+  GLuint cacheTexture = 0, cacheDepth = 0, cacheFramebuffer = 0;
+  ShaderProgram *cacheProgram = nullptr;
+  GLuint cacheVao = 0;
+
+  // the cubes of setCulledObjects(), one mesh drawn once per object
+  GpuCulling gpuCulling;
+  ShaderProgram *objectProgram = nullptr;
+  GLuint objectVao = 0, objectVbo = 0, objectIbo = 0;
+
+  // looked up once, ShaderProgram::uniform() isn't safe on the view workers
+  GLint viewIndexLocation;
+
+  // camera, owned by processInput() / update()
   glm::vec3 cameraPos = glm::vec3(0.0f, 0.0f, 3.0f);
   glm::vec3 cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
   glm::vec3 cameraUp = glm::vec3(0.0f, 1.0f, 0.0f);
@@ -45,6 +153,23 @@ private:
   float lastX = 800.0f / 2.0;
   float lastY = 600.0 / 2.0;
   int debug = 0;
+  float zoom = 5.0f; // becomes cameraSize on the render thread
+  int updateDelayMs = 0;
+  std::chrono::steady_clock::time_point startTime;
+  float animationTime = 0; // seconds, advanced by update()
+
+  // the part of the state the renderer needs, published after each update()
+  struct CameraState
+  {
+    glm::vec3 position;
+    glm::vec3 front;
+    glm::vec3 up;
+    float size;
+    int debug;
+    float time;
+  };
+  TripleBuffer<CameraState> cameraStates;
+  CameraState renderedCamera; // the snapshot being rendered
 };
 
 #endif // OPENGL_CMAKE_SKELETON_MYAPPLICATION
@@ -0,0 +1,264 @@
+/**
+ * ServiceConnection.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifdef WIN32
+#pragma warning(disable : 4464 4820 4514 5045 4201 5039 4061 4710)
+#endif
+
+#include "ServiceConnection.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include "libHoloPlayCore.h"
+
+using namespace std;
+
+// HoloPlay Core backend
+// =========================================================
+HoloPlayCoreBackend::HoloPlayCoreBackend(const string &appName,
+                                         hpc_license_type license)
+    : appName(appName), license(license)
+{
+}
+
+hpc_client_error HoloPlayCoreBackend::connect()
+{
+  // the pipe is set up again on reconnection, hpc_InitializeApp registers the
+  // app and fetches a fresh state message
+  hpc_SetupMessagePipe();
+  hpc_client_error errco = hpc_InitializeApp(appName.c_str(), license);
+  initialized = errco == hpc_CLIERR_NOERROR;
+  return errco;
+}
+
+hpc_client_error HoloPlayCoreBackend::refresh()
+{
+  return hpc_RefreshState();
+}
+
+bool HoloPlayCoreBackend::readCalibration(int devIndex, DeviceCalibration &out)
+{
+  if (hpc_GetNumDevices() <= devIndex)
+    return false;
+  out.pitch = hpc_GetDevicePropertyPitch(devIndex);
+  out.tilt = hpc_GetDevicePropertyTilt(devIndex);
+  out.center = hpc_GetDevicePropertyCenter(devIndex);
+  out.invView = hpc_GetDevicePropertyInvView(devIndex);
+  out.subp = hpc_GetDevicePropertySubp(devIndex);
+  out.ri = hpc_GetDevicePropertyRi(devIndex);
+  out.bi = hpc_GetDevicePropertyBi(devIndex);
+  out.displayAspect = hpc_GetDevicePropertyDisplayAspect(devIndex);
+  out.viewCone =
+      hpc_GetDevicePropertyFloat(devIndex, "/calibration/viewCone/value");
+  out.fringe = hpc_GetDevicePropertyFringe(devIndex);
+  out.screenW = hpc_GetDevicePropertyScreenW(devIndex);
+  out.screenH = hpc_GetDevicePropertyScreenH(devIndex);
+  out.winX = hpc_GetDevicePropertyWinX(devIndex);
+  out.winY = hpc_GetDevicePropertyWinY(devIndex);
+  return true;
+}
+
+void HoloPlayCoreBackend::disconnect()
+{
+  hpc_TeardownMessagePipe();
+}
+
+void HoloPlayCoreBackend::close()
+{
+  if (initialized)
+    hpc_CloseApp();
+  else
+    hpc_TeardownMessagePipe();
+  initialized = false;
+}
+
+// connection manager
+// =========================================================
+ServiceConnection::ServiceConnection(ServiceBackend *backend, int devIndex)
+    : backend(backend),
+      devIndex(devIndex),
+      generation(0),
+      state(ServiceState::Disconnected),
+      reconnects(0)
+{
+}
+
+ServiceConnection::~ServiceConnection()
+{
+  close();
+}
+
+bool ServiceConnection::connect(hpc_client_error &error)
+{
+  lock_guard<mutex> lock(serviceMutex);
+  error = backend->connect();
+  if (error != hpc_CLIERR_NOERROR)
+  {
+    backend->disconnect();
+    return false;
+  }
+  if (!publishCalibration())
+  {
+    backend->close();
+    return false;
+  }
+  state = ServiceState::Connected;
+  return true;
+}
+
+void ServiceConnection::start()
+{
+  if (watcher.joinable())
+    return;
+  {
+    lock_guard<mutex> lock(wakeMutex);
+    stopping = false;
+  }
+  watcher = thread(&ServiceConnection::watch, this);
+}
+
+void ServiceConnection::close()
+{
+  {
+    lock_guard<mutex> lock(wakeMutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  if (watcher.joinable())
+    watcher.join();
+
+  lock_guard<mutex> lock(serviceMutex);
+  if (state != ServiceState::Disconnected)
+    backend->close();
+  state = ServiceState::Disconnected;
+}
+
+shared_ptr<const DeviceCalibration> ServiceConnection::getCalibration() const
+{
+  return atomic_load(&calibration);
+}
+
+bool ServiceConnection::tryCall(const function<hpc_client_error()> &f)
+{
+  if (state != ServiceState::Connected)
+    return false;
+  unique_lock<mutex> lock(serviceMutex, try_to_lock);
+  if (!lock.owns_lock())
+    return false;
+  hpc_client_error errco = f();
+  lock.unlock();
+  if (errco != hpc_CLIERR_NOERROR)
+    reportError(errco);
+  return true;
+}
+
+void ServiceConnection::reportError(hpc_client_error error)
+{
+  // only the pipe errors mean the service went away
+  if (error != hpc_CLIERR_NOSERVICE && error != hpc_CLIERR_PIPEERROR &&
+      error != hpc_CLIERR_SENDTIMEOUT && error != hpc_CLIERR_RECVTIMEOUT)
+    return;
+  {
+    lock_guard<mutex> lock(wakeMutex);
+    errorReported = true;
+  }
+  wake.notify_all();
+}
+
+// called with serviceMutex held
+bool ServiceConnection::publishCalibration()
+{
+  shared_ptr<DeviceCalibration> fresh = make_shared<DeviceCalibration>();
+  if (!backend->readCalibration(devIndex, *fresh))
+    return false;
+  atomic_store(&calibration, shared_ptr<const DeviceCalibration>(fresh));
+  generation++;
+  return true;
+}
+
+bool ServiceConnection::sleepFor(int ms)
+{
+  unique_lock<mutex> lock(wakeMutex);
+  wake.wait_for(lock, chrono::milliseconds(ms),
+                [this] { return stopping || errorReported; });
+  errorReported = false;
+  return !stopping;
+}
+
+void ServiceConnection::watch()
+{
+  int backoffMs = initialBackoffMs;
+  while (sleepFor(state == ServiceState::Connected ? pollIntervalMs : backoffMs))
+  {
+    if (state == ServiceState::Connected)
+    {
+      hpc_client_error errco;
+      {
+        lock_guard<mutex> lock(serviceMutex);
+        errco = backend->refresh();
+      }
+      if (errco == hpc_CLIERR_NOERROR)
+        continue;
+      cout << "[Info] lost HoloPlay Service (" << describeClientError(errco)
+           << "), reconnecting in the background" << endl;
+      state = ServiceState::Reconnecting;
+      backoffMs = initialBackoffMs;
+      lock_guard<mutex> lock(serviceMutex);
+      backend->disconnect();
+      continue;
+    }
+
+    // reconnecting
+    hpc_client_error errco;
+    bool published = false;
+    {
+      lock_guard<mutex> lock(serviceMutex);
+      errco = backend->connect();
+      if (errco == hpc_CLIERR_NOERROR)
+        published = publishCalibration();
+      else
+        backend->disconnect();
+    }
+    if (published)
+    {
+      state = ServiceState::Connected;
+      reconnects++;
+      cout << "[Info] reconnected to HoloPlay Service, calibration "
+           << generation.load() << " published" << endl;
+    }
+    else
+    {
+      // the service may be up without the device yet, keep polling
+      backoffMs = min(backoffMs * 2, maxBackoffMs);
+    }
+  }
+}
+
+const char *describeClientError(hpc_client_error error)
+{
+  switch (error)
+  {
+  case hpc_CLIERR_NOERROR:
+    return "No error";
+  case hpc_CLIERR_NOSERVICE:
+    return "HoloPlay Service not running";
+  case hpc_CLIERR_SERIALIZEERR:
+    return "Client message could not be serialized";
+  case hpc_CLIERR_VERSIONERR:
+    return "Incompatible version of HoloPlay Service";
+  case hpc_CLIERR_PIPEERROR:
+    return "Interprocess pipe broken";
+  case hpc_CLIERR_SENDTIMEOUT:
+    return "Interprocess pipe send timeout";
+  case hpc_CLIERR_RECVTIMEOUT:
+    return "Interprocess pipe receive timeout";
+  default:
+    return "Unknown error";
+  }
+}
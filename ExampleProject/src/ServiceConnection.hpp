@@ -0,0 +1,162 @@
+/**
+ * ServiceConnection.hpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifndef OPENGL_CMAKE_SKELETON_SERVICECONNECTION_HPP
+#define OPENGL_CMAKE_SKELETON_SERVICECONNECTION_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "HoloPlayCore.h"
+
+// Keeps the link to HoloPlay Service alive without blocking the render loop.
+//
+// The first connection is made synchronously, as before. After that a
+// background thread polls the service with hpc_RefreshState; when a call fails
+// (service restarted, pipe broken, timeouts) it tears the pipe down and
+// reconnects with exponential backoff. The render thread keeps drawing with the
+// last known calibration and picks up the new one once getGeneration() changes.
+
+// everything the renderer needs from the state message of one device
+struct DeviceCalibration
+{
+    float pitch;
+    float tilt;
+    float center;
+    float invView;
+    float subp;
+    int ri;
+    int bi;
+    float displayAspect;
+    float viewCone;
+    float fringe;
+    int screenW;
+    int screenH;
+    int winX;
+    int winY;
+};
+
+// The calls made to the service, so tests and benchmarks can plug in a mock.
+// All of them may block for up to the pipe timeouts.
+class ServiceBackend
+{
+public:
+    virtual ~ServiceBackend() {}
+
+    // sets up the message pipe and registers the app
+    virtual hpc_client_error connect() = 0;
+    // round trip to the service, refreshes the state message
+    virtual hpc_client_error refresh() = 0;
+    // reads the calibration from the last state message
+    virtual bool readCalibration(int devIndex, DeviceCalibration &out) = 0;
+    // severs the message pipe
+    virtual void disconnect() = 0;
+    // says goodbye to the service (hpc_CloseApp)
+    virtual void close() = 0;
+};
+
+// the real thing, through HoloPlay Core
+class HoloPlayCoreBackend : public ServiceBackend
+{
+public:
+    HoloPlayCoreBackend(const std::string &appName,
+                        hpc_license_type license = hpc_LICENSE_NONCOMMERCIAL);
+
+    virtual hpc_client_error connect();
+    virtual hpc_client_error refresh();
+    virtual bool readCalibration(int devIndex, DeviceCalibration &out);
+    virtual void disconnect();
+    virtual void close();
+
+private:
+    std::string appName;
+    hpc_license_type license;
+    bool initialized = false;
+};
+
+enum class ServiceState
+{
+    Disconnected, // never connected, or closed
+    Connected,
+    Reconnecting  // lost, the background thread is retrying
+};
+
+class ServiceConnection
+{
+public:
+    // takes ownership of backend
+    ServiceConnection(ServiceBackend *backend, int devIndex = 0);
+    ~ServiceConnection();
+
+    // first connection, blocking. Returns false if the service couldn't be
+    // reached (error says why) or has no device at devIndex (error is
+    // hpc_CLIERR_NOERROR), and leaves the connection Disconnected.
+    bool connect(hpc_client_error &error);
+
+    // starts watching the connection on a background thread
+    void start();
+
+    // stops the background thread and closes the app
+    void close();
+
+    // Last known calibration, never null once connect() succeeded. The object
+    // is immutable; a reconnect publishes a new one.
+    std::shared_ptr<const DeviceCalibration> getCalibration() const;
+
+    // bumped every time a new calibration is published, cheap to poll per frame
+    uint64_t getGeneration() const { return generation.load(); }
+
+    ServiceState getState() const { return state.load(); }
+    uint64_t getReconnectCount() const { return reconnects.load(); }
+
+    // Runs f with exclusive access to the service, unless the connection is
+    // down or the background thread is busy talking to it: returns false
+    // instead of waiting, so the render thread never blocks on the pipe.
+    bool tryCall(const std::function<hpc_client_error()> &f);
+
+    // reports an error seen by the caller, wakes up the background thread
+    void reportError(hpc_client_error error);
+
+    // backoff between reconnection attempts, and health check period
+    int initialBackoffMs = 100;
+    int maxBackoffMs = 5000;
+    int pollIntervalMs = 1000;
+
+private:
+    ServiceConnection(const ServiceConnection &);
+    ServiceConnection &operator=(const ServiceConnection &);
+
+    void watch();
+    bool publishCalibration();
+    bool sleepFor(int ms); // false if stopping
+
+    std::unique_ptr<ServiceBackend> backend;
+    int devIndex;
+
+    std::mutex serviceMutex; // held for every call into the backend
+    std::shared_ptr<const DeviceCalibration> calibration;
+    std::atomic<uint64_t> generation;
+    std::atomic<ServiceState> state;
+    std::atomic<uint64_t> reconnects;
+
+    std::thread watcher;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    bool errorReported = false;
+};
+
+// human readable hpc_client_error
+const char *describeClientError(hpc_client_error error);
+
+#endif // OPENGL_CMAKE_SKELETON_SERVICECONNECTION_HPP
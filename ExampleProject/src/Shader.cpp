@@ -185,7 +185,9 @@ void ShaderProgram::setAttribute(const std::string &name,
                                  GLenum type)
 {
   GLint loc = attribute(name);
-  glEnableVertexAttribArray(loc);
+  if (loc < 0)
+    return;
+  glEnableVertexAttribArray(GLuint(loc));
   glVertexAttribPointer(loc, size, type, normalize, stride,
                         reinterpret_cast<void *>(offset));
 }
@@ -216,6 +218,15 @@ void ShaderProgram::setAttribute(const std::string &name,
   setAttribute(name, size, stride, offset, false, GL_FLOAT);
 }
 
+void ShaderProgram::setNormalizedAttribute(const std::string &name,
+                                           GLint size,
+                                           GLsizei stride,
+                                           GLuint offset,
+                                           GLenum type)
+{
+  setAttribute(name, size, stride, offset, GL_TRUE, type);
+}
+
 void ShaderProgram::setUniform(const std::string &name,
                                float x,
                                float y,
@@ -62,6 +62,8 @@ public:
   void setAttribute(const std::string& name, GLint size, GLsizei stride, GLuint offset, GLboolean normalize);
   void setAttribute(const std::string& name, GLint size, GLsizei stride, GLuint offset, GLenum type); 
   void setAttribute(const std::string& name, GLint size, GLsizei stride, GLuint offset);
+  // integer components read as floats in [0, 1] (unsigned) or [-1, 1] (signed)
+  void setNormalizedAttribute(const std::string& name, GLint size, GLsizei stride, GLuint offset, GLenum type);
   // clang-format on
 
   // provide uniform location
@@ -0,0 +1,135 @@
+/**
+ * SimulationThread.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifdef WIN32
+#pragma warning(disable : 4464 4820 4514 5045 4201 5039 4061 4710)
+#endif
+
+#include "SimulationThread.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace std;
+
+// simulation thread
+// =========================================================
+SimulationThread::SimulationThread() : stopping(false), done(false)
+{
+  stats = SimulationStats();
+}
+
+SimulationThread::~SimulationThread()
+{
+  stop();
+}
+
+void SimulationThread::start(double tickHz, const Tick &tick)
+{
+  stop();
+  this->tickHz = tickHz;
+  this->tick = tick;
+  stopping = false;
+  done = false;
+  {
+    lock_guard<mutex> lock(statsMutex);
+    stats = SimulationStats();
+  }
+  thread = std::thread(&SimulationThread::loop, this);
+}
+
+void SimulationThread::stop()
+{
+  stopping = true;
+  if (thread.joinable())
+    thread.join();
+}
+
+SimulationStats SimulationThread::getStats() const
+{
+  lock_guard<mutex> lock(statsMutex);
+  return stats;
+}
+
+void SimulationThread::loop()
+{
+  typedef chrono::steady_clock Clock;
+  const Clock::duration period = chrono::duration_cast<Clock::duration>(
+      chrono::duration<double>(1.0 / tickHz));
+  const double dt = 1.0 / tickHz;
+  Clock::time_point next = Clock::now();
+
+  while (!stopping)
+  {
+    Clock::time_point begin = Clock::now();
+    bool keepGoing = tick(dt);
+    Clock::time_point end = Clock::now();
+    double ms = chrono::duration<double, milli>(end - begin).count();
+
+    next += period;
+    uint64_t skipped = 0;
+    if (end > next + period * 2)
+    {
+      // more than a couple of ticks behind: drop the missed ticks instead of
+      // running them back to back, the simulation slows down rather than
+      // spiralling. Smaller delays are caught up by not sleeping.
+      skipped = uint64_t((end - next) / period);
+      next += period * int64_t(skipped);
+    }
+
+    {
+      lock_guard<mutex> lock(statsMutex);
+      stats.averageTickMs =
+          (stats.averageTickMs * double(stats.ticks) + ms) / double(stats.ticks + 1);
+      stats.ticks++;
+      stats.maxTickMs = max(stats.maxTickMs, ms);
+      if (ms > dt * 1000.0)
+        stats.overruns++;
+      stats.skipped += skipped;
+    }
+
+    if (!keepGoing)
+    {
+      done = true;
+      return;
+    }
+    this_thread::sleep_until(next);
+  }
+}
+
+// input queue
+// =========================================================
+InputQueue::InputQueue()
+{
+  for (int i = 0; i < KEY_COUNT; ++i)
+    keys[i] = false;
+}
+
+void InputQueue::push(const InputEvent &event)
+{
+  lock_guard<mutex> lock(pendingMutex);
+  pending.push_back(event);
+}
+
+void InputQueue::setKey(int key, bool pressed)
+{
+  if (key >= 0 && key < KEY_COUNT)
+    keys[key] = pressed;
+}
+
+void InputQueue::drain(vector<InputEvent> &events)
+{
+  events.clear();
+  lock_guard<mutex> lock(pendingMutex);
+  events.swap(pending);
+}
+
+bool InputQueue::isKeyPressed(int key) const
+{
+  return key >= 0 && key < KEY_COUNT && keys[key].load();
+}
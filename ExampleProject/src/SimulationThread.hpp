@@ -0,0 +1,105 @@
+/**
+ * SimulationThread.hpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifndef OPENGL_CMAKE_SKELETON_SIMULATIONTHREAD_HPP
+#define OPENGL_CMAKE_SKELETON_SIMULATIONTHREAD_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-rate simulation thread, and the queue feeding it input.
+//
+// GLFW only delivers input on the main thread, so with a simulation thread the
+// main thread keeps polling events and records them in an InputQueue; the
+// simulation thread replays them at the start of each tick.
+
+// counters of a SimulationThread, readable from any thread
+struct SimulationStats
+{
+    uint64_t ticks;      // ticks run
+    uint64_t overruns;   // ticks that took longer than the period
+    uint64_t skipped;    // ticks dropped to catch up after an overrun
+    double averageTickMs;
+    double maxTickMs;
+};
+
+class SimulationThread
+{
+public:
+    // called once per tick with the fixed time step in seconds, returns false
+    // to stop the thread
+    typedef std::function<bool(double dt)> Tick;
+
+    SimulationThread();
+    ~SimulationThread();
+
+    void start(double tickHz, const Tick &tick);
+
+    // waits for the current tick to end
+    void stop();
+
+    // true once the tick function asked to stop
+    bool finished() const { return done.load(); }
+
+    double getTickHz() const { return tickHz; }
+    SimulationStats getStats() const;
+
+private:
+    SimulationThread(const SimulationThread &);
+    SimulationThread &operator=(const SimulationThread &);
+
+    void loop();
+
+    Tick tick;
+    double tickHz = 0;
+    std::thread thread;
+    std::atomic<bool> stopping;
+    std::atomic<bool> done;
+
+    mutable std::mutex statsMutex;
+    SimulationStats stats;
+};
+
+// mouse and scroll events recorded on the main thread
+struct InputEvent
+{
+    enum Type
+    {
+        CursorPos,
+        Scroll
+    } type;
+    double x;
+    double y;
+};
+
+class InputQueue
+{
+public:
+    static const int KEY_COUNT = 512;
+
+    InputQueue();
+
+    // main thread, from the GLFW callbacks
+    void push(const InputEvent &event);
+    void setKey(int key, bool pressed);
+
+    // simulation thread: moves the recorded events into events
+    void drain(std::vector<InputEvent> &events);
+    bool isKeyPressed(int key) const;
+
+private:
+    std::mutex pendingMutex;
+    std::vector<InputEvent> pending;
+    std::atomic<bool> keys[KEY_COUNT];
+};
+
+#endif // OPENGL_CMAKE_SKELETON_SIMULATIONTHREAD_HPP
@@ -0,0 +1,228 @@
+/**
+ * StreamBuffer.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifdef WIN32
+#pragma warning(disable : 4464 4820 4514 5045 4201 5039 4061 4710)
+#endif
+
+#include "StreamBuffer.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#include "glError.hpp"
+
+using namespace std;
+
+// how long a single glClientWaitSync() blocks before trying again
+static const GLuint64 WAIT_STEP_NS = 1000000;
+
+// the binding point used to touch the buffer, none of the draws use it
+static const GLenum TARGET = GL_COPY_WRITE_BUFFER;
+
+StreamBuffer::StreamBuffer()
+{
+  stats = StreamBufferStats();
+}
+
+StreamBuffer::~StreamBuffer()
+{
+  release();
+}
+
+bool StreamBuffer::isPersistentSupported()
+{
+  return GLEW_ARB_buffer_storage;
+}
+
+bool StreamBuffer::create(const StreamBufferSettings &settings)
+{
+  release();
+  size = max<size_t>(settings.size, 1);
+  mapping = settings.mapping;
+  if (mapping != StreamMapping::BufferSubData && !isPersistentSupported())
+    mapping = StreamMapping::BufferSubData;
+
+  GLint alignment = 256;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  uniformAlignment = size_t(max(alignment, 1));
+
+  glGenBuffers(1, &buffer);
+  glBindBuffer(TARGET, buffer);
+  if (mapping != StreamMapping::BufferSubData)
+  {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT;
+    if (mapping == StreamMapping::Coherent)
+      flags |= GL_MAP_COHERENT_BIT;
+    glBufferStorage(TARGET, GLsizeiptr(size), NULL, flags);
+    if (mapping == StreamMapping::ExplicitFlush)
+      flags |= GL_MAP_FLUSH_EXPLICIT_BIT;
+    mapped = static_cast<unsigned char *>(
+        glMapBufferRange(TARGET, 0, GLsizeiptr(size), flags));
+    if (!mapped)
+    {
+      // immutable storage can't be respecified, start over with a plain buffer
+      mapping = StreamMapping::BufferSubData;
+      glBindBuffer(TARGET, 0);
+      glDeleteBuffers(1, &buffer);
+      glGenBuffers(1, &buffer);
+      glBindBuffer(TARGET, buffer);
+    }
+  }
+  if (mapping == StreamMapping::BufferSubData)
+  {
+    glBufferData(TARGET, GLsizeiptr(size), NULL, GL_STREAM_DRAW);
+    staging.resize(size);
+    mapped = staging.data();
+  }
+  glBindBuffer(TARGET, 0);
+  glCheckError(__FILE__, __LINE__);
+
+  head = 0;
+  used = 0;
+  frameBytes = 0;
+  stats = StreamBufferStats();
+  const char *names[] = {"coherent mapping", "explicitly flushed mapping",
+                         "glBufferSubData"};
+  cout << "[Info] stream buffer of " << (size >> 10) << " KiB, "
+       << names[int(mapping)] << endl;
+  return true;
+}
+
+void StreamBuffer::release()
+{
+  for (size_t i = 0; i < frames.size(); ++i)
+    glDeleteSync(frames[i].fence);
+  frames.clear();
+  if (buffer)
+  {
+    if (mapping != StreamMapping::BufferSubData && mapped)
+    {
+      glBindBuffer(TARGET, buffer);
+      glUnmapBuffer(TARGET);
+      glBindBuffer(TARGET, 0);
+    }
+    glDeleteBuffers(1, &buffer);
+    buffer = 0;
+  }
+  mapped = nullptr;
+  staging.clear();
+  staging.shrink_to_fit();
+  size = 0;
+}
+
+void StreamBuffer::retireFrames(bool waitForOldest)
+{
+  bool block = waitForOldest;
+  while (!frames.empty())
+  {
+    GLenum status =
+        glClientWaitSync(frames.front().fence,
+                         block ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                         block ? WAIT_STEP_NS : 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+    {
+      if (block)
+        continue;
+      break;
+    }
+    if (status == GL_WAIT_FAILED)
+      cout << "[Error] glClientWaitSync failed, reusing the stream buffer "
+              "frame anyway"
+           << endl;
+    glDeleteSync(frames.front().fence);
+    used -= frames.front().bytes;
+    frames.pop_front();
+    // one frame was waited for, collect the others only if already done
+    block = false;
+  }
+}
+
+StreamAllocation StreamBuffer::allocate(size_t bytes, size_t alignment)
+{
+  StreamAllocation allocation;
+  if (!buffer || !bytes)
+    return allocation;
+  alignment = max<size_t>(alignment, 1);
+  retireFrames(false);
+
+  for (;;)
+  {
+    // an empty ring starts over, nothing is lost to the wrap
+    if (!used)
+      head = 0;
+    size_t offset = (head + alignment - 1) / alignment * alignment;
+    bool wrap = offset + bytes > size;
+    if (wrap)
+      offset = 0;
+    size_t taken = (wrap ? size - head : offset - head) + bytes;
+    if (used + taken <= size)
+    {
+      head = offset + bytes;
+      used += taken;
+      frameBytes += taken;
+      stats.wraps += wrap ? 1 : 0;
+      stats.allocations++;
+      stats.bytes += bytes;
+      allocation.data = mapped + offset;
+      allocation.offset = offset;
+      allocation.size = bytes;
+      return allocation;
+    }
+    if (frames.empty())
+    {
+      cout << "[Error] stream buffer of " << size << " bytes can't hold "
+           << bytes << " more bytes in a frame of " << frameBytes << endl;
+      return allocation;
+    }
+
+    // the ring is full of frames still in flight
+    Clock::time_point start = Clock::now();
+    retireFrames(true);
+    double ms = chrono::duration<double, milli>(Clock::now() - start).count();
+    stats.stalls++;
+    stats.stallMs += ms;
+    stats.maxStallMs = max(stats.maxStallMs, ms);
+  }
+}
+
+StreamAllocation StreamBuffer::allocateUniform(size_t bytes)
+{
+  return allocate(bytes, uniformAlignment);
+}
+
+void StreamBuffer::flush(const StreamAllocation &allocation)
+{
+  if (!allocation.data || mapping == StreamMapping::Coherent)
+    return;
+  glBindBuffer(TARGET, buffer);
+  if (mapping == StreamMapping::ExplicitFlush)
+    glFlushMappedBufferRange(TARGET, GLintptr(allocation.offset),
+                             GLsizeiptr(allocation.size));
+  else
+    glBufferSubData(TARGET, GLintptr(allocation.offset),
+                    GLsizeiptr(allocation.size), allocation.data);
+  glBindBuffer(TARGET, 0);
+}
+
+void StreamBuffer::endFrame()
+{
+  stats.frames++;
+  if (!frameBytes)
+    return;
+  Frame frame;
+  frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  frame.bytes = frameBytes;
+  frames.push_back(frame);
+  frameBytes = 0;
+}
+
+void StreamBuffer::resetStats()
+{
+  stats = StreamBufferStats();
+}
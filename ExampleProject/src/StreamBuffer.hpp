@@ -0,0 +1,144 @@
+/**
+ * StreamBuffer.hpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifndef OPENGL_CMAKE_SKELETON_STREAMBUFFER_HPP
+#define OPENGL_CMAKE_SKELETON_STREAMBUFFER_HPP
+
+#include <GL/glew.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Ring buffer for data written by the CPU every frame.
+//
+// Re-specifying a buffer with glBufferData each frame makes the driver copy
+// the data, and possibly wait for the GPU to stop reading the old contents.
+// Instead one buffer is created with immutable storage (glBufferStorage) and
+// stays mapped for its whole life. allocate() hands out aligned ranges of it
+// one after the other, wrapping around at the end; the CPU writes straight
+// into them and the draws of the frame read them at their offset. Vertex,
+// index and uniform data can share the ring, each allocated with its own
+// alignment: a vertex stride, an index size or the uniform buffer offset
+// alignment.
+//
+// endFrame() puts a fence after the commands of the frame and remembers how
+// much of the ring the frame took. allocate() only hands out memory whose
+// fence has signalled, so the CPU never overwrites data a queued draw has yet
+// to read. If the ring is full it waits for the oldest frame, a stall, which
+// getStats() counts: sized for the frames the driver queues (three is usual)
+// the ring shouldn't stall.
+//
+// With coherent mapping the writes are seen by the GPU without any call; with
+// explicit flushing flush() makes each range visible, which some drivers
+// prefer for write-combined memory. Without ARB_buffer_storage the ring keeps
+// a copy in ordinary memory and flush() uploads it with glBufferSubData; the
+// fences then only bound the frames in flight.
+//
+// All calls are made on the render thread with the GL context current.
+
+enum class StreamMapping
+{
+    Coherent,      // GL_MAP_COHERENT_BIT, flush() does nothing
+    ExplicitFlush, // GL_MAP_FLUSH_EXPLICIT_BIT, flush() each range
+    BufferSubData  // no persistent mapping, flush() uploads the range
+};
+
+struct StreamBufferSettings
+{
+    size_t size = 16 << 20;
+    StreamMapping mapping = StreamMapping::Coherent;
+};
+
+// a range of the ring, valid until the frame it was allocated in retires
+struct StreamAllocation
+{
+    void *data = nullptr;  // where the CPU writes, nullptr if it failed
+    size_t offset = 0;     // in the buffer, for the draws
+    size_t size = 0;
+};
+
+// counters since create(), reset by resetStats()
+struct StreamBufferStats
+{
+    uint64_t frames;       // endFrame() calls
+    uint64_t allocations;
+    uint64_t bytes;        // allocated, without alignment padding
+    uint64_t wraps;        // times the ring went back to its start
+    uint64_t stalls;       // allocate() calls that waited for the GPU
+    double stallMs;        // time spent in those waits
+    double maxStallMs;
+};
+
+class StreamBuffer
+{
+public:
+    StreamBuffer();
+    ~StreamBuffer();
+
+    // whether the persistent mappings can be used on this context
+    static bool isPersistentSupported();
+
+    // allocates the ring; a persistent mapping that isn't supported falls
+    // back to BufferSubData, see getMapping()
+    bool create(const StreamBufferSettings &settings);
+    void release();
+    bool isCreated() const { return buffer != 0; }
+
+    GLuint getHandle() const { return buffer; }
+    size_t getSize() const { return size; }
+    StreamMapping getMapping() const { return mapping; }
+
+    // bytes starting at a multiple of alignment (any value, a vertex stride
+    // works); waits for the GPU if the ring is full. Fails if the ring can't
+    // hold them next to the rest of the frame.
+    StreamAllocation allocate(size_t bytes, size_t alignment);
+    // allocate() aligned for binding as a uniform buffer range
+    StreamAllocation allocateUniform(size_t bytes);
+
+    // makes the written range visible to the GPU, before the draws using it
+    void flush(const StreamAllocation &allocation);
+
+    // after the last command reading the allocations of this frame
+    void endFrame();
+
+    StreamBufferStats getStats() const { return stats; }
+    void resetStats();
+
+private:
+    StreamBuffer(const StreamBuffer &);
+    StreamBuffer &operator=(const StreamBuffer &);
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Frame
+    {
+        GLsync fence;
+        size_t bytes;      // of the ring, padding included
+    };
+
+    // frees the frames whose fence has signalled, or waits for the oldest
+    void retireFrames(bool waitForOldest);
+
+    GLuint buffer = 0;
+    size_t size = 0;
+    StreamMapping mapping = StreamMapping::Coherent;
+    unsigned char *mapped = nullptr; // the mapping, or the copy
+    std::vector<unsigned char> staging;
+    size_t uniformAlignment = 256;
+
+    size_t head = 0;       // next free byte
+    size_t used = 0;       // bytes from the oldest frame's start to head
+    size_t frameBytes = 0; // taken by the frame not yet ended
+    std::deque<Frame> frames;
+
+    StreamBufferStats stats;
+};
+
+#endif // OPENGL_CMAKE_SKELETON_STREAMBUFFER_HPP
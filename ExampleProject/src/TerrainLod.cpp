@@ -0,0 +1,258 @@
+/**
+ * TerrainLod.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifdef WIN32
+#pragma warning(disable : 4464 4820 4514 5045 4201 5039 4061 4710)
+#endif
+
+#include "TerrainLod.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "JobSystem.hpp"
+
+using namespace std;
+
+static const size_t C = TerrainLod::CHUNK_CELLS;
+
+// the height of a cell split like generateTerrainIndices() does, from the
+// heights of its corners, at (u, v) in [0, 1]
+static float cellHeight(float h00, float h10, float h01, float h11, float u,
+                        float v)
+{
+  if (u >= v) // (0, 0), (1, 0), (1, 1)
+    return h00 + u * (h10 - h00) + v * (h11 - h10);
+  return h00 + v * (h01 - h00) + u * (h11 - h01); // (1, 1), (0, 1), (0, 0)
+}
+
+TerrainLod::TerrainLod() {}
+
+size_t TerrainLod::getChunkVertexCount() const
+{
+  // the grid, then a skirt vertex under each edge vertex
+  return (C + 1) * (C + 1) + 4 * (C + 1);
+}
+
+void TerrainLod::build(unsigned minimumSize, float gridSpacing,
+                       JobSystem *jobs)
+{
+  size = unsigned(C);
+  levels = 0;
+  while (size < minimumSize)
+  {
+    size *= 2;
+    ++levels;
+  }
+  // the rounded grid spans the requested one, only its cells get smaller
+  spacing = gridSpacing * float(max(minimumSize, 1u)) / float(size);
+
+  size_t side = size_t(size) + 1;
+  coordinates.resize(side);
+  vector<float> heights(side);
+  for (size_t i = 0; i < side; ++i)
+  {
+    coordinates[i] = (float(i) - float(size) / 2.0f) * spacing;
+    heights[i] = sin(coordinates[i]);
+  }
+  // the full grid's height, 2 sin(x) sin(y) as in TerrainMesh
+  auto height = [&](size_t i, size_t j) {
+    return 2.0f * heights[i] * heights[j];
+  };
+
+  // level d holds 4^d nodes, row by row, after those of the levels above
+  vector<size_t> levelStart(size_t(levels) + 2, 0);
+  for (int d = 0; d <= levels; ++d)
+    levelStart[size_t(d) + 1] = levelStart[size_t(d)] + (size_t(1) << (2 * d));
+  nodes.resize(levelStart.back());
+  size_t chunkVertices = getChunkVertexCount();
+  vertices.resize(nodes.size() * chunkVertices);
+
+  for (int d = 0; d <= levels; ++d)
+  {
+    size_t across = size_t(1) << d;
+    size_t step = size_t(1) << (levels - d); // full grid cells per chunk cell
+    auto buildNodes = [&](size_t begin, size_t end) {
+      for (size_t n = begin; n < end; ++n)
+      {
+        size_t nx = n % across, ny = n / across;
+        size_t x0 = nx * C * step, y0 = ny * C * step;
+        TerrainLodNode &node = nodes[levelStart[size_t(d)] + n];
+        node.level = d;
+        node.baseVertex = (levelStart[size_t(d)] + n) * chunkVertices;
+        for (int k = 0; k < 4; ++k)
+          node.children[k] =
+              d == levels ? NO_CHILD
+                          : levelStart[size_t(d) + 1] +
+                                (2 * ny + size_t(k / 2)) * across * 2 +
+                                2 * nx + size_t(k % 2);
+
+        TerrainVertex *out = &vertices[node.baseVertex];
+        for (size_t b = 0; b <= C; ++b)
+          for (size_t a = 0; a <= C; ++a)
+            out[b * (C + 1) + a] = terrainVertexAt(
+                coordinates[x0 + a * step], coordinates[y0 + b * step]);
+
+        // compare with every point of the full grid under the node
+        float low = height(x0, y0), high = low, error = 0;
+        for (size_t j = 0; j <= C * step; ++j)
+          for (size_t i = 0; i <= C * step; ++i)
+          {
+            float h = height(x0 + i, y0 + j);
+            low = min(low, h);
+            high = max(high, h);
+            if (step == 1)
+              continue;
+            size_t a = min(i / step, C - 1), b = min(j / step, C - 1);
+            float u = float(i - a * step) / float(step);
+            float v = float(j - b * step) / float(step);
+            const TerrainVertex *cell = out + b * (C + 1) + a;
+            float mesh = cellHeight(cell[0].position.z, cell[1].position.z,
+                                    cell[C + 1].position.z,
+                                    cell[C + 2].position.z, u, v);
+            error = max(error, fabs(h - mesh));
+          }
+        node.error = error;
+        node.boundsMin = glm::vec3(coordinates[x0], coordinates[y0], low);
+        node.boundsMax = glm::vec3(coordinates[x0 + C * step],
+                                   coordinates[y0 + C * step], high);
+      }
+    };
+    size_t count = across * across;
+    if (jobs)
+      jobs->parallelFor(count, 1, buildNodes);
+    else
+      buildNodes(0, count);
+  }
+
+  // a parent is never more accurate than its children, so that select()
+  // never refines into something worse
+  for (size_t n = nodes.size(); n-- > 0;)
+    for (int k = 0; k < 4; ++k)
+      if (nodes[n].children[k] != NO_CHILD)
+        nodes[n].error =
+            max(nodes[n].error, nodes[nodes[n].children[k]].error);
+
+  // the finer of two neighbours has the true height at every vertex of the
+  // coarser one's edge, so they are at most the coarser one's error apart;
+  // the root's error is the largest of all
+  skirtDepth = nodes[0].error + 0.01f * spacing;
+  for (size_t n = 0; n < nodes.size(); ++n)
+  {
+    TerrainVertex *out = &vertices[nodes[n].baseVertex];
+    TerrainVertex *skirt = out + (C + 1) * (C + 1);
+    for (size_t k = 0; k <= C; ++k)
+    {
+      skirt[k] = out[k];                             // bottom, y = 0
+      skirt[C + 1 + k] = out[C * (C + 1) + k];       // top
+      skirt[2 * (C + 1) + k] = out[k * (C + 1)];     // left, x = 0
+      skirt[3 * (C + 1) + k] = out[k * (C + 1) + C]; // right
+    }
+    for (size_t k = 0; k < 4 * (C + 1); ++k)
+      skirt[k].position.z -= skirtDepth;
+  }
+
+  // the grid like generateTerrainIndices(), then a quad down from each edge
+  indices.clear();
+  for (size_t y = 0; y < C; ++y)
+    for (size_t x = 0; x < C; ++x)
+    {
+      uint16_t i00 = uint16_t(y * (C + 1) + x), i10 = uint16_t(i00 + 1);
+      uint16_t i01 = uint16_t(i00 + C + 1), i11 = uint16_t(i01 + 1);
+      uint16_t cell[6] = {i00, i10, i11, i11, i01, i00};
+      indices.insert(indices.end(), cell, cell + 6);
+    }
+  size_t skirtStart = (C + 1) * (C + 1);
+  for (size_t edge = 0; edge < 4; ++edge)
+    for (size_t k = 0; k < C; ++k)
+    {
+      uint16_t s0 = uint16_t(skirtStart + edge * (C + 1) + k);
+      uint16_t s1 = uint16_t(s0 + 1);
+      uint16_t e0 = vertexOfSkirt(s0 - skirtStart);
+      uint16_t e1 = vertexOfSkirt(s1 - skirtStart);
+      uint16_t quad[6] = {e0, e1, s1, s1, s0, e0};
+      indices.insert(indices.end(), quad, quad + 6);
+    }
+}
+
+TerrainBounds TerrainLod::getBounds() const
+{
+  TerrainBounds bounds;
+  if (nodes.empty())
+  {
+    bounds.origin = bounds.extent = glm::vec3(0.0f);
+    return bounds;
+  }
+  // the root's box covers the whole grid, and the skirts hang below it
+  bounds.origin = nodes[0].boundsMin - glm::vec3(0.0f, 0.0f, skirtDepth);
+  bounds.extent = nodes[0].boundsMax - bounds.origin;
+  return bounds;
+}
+
+uint16_t TerrainLod::vertexOfSkirt(size_t skirt)
+{
+  size_t edge = skirt / (C + 1), k = skirt % (C + 1);
+  switch (edge)
+  {
+  case 0:
+    return uint16_t(k);
+  case 1:
+    return uint16_t(C * (C + 1) + k);
+  case 2:
+    return uint16_t(k * (C + 1));
+  default:
+    return uint16_t(k * (C + 1) + C);
+  }
+}
+
+float TerrainLod::screenError(size_t node, const glm::vec3 &eyeA,
+                              const glm::vec3 &eyeB, float pixelScale) const
+{
+  const TerrainLodNode &n = nodes[node];
+  glm::vec3 middle = (eyeA + eyeB) * 0.5f;
+  glm::vec3 outside = glm::max(glm::max(n.boundsMin - middle, glm::vec3(0.0f)),
+                               middle - n.boundsMax);
+  // no view camera is closer than this
+  float distance = glm::length(outside) - glm::length(eyeB - eyeA) * 0.5f;
+  return n.error * pixelScale / max(distance, spacing);
+}
+
+void TerrainLod::select(const glm::vec3 &eyeA, const glm::vec3 &eyeB,
+                        float pixelScale, float tolerance,
+                        vector<size_t> &selected) const
+{
+  selected.clear();
+  if (nodes.empty())
+    return;
+  vector<size_t> pending(1, 0);
+  while (!pending.empty())
+  {
+    size_t n = pending.back();
+    pending.pop_back();
+    if (nodes[n].children[0] == NO_CHILD ||
+        screenError(n, eyeA, eyeB, pixelScale) <= tolerance)
+      selected.push_back(n);
+    else
+      for (int k = 3; k >= 0; --k)
+        pending.push_back(nodes[n].children[k]);
+  }
+}
+
+float TerrainLod::meshHeight(size_t node, float x, float y) const
+{
+  const TerrainLodNode &n = nodes[node];
+  float cell = (n.boundsMax.x - n.boundsMin.x) / float(C);
+  float gx = (x - n.boundsMin.x) / cell, gy = (y - n.boundsMin.y) / cell;
+  size_t a = size_t(min(max(gx, 0.0f), float(C - 1)));
+  size_t b = size_t(min(max(gy, 0.0f), float(C - 1)));
+  float u = min(max(gx - float(a), 0.0f), 1.0f);
+  float v = min(max(gy - float(b), 0.0f), 1.0f);
+  const TerrainVertex *corner = &vertices[n.baseVertex + b * (C + 1) + a];
+  return cellHeight(corner[0].position.z, corner[1].position.z,
+                    corner[C + 1].position.z, corner[C + 2].position.z, u, v);
+}
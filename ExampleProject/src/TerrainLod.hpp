@@ -0,0 +1,105 @@
+/**
+ * TerrainLod.hpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifndef OPENGL_CMAKE_SKELETON_TERRAINLOD_HPP
+#define OPENGL_CMAKE_SKELETON_TERRAINLOD_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "TerrainMesh.hpp"
+
+class JobSystem;
+
+// Chunked level of detail for the height-map terrain of TerrainMesh.
+//
+// The grid is rounded up to CHUNK_CELLS * 2^levels cells over the same
+// extent, the spacing shrunk to match, and covered by a quadtree: the root is the whole terrain at CHUNK_CELLS x CHUNK_CELLS cells,
+// every level below halves the area and doubles the resolution, and the
+// leaves are the full grid. Every node is one chunk of the same shape, so all
+// of them share one 16-bit index list and differ only in their base vertex.
+// Each node knows its error, the largest height difference between its mesh
+// and the full grid (never less than that of its children), and its bounds.
+//
+// select() takes the coarsest chunks whose error projects to at most a
+// tolerance in pixels. Every view of a frame draws the same selection: the
+// distance is measured from the middle of the segment the view cameras lie
+// on, less half its length, which is never more than the distance from any
+// of them. Neighbouring chunks at different levels don't meet exactly, each
+// chunk hangs a skirt down from its edges deep enough to close any gap.
+//
+// GL free; SampleScene uploads the chunks and draws the selection.
+
+struct TerrainLodNode
+{
+    glm::vec3 boundsMin;  // of the full grid over the node, skirts left out
+    glm::vec3 boundsMax;
+    float error;          // largest height difference to the full grid
+    int level;            // 0 for the root
+    size_t baseVertex;    // in TerrainLod::getVertices()
+    size_t children[4];   // NO_CHILD for a leaf
+};
+
+class TerrainLod
+{
+public:
+    static const unsigned CHUNK_CELLS = 32;
+    static const size_t NO_CHILD = size_t(-1);
+
+    TerrainLod();
+
+    // every level of a grid of at least size x size cells over the extent of
+    // size x size cells spacing apart
+    void build(unsigned size, float spacing, JobSystem *jobs);
+
+    // the rounded up grid, cells per side, and the spacing of its cells
+    unsigned getSize() const { return size; }
+    float getSpacing() const { return spacing; }
+    // the box of every chunk, skirts included
+    TerrainBounds getBounds() const;
+    int getLevelCount() const { return levels + 1; }
+    float getSkirtDepth() const { return skirtDepth; }
+
+    const std::vector<TerrainLodNode> &getNodes() const { return nodes; }
+    // the chunks one after the other, getChunkVertexCount() each
+    const std::vector<TerrainVertex> &getVertices() const { return vertices; }
+    // the triangles of one chunk, skirts included
+    const std::vector<uint16_t> &getIndices() const { return indices; }
+    size_t getChunkVertexCount() const;
+    size_t getChunkTriangleCount() const { return indices.size() / 3; }
+
+    // the chunks to draw for cameras anywhere on the segment from eyeA to
+    // eyeB; pixelScale is the size in pixels of one unit at one unit of
+    // distance, half the view height times projection[1][1]
+    void select(const glm::vec3 &eyeA, const glm::vec3 &eyeB, float pixelScale,
+                float tolerance, std::vector<size_t> &selected) const;
+
+    // the projected error select() compares with the tolerance
+    float screenError(size_t node, const glm::vec3 &eyeA,
+                      const glm::vec3 &eyeB, float pixelScale) const;
+
+    // the height of the node's mesh at (x, y) within it
+    float meshHeight(size_t node, float x, float y) const;
+
+private:
+    // the edge vertex of a chunk above its skirt vertex skirt
+    static uint16_t vertexOfSkirt(size_t skirt);
+
+    unsigned size = 0;
+    int levels = 0;
+    float spacing = 0;
+    float skirtDepth = 0;
+    std::vector<float> coordinates; // of the full grid, along x and y
+    std::vector<TerrainLodNode> nodes;
+    std::vector<TerrainVertex> vertices;
+    std::vector<uint16_t> indices;
+};
+
+#endif // OPENGL_CMAKE_SKELETON_TERRAINLOD_HPP
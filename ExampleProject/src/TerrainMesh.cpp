@@ -0,0 +1,341 @@
+/**
+ * TerrainMesh.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifdef WIN32
+#pragma warning(disable : 4464 4820 4514 5045 4201 5039 4061 4710)
+#endif
+
+#include "TerrainMesh.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "JobSystem.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TERRAIN_MESH_SSE
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// about this many vertices or cells per job
+static const size_t JOB_ITEMS = 16384;
+
+// runs job over [0, count) on jobs, or inline without
+static void forRows(JobSystem *jobs, size_t count, size_t grain,
+                    const JobSystem::RangeJob &job)
+{
+  if (jobs)
+    jobs->parallelFor(count, grain, job);
+  else
+    job(0, count);
+}
+
+static TerrainVertex makeVertex(float x, float y, float sx, float cx, float sy,
+                                float cy)
+{
+  float h = 2.0f * sx * sy;
+  float hx = 2.0f * cx * sy;
+  float hy = 2.0f * sx * cy;
+  float inverseLength = 1.0f / sqrt(hx * hx + hy * hy + 1.0f);
+  float c = sin(h * 5.0f) * 0.5f + 0.5f;
+
+  TerrainVertex v;
+  v.position = glm::vec3(x, y, h);
+  v.normal = glm::vec3(-hx, -hy, 1.0f) * inverseLength;
+  v.color = glm::vec4(c, 1.0f - c, 1.0f, 1.0f);
+  return v;
+}
+
+#ifdef TERRAIN_MESH_SSE
+// sin of four values, to about 4e-6: x = q pi + r with |r| <= pi / 2, then
+// sin(x) = (-1)^q sin(r) with sin(r) as a degree 9 polynomial
+static inline __m128 sin4(__m128 x)
+{
+  const __m128 invPi = _mm_set1_ps(0.318309886f);
+  const __m128 piHigh = _mm_set1_ps(3.140625f);
+  const __m128 piLow = _mm_set1_ps(9.67653589793e-4f);
+  __m128i q = _mm_cvtps_epi32(_mm_mul_ps(x, invPi));
+  __m128 qf = _mm_cvtepi32_ps(q);
+  __m128 r = _mm_sub_ps(_mm_sub_ps(x, _mm_mul_ps(qf, piHigh)),
+                        _mm_mul_ps(qf, piLow));
+  __m128 r2 = _mm_mul_ps(r, r);
+  __m128 p = _mm_set1_ps(2.75573192e-6f);
+  p = _mm_add_ps(_mm_mul_ps(p, r2), _mm_set1_ps(-1.98412698e-4f));
+  p = _mm_add_ps(_mm_mul_ps(p, r2), _mm_set1_ps(8.33333333e-3f));
+  p = _mm_add_ps(_mm_mul_ps(p, r2), _mm_set1_ps(-1.66666667e-1f));
+  p = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(p, r2), r), r);
+  __m128i odd = _mm_slli_epi32(_mm_and_si128(q, _mm_set1_epi32(1)), 31);
+  return _mm_xor_ps(p, _mm_castsi128_ps(odd));
+}
+
+// four vertices of a row, from the column tables at x
+static inline void makeVertices4(const float *xs, const float *sxs,
+                                 const float *cxs, float y, float sy, float cy,
+                                 TerrainVertex *out)
+{
+  __m128 sx = _mm_loadu_ps(sxs), cx = _mm_loadu_ps(cxs);
+  __m128 two = _mm_set1_ps(2.0f), half = _mm_set1_ps(0.5f);
+  __m128 h = _mm_mul_ps(_mm_mul_ps(two, sx), _mm_set1_ps(sy));
+  __m128 nx = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(-2.0f), cx), _mm_set1_ps(sy));
+  __m128 ny = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(-2.0f), sx), _mm_set1_ps(cy));
+  __m128 one = _mm_set1_ps(1.0f);
+  __m128 length = _mm_sqrt_ps(_mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), one));
+  __m128 nz = _mm_div_ps(one, length);
+  nx = _mm_mul_ps(nx, nz);
+  ny = _mm_mul_ps(ny, nz);
+  __m128 c = _mm_add_ps(_mm_mul_ps(sin4(_mm_mul_ps(h, _mm_set1_ps(5.0f))), half),
+                        half);
+
+  float hs[4], nxs[4], nys[4], nzs[4], cs[4];
+  _mm_storeu_ps(hs, h);
+  _mm_storeu_ps(nxs, nx);
+  _mm_storeu_ps(nys, ny);
+  _mm_storeu_ps(nzs, nz);
+  _mm_storeu_ps(cs, c);
+  for (int i = 0; i < 4; ++i)
+  {
+    TerrainVertex &v = out[i];
+    v.position.x = xs[i];
+    v.position.y = y;
+    v.position.z = hs[i];
+    v.normal.x = nxs[i];
+    v.normal.y = nys[i];
+    v.normal.z = nzs[i];
+    v.color.x = cs[i];
+    v.color.y = 1.0f - cs[i];
+    v.color.z = 1.0f;
+    v.color.w = 1.0f;
+  }
+}
+#endif
+
+// sin and cos of every column, and every row, computed once; phase shifts
+// the wave along the coordinate
+struct TerrainTables
+{
+  vector<float> coordinates, sines, cosines;
+
+  TerrainTables(unsigned size, float spacing, float phase = 0.0f)
+  {
+    size_t side = size_t(size) + 1;
+    coordinates.resize(side);
+    sines.resize(side);
+    cosines.resize(side);
+    for (size_t i = 0; i < side; ++i)
+    {
+      coordinates[i] = (float(i) - float(size) / 2.0f) * spacing;
+      sines[i] = sin(coordinates[i] + phase);
+      cosines[i] = cos(coordinates[i] + phase);
+    }
+  }
+
+  void makeRow(size_t row, TerrainVertex *out) const
+  {
+    makeRow(row, *this, out);
+  }
+
+  // with the row terms from other tables
+  void makeRow(size_t row, const TerrainTables &rows, TerrainVertex *out) const
+  {
+    size_t side = coordinates.size();
+    float y = rows.coordinates[row], sy = rows.sines[row],
+          cy = rows.cosines[row];
+    size_t x = 0;
+#ifdef TERRAIN_MESH_SSE
+    for (; x + 4 <= side; x += 4)
+      makeVertices4(&coordinates[x], &sines[x], &cosines[x], y, sy, cy,
+                    out + x);
+#endif
+    for (; x < side; ++x)
+      out[x] = makeVertex(coordinates[x], y, sines[x], cosines[x], sy, cy);
+  }
+};
+
+void generateTerrainVertices(unsigned size, float spacing,
+                             TerrainVertex *vertices, JobSystem *jobs)
+{
+  TerrainTables tables(size, spacing);
+  size_t side = size_t(size) + 1;
+  size_t grain = max<size_t>(1, JOB_ITEMS / side);
+  forRows(jobs, side, grain, [&](size_t begin, size_t end) {
+    for (size_t row = begin; row < end; ++row)
+      tables.makeRow(row, vertices + row * side);
+  });
+}
+
+void generateAnimatedTerrainVertices(unsigned size, float spacing, float time,
+                                     TerrainVertex *vertices, JobSystem *jobs)
+{
+  TerrainTables columns(size, spacing, time);
+  TerrainTables rows(size, spacing, time * 0.7f);
+  size_t side = size_t(size) + 1;
+  size_t grain = max<size_t>(1, JOB_ITEMS / side);
+  forRows(jobs, side, grain, [&](size_t begin, size_t end) {
+    for (size_t row = begin; row < end; ++row)
+      columns.makeRow(row, rows, vertices + row * side);
+  });
+}
+
+TerrainVertex terrainVertexAt(float x, float y)
+{
+  return makeVertex(x, y, sin(x), cos(x), sin(y), cos(y));
+}
+
+TerrainBounds getTerrainBounds(unsigned size, float spacing)
+{
+  TerrainTables tables(size, spacing);
+  // rows and columns share the same sines, so the extremes of the height are
+  // among the products of the smallest and largest sine
+  float low = *min_element(tables.sines.begin(), tables.sines.end());
+  float high = *max_element(tables.sines.begin(), tables.sines.end());
+  float zMin = 2.0f * min(low * high, min(low * low, high * high));
+  float zMax = 2.0f * max(low * high, max(low * low, high * high));
+  float xMin = tables.coordinates.front(), xMax = tables.coordinates.back();
+
+  TerrainBounds bounds;
+  bounds.origin = glm::vec3(xMin, xMin, zMin);
+  bounds.extent = glm::vec3(xMax - xMin, xMax - xMin, zMax - zMin);
+  return bounds;
+}
+
+static inline uint16_t toUnorm16(float v)
+{
+  return uint16_t(min(max(v, 0.0f), 1.0f) * 65535.0f + 0.5f);
+}
+
+static inline int16_t toSnorm16(float v)
+{
+  v = min(max(v, -1.0f), 1.0f) * 32767.0f;
+  return int16_t(v >= 0.0f ? v + 0.5f : v - 0.5f);
+}
+
+static inline float sign(float v) { return v >= 0.0f ? 1.0f : -1.0f; }
+
+// packs with scale = 1 / bounds.extent worked out once
+static inline void pack(const TerrainVertex &vertex, const glm::vec3 &origin,
+                        const glm::vec3 &scale, PackedTerrainVertex &packed)
+{
+  packed.position[0] = toUnorm16((vertex.position.x - origin.x) * scale.x);
+  packed.position[1] = toUnorm16((vertex.position.y - origin.y) * scale.y);
+  packed.position[2] = toUnorm16((vertex.position.z - origin.z) * scale.z);
+  packed.position[3] = 0;
+
+  // project on the octahedron |x| + |y| + |z| = 1, fold the lower half out
+  const glm::vec3 &n = vertex.normal;
+  float l1 = 1.0f / (fabs(n.x) + fabs(n.y) + fabs(n.z));
+  float u = n.x * l1, v = n.y * l1;
+  if (n.z < 0.0f)
+  {
+    float fu = (1.0f - fabs(v)) * sign(u);
+    v = (1.0f - fabs(u)) * sign(v);
+    u = fu;
+  }
+  packed.normal[0] = toSnorm16(u);
+  packed.normal[1] = toSnorm16(v);
+
+  for (int i = 0; i < 4; ++i)
+    packed.color[i] =
+        uint8_t(min(max(vertex.color[i], 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+static glm::vec3 inverseExtent(const TerrainBounds &bounds)
+{
+  glm::vec3 scale;
+  for (int i = 0; i < 3; ++i)
+    scale[i] = bounds.extent[i] > 0.0f ? 1.0f / bounds.extent[i] : 0.0f;
+  return scale;
+}
+
+PackedTerrainVertex packTerrainVertex(const TerrainVertex &vertex,
+                                      const TerrainBounds &bounds)
+{
+  PackedTerrainVertex packed;
+  pack(vertex, bounds.origin, inverseExtent(bounds), packed);
+  return packed;
+}
+
+TerrainVertex unpackTerrainVertex(const PackedTerrainVertex &packed,
+                                  const TerrainBounds &bounds)
+{
+  TerrainVertex vertex;
+  for (int i = 0; i < 3; ++i)
+    vertex.position[i] = bounds.origin[i] + bounds.extent[i] *
+                                                float(packed.position[i]) /
+                                                65535.0f;
+
+  float u = max(float(packed.normal[0]) / 32767.0f, -1.0f);
+  float v = max(float(packed.normal[1]) / 32767.0f, -1.0f);
+  glm::vec3 n(u, v, 1.0f - fabs(u) - fabs(v));
+  float t = max(-n.z, 0.0f);
+  n.x += n.x >= 0.0f ? -t : t;
+  n.y += n.y >= 0.0f ? -t : t;
+  vertex.normal = glm::normalize(n);
+
+  for (int i = 0; i < 4; ++i)
+    vertex.color[i] = float(packed.color[i]) / 255.0f;
+  return vertex;
+}
+
+void generatePackedTerrainVertices(unsigned size, float spacing,
+                                   PackedTerrainVertex *vertices,
+                                   JobSystem *jobs)
+{
+  TerrainTables tables(size, spacing);
+  TerrainBounds bounds = getTerrainBounds(size, spacing);
+  glm::vec3 scale = inverseExtent(bounds);
+  size_t side = size_t(size) + 1;
+  size_t grain = max<size_t>(1, JOB_ITEMS / side);
+  forRows(jobs, side, grain, [&](size_t begin, size_t end) {
+    // a row at a time through the float vertex, then packed
+    vector<TerrainVertex> row(side);
+    for (size_t r = begin; r < end; ++r)
+    {
+      tables.makeRow(r, row.data());
+      PackedTerrainVertex *out = vertices + r * side;
+      for (size_t x = 0; x < side; ++x)
+        pack(row[x], bounds.origin, scale, out[x]);
+    }
+  });
+}
+
+void generateTerrainIndices(unsigned size, uint32_t *indices, JobSystem *jobs)
+{
+  uint32_t side = uint32_t(size) + 1;
+  size_t grain = max<size_t>(1, JOB_ITEMS / max(size, 1u));
+  forRows(jobs, size, grain, [&](size_t begin, size_t end) {
+    for (size_t row = begin; row < end; ++row)
+    {
+      uint32_t y = uint32_t(row);
+      uint32_t *out = indices + row * size_t(size) * 6;
+      for (uint32_t x = 0; x < size; ++x, out += 6)
+      {
+        out[0] = (x + 0) + side * (y + 0);
+        out[1] = (x + 1) + side * (y + 0);
+        out[2] = (x + 1) + side * (y + 1);
+
+        out[3] = (x + 1) + side * (y + 1);
+        out[4] = (x + 0) + side * (y + 1);
+        out[5] = (x + 0) + side * (y + 0);
+      }
+    }
+  });
+}
+
+void generateTerrain(unsigned size, float spacing, TerrainMesh &mesh,
+                     JobSystem *jobs)
+{
+  size_t side = size_t(size) + 1;
+  mesh.vertices.resize(side * side);
+  mesh.indices.resize(size_t(size) * size_t(size) * 6);
+  generateTerrainVertices(size, spacing, mesh.vertices.data(), jobs);
+  generateTerrainIndices(size, mesh.indices.data(), jobs);
+}
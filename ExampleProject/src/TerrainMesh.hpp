@@ -0,0 +1,97 @@
+/**
+ * TerrainMesh.hpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifndef OPENGL_CMAKE_SKELETON_TERRAINMESH_HPP
+#define OPENGL_CMAKE_SKELETON_TERRAINMESH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+class JobSystem;
+
+// The height-map terrain of SampleScene, generated in parallel.
+//
+// The height is h = 2 sin(x) sin(y) over a grid of size x size cells centred
+// on the origin. Each factor depends on one coordinate only, so the sin and
+// cos of every column are computed once up front and those of a row once per
+// row; a vertex is then a few products, and its normal comes from the
+// analytic derivatives (2 cos(x) sin(y), 2 sin(x) cos(y)) rather than from
+// two more height samples. Rows of vertices and of triangles are split over a
+// JobSystem and vertices are computed four at a time with SSE where
+// available. The buffers are sized once and written in place.
+
+struct TerrainVertex
+{
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec4 color;
+};
+
+// the same vertex in 16 bytes instead of 40, for a vertex fetched once per
+// view: the position as unorm16 within the mesh's TerrainBounds, the normal
+// octahedral-encoded into two snorm16 and the colour as RGBA8. The shader
+// gets position, normal and color through normalized attributes and decodes
+// origin + extent * position and the octahedral normal.
+struct PackedTerrainVertex
+{
+    uint16_t position[4]; // [3] unused, keeps the normal 4-byte aligned
+    int16_t normal[2];
+    uint8_t color[4];
+};
+
+// the box the positions of a mesh are quantized in
+struct TerrainBounds
+{
+    glm::vec3 origin;
+    glm::vec3 extent;
+};
+
+struct TerrainMesh
+{
+    std::vector<TerrainVertex> vertices; // (size + 1)² vertices, row by row
+    std::vector<uint32_t> indices;       // two triangles per cell
+};
+
+// fills mesh for a size x size grid with cells spacing apart; jobs may be
+// NULL to do everything on the calling thread
+void generateTerrain(unsigned size, float spacing, TerrainMesh &mesh,
+                     JobSystem *jobs);
+
+// the two halves of generateTerrain(), into buffers of the right size
+void generateTerrainVertices(unsigned size, float spacing,
+                             TerrainVertex *vertices, JobSystem *jobs);
+void generateTerrainIndices(unsigned size, uint32_t *indices,
+                            JobSystem *jobs);
+
+// the grid of generateTerrainVertices() with the waves moving over time
+// seconds: h = 2 sin(x + time) sin(y + 0.7 time), same bounds
+void generateAnimatedTerrainVertices(unsigned size, float spacing, float time,
+                                     TerrainVertex *vertices, JobSystem *jobs);
+
+// the vertex of the height map at (x, y), as generateTerrainVertices() makes
+// it at grid points
+TerrainVertex terrainVertexAt(float x, float y);
+
+// the bounds of the grid generateTerrain() makes, exact in z
+TerrainBounds getTerrainBounds(unsigned size, float spacing);
+
+// generateTerrainVertices() into the packed format, within
+// getTerrainBounds(size, spacing)
+void generatePackedTerrainVertices(unsigned size, float spacing,
+                                   PackedTerrainVertex *vertices,
+                                   JobSystem *jobs);
+
+PackedTerrainVertex packTerrainVertex(const TerrainVertex &vertex,
+                                      const TerrainBounds &bounds);
+// what the shader reads back from a packed vertex
+TerrainVertex unpackTerrainVertex(const PackedTerrainVertex &vertex,
+                                  const TerrainBounds &bounds);
+
+#endif // OPENGL_CMAKE_SKELETON_TERRAINMESH_HPP
@@ -0,0 +1,72 @@
+/**
+ * TripleBuffer.hpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifndef OPENGL_CMAKE_SKELETON_TRIPLEBUFFER_HPP
+#define OPENGL_CMAKE_SKELETON_TRIPLEBUFFER_HPP
+
+#include <atomic>
+
+// Lock-free hand-over of a value from one writer thread to one reader thread.
+//
+// The writer fills write() and calls publish(); the reader calls read() and
+// gets the latest published value. Neither side ever waits: the writer always
+// owns one slot, the reader another, and the third one is swapped between
+// them with a single atomic exchange. Values the reader never got to see are
+// simply overwritten.
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() : middle(1), back(0), front(2) {}
+
+    // sets all three slots, before the threads start
+    void reset(const T &value)
+    {
+        slots[0] = slots[1] = slots[2] = value;
+        middle.store(1);
+    }
+
+    // writer side: the slot to fill. It holds an older value, so every field
+    // the reader uses must be written before publish().
+    T &write() { return slots[back]; }
+
+    // writer side: makes write() visible to the reader and takes a new slot
+    void publish()
+    {
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    // reader side: switches to the latest published value, if there is a new
+    // one, and returns it. The reference stays valid until the next read().
+    const T &read()
+    {
+        if (middle.load(std::memory_order_relaxed) & FRESH)
+            front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+        return slots[front];
+    }
+
+    // reader side: true if something was published since the last read()
+    bool hasNew() const { return (middle.load(std::memory_order_relaxed) & FRESH) != 0; }
+
+private:
+    TripleBuffer(const TripleBuffer &);
+    TripleBuffer &operator=(const TripleBuffer &);
+
+    enum
+    {
+        INDEX = 3,
+        FRESH = 4
+    };
+
+    T slots[3];
+    std::atomic<unsigned> middle; // index of the shared slot, plus FRESH
+    unsigned back;                // owned by the writer
+    unsigned front;               // owned by the reader
+};
+
+#endif // OPENGL_CMAKE_SKELETON_TRIPLEBUFFER_HPP
@@ -0,0 +1,96 @@
+/**
+ * ViewCommands.hpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifndef OPENGL_CMAKE_SKELETON_VIEWCOMMANDS_HPP
+#define OPENGL_CMAKE_SKELETON_VIEWCOMMANDS_HPP
+
+#include <cstddef>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Per-view command lists.
+//
+// The CPU side of a view (camera, culling, draw list, uniform values) is built
+// into a ViewCommandList on a JobSystem worker, without touching GL. The
+// render thread then submits the lists of all views in order with
+// HoloPlayContext::submitViewCommands().
+
+// a mat4 uniform value, stored in ViewCommandList::matrices, or an int
+struct UniformValue
+{
+    int location;  // uniform location, looked up once on the render thread
+    size_t matrix; // index into ViewCommandList::matrices, NO_MATRIX for an int
+    int integer;   // the value of an int uniform
+};
+
+static const size_t NO_MATRIX = size_t(-1);
+
+struct DrawCommand
+{
+    unsigned int program;   // 0 keeps the program of the previous draw
+    unsigned int vao;       // 0 keeps the vertex array of the previous draw
+    unsigned int mode;      // GL_TRIANGLES, ...
+    int count;              // vertices or indices
+    unsigned int indexType; // GL_UNSIGNED_INT, ..., 0 for glDrawArrays
+    size_t first;           // first vertex, or byte offset in the index buffer
+    int baseVertex;         // added to every index, glDrawElementsBaseVertex
+    size_t firstUniform;    // uniforms set before the draw, in
+    size_t uniformCount;    // ViewCommandList::uniforms
+};
+
+struct ViewCommandList
+{
+    // filled in by HoloPlayContext before building
+    int viewIndex = 0;
+    glm::mat4 view = glm::mat4(1.0f);
+    glm::mat4 projection = glm::mat4(1.0f);
+
+    // filled in by the scene
+    bool built = false;        // false falls back to renderScene() for this view
+    unsigned int clearMask = 0; // glClear() bits for the start of the view
+    glm::vec4 clearColor = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    std::vector<DrawCommand> draws;
+    std::vector<UniformValue> uniforms;
+    std::vector<glm::mat4> matrices;
+
+    // keeps the capacity, the lists are reused every frame
+    void clear()
+    {
+        built = false;
+        clearMask = 0;
+        clearColor = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        draws.clear();
+        uniforms.clear();
+        matrices.clear();
+    }
+
+    // adds a uniform for the next draw
+    void setUniform(int location, const glm::mat4 &value)
+    {
+        UniformValue uniform = {location, matrices.size(), 0};
+        matrices.push_back(value);
+        uniforms.push_back(uniform);
+    }
+
+    void setUniform(int location, int value)
+    {
+        UniformValue uniform = {location, NO_MATRIX, value};
+        uniforms.push_back(uniform);
+    }
+
+    // adds a draw using every uniform set since the previous draw
+    void draw(DrawCommand command)
+    {
+        size_t used = draws.empty() ? 0 : draws.back().firstUniform + draws.back().uniformCount;
+        command.firstUniform = used;
+        command.uniformCount = uniforms.size() - used;
+        draws.push_back(command);
+    }
+};
+
+#endif // OPENGL_CMAKE_SKELETON_VIEWCOMMANDS_HPP
@@ -0,0 +1,176 @@
+/**
+ * ViewMatrices.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifdef WIN32
+#pragma warning(disable : 4464 4820 4514 5045 4201 5039 4061 4710)
+#endif
+
+#include "ViewMatrices.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <glm/gtc/matrix_transform.hpp>
+
+#if defined(__AVX__)
+#define VIEW_MATRICES_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VIEW_MATRICES_SSE
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// why 14°: see "Set Up Virtual Camera" in README.md
+static const float FOV_DEGREES = 14.0f;
+
+ViewMatrices::ViewMatrices()
+    : view(1.0f), projection(1.0f), translation(0.0f), shift(0.0f)
+{
+}
+
+void ViewMatrices::setViews(int newCount, float viewConeDegrees)
+{
+  if (newCount == count && viewConeDegrees == cone)
+    return;
+  count = newCount;
+  cone = viewConeDegrees;
+  tangents.resize(size_t(max(count, 0)));
+  for (int i = 0; i < count; ++i)
+  {
+    // the offset angle of computeView()
+    float t = count > 1 ? float(i) / (float(count) - 1.0f) - 0.5f : 0.0f;
+    tangents[size_t(i)] = tan(t * glm::radians(cone));
+  }
+}
+
+void ViewMatrices::prepare(const glm::mat4 &frameView, float cameraSize,
+                           float aspect)
+{
+  const float fov = glm::radians(FOV_DEGREES);
+  float cameraDistance = -cameraSize / tan(fov / 2.0f);
+
+  // computeView() translates frameView by
+  //   frameView * (offset, 0, cameraDistance, 1)
+  // which is base + offset * side, so the translation column it ends up with
+  // is frameView * (base, 1) + offset * frameView * (side, 0), and offset is
+  // cameraDistance * tan_i
+  glm::vec3 base = glm::vec3(frameView[2] * cameraDistance + frameView[3]);
+  glm::vec3 side = glm::vec3(frameView[0]);
+  view = frameView;
+  translation = frameView * glm::vec4(base, 1.0f);
+  shift = cameraDistance * (frameView * glm::vec4(side, 0.0f));
+
+  projection = glm::perspective(fov, aspect, 0.1f, 100.0f);
+  shear = cameraDistance / (cameraSize * aspect);
+}
+
+void ViewMatrices::get(int viewIndex, glm::mat4 &v, glm::mat4 &p) const
+{
+  float t = tangents[size_t(viewIndex)];
+  v = view;
+  v[3] = translation + t * shift;
+  p = projection;
+  p[2][0] += t * shear;
+}
+
+void ViewMatrices::write(void *dst, size_t stride) const
+{
+  unsigned char *out = static_cast<unsigned char *>(dst);
+  const float *v = &view[0][0];
+  const float *p = &projection[0][0];
+  const float *t = tangents.data();
+
+#if defined(VIEW_MATRICES_AVX)
+  // a view's matrices are four 8-float stores, only two of them change
+  const __m256 view01 = _mm256_loadu_ps(v);
+  const __m256 projection01 = _mm256_loadu_ps(p);
+  const __m128 view2 = _mm_loadu_ps(v + 8);
+  const __m128 projection2 = _mm_loadu_ps(p + 8);
+  const __m128 projection3 = _mm_loadu_ps(p + 12);
+  const __m128 base = _mm_loadu_ps(&translation[0]);
+  const __m128 side = _mm_loadu_ps(&shift[0]);
+  const __m128 shearX = _mm_setr_ps(shear, 0.0f, 0.0f, 0.0f);
+  for (int i = 0; i < count; ++i, out += stride)
+  {
+    float *f = reinterpret_cast<float *>(out);
+    __m128 tangent = _mm_set1_ps(t[i]);
+    __m128 view3 = _mm_add_ps(base, _mm_mul_ps(tangent, side));
+    __m128 sheared = _mm_add_ps(projection2, _mm_mul_ps(tangent, shearX));
+    _mm256_storeu_ps(f, view01);
+    _mm256_storeu_ps(f + 8, _mm256_insertf128_ps(
+                                _mm256_castps128_ps256(view2), view3, 1));
+    _mm256_storeu_ps(f + 16, projection01);
+    _mm256_storeu_ps(f + 24, _mm256_insertf128_ps(
+                                 _mm256_castps128_ps256(sheared), projection3, 1));
+  }
+#elif defined(VIEW_MATRICES_SSE)
+  const __m128 view0 = _mm_loadu_ps(v), view1 = _mm_loadu_ps(v + 4);
+  const __m128 view2 = _mm_loadu_ps(v + 8);
+  const __m128 projection0 = _mm_loadu_ps(p), projection1 = _mm_loadu_ps(p + 4);
+  const __m128 projection2 = _mm_loadu_ps(p + 8);
+  const __m128 projection3 = _mm_loadu_ps(p + 12);
+  const __m128 base = _mm_loadu_ps(&translation[0]);
+  const __m128 side = _mm_loadu_ps(&shift[0]);
+  const __m128 shearX = _mm_setr_ps(shear, 0.0f, 0.0f, 0.0f);
+  for (int i = 0; i < count; ++i, out += stride)
+  {
+    float *f = reinterpret_cast<float *>(out);
+    __m128 tangent = _mm_set1_ps(t[i]);
+    _mm_storeu_ps(f, view0);
+    _mm_storeu_ps(f + 4, view1);
+    _mm_storeu_ps(f + 8, view2);
+    _mm_storeu_ps(f + 12, _mm_add_ps(base, _mm_mul_ps(tangent, side)));
+    _mm_storeu_ps(f + 16, projection0);
+    _mm_storeu_ps(f + 20, projection1);
+    _mm_storeu_ps(f + 24, _mm_add_ps(projection2, _mm_mul_ps(tangent, shearX)));
+    _mm_storeu_ps(f + 28, projection3);
+  }
+#else
+  (void)v;
+  (void)p;
+  (void)t;
+  ViewCamera camera;
+  for (int i = 0; i < count; ++i, out += stride)
+  {
+    get(i, camera.view, camera.projection);
+    memcpy(out, &camera, sizeof(camera));
+  }
+#endif
+}
+
+void ViewMatrices::computeView(int viewIndex, int viewCount,
+                               float viewConeDegrees,
+                               const glm::mat4 &frameView, float cameraSize,
+                               float aspect, glm::mat4 &view,
+                               glm::mat4 &projection)
+{
+  const float fov = glm::radians(FOV_DEGREES);
+  float cameraDistance = -cameraSize / tan(fov / 2.0f);
+
+  float offsetAngle =
+      (float(viewIndex) / (float(viewCount) - 1.0f) - 0.5f) *
+      glm::radians(viewConeDegrees); // start at -viewCone * 0.5 and go up to
+                                     // viewCone * 0.5
+
+  float offset =
+      cameraDistance *
+      tan(offsetAngle); // calculate the offset that the camera should move
+
+  // modify the view matrix (position)
+  // determine the local direction of the offset using frameView and translate
+  glm::vec3 offsetLocal =
+      glm::vec3(frameView * glm::vec4(offset, 0.0f, cameraDistance, 1.0f));
+  view = glm::translate(frameView, offsetLocal);
+
+  projection = glm::perspective(fov, aspect, 0.1f, 100.0f);
+  // modify the projection matrix, relative to the camera size and aspect ratio
+  projection[2][0] += offset / (cameraSize * aspect);
+}
@@ -0,0 +1,84 @@
+/**
+ * ViewMatrices.hpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ */
+
+#ifndef OPENGL_CMAKE_SKELETON_VIEWMATRICES_HPP
+#define OPENGL_CMAKE_SKELETON_VIEWMATRICES_HPP
+
+#include <cstddef>
+#include <glm/glm.hpp>
+#include <vector>
+
+// The view and projection matrices of all views of a frame, in one pass.
+//
+// Each view's camera is the frame's camera moved sideways by an offset, and
+// its projection is the frame's projection sheared by the same offset. Both
+// are affine in the offset: view i differs from the frame's view matrix only
+// in its translation column, translation + tan_i * shift, and projection i
+// only in [2][0], by tan_i * shear. prepare() works out those terms once per
+// frame; write() then streams the matrices of every view with no trigonometry
+// or matrix product per view, using SSE (AVX when the build enables it). The
+// tan_i depend only on the view count and cone and are kept, one array for
+// all views, until either changes.
+//
+// write() works a view at a time, array of structures, rather than on four or
+// eight views at once in structure-of-arrays lanes: a view only costs two
+// multiply-adds, and the uniform buffer wants each view's ViewCamera whole, so
+// SoA lanes would add a transpose per view for nothing to vectorize.
+//
+// GL free; HoloPlayContext writes the result straight into a mapped uniform
+// buffer.
+
+// the ViewCamera uniform block of one view, std140 layout:
+//   layout(std140) uniform ViewCamera { mat4 view; mat4 projection; };
+struct ViewCamera
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+};
+
+class ViewMatrices
+{
+public:
+    ViewMatrices();
+
+    // recomputes the per-view tangents if the count or cone changed
+    void setViews(int count, float viewConeDegrees);
+    int getViewCount() const { return int(tangents.size()); }
+
+    // the terms shared by all views for this frame's camera
+    void prepare(const glm::mat4 &frameView, float cameraSize, float aspect);
+
+    // the frame's camera, before any view's offset
+    const glm::mat4 &getFrameView() const { return view; }
+    const glm::mat4 &getFrameProjection() const { return projection; }
+
+    // the matrices of one view, as computeView() would give them
+    void get(int viewIndex, glm::mat4 &view, glm::mat4 &projection) const;
+
+    // writes the ViewCamera of every view to dst, stride bytes apart
+    void write(void *dst, size_t stride) const;
+
+    // one view at a time with glm, what the batch replaces
+    static void computeView(int viewIndex, int viewCount, float viewConeDegrees,
+                            const glm::mat4 &frameView, float cameraSize,
+                            float aspect, glm::mat4 &view,
+                            glm::mat4 &projection);
+
+private:
+    int count = 0;
+    float cone = 0;
+    std::vector<float> tangents; // tan of each view's offset angle
+
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 translation;       // translation column at a zero offset
+    glm::vec4 shift;             // its change per unit of tangent
+    float shear = 0;             // projection [2][0] per unit of tangent
+};
+
+#endif // OPENGL_CMAKE_SKELETON_VIEWMATRICES_HPP
@@ -12,16 +12,248 @@
 
 #include "SampleScene.hpp"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
 using namespace std;
 
-#define UNUSED(x) [&x]{}()
+// writes a captured frame as a binary PPM, flipped to top-down rows
+static void writePPM(const string &dir, const CapturedFrame &frame)
+{
+  char name[64];
+  snprintf(name, sizeof(name), "/%s_%06llu.ppm",
+           frame.source == CaptureSource::Quilt ? "quilt" : "panel",
+           (unsigned long long)frame.frame);
+  FILE *file = fopen((dir + name).c_str(), "wb");
+  if (!file)
+    return;
+  fprintf(file, "P6\n%d %d\n255\n", frame.width, frame.height);
+  size_t row = size_t(frame.width) * 3;
+  for (int y = frame.height - 1; y >= 0; --y)
+    fwrite(frame.pixels + size_t(y) * row, 1, row, file);
+  fclose(file);
+}
 
+// options:
+//   --simulation-thread [hz]  run input and update() on their own thread
+//   --update-delay ms         make every update() take ms milliseconds
+//   --view-jobs n             build the per-view draw lists on n threads
+//   --instanced-views         draw all views at once, an instance per view
+//   --terrain-size n          terrain of n x n cells (100)
+//   --packed-vertices         16-byte quantized terrain vertices
+//   --optimize-mesh           vertex cache order, 16-bit index chunks
+//   --procedural-terrain      no terrain buffers, grid from gl_VertexID
+//   --terrain-lod [px]        chunked LOD, at most px pixels of error (2)
+//   --mesh file.hpm           draw a mesh baked by mesh_bake, not the terrain
+//   --gpu-culling n           n cubes culled and drawn indirect on the GPU
+//   --animated-terrain [mode] stream moving terrain vertices every frame,
+//                             mode coherent (default), flush or subdata
+//   --shading-cache [texels]  terrain diffuse shaded once per frame into a
+//                             texture of texels per side (1024), not per view
+//   --swap-interval n         glfwSwapInterval(n)
+//   --max-frames-in-flight n  frames the driver may queue, 0 for no limit
+//   --latency-report [s]      log input-to-present latency every s seconds
+//   --quilt-preset n          0: 32 views, 1: 45 views, 2: 45 views for 8K
+//   --quilt-buffers n         quilts rendered and interlaced in turn; one
+//                             context, so only adds latency (QuiltChain.hpp)
+//   --quilt-budget MiB        memory the quilts may take, fewer if over
+//   --compact-quilt           allow 16-bit quilts to stay in the budget
+//   --quilt-depth mode        none, renderbuffer (default) or texture
+//   --capture-dir dir         write every quilt (and panel frame) as PPM
+//   --capture-panel           also capture the interlaced panel output
+//   --capture-downscale n     capture at 1/n of the width and height
+//   --record file.hpq         record the quilts to a compressed quilt file
+//   --record-threads n        compression threads for --record
+//   --play file.hpq           show the quilts of a quilt file, looping
+//   --play-once               stop on the last quilt instead of looping
+//   --play-threads n          decode threads for --play
+//   --play-slots n            decoded quilts held ahead for --play
 int main(int argc, const char *argv[])
 {
-  UNUSED(argc);
-  UNUSED(argv);
-
   SampleScene sampleScene;
+  QuiltChainSettings quiltBuffering;
+  bool quiltBufferingChanged = false;
+  FrameCaptureSettings capture;
+  string captureDir;
+  string recordPath;
+  QuiltRecorderSettings recording;
+  string playPath;
+  QuiltPlaybackSettings playback;
+  bool capturePanel = false;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "--simulation-thread"))
+    {
+      double hz = 120.0;
+      if (i + 1 < argc && atof(argv[i + 1]) > 0)
+        hz = atof(argv[++i]);
+      sampleScene.enableSimulationThread(hz);
+    }
+    else if (!strcmp(argv[i], "--update-delay") && i + 1 < argc)
+    {
+      sampleScene.setUpdateDelay(atoi(argv[++i]));
+    }
+    else if (!strcmp(argv[i], "--view-jobs") && i + 1 < argc)
+    {
+      sampleScene.enableViewJobs(unsigned(max(atoi(argv[++i]), 1)));
+    }
+    else if (!strcmp(argv[i], "--instanced-views"))
+    {
+      sampleScene.enableInstancedViews(true);
+    }
+    else if (!strcmp(argv[i], "--terrain-size") && i + 1 < argc)
+    {
+      sampleScene.setTerrainSize(unsigned(max(atoi(argv[++i]), 1)));
+    }
+    else if (!strcmp(argv[i], "--packed-vertices"))
+    {
+      sampleScene.setPackedVertices(true);
+    }
+    else if (!strcmp(argv[i], "--optimize-mesh"))
+    {
+      sampleScene.setOptimizedMesh(true);
+    }
+    else if (!strcmp(argv[i], "--procedural-terrain"))
+    {
+      sampleScene.setProceduralTerrain(true);
+    }
+    else if (!strcmp(argv[i], "--terrain-lod"))
+    {
+      float pixels = 2.0f;
+      if (i + 1 < argc && atof(argv[i + 1]) > 0)
+        pixels = float(atof(argv[++i]));
+      sampleScene.setTerrainLod(pixels);
+    }
+    else if (!strcmp(argv[i], "--mesh") && i + 1 < argc)
+    {
+      sampleScene.setMeshFile(argv[++i]);
+    }
+    else if (!strcmp(argv[i], "--gpu-culling") && i + 1 < argc)
+    {
+      sampleScene.setCulledObjects(size_t(max(atoi(argv[++i]), 0)));
+    }
+    else if (!strcmp(argv[i], "--animated-terrain"))
+    {
+      const char *mode = i + 1 < argc ? argv[i + 1] : "";
+      StreamMapping mapping = StreamMapping::Coherent;
+      if (!strcmp(mode, "flush"))
+        mapping = StreamMapping::ExplicitFlush;
+      else if (!strcmp(mode, "subdata"))
+        mapping = StreamMapping::BufferSubData;
+      if (mapping != StreamMapping::Coherent || !strcmp(mode, "coherent"))
+        ++i;
+      sampleScene.setAnimatedTerrain(true, mapping);
+    }
+    else if (!strcmp(argv[i], "--shading-cache"))
+    {
+      int texels = 1024;
+      if (i + 1 < argc && atoi(argv[i + 1]) > 0)
+        texels = atoi(argv[++i]);
+      sampleScene.setShadingCache(texels);
+    }
+    else if (!strcmp(argv[i], "--swap-interval") && i + 1 < argc)
+    {
+      sampleScene.setSwapInterval(atoi(argv[++i]));
+    }
+    else if (!strcmp(argv[i], "--max-frames-in-flight") && i + 1 < argc)
+    {
+      sampleScene.setMaxFramesInFlight(atoi(argv[++i]));
+    }
+    else if (!strcmp(argv[i], "--latency-report"))
+    {
+      double seconds = 1.0;
+      if (i + 1 < argc && atof(argv[i + 1]) > 0)
+        seconds = atof(argv[++i]);
+      sampleScene.setLatencyReportInterval(seconds);
+    }
+    else if (!strcmp(argv[i], "--quilt-preset") && i + 1 < argc)
+    {
+      sampleScene.setQuiltPreset(atoi(argv[++i]));
+    }
+    else if (!strcmp(argv[i], "--quilt-buffers") && i + 1 < argc)
+    {
+      quiltBuffering.bufferCount = max(atoi(argv[++i]), 1);
+      quiltBufferingChanged = true;
+    }
+    else if (!strcmp(argv[i], "--quilt-budget") && i + 1 < argc)
+    {
+      quiltBuffering.memoryBudgetBytes = size_t(max(atoi(argv[++i]), 0)) << 20;
+      quiltBufferingChanged = true;
+    }
+    else if (!strcmp(argv[i], "--compact-quilt"))
+    {
+      quiltBuffering.allowCompactFormat = true;
+      quiltBufferingChanged = true;
+    }
+    else if (!strcmp(argv[i], "--quilt-depth") && i + 1 < argc)
+    {
+      const char *mode = argv[++i];
+      quiltBuffering.depth = !strcmp(mode, "none")      ? QuiltDepth::None
+                             : !strcmp(mode, "texture") ? QuiltDepth::Texture
+                                                        : QuiltDepth::Renderbuffer;
+      quiltBufferingChanged = true;
+    }
+    else if (!strcmp(argv[i], "--capture-dir") && i + 1 < argc)
+    {
+      captureDir = argv[++i];
+    }
+    else if (!strcmp(argv[i], "--capture-panel"))
+    {
+      capturePanel = true;
+    }
+    else if (!strcmp(argv[i], "--capture-downscale") && i + 1 < argc)
+    {
+      capture.downscale = max(atoi(argv[++i]), 1);
+    }
+    else if (!strcmp(argv[i], "--record") && i + 1 < argc)
+    {
+      recordPath = argv[++i];
+    }
+    else if (!strcmp(argv[i], "--record-threads") && i + 1 < argc)
+    {
+      recording.threads = max(atoi(argv[++i]), 1);
+    }
+    else if (!strcmp(argv[i], "--play") && i + 1 < argc)
+    {
+      playPath = argv[++i];
+    }
+    else if (!strcmp(argv[i], "--play-once"))
+    {
+      playback.loop = false;
+    }
+    else if (!strcmp(argv[i], "--play-threads") && i + 1 < argc)
+    {
+      playback.decodeThreads = max(atoi(argv[++i]), 1);
+    }
+    else if (!strcmp(argv[i], "--play-slots") && i + 1 < argc)
+    {
+      playback.slots = max(atoi(argv[++i]), 2);
+    }
+  }
+
+  if (quiltBufferingChanged)
+    sampleScene.setQuiltBuffering(quiltBuffering);
+
+  if (!playPath.empty())
+    sampleScene.enablePlayback(playPath, playback);
+
+  if (!captureDir.empty())
+  {
+    // the disk is the slow part, keep the latest frames if it falls behind
+    capture.dropPolicy = CaptureDropPolicy::DropOldest;
+    sampleScene.enableFrameCapture(
+        capture, [captureDir](const CapturedFrame &frame) {
+          writePPM(captureDir, frame);
+        },
+        true, capturePanel);
+  }
+
+  if (!recordPath.empty())
+    sampleScene.startRecording(recordPath, recording, capture.downscale);
 
   sampleScene.run();
 
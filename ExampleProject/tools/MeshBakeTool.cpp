@@ -0,0 +1,84 @@
+/**
+ * MeshBakeTool.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ *
+ * The offline bake step for main --mesh: converts an OBJ file, or the
+ * generated terrain, into a mesh file (MeshFile.hpp) once, so that startup
+ * only maps it and uploads it. Packed vertices in vertex cache order by
+ * default.
+ *
+ * usage: mesh_bake <input.obj | --terrain cells> <output.hpm>
+ *                  [--float] [--no-optimize] [--obj output.obj]
+ *
+ *   --terrain n     bakes SampleScene's terrain of n x n cells
+ *   --float         TerrainVertex (40 bytes) instead of PackedTerrainVertex
+ *   --no-optimize   keeps the triangle order, one chunk
+ *   --obj file      also writes the input as OBJ, e.g. to export the terrain
+ */
+
+#include "JobSystem.hpp"
+#include "MeshBake.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+// as SampleScene spaces its terrain
+static const float TERRAIN_SPACING = 0.1f;
+
+int main(int argc, const char *argv[])
+{
+  string input, output, obj;
+  unsigned terrainCells = 0;
+  MeshBakeSettings settings;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "--terrain") && i + 1 < argc)
+      terrainCells = unsigned(max(atoi(argv[++i]), 1));
+    else if (!strcmp(argv[i], "--float"))
+      settings.packed = false;
+    else if (!strcmp(argv[i], "--no-optimize"))
+      settings.optimize = false;
+    else if (!strcmp(argv[i], "--obj") && i + 1 < argc)
+      obj = argv[++i];
+    else if (input.empty() && !terrainCells)
+      input = argv[i];
+    else
+      output = argv[i];
+  }
+  if ((input.empty() && !terrainCells) || output.empty())
+  {
+    cout << "usage: mesh_bake <input.obj | --terrain cells> <output.hpm> "
+            "[--float] [--no-optimize] [--obj output.obj]"
+         << endl;
+    return 1;
+  }
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  TerrainMesh mesh;
+  if (terrainCells)
+  {
+    JobSystem jobs(max(thread::hardware_concurrency(), 1u));
+    generateTerrain(terrainCells, TERRAIN_SPACING, mesh, &jobs);
+  }
+  else if (!loadObj(input, mesh))
+    return 1;
+  if (!obj.empty() && !writeObj(obj, mesh))
+    return 1;
+  if (!bakeMesh(mesh, settings, output))
+    return 1;
+  cout << "[Info] done in "
+       << chrono::duration<double, milli>(chrono::steady_clock::now() - start)
+              .count()
+       << " ms" << endl;
+  return 0;
+}
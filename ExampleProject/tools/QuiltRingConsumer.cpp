@@ -0,0 +1,103 @@
+/**
+ * QuiltRingConsumer.cpp
+ * Contributors:
+ *      * Looking Glass Factory Inc.
+ * Licence:
+ *      * MIT
+ *
+ * Stand-in for HoloPlay Service on the consuming side of a quilt ring: maps
+ * the shared memory created by QuiltRingProducer, takes the newest frame,
+ * pretends to process it and prints the ring metrics once per second.
+ *
+ * usage: quilt_ring_consumer [name] [seconds] [processing ms]
+ */
+
+#include "QuiltRing.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+using namespace std;
+
+static void printMetrics(const QuiltRingMetrics &m)
+{
+  cout << "[Ring] published=" << m.published << " consumed=" << m.consumed
+       << " overwritten=" << m.overwritten << " skipped=" << m.skipped
+       << " stalls=" << m.producerStalls << " (avg " << m.averageStallMs()
+       << " ms)"
+       << " occupancy avg=" << m.averageOccupancy()
+       << " max=" << m.occupancyMax
+       << " latency avg=" << m.averageLatencyMs()
+       << " ms max=" << double(m.latencyMaxNs) * 1e-6 << " ms" << endl;
+}
+
+int main(int argc, const char *argv[])
+{
+  string name = argc > 1 ? argv[1] : "/holoplay_quilt";
+  double seconds = argc > 2 ? atof(argv[2]) : 10.0;
+  int processingMs = argc > 3 ? atoi(argv[3]) : 0;
+
+  // the producer may not be up yet
+  QuiltRingConsumer *ring = NULL;
+  auto start = chrono::steady_clock::now();
+  while (!ring)
+  {
+    try
+    {
+      ring = new QuiltRingConsumer(name);
+    }
+    catch (const std::runtime_error &)
+    {
+      if (chrono::steady_clock::now() - start > chrono::seconds(10))
+      {
+        cout << "[Error] no quilt ring named " << name << endl;
+        return 1;
+      }
+      this_thread::sleep_for(chrono::milliseconds(50));
+    }
+  }
+  cout << "[Info] attached to " << name << ", " << ring->getSlotCount()
+       << " slots of " << ring->getSlotBytes() << " bytes" << endl;
+
+  start = chrono::steady_clock::now();
+  auto lastReport = start;
+  uint64_t frames = 0;
+  uint64_t checksum = 0;
+  while (chrono::duration<double>(chrono::steady_clock::now() - start)
+             .count() < seconds)
+  {
+    QuiltRingFrameInfo info;
+    const unsigned char *pixels = ring->acquireLatest(info);
+    if (!pixels)
+    {
+      this_thread::sleep_for(chrono::microseconds(200));
+    }
+    else
+    {
+      // touch one byte per page so the frame is actually read
+      const size_t bytes = size_t(info.width) * info.height * info.channels;
+      for (size_t i = 0; i < bytes; i += 4096)
+        checksum += pixels[i];
+      if (processingMs > 0)
+        this_thread::sleep_for(chrono::milliseconds(processingMs));
+      ring->release();
+      frames++;
+    }
+
+    auto now = chrono::steady_clock::now();
+    if (now - lastReport >= chrono::seconds(1))
+    {
+      lastReport = now;
+      printMetrics(ring->getMetrics());
+    }
+  }
+
+  cout << "[Info] consumed " << frames << " frames (checksum " << checksum
+       << ")" << endl;
+  printMetrics(ring->getMetrics());
+  delete ring;
+  return 0;
+}
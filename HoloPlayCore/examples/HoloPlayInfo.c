@@ -3,6 +3,8 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include "HoloPlayCore.h"
+#define HPC_SNAPSHOT_IMPLEMENTATION
+#include "HoloPlayCoreSnapshot.h"
 
 int main(int argc, char **argv)
 {
@@ -45,6 +47,8 @@ int main(int argc, char **argv)
 		printf("HoloPlay Service version %s.\n", buf);
 		int num_displays = hpc_GetNumDevices();
 		printf("%d device%s connected.\n", num_displays, (num_displays == 1 ? "" : "s"));
+		// one snapshot of the state for all the button reads below
+		hpc_snapshot *state = hpc_SnapshotState();
 		for (int i = 0; i < num_displays; ++i)
 		{
 			printf("Device information for display %d:\n", i);
@@ -52,11 +56,16 @@ int main(int argc, char **argv)
 			printf(" Device name: %s\n", buf);
 			hpc_GetDeviceType(i, buf, 1000);
 			printf(" Device type: %s\n", buf);
-			int b0 = hpc_GetDevicePropertyInt(i, "/buttons/0");
-			int b1 = hpc_GetDevicePropertyInt(i, "/buttons/1");
-			int b2 = hpc_GetDevicePropertyInt(i, "/buttons/2");
-			int b3 = hpc_GetDevicePropertyInt(i, "/buttons/3");
-			printf(" Button status: %d %d %d %d", b0, b1, b2, b3);
+			hpc_query *buttons[4] = {
+				hpc_CompileDeviceQuery(i, "/buttons/0"),
+				hpc_CompileDeviceQuery(i, "/buttons/1"),
+				hpc_CompileDeviceQuery(i, "/buttons/2"),
+				hpc_CompileDeviceQuery(i, "/buttons/3")};
+			hpc_value b[4];
+			hpc_SnapshotBatchRead(state, (const hpc_query *const *)buttons, 4, b);
+			printf(" Button status: %d %d %d %d", b[0].i, b[1].i, b[2].i, b[3].i);
+			for (int q = 0; q < 4; ++q)
+				hpc_FreeQuery(buttons[q]);
 			printf("\nWindow parameters for display %d:\n", i);
 			printf(" Position: (%d, %d)\n", hpc_GetDevicePropertyWinX(i), hpc_GetDevicePropertyWinY(i));
 			printf(" Size: (%d, %d)\n", hpc_GetDevicePropertyScreenW(i), hpc_GetDevicePropertyScreenH(i));
@@ -69,6 +78,7 @@ int main(int argc, char **argv)
 			printf(" fringe: %.1f\n", hpc_GetDevicePropertyFringe(i));
 			printf(" RI: %d\n BI: %d\n invView: %d\n", hpc_GetDevicePropertyRi(i), hpc_GetDevicePropertyBi(i), hpc_GetDevicePropertyInvView(i));
 		}
+		hpc_FreeSnapshot(state);
 	}
 	hpc_CloseApp();
 	return 0;
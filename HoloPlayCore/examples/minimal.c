@@ -3,6 +3,13 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <HoloPlayCore.h>
+#define HPC_SNAPSHOT_IMPLEMENTATION
+#include <HoloPlayCoreSnapshot.h>
+
+static int write_stdout(const char *data, size_t data_sz, void *context)
+{
+    return fwrite(data, 1, data_sz, stdout) != data_sz;
+}
 
 int main(int argc, char **argv)
 {
@@ -10,19 +17,9 @@ int main(int argc, char **argv)
     if (!(errco = hpc_InitializeApp("minimal.c", hpc_LICENSE_NONCOMMERCIAL)))
     {
         char buf[1500];
-        size_t d = hpc_GetStateAsJSON(buf, 1500);
-        // if we haven't allocated enough space for the string, try again
-        if (d)
-        {
-            char *buf2 = (char *)malloc(d);
-            size_t c = hpc_GetStateAsJSON(buf2, d);
-            printf("%s\n", buf2);
-            free(buf2);
-        }
-        else
-        {
-            printf("%s\n", buf);
-        }
+        // the state is serialized once and streamed to stdout
+        hpc_WriteStateJSON(write_stdout, NULL);
+        printf("\n");
         hpc_GetHoloPlayServiceVersion(buf, 1500);
         printf("Version %s\n", buf);
         printf("%d devices.\n", hpc_GetNumDevices());
@@ -0,0 +1,105 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <time.h>
+#include "HoloPlayCore.h"
+#define HPC_SNAPSHOT_IMPLEMENTATION
+#include "HoloPlayCoreSnapshot.h"
+
+// compares reading device fields through query strings (parsed on every call)
+// with compiled queries and one batch read over a snapshot of the state
+
+#define ITERATIONS 20000
+
+static const char *fields[] = {
+    "/buttons/0",
+    "/buttons/1",
+    "/buttons/2",
+    "/buttons/3",
+    "/calibration/pitch/value",
+    "/calibration/slope/value",
+    "/calibration/center/value",
+    "/calibration/viewCone/value",
+    "/calibration/invView/value",
+    "/calibration/screenW/value",
+    "/calibration/screenH/value",
+    "/calibration/fringe/value",
+};
+#define FIELD_COUNT (int)(sizeof(fields) / sizeof(fields[0]))
+
+static double seconds_since(clock_t start)
+{
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char **argv)
+{
+    hpc_client_error errco = hpc_InitializeApp("querybench.c", hpc_LICENSE_NONCOMMERCIAL);
+    if (errco)
+    {
+        printf("Error connecting to HoloPlay Service (code %d).\n", errco);
+        hpc_CloseApp();
+        return 1;
+    }
+    int num_displays = hpc_GetNumDevices();
+    if (num_displays < 1)
+    {
+        printf("No device connected.\n");
+        hpc_CloseApp();
+        return 1;
+    }
+
+    float checksum_string = 0.0f, checksum_batch = 0.0f;
+
+    // string path: every call parses the query and walks the tree from the root
+    clock_t start = clock();
+    for (int it = 0; it < ITERATIONS; ++it)
+        for (int d = 0; d < num_displays; ++d)
+            for (int f = 0; f < FIELD_COUNT; ++f)
+                checksum_string += hpc_GetDevicePropertyFloat(d, fields[f]);
+    double string_time = seconds_since(start);
+
+    // compiled path: compile once, then one snapshot and one batch read per
+    // refresh. The two are timed separately: the snapshot in its own loop, the
+    // batch read over a single snapshot taken before its timer starts
+    int count = num_displays * FIELD_COUNT;
+    hpc_query **queries = (hpc_query **)malloc(sizeof(hpc_query *) * count);
+    hpc_value *values = (hpc_value *)malloc(sizeof(hpc_value) * count);
+    for (int d = 0; d < num_displays; ++d)
+        for (int f = 0; f < FIELD_COUNT; ++f)
+            queries[d * FIELD_COUNT + f] = hpc_CompileDeviceQuery(d, fields[f]);
+
+    double snapshot_time = 0.0;
+    start = clock();
+    for (int it = 0; it < ITERATIONS / 100; ++it)
+    {
+        hpc_snapshot *snapshot = hpc_SnapshotState();
+        hpc_FreeSnapshot(snapshot);
+    }
+    snapshot_time = seconds_since(start) / (ITERATIONS / 100);
+
+    hpc_snapshot *snapshot = hpc_SnapshotState();
+    start = clock();
+    for (int it = 0; it < ITERATIONS; ++it)
+    {
+        hpc_SnapshotBatchRead(snapshot, (const hpc_query *const *)queries, count, values);
+        for (int i = 0; i < count; ++i)
+            checksum_batch += values[i].f;
+    }
+    double batch_time = seconds_since(start);
+
+    printf("%d devices, %d fields each, %d iterations\n", num_displays, FIELD_COUNT, ITERATIONS);
+    printf(" query strings:  %8.3f us per read-all (checksum %f)\n", string_time / ITERATIONS * 1e6, checksum_string);
+    printf(" batch read:     %8.3f us per read-all (checksum %f)\n", batch_time / ITERATIONS * 1e6, checksum_batch);
+    printf(" state snapshot: %8.3f us, paid once per hpc_RefreshState\n", snapshot_time * 1e6);
+    printf(" both, per refresh: %5.3f us\n", (snapshot_time + batch_time / ITERATIONS) * 1e6);
+
+    hpc_FreeSnapshot(snapshot);
+    for (int i = 0; i < count; ++i)
+        hpc_FreeQuery(queries[i]);
+    free(queries);
+    free(values);
+    hpc_CloseApp();
+    return 0;
+}
@@ -40,6 +40,8 @@
 
 */
 
+#ifndef HOLOPLAYCORE_H
+#define HOLOPLAYCORE_H
 
 #ifndef IMPORT_DECL
 #ifdef _WIN32
@@ -345,3 +347,5 @@ extern "C"
 #ifdef __cplusplus
 }
 #endif
+
+#endif // HOLOPLAYCORE_H
@@ -0,0 +1,305 @@
+/*
+    HoloPlayCore 0.2.0
+
+    File: include/HoloPlayCore.hpp
+
+     This header contains a header-only C++11 wrapper around the opaque hpc_obj functions
+    declared in libHoloPlayCore.h:
+
+        hpc::Object         move-only owner of an hpc_obj, deleted with hpc_DeleteObject.
+        hpc::Request        a request parsed once by hpc_MakeObject and sent any number of
+                            times, blocking or asynchronously.
+        hpc::RequestPool    prepared requests keyed by their JSON text, so periodic queries
+                            (info, state...) are never parsed again.
+        hpc::ResponseArena  collects response objects and frees them in bulk, typically once
+                            per frame.
+
+     Response objects are allocated inside the library, so they can't be placed in caller
+    memory. The arena instead owns them until clear(), which turns one hpc_DeleteObject call
+    per reply scattered across callbacks into a single pass at a point the app chooses.
+
+    Copyright 2020 Looking Glass Factory
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+    and associated documentation files (the "Software"), to deal in the Software without
+    restriction, including without limitation the rights to use, copy, modify, merge, publish,
+    distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+    BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef HOLOPLAYCORE_HPP
+#define HOLOPLAYCORE_HPP
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "HoloPlayCore.h"
+
+namespace hpc
+{
+    /*
+       hpc::Object
+
+        Owns one hpc_obj. Moving transfers ownership; the object is deleted when the owner
+       goes out of scope or is reset.
+
+        The accessors of an empty Object return 0, an empty string or hpc_ERR_NOERROR: no
+       reply isn't a service error, the client error of the call that should have filled it
+       says why.
+    */
+    class Object
+    {
+    public:
+        Object() : obj(NULL) {}
+        explicit Object(hpc_obj *obj) : obj(obj) {}
+        Object(Object &&other) : obj(other.release()) {}
+        ~Object() { reset(); }
+
+        Object &operator=(Object &&other)
+        {
+            if (this != &other)
+                reset(other.release());
+            return *this;
+        }
+
+        // parses cmd_json; the result is empty if it isn't valid JSON
+        static Object fromJSON(const std::string &cmd_json, size_t binlen = 0, const unsigned char *bin = NULL)
+        {
+            return Object(hpc_MakeObject(cmd_json.c_str(), binlen, bin));
+        }
+
+        hpc_obj *get() const { return obj; }
+        explicit operator bool() const { return obj != NULL; }
+
+        // gives up ownership without deleting
+        hpc_obj *release()
+        {
+            hpc_obj *released = obj;
+            obj = NULL;
+            return released;
+        }
+
+        void reset(hpc_obj *replacement = NULL)
+        {
+            if (obj)
+                hpc_DeleteObject(obj);
+            obj = replacement;
+        }
+
+        int queryInt(const char *query_string) const { return obj ? hpc_ObjQueryInt(obj, query_string) : 0; }
+        float queryFloat(const char *query_string) const { return obj ? hpc_ObjQueryFloat(obj, query_string) : 0.0f; }
+        int getLength(const char *query_string) const { return obj ? hpc_ObjGetLength(obj, query_string) : 0; }
+        hpc_service_error errorCode() const { return obj ? hpc_ObjGetErrorCode(obj) : hpc_ERR_NOERROR; }
+
+        std::string queryString(const char *query_string) const
+        {
+            if (!obj)
+                return std::string();
+            char small[256] = "";
+            size_t needed = hpc_ObjQueryString(obj, query_string, small, sizeof(small));
+            if (!needed)
+                return small;
+            // see the note on string return functions
+            std::vector<char> buf(needed + 1, '\0');
+            hpc_ObjQueryString(obj, query_string, buf.data(), buf.size());
+            return buf.data();
+        }
+
+        std::string json() const
+        {
+            if (!obj)
+                return std::string();
+            char small[1024] = "";
+            size_t needed = hpc_ObjAsJson(obj, small, sizeof(small));
+            if (!needed)
+                return small;
+            std::vector<char> buf(needed + 1, '\0');
+            hpc_ObjAsJson(obj, buf.data(), buf.size());
+            return buf.data();
+        }
+
+    private:
+        Object(const Object &);
+        Object &operator=(const Object &);
+
+        hpc_obj *obj;
+    };
+
+    /*
+       hpc::ResponseArena
+
+        Owns response objects until clear(). adopt() may be called from the library's
+       callback thread while the app thread reads earlier replies; clear() must not run while
+       the app still uses pointers returned by adopt().
+    */
+    class ResponseArena
+    {
+    public:
+        ResponseArena() {}
+        ~ResponseArena() { clear(); }
+
+        // takes ownership, the returned pointer stays valid until clear()
+        hpc_obj *adopt(hpc_obj *response)
+        {
+            if (!response)
+                return NULL;
+            std::lock_guard<std::mutex> lock(mutex);
+            objects.push_back(response);
+            return response;
+        }
+
+        hpc_obj *adopt(Object &&response) { return adopt(response.release()); }
+
+        // deletes every adopted object; the list keeps its capacity for the next frame
+        void clear()
+        {
+            std::vector<hpc_obj *> expired;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                expired.swap(objects);
+                objects.reserve(expired.capacity());
+            }
+            for (size_t i = 0; i < expired.size(); ++i)
+                hpc_DeleteObject(expired[i]);
+        }
+
+        size_t size() const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return objects.size();
+        }
+
+    private:
+        ResponseArena(const ResponseArena &);
+        ResponseArena &operator=(const ResponseArena &);
+
+        mutable std::mutex mutex;
+        std::vector<hpc_obj *> objects;
+    };
+
+    /*
+       hpc::Request
+
+        A request parsed once and sent as often as needed. Copies share the same parsed
+       object, which stays alive until the last copy and the last pending reply are gone, so
+       a Request may be destroyed while asynchronous sends are still in flight.
+    */
+    class Request
+    {
+    public:
+        // called on the library's thread with the reply (may be null on error)
+        typedef std::function<void(const hpc_obj *reply, hpc_client_error clierr)> Callback;
+
+        Request() {}
+        explicit Request(const std::string &cmd_json, size_t binlen = 0, const unsigned char *bin = NULL)
+        {
+            Object parsed = Object::fromJSON(cmd_json, binlen, bin);
+            if (parsed)
+                object = std::make_shared<Object>(std::move(parsed));
+        }
+
+        bool valid() const { return object != nullptr; }
+        const hpc_obj *get() const { return object ? object->get() : NULL; }
+
+        // waits for the reply and stores it in response
+        hpc_client_error send(Object &response) const
+        {
+            hpc_obj *reply = NULL;
+            hpc_client_error clierr = object ? hpc_SendBlocking(object->get(), &reply) : hpc_CLIERR_SERIALIZEERR;
+            response.reset(reply);
+            return clierr;
+        }
+
+        // sends without waiting. With an arena the reply is adopted by it and stays valid
+        // until its next clear(); without one it's deleted once the callback returns.
+        hpc_client_error sendAsync(ResponseArena *arena = NULL, Callback callback = Callback()) const
+        {
+            if (!object)
+                return hpc_CLIERR_SERIALIZEERR;
+            Pending *pending = new Pending;
+            pending->request = object;
+            pending->arena = arena;
+            pending->callback = std::move(callback);
+            hpc_client_error clierr = hpc_SendCallback(object->get(), &Request::onReply, pending);
+            // the callback isn't called if the message couldn't be sent
+            if (clierr != hpc_CLIERR_NOERROR)
+                delete pending;
+            return clierr;
+        }
+
+    private:
+        struct Pending
+        {
+            std::shared_ptr<Object> request;
+            ResponseArena *arena;
+            Callback callback;
+        };
+
+        static void onReply(hpc_obj reply, hpc_client_error clierr, void *context)
+        {
+            Pending *pending = (Pending *)context;
+            Object response((hpc_obj *)reply);
+            const hpc_obj *kept = pending->arena ? pending->arena->adopt(std::move(response)) : response.get();
+            if (pending->callback)
+                pending->callback(kept, clierr);
+            delete pending;
+        }
+
+        std::shared_ptr<Object> object;
+    };
+
+    /*
+       hpc::RequestPool
+
+        Prepared requests keyed by their JSON text. The first get() for a given text parses
+       it, later ones return the same prepared request.
+    */
+    class RequestPool
+    {
+    public:
+        // returns an invalid Request if cmd_json doesn't parse (the failure isn't cached)
+        Request get(const std::string &cmd_json)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::unordered_map<std::string, Request>::iterator it = requests.find(cmd_json);
+            if (it != requests.end())
+                return it->second;
+            Request request(cmd_json);
+            if (request.valid())
+                requests[cmd_json] = request;
+            return request;
+        }
+
+        size_t size() const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return requests.size();
+        }
+
+        void clear()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            requests.clear();
+        }
+
+    private:
+        mutable std::mutex mutex;
+        std::unordered_map<std::string, Request> requests;
+    };
+}
+
+#endif // HOLOPLAYCORE_HPP
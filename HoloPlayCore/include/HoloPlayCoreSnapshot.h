@@ -0,0 +1,1341 @@
+/*
+    HoloPlayCore 0.2.0
+
+    File: include/HoloPlayCoreSnapshot.h
+
+     This header contains a small companion library for HoloPlayCore: compiled jsonpointer
+    queries and multi-field reads over a parsed snapshot of an hpc_obj, and streaming JSON /
+    CBOR export of the state message.
+
+     hpc_ObjQuery* and hpc_GetDeviceProperty* parse their query string on every call and walk
+    the jsoncons tree from the root. Apps that read the same fields over and over (per device,
+    per frame, or after each hpc_RefreshState) can instead:
+
+        1. compile their queries once with hpc_CompileQuery / hpc_CompileDeviceQuery,
+        2. take a snapshot of the state (or any other object) after each refresh,
+        3. read all the fields they need with one hpc_SnapshotBatchRead call.
+
+     Compiled queries don't refer to any object and can be reused across snapshots.
+
+     hpc_GetStateAsJSON and hpc_ObjAsJson need to be called twice when the caller's buffer is
+    too small, serializing the whole tree each time. The hpc_Write* functions below hand the
+    serialized form to a writer callback instead, so callers can append it to their own
+    buffers (see hpc_BufferWriter). The state is serialized once and cached until the next
+    hpc_RefreshStateCached.
+
+     This file is header-only and built on top of the functions declared in libHoloPlayCore.h.
+    Define HPC_SNAPSHOT_IMPLEMENTATION in exactly one C or C++ file before including it:
+
+        #define HPC_SNAPSHOT_IMPLEMENTATION
+        #include "HoloPlayCoreSnapshot.h"
+
+    Copyright 2020 Looking Glass Factory
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+    and associated documentation files (the "Software"), to deal in the Software without
+    restriction, including without limitation the rights to use, copy, modify, merge, publish,
+    distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+    BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef HOLOPLAYCORE_SNAPSHOT_H
+#define HOLOPLAYCORE_SNAPSHOT_H
+
+#include <stddef.h>
+#include "HoloPlayCore.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /*
+       hpc_query
+
+        Opaque handle to a compiled jsonpointer: the query string split into reference tokens,
+       with escapes resolved and array indices already converted to integers.
+    */
+    typedef struct hpc_query_t hpc_query;
+
+    /*
+       hpc_snapshot
+
+        Opaque handle to a parsed, read-only copy of an hpc_obj. Strings returned from a
+       snapshot stay valid until the snapshot is freed.
+    */
+    typedef struct hpc_snapshot_t hpc_snapshot;
+
+    typedef enum _hpc_value_type
+    {
+        hpc_VALUE_MISSING,             // the query didn't match anything
+        hpc_VALUE_NULL,
+        hpc_VALUE_BOOL,
+        hpc_VALUE_NUMBER,
+        hpc_VALUE_STRING,
+        hpc_VALUE_ARRAY,
+        hpc_VALUE_OBJECT
+    } hpc_value_type;
+
+    /*
+       hpc_value
+
+        Result of a snapshot query. Numbers and booleans fill both i and f (with the same
+       conversions as hpc_ObjQueryInt / hpc_ObjQueryFloat), strings fill s, and length is the
+       string length or the number of elements of an array or object.
+    */
+    typedef struct _hpc_value
+    {
+        hpc_value_type type;
+        int i;
+        float f;
+        const char *s;
+        int length;
+    } hpc_value;
+
+    /*
+       hpc_CompileQuery
+
+        Args: jsonpointer query string (https://tools.ietf.org/html/rfc6901)
+        Returns: compiled query, to be freed with hpc_FreeQuery. Null if the string is not a
+       valid jsonpointer.
+    */
+    hpc_query *hpc_CompileQuery(const char *query_string);
+
+    /*
+       hpc_CompileDeviceQuery
+
+        Compiles a query relative to one device of the state message, the same way
+       hpc_GetDeviceProperty* interpret their query string (it is prefixed with
+       /devices/<dev_index>).
+
+        Args: index of device; jsonpointer query string
+        Returns: compiled query, to be freed with hpc_FreeQuery. Null if invalid.
+    */
+    hpc_query *hpc_CompileDeviceQuery(int dev_index, const char *query_string);
+
+    /*
+       hpc_FreeQuery
+
+        Args: compiled query (may be null)
+        Returns: none
+    */
+    void hpc_FreeQuery(hpc_query *query);
+
+    /*
+       hpc_SnapshotObject
+
+        Serializes an object once and parses it into a snapshot.
+
+        Args: object to copy
+        Returns: snapshot, to be freed with hpc_FreeSnapshot. Null on failure.
+    */
+    hpc_snapshot *hpc_SnapshotObject(const hpc_obj *obj);
+
+    /*
+       hpc_SnapshotState
+
+        Args: none
+        Returns: snapshot of the global state message (see hpc_StateMsgInstance). Take a new
+       one after each hpc_RefreshState. Null if no state message has been received yet.
+    */
+    hpc_snapshot *hpc_SnapshotState(void);
+
+    /*
+       hpc_SnapshotFromJSON
+
+        Args: JSON text and its length in bytes
+        Returns: snapshot, to be freed with hpc_FreeSnapshot. Null if the text isn't valid JSON.
+    */
+    hpc_snapshot *hpc_SnapshotFromJSON(const char *json, size_t json_len);
+
+    /*
+       hpc_FreeSnapshot
+
+        Args: snapshot (may be null)
+        Returns: none
+    */
+    void hpc_FreeSnapshot(hpc_snapshot *snapshot);
+
+    /*
+       hpc_SnapshotQuery functions
+
+        Same results as the hpc_ObjQuery functions in libHoloPlayCore.h, for compiled queries
+       against a snapshot.
+
+        Args: snapshot; compiled query
+        Returns: query result; 0 if query has failed. hpc_SnapshotQueryString follows the
+       note on string return functions in HoloPlayCore.h.
+    */
+    hpc_value hpc_SnapshotQuery(const hpc_snapshot *snapshot, const hpc_query *query);
+    int hpc_SnapshotQueryInt(const hpc_snapshot *snapshot, const hpc_query *query);
+    float hpc_SnapshotQueryFloat(const hpc_snapshot *snapshot, const hpc_query *query);
+    size_t hpc_SnapshotQueryString(const hpc_snapshot *snapshot, const hpc_query *query, char *out_buf, size_t out_buf_sz);
+    int hpc_SnapshotGetLength(const hpc_snapshot *snapshot, const hpc_query *query);
+
+    /*
+       hpc_SnapshotBatchRead
+
+        Resolves several compiled queries in one traversal: queries are visited in path order
+       and shared prefixes (e.g. /devices/0/calibration) are resolved only once.
+
+        Args: snapshot; array of compiled queries; number of queries; output array of the same
+       size, filled in the order of the queries
+        Returns: number of queries that matched a value
+    */
+    int hpc_SnapshotBatchRead(const hpc_snapshot *snapshot, const hpc_query *const *queries, int count, hpc_value *out_values);
+
+    /*
+       hpc_writer
+
+        Callback receiving serialized output in one or more chunks.
+
+        Args: chunk of output; size of chunk in bytes; context pointer passed along
+        Returns: 0 to continue, anything else to stop writing
+    */
+    typedef int (*hpc_writer)(const char *data, size_t data_sz, void *context);
+
+    /*
+       hpc_buffer
+
+        Growable buffer owned by the caller. hpc_BufferWriter appends to it and keeps it
+       zero-terminated, so JSON output can be used as a string directly. Start from
+       {NULL, 0, 0} and free(data) when done.
+    */
+    typedef struct _hpc_buffer
+    {
+        char *data;
+        size_t size;
+        size_t capacity;
+    } hpc_buffer;
+
+    /*
+       hpc_BufferWriter
+
+        hpc_writer appending to the hpc_buffer passed as context.
+    */
+    int hpc_BufferWriter(const char *data, size_t data_sz, void *context);
+
+    /*
+       hpc_RefreshStateCached
+
+        Same as hpc_RefreshState, and drops the cached serializations of the state. Use it
+       instead of hpc_RefreshState when the functions below are used.
+
+        Args: none
+        Returns: error code returned from HoloPlay Service request.
+    */
+    hpc_client_error hpc_RefreshStateCached(void);
+
+    /*
+       hpc_InvalidateStateCache
+
+        Drops the cached serializations of the state; the next call serializes it again.
+       Only needed if hpc_RefreshState or hpc_InitializeApp is called directly.
+    */
+    void hpc_InvalidateStateCache(void);
+
+    /*
+       hpc_GetStateSnapshot
+
+        Args: none
+        Returns: snapshot of the state message, owned by the cache: valid until the next
+       hpc_RefreshStateCached. Null if no state message has been received yet.
+    */
+    const hpc_snapshot *hpc_GetStateSnapshot(void);
+
+    /*
+       hpc_WriteStateJSON
+
+        Writes the state message as JSON, serialized once per refresh.
+
+        Args: writer callback; context pointer
+        Returns: 0 on success, 1 if there is no state or the writer stopped early
+    */
+    int hpc_WriteStateJSON(hpc_writer writer, void *context);
+
+    /*
+       hpc_WriteStateCBOR
+
+        Writes the state message as CBOR (https://tools.ietf.org/html/rfc7049), encoded once
+       per refresh. Integral numbers are encoded as integers, others as floats.
+
+        Args: writer callback; context pointer
+        Returns: 0 on success, 1 if there is no state or the writer stopped early
+    */
+    int hpc_WriteStateCBOR(hpc_writer writer, void *context);
+
+    /*
+       hpc_WriteObjectJSON
+
+        Writes any object as JSON without the two-call pattern of hpc_ObjAsJson.
+
+        Args: object; writer callback; context pointer
+        Returns: 0 on success, 1 on failure or if the writer stopped early
+    */
+    int hpc_WriteObjectJSON(const hpc_obj *obj, hpc_writer writer, void *context);
+
+    /*
+       hpc_WriteSnapshotJSON / hpc_WriteSnapshotCBOR
+
+        Stream a snapshot as JSON or CBOR through a small fixed buffer, never holding the
+       whole output in memory.
+
+        Args: snapshot; writer callback; context pointer
+        Returns: 0 on success, 1 if the writer stopped early
+    */
+    int hpc_WriteSnapshotJSON(const hpc_snapshot *snapshot, hpc_writer writer, void *context);
+    int hpc_WriteSnapshotCBOR(const hpc_snapshot *snapshot, hpc_writer writer, void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOLOPLAYCORE_SNAPSHOT_H
+
+#ifdef HPC_SNAPSHOT_IMPLEMENTATION
+#ifndef HOLOPLAYCORE_SNAPSHOT_IMPLEMENTED
+#define HOLOPLAYCORE_SNAPSHOT_IMPLEMENTED
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define hpc__SNAPSHOT_MAX_DEPTH 256
+
+/* a compiled jsonpointer: token i is text + offset[i], zero-terminated */
+struct hpc_query_t
+{
+    int token_count;
+    size_t *offset;
+    size_t *length;
+    long *index;           /* array index, or -1 if the token isn't one */
+    char *text;
+};
+
+/* one value of the parsed document; containers list their children in kids */
+typedef struct hpc__node_t
+{
+    hpc_value_type type;
+    double number;
+    const char *key;       /* member name, null for array elements and the root */
+    size_t key_length;
+    const char *str;
+    size_t str_length;
+    size_t first_kid;      /* into hpc_snapshot_t.kids */
+    int kid_count;
+} hpc__node;
+
+struct hpc_snapshot_t
+{
+    char *text;            /* copy of the JSON, strings are unescaped in place */
+    hpc__node *nodes;
+    size_t node_count, node_capacity;
+    size_t *kids;
+    size_t kid_count, kid_capacity;
+    size_t *stack;         /* children of the containers being parsed */
+    size_t stack_count, stack_capacity;
+};
+
+/* queries
+   ======================================================================== */
+
+static hpc_query *hpc__compile(const char *prefix, const char *query_string)
+{
+    size_t prefix_len = prefix ? strlen(prefix) : 0;
+    size_t query_len = strlen(query_string);
+    size_t total = prefix_len + query_len;
+    hpc_query *q;
+    int tokens = 0;
+    size_t i, out = 0;
+
+    if ((prefix_len && prefix[0] != '/') || (query_len && query_string[0] != '/'))
+        return NULL;
+
+    q = (hpc_query *)calloc(1, sizeof(hpc_query));
+    if (!q)
+        return NULL;
+    q->text = (char *)malloc(total + 1);
+    for (i = 0; i < prefix_len; ++i)
+        tokens += prefix[i] == '/';
+    for (i = 0; i < query_len; ++i)
+        tokens += query_string[i] == '/';
+    q->offset = (size_t *)malloc(sizeof(size_t) * (size_t)(tokens + 1));
+    q->length = (size_t *)malloc(sizeof(size_t) * (size_t)(tokens + 1));
+    q->index = (long *)malloc(sizeof(long) * (size_t)(tokens + 1));
+    if (!q->text || !q->offset || !q->length || !q->index)
+    {
+        hpc_FreeQuery(q);
+        return NULL;
+    }
+
+    /* split on '/', then resolve ~1 and ~0 (in that order, see RFC 6901) */
+    for (i = 0; i < total; ++i)
+    {
+        char c = i < prefix_len ? prefix[i] : query_string[i - prefix_len];
+        if (c == '/')
+        {
+            if (q->token_count)
+                q->text[out++] = '\0';
+            q->offset[q->token_count++] = out;
+            continue;
+        }
+        if (c == '~')
+        {
+            char next = i + 1 < prefix_len ? prefix[i + 1]
+                        : i + 1 < total    ? query_string[i + 1 - prefix_len]
+                                           : '\0';
+            if (next != '0' && next != '1')
+            {
+                hpc_FreeQuery(q);
+                return NULL;
+            }
+            c = next == '1' ? '/' : '~';
+            ++i;
+        }
+        q->text[out++] = c;
+    }
+    q->text[out] = '\0';
+
+    for (i = 0; i < (size_t)q->token_count; ++i)
+    {
+        const char *t = q->text + q->offset[i];
+        size_t len = strlen(t), k;
+        q->length[i] = len;
+        q->index[i] = -1;
+        /* array indices have no sign and no leading zeros */
+        if (len == 0 || len > 9 || (len > 1 && t[0] == '0'))
+            continue;
+        for (k = 0; k < len && t[k] >= '0' && t[k] <= '9'; ++k)
+            ;
+        if (k == len)
+            q->index[i] = strtol(t, NULL, 10);
+    }
+    return q;
+}
+
+hpc_query *hpc_CompileQuery(const char *query_string)
+{
+    return query_string ? hpc__compile(NULL, query_string) : NULL;
+}
+
+hpc_query *hpc_CompileDeviceQuery(int dev_index, const char *query_string)
+{
+    char prefix[32];
+    if (!query_string || dev_index < 0)
+        return NULL;
+    snprintf(prefix, sizeof(prefix), "/devices/%d", dev_index);
+    return hpc__compile(prefix, query_string);
+}
+
+void hpc_FreeQuery(hpc_query *query)
+{
+    if (!query)
+        return;
+    free(query->offset);
+    free(query->length);
+    free(query->index);
+    free(query->text);
+    free(query);
+}
+
+/* parser
+   ======================================================================== */
+
+typedef struct hpc__parser_t
+{
+    hpc_snapshot *snap;
+    char *p;
+    char *end;
+} hpc__parser;
+
+static int hpc__grow(void **data, size_t *capacity, size_t needed, size_t elem)
+{
+    size_t cap = *capacity ? *capacity : 64;
+    void *grown;
+    if (needed <= *capacity)
+        return 1;
+    while (cap < needed)
+        cap *= 2;
+    grown = realloc(*data, cap * elem);
+    if (!grown)
+        return 0;
+    *data = grown;
+    *capacity = cap;
+    return 1;
+}
+
+static void hpc__skip_ws(hpc__parser *ps)
+{
+    while (ps->p < ps->end && (*ps->p == ' ' || *ps->p == '\t' || *ps->p == '\n' || *ps->p == '\r'))
+        ps->p++;
+}
+
+static int hpc__hex(const char *p, unsigned *out)
+{
+    unsigned v = 0;
+    int i;
+    for (i = 0; i < 4; ++i)
+    {
+        char c = p[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9')
+            v |= (unsigned)(c - '0');
+        else if (c >= 'a' && c <= 'f')
+            v |= (unsigned)(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F')
+            v |= (unsigned)(c - 'A' + 10);
+        else
+            return 0;
+    }
+    *out = v;
+    return 1;
+}
+
+/* unescapes a string in place; the result is zero-terminated where the
+   closing quote was, which is never past it */
+static int hpc__parse_string(hpc__parser *ps, const char **str, size_t *length)
+{
+    char *out = ++ps->p; /* skip the opening quote */
+    *str = out;
+    while (ps->p < ps->end && *ps->p != '"')
+    {
+        char c = *ps->p++;
+        if ((unsigned char)c < 0x20)
+            return 0;
+        if (c != '\\')
+        {
+            *out++ = c;
+            continue;
+        }
+        if (ps->p >= ps->end)
+            return 0;
+        c = *ps->p++;
+        switch (c)
+        {
+        case '"': case '\\': case '/': *out++ = c; break;
+        case 'b': *out++ = '\b'; break;
+        case 'f': *out++ = '\f'; break;
+        case 'n': *out++ = '\n'; break;
+        case 'r': *out++ = '\r'; break;
+        case 't': *out++ = '\t'; break;
+        case 'u':
+        {
+            unsigned cp, lo;
+            if (ps->end - ps->p < 4 || !hpc__hex(ps->p, &cp))
+                return 0;
+            ps->p += 4;
+            /* surrogate pair */
+            if (cp >= 0xD800 && cp <= 0xDBFF && ps->end - ps->p >= 6 && ps->p[0] == '\\' &&
+                ps->p[1] == 'u' && hpc__hex(ps->p + 2, &lo) && lo >= 0xDC00 && lo <= 0xDFFF)
+            {
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                ps->p += 6;
+            }
+            /* the escape is at least as long as its UTF-8 encoding */
+            if (cp < 0x80)
+                *out++ = (char)cp;
+            else if (cp < 0x800)
+            {
+                *out++ = (char)(0xC0 | (cp >> 6));
+                *out++ = (char)(0x80 | (cp & 0x3F));
+            }
+            else if (cp < 0x10000)
+            {
+                *out++ = (char)(0xE0 | (cp >> 12));
+                *out++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+                *out++ = (char)(0x80 | (cp & 0x3F));
+            }
+            else
+            {
+                *out++ = (char)(0xF0 | (cp >> 18));
+                *out++ = (char)(0x80 | ((cp >> 12) & 0x3F));
+                *out++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+                *out++ = (char)(0x80 | (cp & 0x3F));
+            }
+            break;
+        }
+        default:
+            return 0;
+        }
+    }
+    if (ps->p >= ps->end)
+        return 0;
+    *length = (size_t)(out - *str);
+    *out = '\0';
+    ps->p++; /* closing quote */
+    return 1;
+}
+
+static int hpc__parse_value(hpc__parser *ps, int depth, size_t *node_index);
+
+static int hpc__parse_container(hpc__parser *ps, int depth, size_t index, char close)
+{
+    hpc_snapshot *s = ps->snap;
+    size_t base = s->stack_count;
+    int count = 0;
+
+    ps->p++; /* opening bracket */
+    hpc__skip_ws(ps);
+    if (ps->p < ps->end && *ps->p == close)
+        ps->p++;
+    else
+        for (;;)
+        {
+            const char *key = NULL;
+            size_t key_length = 0, child;
+
+            hpc__skip_ws(ps);
+            if (close == '}')
+            {
+                if (ps->p >= ps->end || *ps->p != '"' || !hpc__parse_string(ps, &key, &key_length))
+                    return 0;
+                hpc__skip_ws(ps);
+                if (ps->p >= ps->end || *ps->p != ':')
+                    return 0;
+                ps->p++;
+            }
+            if (!hpc__parse_value(ps, depth + 1, &child))
+                return 0;
+            s->nodes[child].key = key;
+            s->nodes[child].key_length = key_length;
+
+            if (!hpc__grow((void **)&s->stack, &s->stack_capacity, s->stack_count + 1, sizeof(size_t)))
+                return 0;
+            s->stack[s->stack_count++] = child;
+            count++;
+
+            hpc__skip_ws(ps);
+            if (ps->p < ps->end && *ps->p == ',')
+            {
+                ps->p++;
+                continue;
+            }
+            if (ps->p < ps->end && *ps->p == close)
+            {
+                ps->p++;
+                break;
+            }
+            return 0;
+        }
+
+    /* move the children to their final, contiguous place */
+    if (!hpc__grow((void **)&s->kids, &s->kid_capacity, s->kid_count + (size_t)count, sizeof(size_t)))
+        return 0;
+    memcpy(s->kids + s->kid_count, s->stack + base, sizeof(size_t) * (size_t)count);
+    s->nodes[index].first_kid = s->kid_count;
+    s->nodes[index].kid_count = count;
+    s->kid_count += (size_t)count;
+    s->stack_count = base;
+    return 1;
+}
+
+static int hpc__parse_value(hpc__parser *ps, int depth, size_t *node_index)
+{
+    hpc_snapshot *s = ps->snap;
+    size_t index = s->node_count;
+    hpc__node *n;
+    char c;
+
+    if (depth > hpc__SNAPSHOT_MAX_DEPTH)
+        return 0;
+    hpc__skip_ws(ps);
+    if (ps->p >= ps->end)
+        return 0;
+    if (!hpc__grow((void **)&s->nodes, &s->node_capacity, s->node_count + 1, sizeof(hpc__node)))
+        return 0;
+    s->node_count++;
+    *node_index = index;
+    n = &s->nodes[index];
+    memset(n, 0, sizeof(*n));
+
+    c = *ps->p;
+    if (c == '{' || c == '[')
+    {
+        n->type = c == '{' ? hpc_VALUE_OBJECT : hpc_VALUE_ARRAY;
+        return hpc__parse_container(ps, depth, index, c == '{' ? '}' : ']');
+    }
+    if (c == '"')
+    {
+        n->type = hpc_VALUE_STRING;
+        return hpc__parse_string(ps, &n->str, &n->str_length);
+    }
+    if (ps->end - ps->p >= 4 && !strncmp(ps->p, "true", 4))
+    {
+        n->type = hpc_VALUE_BOOL;
+        n->number = 1.0;
+        ps->p += 4;
+        return 1;
+    }
+    if (ps->end - ps->p >= 5 && !strncmp(ps->p, "false", 5))
+    {
+        n->type = hpc_VALUE_BOOL;
+        ps->p += 5;
+        return 1;
+    }
+    if (ps->end - ps->p >= 4 && !strncmp(ps->p, "null", 4))
+    {
+        n->type = hpc_VALUE_NULL;
+        ps->p += 4;
+        return 1;
+    }
+    if (c == '-' || (c >= '0' && c <= '9'))
+    {
+        char *after;
+        n->type = hpc_VALUE_NUMBER;
+        n->number = strtod(ps->p, &after);
+        if (after == ps->p || after > ps->end)
+            return 0;
+        ps->p = after;
+        return 1;
+    }
+    return 0;
+}
+
+hpc_snapshot *hpc_SnapshotFromJSON(const char *json, size_t json_len)
+{
+    hpc_snapshot *s;
+    hpc__parser ps;
+    size_t root;
+
+    if (!json)
+        return NULL;
+    s = (hpc_snapshot *)calloc(1, sizeof(hpc_snapshot));
+    if (!s)
+        return NULL;
+    s->text = (char *)malloc(json_len + 1);
+    if (!s->text)
+    {
+        free(s);
+        return NULL;
+    }
+    memcpy(s->text, json, json_len);
+    s->text[json_len] = '\0'; /* also stops strtod at the end */
+
+    ps.snap = s;
+    ps.p = s->text;
+    ps.end = s->text + json_len;
+    if (!hpc__parse_value(&ps, 0, &root))
+    {
+        hpc_FreeSnapshot(s);
+        return NULL;
+    }
+    hpc__skip_ws(&ps);
+    if (ps.p != ps.end && *ps.p != '\0')
+    {
+        hpc_FreeSnapshot(s);
+        return NULL;
+    }
+
+    free(s->stack);
+    s->stack = NULL;
+    s->stack_count = s->stack_capacity = 0;
+    return s;
+}
+
+hpc_snapshot *hpc_SnapshotObject(const hpc_obj *obj)
+{
+    char small[1024];
+    hpc_snapshot *s;
+    size_t needed;
+    char *buf;
+
+    if (!obj)
+        return NULL;
+    needed = hpc_ObjAsJson(obj, small, sizeof(small));
+    if (!needed)
+        return hpc_SnapshotFromJSON(small, strlen(small));
+
+    /* see the note on string return functions */
+    buf = (char *)malloc(needed + 1);
+    if (!buf)
+        return NULL;
+    if (hpc_ObjAsJson(obj, buf, needed + 1))
+    {
+        free(buf);
+        return NULL;
+    }
+    s = hpc_SnapshotFromJSON(buf, strlen(buf));
+    free(buf);
+    return s;
+}
+
+hpc_snapshot *hpc_SnapshotState(void)
+{
+    return hpc_SnapshotObject(hpc_StateMsgInstance());
+}
+
+void hpc_FreeSnapshot(hpc_snapshot *snapshot)
+{
+    if (!snapshot)
+        return;
+    free(snapshot->text);
+    free(snapshot->nodes);
+    free(snapshot->kids);
+    free(snapshot->stack);
+    free(snapshot);
+}
+
+/* lookups
+   ======================================================================== */
+
+/* child of node n matching token t of query q, or -1 */
+static long hpc__step(const hpc_snapshot *s, size_t n, const hpc_query *q, int t)
+{
+    const hpc__node *node = &s->nodes[n];
+    const size_t *kids = s->kids + node->first_kid;
+    int i;
+
+    if (node->type == hpc_VALUE_ARRAY)
+        return q->index[t] >= 0 && q->index[t] < node->kid_count ? (long)kids[q->index[t]] : -1;
+    if (node->type != hpc_VALUE_OBJECT)
+        return -1;
+    for (i = 0; i < node->kid_count; ++i)
+    {
+        const hpc__node *kid = &s->nodes[kids[i]];
+        if (kid->key_length == q->length[t] && !memcmp(kid->key, q->text + q->offset[t], q->length[t]))
+            return (long)kids[i];
+    }
+    return -1;
+}
+
+static hpc_value hpc__value(const hpc_snapshot *s, long n)
+{
+    hpc_value v;
+    const hpc__node *node;
+
+    memset(&v, 0, sizeof(v));
+    if (n < 0)
+        return v;
+    node = &s->nodes[n];
+    v.type = node->type;
+    switch (node->type)
+    {
+    case hpc_VALUE_BOOL:
+    case hpc_VALUE_NUMBER:
+        v.i = (int)node->number;
+        v.f = (float)node->number;
+        break;
+    case hpc_VALUE_STRING:
+        v.s = node->str;
+        v.length = (int)node->str_length;
+        break;
+    case hpc_VALUE_ARRAY:
+    case hpc_VALUE_OBJECT:
+        v.length = node->kid_count;
+        break;
+    default:
+        break;
+    }
+    return v;
+}
+
+static long hpc__resolve(const hpc_snapshot *s, const hpc_query *q, long from, int first_token)
+{
+    long n = from;
+    int t;
+    for (t = first_token; t < q->token_count && n >= 0; ++t)
+        n = hpc__step(s, (size_t)n, q, t);
+    return n;
+}
+
+hpc_value hpc_SnapshotQuery(const hpc_snapshot *snapshot, const hpc_query *query)
+{
+    if (!snapshot || !query)
+        return hpc__value(snapshot, -1);
+    return hpc__value(snapshot, hpc__resolve(snapshot, query, 0, 0));
+}
+
+int hpc_SnapshotQueryInt(const hpc_snapshot *snapshot, const hpc_query *query)
+{
+    return hpc_SnapshotQuery(snapshot, query).i;
+}
+
+float hpc_SnapshotQueryFloat(const hpc_snapshot *snapshot, const hpc_query *query)
+{
+    return hpc_SnapshotQuery(snapshot, query).f;
+}
+
+size_t hpc_SnapshotQueryString(const hpc_snapshot *snapshot, const hpc_query *query, char *out_buf, size_t out_buf_sz)
+{
+    hpc_value v = hpc_SnapshotQuery(snapshot, query);
+    size_t needed;
+    if (v.type != hpc_VALUE_STRING)
+        return 0;
+    needed = (size_t)v.length + 1;
+    if (needed > out_buf_sz)
+        return needed;
+    memcpy(out_buf, v.s, needed);
+    return 0;
+}
+
+int hpc_SnapshotGetLength(const hpc_snapshot *snapshot, const hpc_query *query)
+{
+    hpc_value v = hpc_SnapshotQuery(snapshot, query);
+    return v.type == hpc_VALUE_ARRAY ? v.length : 0;
+}
+
+static int hpc__token_cmp(const hpc_query *a, int ta, const hpc_query *b, int tb)
+{
+    size_t la = a->length[ta], lb = b->length[tb];
+    int c = memcmp(a->text + a->offset[ta], b->text + b->offset[tb], la < lb ? la : lb);
+    return c ? c : (la < lb ? -1 : la > lb);
+}
+
+static int hpc__query_cmp(const hpc_query *a, const hpc_query *b)
+{
+    int t;
+    for (t = 0; t < a->token_count && t < b->token_count; ++t)
+    {
+        int c = hpc__token_cmp(a, t, b, t);
+        if (c)
+            return c;
+    }
+    return a->token_count - b->token_count;
+}
+
+/* orders queries by path so neighbours share the longest prefixes; batches
+   are small, an insertion sort is enough */
+static void hpc__sort_queries(const hpc_query *const *queries, int *order, int count)
+{
+    int i, j;
+    for (i = 1; i < count; ++i)
+    {
+        int current = order[i];
+        for (j = i; j > 0 && hpc__query_cmp(queries[order[j - 1]], queries[current]) > 0; --j)
+            order[j] = order[j - 1];
+        order[j] = current;
+    }
+}
+
+int hpc_SnapshotBatchRead(const hpc_snapshot *snapshot, const hpc_query *const *queries, int count, hpc_value *out_values)
+{
+    long path[hpc__SNAPSHOT_MAX_DEPTH + 1];
+    int order_small[64];
+    int *order = order_small;
+    const hpc_query *previous = NULL;
+    int i, found = 0;
+
+    if (!snapshot || !queries || count <= 0)
+        return 0;
+    if (count > 64)
+    {
+        order = (int *)malloc(sizeof(int) * (size_t)count);
+        if (!order)
+            return 0;
+    }
+    for (i = 0; i < count; ++i)
+        order[i] = i;
+    for (i = 0; i < count && queries[i]; ++i)
+        ;
+    if (i == count)
+        hpc__sort_queries(queries, order, count);
+
+    /* path[d] is the node reached after d tokens of the previous query */
+    path[0] = 0;
+    for (i = 0; i < count; ++i)
+    {
+        const hpc_query *q = queries[order[i]];
+        int shared = 0, t;
+        long n;
+
+        if (!q || q->token_count > hpc__SNAPSHOT_MAX_DEPTH)
+        {
+            out_values[order[i]] = hpc__value(snapshot, -1);
+            continue;
+        }
+        if (previous)
+            while (shared < q->token_count && shared < previous->token_count &&
+                   path[shared] >= 0 && !hpc__token_cmp(q, shared, previous, shared) &&
+                   q->index[shared] == previous->index[shared])
+                shared++;
+
+        n = path[shared];
+        for (t = shared; t < q->token_count; ++t)
+        {
+            n = n >= 0 ? hpc__step(snapshot, (size_t)n, q, t) : -1;
+            path[t + 1] = n;
+        }
+        out_values[order[i]] = hpc__value(snapshot, n);
+        found += n >= 0;
+        previous = q;
+    }
+
+    if (order != order_small)
+        free(order);
+    return found;
+}
+
+/* streaming output
+   ======================================================================== */
+
+int hpc_BufferWriter(const char *data, size_t data_sz, void *context)
+{
+    hpc_buffer *b = (hpc_buffer *)context;
+    if (!hpc__grow((void **)&b->data, &b->capacity, b->size + data_sz + 1, 1))
+        return 1;
+    memcpy(b->data + b->size, data, data_sz);
+    b->size += data_sz;
+    b->data[b->size] = '\0';
+    return 0;
+}
+
+/* output is gathered in a small buffer and handed to the writer when full */
+typedef struct hpc__out_t
+{
+    hpc_writer writer;
+    void *context;
+    int failed;
+    size_t used;
+    char buf[4096];
+} hpc__out;
+
+static void hpc__flush(hpc__out *o)
+{
+    if (!o->failed && o->used && o->writer(o->buf, o->used, o->context))
+        o->failed = 1;
+    o->used = 0;
+}
+
+static void hpc__put(hpc__out *o, const void *data, size_t len)
+{
+    const char *p = (const char *)data;
+    while (len && !o->failed)
+    {
+        size_t n = sizeof(o->buf) - o->used;
+        if (n > len)
+            n = len;
+        memcpy(o->buf + o->used, p, n);
+        o->used += n;
+        p += n;
+        len -= n;
+        if (o->used == sizeof(o->buf))
+            hpc__flush(o);
+    }
+}
+
+static void hpc__put_json_string(hpc__out *o, const char *str, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t i, run = 0;
+    hpc__put(o, "\"", 1);
+    for (i = 0; i < len; ++i)
+    {
+        unsigned char c = (unsigned char)str[i];
+        char esc[6] = {'\\', 0, 0, 0, 0, 0};
+        size_t esc_len = 2;
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+        hpc__put(o, str + run, i - run);
+        run = i + 1;
+        switch (c)
+        {
+        case '"': esc[1] = '"'; break;
+        case '\\': esc[1] = '\\'; break;
+        case '\b': esc[1] = 'b'; break;
+        case '\f': esc[1] = 'f'; break;
+        case '\n': esc[1] = 'n'; break;
+        case '\r': esc[1] = 'r'; break;
+        case '\t': esc[1] = 't'; break;
+        default:
+            esc[1] = 'u';
+            esc[2] = '0';
+            esc[3] = '0';
+            esc[4] = hex[c >> 4];
+            esc[5] = hex[c & 15];
+            esc_len = 6;
+        }
+        hpc__put(o, esc, esc_len);
+    }
+    hpc__put(o, str + run, len - run);
+    hpc__put(o, "\"", 1);
+}
+
+static void hpc__put_json_number(hpc__out *o, double number)
+{
+    char text[32];
+    /* shortest form that reads back as the same double */
+    int len = snprintf(text, sizeof(text), "%.15g", number);
+    if (strtod(text, NULL) != number)
+        len = snprintf(text, sizeof(text), "%.17g", number);
+    hpc__put(o, text, (size_t)len);
+}
+
+static void hpc__put_json(hpc__out *o, const hpc_snapshot *s, size_t n)
+{
+    const hpc__node *node = &s->nodes[n];
+    int i;
+    switch (node->type)
+    {
+    case hpc_VALUE_NULL: hpc__put(o, "null", 4); break;
+    case hpc_VALUE_BOOL: node->number ? hpc__put(o, "true", 4) : hpc__put(o, "false", 5); break;
+    case hpc_VALUE_NUMBER: hpc__put_json_number(o, node->number); break;
+    case hpc_VALUE_STRING: hpc__put_json_string(o, node->str, node->str_length); break;
+    case hpc_VALUE_ARRAY:
+    case hpc_VALUE_OBJECT:
+        hpc__put(o, node->type == hpc_VALUE_ARRAY ? "[" : "{", 1);
+        for (i = 0; i < node->kid_count && !o->failed; ++i)
+        {
+            size_t kid = s->kids[node->first_kid + (size_t)i];
+            if (i)
+                hpc__put(o, ",", 1);
+            if (node->type == hpc_VALUE_OBJECT)
+            {
+                hpc__put_json_string(o, s->nodes[kid].key, s->nodes[kid].key_length);
+                hpc__put(o, ":", 1);
+            }
+            hpc__put_json(o, s, kid);
+        }
+        hpc__put(o, node->type == hpc_VALUE_ARRAY ? "]" : "}", 1);
+        break;
+    default:
+        break;
+    }
+}
+
+/* CBOR head: major type in the top 3 bits, argument in the shortest form */
+static void hpc__put_cbor_head(hpc__out *o, unsigned major, unsigned long long arg)
+{
+    unsigned char head[9];
+    size_t len, i;
+    if (arg < 24)
+    {
+        head[0] = (unsigned char)(major << 5 | arg);
+        len = 1;
+    }
+    else
+    {
+        size_t bytes = arg <= 0xFF ? 1 : arg <= 0xFFFF ? 2 : arg <= 0xFFFFFFFFull ? 4 : 8;
+        head[0] = (unsigned char)(major << 5 | (bytes == 1 ? 24 : bytes == 2 ? 25 : bytes == 4 ? 26 : 27));
+        for (i = 0; i < bytes; ++i)
+            head[1 + i] = (unsigned char)(arg >> (8 * (bytes - 1 - i)));
+        len = 1 + bytes;
+    }
+    hpc__put(o, head, len);
+}
+
+static void hpc__put_cbor_number(hpc__out *o, double number)
+{
+    unsigned char bytes[9];
+    float single = (float)number;
+    int i;
+
+    if (number > -9.2e18 && number < 9.2e18 && number == (double)(long long)number)
+    {
+        long long integer = (long long)number;
+        if (integer >= 0)
+            hpc__put_cbor_head(o, 0, (unsigned long long)integer);
+        else
+            hpc__put_cbor_head(o, 1, (unsigned long long)(-1 - integer));
+        return;
+    }
+    if ((double)single == number)
+    {
+        /* calibration values are floats, keep them at 4 bytes */
+        unsigned int bits;
+        memcpy(&bits, &single, 4);
+        bytes[0] = 0xFA;
+        for (i = 0; i < 4; ++i)
+            bytes[1 + i] = (unsigned char)(bits >> (24 - 8 * i));
+        hpc__put(o, bytes, 5);
+    }
+    else
+    {
+        unsigned long long bits;
+        memcpy(&bits, &number, 8);
+        bytes[0] = 0xFB;
+        for (i = 0; i < 8; ++i)
+            bytes[1 + i] = (unsigned char)(bits >> (56 - 8 * i));
+        hpc__put(o, bytes, 9);
+    }
+}
+
+static void hpc__put_cbor(hpc__out *o, const hpc_snapshot *s, size_t n)
+{
+    const hpc__node *node = &s->nodes[n];
+    unsigned char simple;
+    int i;
+    switch (node->type)
+    {
+    case hpc_VALUE_NULL:
+        simple = 0xF6;
+        hpc__put(o, &simple, 1);
+        break;
+    case hpc_VALUE_BOOL:
+        simple = node->number ? 0xF5 : 0xF4;
+        hpc__put(o, &simple, 1);
+        break;
+    case hpc_VALUE_NUMBER:
+        hpc__put_cbor_number(o, node->number);
+        break;
+    case hpc_VALUE_STRING:
+        hpc__put_cbor_head(o, 3, node->str_length);
+        hpc__put(o, node->str, node->str_length);
+        break;
+    case hpc_VALUE_ARRAY:
+    case hpc_VALUE_OBJECT:
+        hpc__put_cbor_head(o, node->type == hpc_VALUE_ARRAY ? 4 : 5, (unsigned long long)node->kid_count);
+        for (i = 0; i < node->kid_count && !o->failed; ++i)
+        {
+            size_t kid = s->kids[node->first_kid + (size_t)i];
+            if (node->type == hpc_VALUE_OBJECT)
+            {
+                hpc__put_cbor_head(o, 3, s->nodes[kid].key_length);
+                hpc__put(o, s->nodes[kid].key, s->nodes[kid].key_length);
+            }
+            hpc__put_cbor(o, s, kid);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static int hpc__write_snapshot(const hpc_snapshot *snapshot, hpc_writer writer, void *context, int cbor)
+{
+    hpc__out *o;
+    int failed;
+    if (!snapshot || !writer || !snapshot->node_count)
+        return 1;
+    /* the chunk buffer is too big for some thread stacks */
+    o = (hpc__out *)malloc(sizeof(hpc__out));
+    if (!o)
+        return 1;
+    o->writer = writer;
+    o->context = context;
+    o->failed = 0;
+    o->used = 0;
+    if (cbor)
+        hpc__put_cbor(o, snapshot, 0);
+    else
+        hpc__put_json(o, snapshot, 0);
+    hpc__flush(o);
+    failed = o->failed;
+    free(o);
+    return failed;
+}
+
+int hpc_WriteSnapshotJSON(const hpc_snapshot *snapshot, hpc_writer writer, void *context)
+{
+    return hpc__write_snapshot(snapshot, writer, context, 0);
+}
+
+int hpc_WriteSnapshotCBOR(const hpc_snapshot *snapshot, hpc_writer writer, void *context)
+{
+    return hpc__write_snapshot(snapshot, writer, context, 1);
+}
+
+/* serializes obj into b, reusing its capacity as the first size guess so
+   hpc_ObjAsJson usually runs once */
+static int hpc__serialize(const hpc_obj *obj, hpc_buffer *b)
+{
+    size_t needed;
+    if (!obj)
+        return 0;
+    if (!hpc__grow((void **)&b->data, &b->capacity, 4096, 1))
+        return 0;
+    needed = hpc_ObjAsJson(obj, b->data, b->capacity);
+    if (needed)
+    {
+        if (!hpc__grow((void **)&b->data, &b->capacity, needed + 1, 1) ||
+            hpc_ObjAsJson(obj, b->data, b->capacity))
+            return 0;
+    }
+    b->size = strlen(b->data);
+    return 1;
+}
+
+int hpc_WriteObjectJSON(const hpc_obj *obj, hpc_writer writer, void *context)
+{
+    hpc_buffer b = {NULL, 0, 0};
+    int failed = !writer || !hpc__serialize(obj, &b) || writer(b.data, b.size, context);
+    free(b.data);
+    return failed;
+}
+
+/* state cache: one serialization, one parse and one CBOR encoding per refresh */
+static struct
+{
+    int valid;
+    hpc_buffer json;
+    hpc_snapshot *snapshot;
+    int cbor_valid;
+    hpc_buffer cbor;
+} hpc__state_cache;
+
+void hpc_InvalidateStateCache(void)
+{
+    /* keep the buffers, their capacity is the size guess for the next refresh */
+    hpc__state_cache.valid = 0;
+    hpc__state_cache.cbor_valid = 0;
+    hpc__state_cache.json.size = 0;
+    hpc__state_cache.cbor.size = 0;
+    hpc_FreeSnapshot(hpc__state_cache.snapshot);
+    hpc__state_cache.snapshot = NULL;
+}
+
+hpc_client_error hpc_RefreshStateCached(void)
+{
+    hpc_InvalidateStateCache();
+    return hpc_RefreshState();
+}
+
+static int hpc__cache_state(void)
+{
+    if (hpc__state_cache.valid)
+        return 1;
+    if (!hpc__serialize(hpc_StateMsgInstance(), &hpc__state_cache.json))
+        return 0;
+    hpc__state_cache.valid = 1;
+    return 1;
+}
+
+const hpc_snapshot *hpc_GetStateSnapshot(void)
+{
+    if (!hpc__cache_state())
+        return NULL;
+    if (!hpc__state_cache.snapshot)
+        hpc__state_cache.snapshot = hpc_SnapshotFromJSON(hpc__state_cache.json.data, hpc__state_cache.json.size);
+    return hpc__state_cache.snapshot;
+}
+
+int hpc_WriteStateJSON(hpc_writer writer, void *context)
+{
+    if (!writer || !hpc__cache_state())
+        return 1;
+    return writer(hpc__state_cache.json.data, hpc__state_cache.json.size, context) != 0;
+}
+
+int hpc_WriteStateCBOR(hpc_writer writer, void *context)
+{
+    const hpc_snapshot *snapshot = hpc_GetStateSnapshot();
+    if (!writer || !snapshot)
+        return 1;
+    if (!hpc__state_cache.cbor_valid)
+    {
+        if (hpc_WriteSnapshotCBOR(snapshot, hpc_BufferWriter, &hpc__state_cache.cbor))
+            return 1;
+        hpc__state_cache.cbor_valid = 1;
+    }
+    return writer(hpc__state_cache.cbor.data, hpc__state_cache.cbor.size, context) != 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOLOPLAYCORE_SNAPSHOT_IMPLEMENTED
+#endif // HPC_SNAPSHOT_IMPLEMENTATION
@@ -37,6 +37,9 @@
     OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#ifndef LIBHOLOPLAYCORE_H
+#define LIBHOLOPLAYCORE_H
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -284,3 +287,5 @@ extern "C"
 #ifdef __cplusplus
 }
 #endif
+
+#endif // LIBHOLOPLAYCORE_H